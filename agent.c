@@ -0,0 +1,274 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "agent.h"
+#include "threadpool.h"
+
+// One tick of agent_update, shared by its tasks
+typedef struct AgentTick {
+    AgentStore *store;
+    const Map *map;
+    float moveStep;         // Distance a forward key moves an agent this tick
+    float cosTurn;          // Rotation of a left turn this tick; right turns use -sinTurn
+    float sinTurn;
+} AgentTick;
+
+// ****************************************************
+// Private (static) function declarations
+// ****************************************************
+
+// Grow a store's arrays to hold at least capacity agents
+static int agent_reserve(AgentStore *store, int capacity);
+
+// Work out agents [first, last)'s moves from their keys and old directions, then turn them
+static void agent_steer(AgentStore *store, const AgentTick *tick, int first, int last);
+
+// Sweep agents [first, last) by the moves agent_steer left them
+static void agent_collide(AgentStore *store, const Map *map, int first, int last);
+
+// Thread pool task: steer and sweep one batch of agents
+static void agent_update_task(void *context, int taskIndex, int workerIndex);
+
+// Sweep along one axis from pos by move, with across the other coordinate;
+// axis 1 moves along y. Returns the position the circle stops at.
+static double agent_sweep_axis(const Map *map, double radius, double pos, double across, double move, int axis);
+
+// Check whether tile (x, y) blocks movement; outside the map does
+static inline int agent_solid(const Map *map, int x, int y) {
+    return x < 0 || y < 0 || x >= map->width || y >= map->height || map_get(map, x, y) > 0;
+}
+
+// ****************************************************
+// Public API Implementation
+// ****************************************************
+
+// Start an empty store with the default radius and speeds
+void agent_store_init(AgentStore *store) {
+    memset(store, 0, sizeof(AgentStore));
+    store->radius = AGENT_RADIUS;
+    store->moveSpeed = AGENT_MOVE_SPEED;
+    store->rotSpeed = AGENT_ROT_SPEED;
+}
+
+// Free a store's arrays
+void agent_store_free(AgentStore *store) {
+    free(store->posX);
+    free(store->posY);
+    free(store->dirX);
+    free(store->dirY);
+    free(store->keys);
+    free(store->moveX);
+    free(store->moveY);
+    agent_store_init(store);
+}
+
+// Add an agent at (x, y) facing angle radians, holding no keys; returns its index, -1 when out of memory
+int agent_add(AgentStore *store, double x, double y, double angle) {
+    if (store->count == store->capacity &&
+        !agent_reserve(store, store->capacity ? 2 * store->capacity : 64)) {
+        fprintf(stderr, "Failed to allocate agents!\n");
+        return -1;
+    }
+
+    int index = store->count++;
+    store->posX[index] = (float)x;
+    store->posY[index] = (float)y;
+    store->dirX[index] = (float)cos(angle);
+    store->dirY[index] = (float)sin(angle);
+    store->keys[index] = 0;
+    return index;
+}
+
+// Remove every agent
+void agent_clear(AgentStore *store) {
+    store->count = 0;
+}
+
+// Move every agent one tick of deltaTime seconds on a map, in batches across
+// the pool (on the calling thread when pool is NULL). The turn's sine and
+// cosine are computed once per tick, not per agent.
+void agent_update(AgentStore *store, const Map *map, double deltaTime, struct ThreadPool *pool) {
+    AgentTick tick;
+    tick.store = store;
+    tick.map = map;
+    tick.moveStep = (float)(store->moveSpeed * deltaTime);
+    tick.cosTurn = (float)cos(store->rotSpeed * deltaTime);
+    tick.sinTurn = (float)sin(store->rotSpeed * deltaTime);
+
+    int batches = (store->count + AGENT_BATCH - 1) / AGENT_BATCH;
+    if (pool) {
+        threadpool_run(pool, batches, agent_update_task, &tick);
+    } else {
+        for (int i = 0; i < batches; i++) {
+            agent_update_task(&tick, i, 0);
+        }
+    }
+}
+
+// Move a circle of radius (under one tile) from (*posX, *posY) by (moveX, moveY):
+// swept along x and then y against the wall tiles, so it stops at the first wall
+// face or corner in its way and slides along it; outside the map counts as wall
+void agent_sweep(const Map *map, double radius, double *posX, double *posY, double moveX, double moveY) {
+    if (moveX != 0.0) {
+        *posX = agent_sweep_axis(map, radius, *posX, *posY, moveX, 0);
+    }
+    if (moveY != 0.0) {
+        *posY = agent_sweep_axis(map, radius, *posY, *posX, moveY, 1);
+    }
+}
+
+// ****************************************************
+// Private functions implementation
+// ****************************************************
+
+// Grow a store's arrays to hold at least capacity agents
+static int agent_reserve(AgentStore *store, int capacity) {
+    int ok = 1;
+    float **arrays[] = { &store->posX, &store->posY, &store->dirX, &store->dirY, &store->moveX, &store->moveY };
+    for (size_t i = 0; i < sizeof(arrays) / sizeof(arrays[0]); i++) {
+        float *grown = (float*)realloc(*arrays[i], (size_t)capacity * sizeof(float));
+        if (grown) *arrays[i] = grown; else ok = 0;
+    }
+    Uint8 *keys = (Uint8*)realloc(store->keys, capacity);
+    if (keys) store->keys = keys; else ok = 0;
+    if (!ok) {
+        return 0;
+    }
+    store->capacity = capacity;
+    return 1;
+}
+
+// Work out agents [first, last)'s moves from their keys and old directions, then turn them
+static void agent_steer(AgentStore *store, const AgentTick *tick, int first, int last) {
+    int i = first;
+
+#if defined(__SSE2__)
+    const __m128i forwardBit = _mm_set1_epi32(ENGINE_KEY_FORWARD);
+    const __m128i backwardBit = _mm_set1_epi32(ENGINE_KEY_BACKWARD);
+    const __m128i leftBit = _mm_set1_epi32(ENGINE_KEY_LEFT);
+    const __m128i rightBit = _mm_set1_epi32(ENGINE_KEY_RIGHT);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 moveStep = _mm_set1_ps(tick->moveStep);
+    const __m128 cosTurn = _mm_set1_ps(tick->cosTurn);
+    const __m128 sinTurn = _mm_set1_ps(tick->sinTurn);
+
+    for (; i + AGENT_LANES <= last; i += AGENT_LANES) {
+        // Widen four key bytes to one 32-bit lane each, and each key to an all-ones mask
+        Sint32 packed;
+        memcpy(&packed, store->keys + i, sizeof(packed));
+        __m128i keys = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zero), zero);
+        __m128 forward = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(keys, forwardBit), forwardBit));
+        __m128 backward = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(keys, backwardBit), backwardBit));
+        __m128 left = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(keys, leftBit), leftBit));
+        __m128 right = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(keys, rightBit), rightBit));
+
+        // Forward and backward together cancel, as do left and right
+        __m128 step = _mm_mul_ps(_mm_sub_ps(_mm_and_ps(forward, one), _mm_and_ps(backward, one)), moveStep);
+        __m128 turning = _mm_xor_ps(left, right);
+        __m128 sine = _mm_mul_ps(_mm_sub_ps(_mm_and_ps(left, one), _mm_and_ps(right, one)), sinTurn);
+        __m128 cosine = _mm_or_ps(_mm_and_ps(turning, cosTurn), _mm_andnot_ps(turning, one));
+
+        __m128 dirX = _mm_loadu_ps(store->dirX + i);
+        __m128 dirY = _mm_loadu_ps(store->dirY + i);
+        _mm_storeu_ps(store->moveX + i, _mm_mul_ps(dirX, step));
+        _mm_storeu_ps(store->moveY + i, _mm_mul_ps(dirY, step));
+        _mm_storeu_ps(store->dirX + i, _mm_sub_ps(_mm_mul_ps(dirX, cosine), _mm_mul_ps(dirY, sine)));
+        _mm_storeu_ps(store->dirY + i, _mm_add_ps(_mm_mul_ps(dirX, sine), _mm_mul_ps(dirY, cosine)));
+    }
+#endif
+
+    // The remaining agents (all of them without SSE2), with the same float arithmetic
+    for (; i < last; i++) {
+        int keys = store->keys[i];
+        float step = ((float)((keys & ENGINE_KEY_FORWARD) != 0) - (float)((keys & ENGINE_KEY_BACKWARD) != 0)) *
+                     tick->moveStep;
+        int left = (keys & ENGINE_KEY_LEFT) != 0;
+        int right = (keys & ENGINE_KEY_RIGHT) != 0;
+        float sine = ((float)left - (float)right) * tick->sinTurn;
+        float cosine = left != right ? tick->cosTurn : 1.0f;
+
+        float dirX = store->dirX[i];
+        float dirY = store->dirY[i];
+        store->moveX[i] = dirX * step;
+        store->moveY[i] = dirY * step;
+        store->dirX[i] = dirX * cosine - dirY * sine;
+        store->dirY[i] = dirX * sine + dirY * cosine;
+    }
+}
+
+// Sweep agents [first, last) by the moves agent_steer left them
+static void agent_collide(AgentStore *store, const Map *map, int first, int last) {
+    for (int i = first; i < last; i++) {
+        if (store->moveX[i] == 0.0f && store->moveY[i] == 0.0f) {
+            continue;
+        }
+
+        double x = store->posX[i];
+        double y = store->posY[i];
+        agent_sweep(map, store->radius, &x, &y, store->moveX[i], store->moveY[i]);
+        store->posX[i] = (float)x;
+        store->posY[i] = (float)y;
+    }
+}
+
+// Thread pool task: steer and sweep one batch of agents
+static void agent_update_task(void *context, int taskIndex, int workerIndex) {
+    (void)workerIndex;
+    const AgentTick *tick = (const AgentTick*)context;
+    int first = taskIndex * AGENT_BATCH;
+    int last = first + AGENT_BATCH < tick->store->count ? first + AGENT_BATCH : tick->store->count;
+
+    agent_steer(tick->store, tick, first, last);
+    agent_collide(tick->store, tick->map, first, last);
+}
+
+// Sweep along one axis from pos by move, with across the other coordinate;
+// axis 1 moves along y. Returns the position the circle stops at.
+static double agent_sweep_axis(const Map *map, double radius, double pos, double across, double move, int axis) {
+    // Rows across the motion the circle overlaps, and the grid lines along it
+    // its leading edge crosses, nearest first
+    double reach = radius - AGENT_SKIN;
+    int firstRow = (int)floor(across - reach);
+    int lastRow = (int)floor(across + reach);
+    int step = move > 0.0 ? 1 : -1;
+    int line = (int)floor(pos) + step;
+    int lastLine = (int)floor(pos + move + step * radius);
+    double limit = pos + move;
+
+    for (; step > 0 ? line <= lastLine : line >= lastLine; line += step) {
+        int blocked = 0;
+        for (int row = firstRow; row <= lastRow; row++) {
+            if (!agent_solid(map, axis ? row : line, axis ? line : row)) {
+                continue;
+            }
+
+            // A tile level with the centre is met by its face, others by their
+            // corner, which the circle reaches later the farther it is aside
+            double gap = across < row ? row - across : across > row + 1 ? across - (row + 1) : 0.0;
+            double contact = sqrt(radius * radius - gap * gap);
+            double stop = step > 0 ? line - contact : line + 1 + contact;
+            if (step > 0 ? stop < limit : stop > limit) {
+                limit = stop;
+            }
+            blocked = 1;
+        }
+
+        // A farther line's wall is at least 1 - radius farther, it cannot stop the circle sooner
+        if (blocked) {
+            break;
+        }
+    }
+
+    // A circle already touching the wall stays where it is
+    if (step > 0 ? limit < pos : limit > pos) {
+        limit = pos;
+    }
+    return limit;
+}
@@ -0,0 +1,77 @@
+#ifndef AGENT_H
+#define AGENT_H
+
+#include "engine.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Agents the steering kernel updates together
+#define AGENT_LANES 4
+
+// Instruction set the steering kernel was compiled for
+#if defined(__SSE2__)
+#define AGENT_SIMD "sse2"
+#else
+#define AGENT_SIMD "scalar"
+#endif
+
+// Agents per thread pool task; a task steers its agents and then sweeps them,
+// so their intended moves are still in cache
+#define AGENT_BATCH 4096
+
+// Default collision radius and speeds, as the player moves
+#define AGENT_RADIUS 0.25
+#define AGENT_MOVE_SPEED 5.0    // Tiles per second
+#define AGENT_ROT_SPEED 3.0     // Radians per second
+
+// Clearance a sweep may lose to rounding: walls nearer than the radius by less
+// than this do not block, so an agent sliding along a wall is not caught on it
+#define AGENT_SKIN 1e-4
+
+// Agents as parallel arrays (structure of arrays), all with the same radius
+// and speeds. Each tick an agent moves by the ENGINE_KEY_* bits it holds, as
+// the player does: forward or backward along its direction, then turned.
+typedef struct AgentStore {
+    float *posX;
+    float *posY;
+    float *dirX;            // Unit direction each agent faces
+    float *dirY;
+    Uint8 *keys;            // ENGINE_KEY_* bits each agent holds
+    float *moveX;           // Scratch: the move each agent intends this tick
+    float *moveY;
+    int count;
+    int capacity;
+    double radius;          // Collision radius in tiles
+    double moveSpeed;       // Tiles per second
+    double rotSpeed;        // Radians per second
+} AgentStore;
+
+// Start an empty store with the default radius and speeds
+void agent_store_init(AgentStore *store);
+
+// Free a store's arrays
+void agent_store_free(AgentStore *store);
+
+// Add an agent at (x, y) facing angle radians, holding no keys; returns its index, -1 when out of memory
+int agent_add(AgentStore *store, double x, double y, double angle);
+
+// Remove every agent
+void agent_clear(AgentStore *store);
+
+// Move every agent one tick of deltaTime seconds on a map, in batches across
+// the pool (on the calling thread when pool is NULL). The turn's sine and
+// cosine are computed once per tick, not per agent.
+void agent_update(AgentStore *store, const Map *map, double deltaTime, struct ThreadPool *pool);
+
+// Move a circle of radius (under one tile) from (*posX, *posY) by (moveX, moveY):
+// swept along x and then y against the wall tiles, so it stops at the first wall
+// face or corner in its way and slides along it; outside the map counts as wall
+void agent_sweep(const Map *map, double radius, double *posX, double *posY, double moveX, double moveY);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // AGENT_H
@@ -0,0 +1,2973 @@
+// mkdir and rmdir are POSIX, not C99
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <direct.h>
+#endif
+
+#include "engine.h"
+#include "raycaster.h"
+#include "floorcast.h"
+#include "entity.h"
+#include "profiler.h"
+#include "replay.h"
+#include "agent.h"
+#include "framecodec.h"
+#include "mapwatch.h"
+
+// Benchmark defaults
+#define BENCH_DEFAULT_FRAMES 300
+#define BENCH_WARMUP_FRAMES 10
+#define BENCH_MOVE_DT (1.0 / 60.0)
+#define BENCH_TURN_FRAMES 12
+#define BENCH_WALL_INSET 1.5
+#define BENCH_MAX_THREAD_COUNTS 16
+#define BENCH_MAX_RESOLUTIONS 8
+#define BENCH_MAX_LARGE_MAPS 8
+#define BENCH_DDA_SAMPLES 30         // Poses per path sampled for DDA step counts
+#define BENCH_TEMP_MAP "raycaster-bench-load" MAP_FILE_EXTENSION
+#define BENCH_PILLAR_ODDS 400       // One tile in this many is a wall on generated maps
+#define BENCH_MAX_CATALOG_SIZES 8
+#define BENCH_CATALOG_DIR "raycaster-bench-catalog"
+#define BENCH_CATALOG_SWITCHES 100000   // Switches between cached maps timed per catalog size
+#define BENCH_CACHE_LINE 64
+#define BENCH_FLOOR_WIDTH 1024      // Resolution the floor pass is measured at
+#define BENCH_FLOOR_HEIGHT 768
+#define BENCH_FLOOR_BUDGET 0.75     // Most a floor pixel may cost, as a fraction of a wall pixel
+#define BENCH_FIXED_MAX_ERROR 0.005   // Largest fraction of a frame's pixels the fixed-point path may get wrong
+#define BENCH_FIXED_MAX_MEAN_ERROR 0.0005   // and of all pixels over every frame
+#define BENCH_LIGHT_SPACING 16      // Generated maps get a light every this many tiles each way
+#define BENCH_LIGHT_RADIUS 8
+#define BENCH_LIGHT_LEVEL 24
+#define BENCH_LIGHT_AMBIENT 6
+#define BENCH_LIGHT_MOVES 1000      // Single-light changes timed per map
+#define BENCH_RELOAD_DIR "raycaster-bench-reload"
+#define BENCH_RELOAD_EDITS 10       // Saved edits timed per map
+#define BENCH_RELOAD_TIMEOUT_MS 10000   // Longest wait for the watcher to read a saved map
+#define BENCH_MAX_SPRITE_COUNTS 8
+#define BENCH_SPRITE_MAP_SIZE 256   // Generated map the sprite counts are scattered over
+#define BENCH_MAX_AGENT_COUNTS 8
+#define BENCH_AGENT_TICKS 120       // Ticks timed per agent count and thread count
+#define BENCH_AGENT_WARMUP 10
+#define BENCH_AGENT_TURN_TICKS 30   // Ticks between agents choosing new keys
+#define BENCH_RAY_RANGE 16.0        // Range of the timed sensor rays, in tiles
+#define BENCH_RAY_REPEATS 5         // Times each ray query is timed; the fastest counts
+#define BENCH_MAX_VIEW_COUNTS 8
+#define BENCH_VIEW_WIDTH 64         // Size of each view of a multi-view render
+#define BENCH_VIEW_HEIGHT 48
+#define BENCH_VIEW_REPEATS 3        // Times each batch is rendered; the fastest counts
+#define BENCH_CODEC_KEYFRAMES 60    // Encoded frames from one keyframe to the next
+#define BENCH_INCREMENTAL_POSES 8   // Poses along the walk path each map is edited at
+#define BENCH_INCREMENTAL_EDITS 8   // Edits made and undone at each pose
+#define BENCH_INCREMENTAL_SPRITES 64    // Sprites scattered over each edited map
+#define BENCH_FNV_OFFSET 0xcbf29ce484222325ull   // FNV-1a 64, hashing rendered frames
+#define BENCH_FNV_PRIME 0x100000001b3ull
+#define BENCH_GOLDEN_WIDTH 640      // Resolution the regression check renders at
+#define BENCH_GOLDEN_HEIGHT 480
+#define BENCH_GOLDEN_POSES 16       // Poses per camera path in the regression check
+#define BENCH_GOLDEN_REPEATS 5      // Timed renders of each pose, the fastest counts
+#define BENCH_GOLDEN_SPRITES 200    // Sprites scattered for the sprites render mode
+#define BENCH_GOLDEN_TOLERANCE 0.25 // Default slowdown allowed against the baseline
+#define BENCH_GOLDEN_FRAMES "frames.txt"    // Frame hashes in the golden directory
+#define BENCH_GOLDEN_TIMINGS "timings.txt"  // Baseline render times in the golden directory
+#define BENCH_MAX_GOLDEN 64         // Entries read from a golden file
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// Wall shading modes: flat colors, full-size textures, mipmapped textures
+#define BENCH_WALLS_FLAT 0
+#define BENCH_WALLS_TEXTURED 1
+#define BENCH_WALLS_MIPMAPPED 2
+static const char *const BENCH_WALL_NAMES[] = { "flat", "textured", "mipmapped" };
+#define BENCH_WALL_MODE_COUNT (int)(sizeof(BENCH_WALL_NAMES) / sizeof(BENCH_WALL_NAMES[0]))
+
+// Render settings the regression check covers, each hashed and timed on its own
+typedef struct BenchRenderMode {
+    const char *name;
+    int texturedWalls;
+    int texturedFloors;
+    int mipmapping;
+    int fixedPoint;
+    int sprites;
+} BenchRenderMode;
+
+static const BenchRenderMode BENCH_RENDER_MODES[] = {
+    { "flat", 0, 0, 0, 0, 0 },
+    { "textured", 1, 1, 0, 0, 0 },
+    { "mipmapped", 1, 1, 1, 0, 0 },
+    { "fixed", 1, 1, 1, 1, 0 },
+    { "sprites", 1, 1, 1, 0, BENCH_GOLDEN_SPRITES },
+};
+#define BENCH_RENDER_MODE_COUNT (int)(sizeof(BENCH_RENDER_MODES) / sizeof(BENCH_RENDER_MODES[0]))
+
+// Command line options
+typedef struct BenchOptions {
+    const char *mapsDir;  // Directory the maps are loaded from
+    const char *outPath;  // JSON output file (stdout when NULL)
+    int frames;           // Frames per camera path
+    int threadCounts[BENCH_MAX_THREAD_COUNTS];  // Render thread counts to measure
+    int threadCountCount;
+    int widths[BENCH_MAX_RESOLUTIONS];          // Output resolutions to measure
+    int heights[BENCH_MAX_RESOLUTIONS];
+    int resolutionCount;
+    double scale;         // Fixed render scale
+    double budgetMs;      // Frame budget for the render scale controller (0 = off)
+    int largeSizes[BENCH_MAX_LARGE_MAPS];       // Edge lengths of generated maps
+    int largeCount;
+    int catalogSizes[BENCH_MAX_CATALOG_SIZES];  // Map counts of generated catalogs
+    int catalogCount;
+    int wallModes[BENCH_WALL_MODE_COUNT];       // Wall shading modes to measure
+    int wallModeCount;
+    int spriteCounts[BENCH_MAX_SPRITE_COUNTS];  // Sprite counts to measure
+    int spriteCountCount;
+    int agentCounts[BENCH_MAX_AGENT_COUNTS];    // Agent counts to measure
+    int agentCountCount;
+    int rayCount;         // Rays per query timed on every map (0 = off)
+    int viewCounts[BENCH_MAX_VIEW_COUNTS];      // View counts of the multi-view renders to measure
+    int viewCountCount;
+    int codec;            // Encode every camera path's frames and decode them again
+    int reload;           // Edit the generated maps on disk and apply the edits as the game does
+    int incremental;      // Edit the installed maps in view and redraw only what the edits changed
+    int noSkip;           // Render without empty-space skipping
+    int verifyPackets;    // Compare packet and scalar rays instead of timing
+    int verifyFixed;      // Compare fixed-point and double rays instead of timing
+    int fixedPoint;       // Render the timed runs with the fixed-point DDA
+    const char *tracePath;  // Profile the timed runs into this Chrome trace file (NULL = off)
+    const char *replayPath; // Replay this recording instead of the camera paths (NULL = off)
+    const char *encodePath; // Write the replayed frames to this file, encoded (NULL = off)
+    const char *goldenDir;  // Check frame hashes and render times against this directory (NULL = off)
+    int updateGolden;       // Write the frame hashes to goldenDir instead of checking them
+    int updateBaseline;     // Write the render times to goldenDir instead of checking them
+    double tolerance;       // Slowdown against the baseline that still passes, as a fraction
+} BenchOptions;
+
+// A deterministic sequence of camera poses replayed for every map
+typedef struct BenchPath {
+    const char *name;
+    Player *poses;
+    int count;
+} BenchPath;
+
+// Timing summary of one path on one map
+typedef struct BenchResult {
+    double meanMs;
+    double p50Ms;
+    double p95Ms;
+    double p99Ms;
+    double fps;
+} BenchResult;
+
+// Rays traced while verifying kernels and counting DDA steps
+typedef struct BenchRayStats {
+    long rays;
+    long plainSteps;        // DDA steps without empty-space skipping
+    long skipSteps;         // DDA steps with empty-space skipping
+    int packetMismatches;   // Packet rays that differ from scalar rays
+    int skipMismatches;     // Rays that hit differently with skipping
+    long floorRows;         // Floor rows cast
+    int floorMismatches;    // SIMD floor spans that differ from scalar spans
+} BenchRayStats;
+
+// Fixed-point rays against double rays over the columns of many poses. A pixel
+// is wrong when it shows another surface, past the one-row rounding allowed at
+// each wall edge, or a texel column more than one off.
+typedef struct BenchFixedStats {
+    long frames;
+    long rays;
+    long pixels;            // Pixels of all frames
+    long wrongPixels;
+    double maxError;        // Largest fraction of wrong pixels in one frame
+    long faceMisses;        // Columns where the two paths hit a different tile or side
+    int skipMismatches;     // Fixed-point rays that hit differently with skipping
+} BenchFixedStats;
+
+// Load times of one map in both formats
+typedef struct BenchLoadResult {
+    size_t textBytes;
+    double textMs;      // Parsing the text, including the distance field
+    size_t binaryBytes;
+    double binaryMs;    // Mapping and checking the compiled file
+} BenchLoadResult;
+
+// Texture memory read per frame, with and without mipmapping
+typedef struct BenchTexelStats {
+    long frames;
+    long texelReads;        // Wall pixels sampled
+    long lines;             // Distinct cache lines of texels touched, level 0 only
+    long mipLines;          // Distinct cache lines of texels touched with mipmapping
+    long columnLines;       // Cache lines spanned by each column's texels, summed over columns
+    long mipColumnLines;
+} BenchTexelStats;
+
+// Cost of casting textured floors and ceilings against the rest of the frame
+typedef struct BenchFloorResult {
+    double flatMs;      // Mean frame time with flat floor and ceiling fills
+    double frameMs;     // Mean frame time with cast floors
+    double wallMs;      // Mean time of everything but the floor pass: rays and wall slices
+    double floorMs;     // Mean time of the floor pass
+    double fraction;    // floorMs / wallMs
+    double floorPixelNs;    // Floor pass time per floor and ceiling pixel
+    double wallPixelNs;     // Wall pass time per wall pixel
+    double pixelFraction;   // floorPixelNs / wallPixelNs
+} BenchFloorResult;
+
+// Cost of baking a map's light levels and of changing one light at a time
+typedef struct BenchLightResult {
+    int lights;
+    double bakeMs;      // Baking every tile
+    double updateUs;    // Moving one light and re-baking the tiles it reaches
+    double tilesPerUpdate;
+    int matches;        // Incremental updates left the same levels as a full bake
+} BenchLightResult;
+
+// Cost of applying a saved edit to a loaded map against loading the map again
+typedef struct BenchReloadResult {
+    int edits;
+    double tilesPerEdit;    // Tiles each edit changed
+    double readyMs;         // From the save until the watcher has read the file, settling included
+    double loadMs;          // Reading and parsing the file, on the watcher thread
+    double applyMs;         // Applying it to the loaded map, between frames
+    double fullMs;          // Loading the file from scratch instead
+    int matches;            // Edits after which the map was the same as a full load
+} BenchReloadResult;
+
+// Frame cost with a given number of sprites in the world
+typedef struct BenchSpriteResult {
+    double meanMs;
+    double p95Ms;
+    double spriteMs;    // Mean time of culling, sorting and drawing the sprites
+    double visible;     // Mean sprites left after culling
+} BenchSpriteResult;
+
+// Catalog costs with a given number of installed maps
+typedef struct BenchCatalogResult {
+    double scanMs;      // Scanning the directory
+    double firstUseMs;  // Making an uncached map active
+    double switchUs;    // Switching between cached maps
+    int maps;           // Maps found by the scan
+} BenchCatalogResult;
+
+// Tick cost of one agent count on one thread count
+typedef struct BenchAgentResult {
+    double tickMs;      // Mean time of one agent_update
+    double agentsPerMs; // Agents moved per millisecond
+    int overlapping;    // Agents found overlapping a wall after the last tick
+} BenchAgentResult;
+
+// Ray query throughput on one map and thread count, in millions of rays per second
+typedef struct BenchRayQueryResult {
+    double castMrays;   // Unlimited rays from random open points in random directions
+    double rangeMrays;  // The same rays as sensors limited to BENCH_RAY_RANGE
+    double losMrays;    // Line of sight between random pairs of open points
+    double visible;     // Fraction of the pairs that see each other
+    int mismatches;     // Rays whose results differ from scalar raycaster_cast_range
+} BenchRayQueryResult;
+
+// Multi-view throughput of one view count on one map and thread count
+typedef struct BenchViewResult {
+    double batchMs;     // Fastest engine_render_views of every view
+    double viewsPerSec;
+    double loopViewsPerSec;     // Rendering the same views one engine_render_scene at a time
+    int mismatches;     // Views whose pixels differ from engine_render_scene's
+} BenchViewResult;
+
+// Encoded size of the frames of one camera path on one map
+typedef struct BenchCodecResult {
+    int frames;
+    double rawBytes;        // Bytes of each frame's pixels
+    double bytes;           // Mean encoded bytes per frame, keyframes included
+    double keyframeBytes;   // Mean encoded bytes per keyframe
+    double encodeMs;        // Mean time to encode a frame
+    double decodeMs;        // Mean time to decode a frame
+    int mismatches;         // Frames that did not decode to the pixels encoded
+} BenchCodecResult;
+
+// Frames brought up to date after small map edits, against rendering them whole
+typedef struct BenchIncrementalResult {
+    int frames;             // Frames brought up to date, after an edit or its undo
+    double fullMs;          // Mean time to render a frame whole
+    double idleMs;          // Mean engine_update_scene with nothing changed
+    int idleColumns;        // Columns rendered by those, which should be none
+    double updateMs;        // Mean engine_update_scene after an edit
+    double columns;         // Mean columns it rendered
+    int mismatches;         // Frames that differ from the same frame rendered whole
+} BenchIncrementalResult;
+
+// One line of a golden file: a frame hash or a render time of a map in a render mode
+typedef struct BenchGolden {
+    char map[64];
+    char mode[16];
+    Uint64 hash;
+    double ms;
+} BenchGolden;
+
+// State shared by every measured map
+typedef struct BenchRun {
+    Engine *engine;
+    const BenchOptions *options;
+    Player *poses;      // Pose buffer, options->frames long
+    double *times;      // Frame time buffer, options->frames long
+    FILE *out;
+    int first;          // No result has been written yet
+} BenchRun;
+
+// Camera paths replayed on every map
+static int bench_build_walk(Engine *engine, Player *poses, int frames);
+static int bench_build_spin(Engine *engine, Player *poses, int frames);
+static int bench_build_strafe(Engine *engine, Player *poses, int frames);
+
+static const char *const BENCH_PATH_NAMES[] = { "walk", "spin", "strafe" };
+static int (*const BENCH_PATH_BUILDERS[])(Engine*, Player*, int) = {
+    bench_build_walk, bench_build_spin, bench_build_strafe
+};
+#define BENCH_PATH_COUNT (int)(sizeof(BENCH_PATH_NAMES) / sizeof(BENCH_PATH_NAMES[0]))
+
+// Point the player at the given angle, keeping the default field of view
+static void bench_set_pose(Player *player, double posX, double posY, double angle) {
+    player->posX = posX;
+    player->posY = posY;
+    player->dirX = cos(angle);
+    player->dirY = sin(angle);
+    player->planeX = 0.66 * sin(angle);
+    player->planeY = -0.66 * cos(angle);
+}
+
+// Check whether a position lies inside an empty map cell
+static int bench_is_open(const Map *map, double x, double y) {
+    int mapX = (int)x;
+    int mapY = (int)y;
+    if (x < 0 || y < 0 || mapX >= map->width || mapY >= map->height) {
+        return 0;
+    }
+    return map_get(map, mapX, mapY) == TILE_EMPTY;
+}
+
+// Generate a size x size map: outer walls and scattered pillars around an open centre
+static int bench_generate_map(Map *map, int size, int blockShift) {
+    if (!map_create(map, size, size, blockShift)) {
+        return 0;
+    }
+    snprintf(map->name, sizeof(map->name), "Generated %dx%d", size, size);
+    map->startX = size / 2 + 0.5;
+    map->startY = size / 2 + 0.5;
+
+    // Fixed seed so every run and layout sees the same map
+    Uint32 seed = 12345;
+    for (int y = 0; y < size; y++) {
+        for (int x = 0; x < size; x++) {
+            seed = seed * 1664525u + 1013904223u;
+            int border = x == 0 || y == 0 || x == size - 1 || y == size - 1;
+            int pillar = (seed >> 8) % BENCH_PILLAR_ODDS == 0;
+            int centre = abs(x - size / 2) <= 2 && abs(y - size / 2) <= 2;
+            if (border || (pillar && !centre)) {
+                map_set(map, x, y, 1 + (seed >> 24) % 4);
+            }
+        }
+    }
+
+    // Floors in 4x4 squares of two textures; the ceiling is open sky in every other square
+    if (!map_create_floors(map)) {
+        return 0;
+    }
+    for (int y = 0; y < size; y++) {
+        for (int x = 0; x < size; x++) {
+            int square = ((x >> 2) + (y >> 2)) & 1;
+            map->floor[map_tile_index(map, x, y)] = (Uint8)(square ? 1 : 5);
+            map->ceiling[map_tile_index(map, x, y)] = (Uint8)(square ? 4 : 0);
+        }
+    }
+    return map_build_distance(map);
+}
+
+// Write a map in the text format
+static char* bench_format_map(const Map *map, size_t *length) {
+    // Four characters per tile covers "255," and a newline per row
+    int planes = map->floor ? 3 : 1;
+    size_t capacity = (size_t)map->width * map->height * 4 * planes + (size_t)map->lightCount * 64 + 256;
+    char *text = (char*)malloc(capacity);
+    if (!text) {
+        return NULL;
+    }
+
+    size_t used = sprintf(text, "NAME:%s\nSTART:%.1f,%.1f\n", map->name, map->startX, map->startY);
+    if (map->ambient != MAP_LIGHT_FULL) {
+        used += sprintf(text + used, "AMBIENT:%d\n", map->ambient);
+    }
+    for (int i = 0; i < map->lightCount; i++) {
+        const MapLight *light = &map->lights[i];
+        used += sprintf(text + used, "LIGHT:%d,%d,%d,%d\n", light->x, light->y, light->radius, light->level);
+    }
+    used += sprintf(text + used, "DATA:\n");
+    for (int y = 0; y < map->height; y++) {
+        for (int x = 0; x < map->width; x++) {
+            used += sprintf(text + used, x + 1 < map->width ? "%d," : "%d\n", map_get(map, x, y));
+        }
+    }
+    if (map->floor) {
+        used += sprintf(text + used, "FLOOR:\n");
+        for (int y = 0; y < map->height; y++) {
+            for (int x = 0; x < map->width; x++) {
+                used += sprintf(text + used, x + 1 < map->width ? "%d," : "%d\n", map_floor(map, x, y));
+            }
+        }
+        used += sprintf(text + used, "CEILING:\n");
+        for (int y = 0; y < map->height; y++) {
+            for (int x = 0; x < map->width; x++) {
+                used += sprintf(text + used, x + 1 < map->width ? "%d," : "%d\n", map_ceiling(map, x, y));
+            }
+        }
+    }
+    *length = used;
+    return text;
+}
+
+// Time parsing a map from text against loading it as a compiled file
+static int bench_measure_load(const Map *map, BenchLoadResult *result) {
+    double frequency = (double)SDL_GetPerformanceFrequency();
+
+    size_t length;
+    char *text = bench_format_map(map, &length);
+    if (!text) {
+        return 0;
+    }
+
+    Map parsed;
+    Uint64 start = SDL_GetPerformanceCounter();
+    int ok = map_parse(&parsed, text, MAP_BLOCK_SHIFT);
+    result->textMs = (SDL_GetPerformanceCounter() - start) * 1000.0 / frequency;
+    result->textBytes = length;
+    free(text);
+    if (!ok) {
+        return 0;
+    }
+    map_destroy(&parsed);
+
+    if (!map_save_binary(map, BENCH_TEMP_MAP)) {
+        return 0;
+    }
+
+    Map loaded;
+    start = SDL_GetPerformanceCounter();
+    ok = map_load_binary(&loaded, BENCH_TEMP_MAP);
+    result->binaryMs = (SDL_GetPerformanceCounter() - start) * 1000.0 / frequency;
+    if (ok) {
+        result->binaryBytes = loaded.mappingSize;
+        map_destroy(&loaded);
+    }
+    remove(BENCH_TEMP_MAP);
+    return ok;
+}
+
+// Create a directory for generated files
+static int bench_make_dir(const char *path) {
+#ifndef _WIN32
+    return mkdir(path, 0755) == 0;
+#else
+    return _mkdir(path) == 0;
+#endif
+}
+
+// Remove an empty directory
+static void bench_remove_dir(const char *path) {
+#ifndef _WIN32
+    rmdir(path);
+#else
+    _rmdir(path);
+#endif
+}
+
+// Put lights on a regular grid over a map and dim its ambient level; the
+// levels are not baked
+static int bench_add_lights(Map *map) {
+    int perRow = (map->width + BENCH_LIGHT_SPACING - 1) / BENCH_LIGHT_SPACING;
+    int perColumn = (map->height + BENCH_LIGHT_SPACING - 1) / BENCH_LIGHT_SPACING;
+    free(map->lights);
+    map->lightCount = 0;
+    map->lights = (MapLight*)malloc((size_t)perRow * perColumn * sizeof(MapLight));
+    if (!map->lights) {
+        return 0;
+    }
+    for (int y = BENCH_LIGHT_SPACING / 2; y < map->height; y += BENCH_LIGHT_SPACING) {
+        for (int x = BENCH_LIGHT_SPACING / 2; x < map->width; x += BENCH_LIGHT_SPACING) {
+            MapLight *light = &map->lights[map->lightCount++];
+            light->x = x;
+            light->y = y;
+            light->radius = BENCH_LIGHT_RADIUS;
+            light->level = BENCH_LIGHT_LEVEL;
+        }
+    }
+    map->ambient = BENCH_LIGHT_AMBIENT;
+    return 1;
+}
+
+// Light a copy of a map on a regular grid, then time a full bake against moving
+// one light at a time, and check the incremental levels against a full bake
+static int bench_measure_lighting(const Map *map, BenchLightResult *result) {
+    double frequency = (double)SDL_GetPerformanceFrequency();
+    Map lit;
+    if (!map_copy(&lit, map, map->blockShift)) {
+        return 0;
+    }
+    if (!bench_add_lights(&lit)) {
+        map_destroy(&lit);
+        return 0;
+    }
+
+    Uint64 start = SDL_GetPerformanceCounter();
+    int ok = lighting_bake(&lit);
+    result->bakeMs = (SDL_GetPerformanceCounter() - start) * 1000.0 / frequency;
+    result->lights = lit.lightCount;
+
+    // Move lights around by a few tiles, the way a flickering torch or a carried lamp would
+    Uint32 seed = 54321;
+    long tiles = 0;
+    start = SDL_GetPerformanceCounter();
+    for (int i = 0; i < BENCH_LIGHT_MOVES && ok; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        int index = (int)((seed >> 8) % (Uint32)lit.lightCount);
+        MapLight light = lit.lights[index];
+        light.x += (int)((seed >> 4) % 5) - 2;
+        light.y += (int)((seed >> 12) % 5) - 2;
+        if (light.x < 0 || light.x >= lit.width || light.y < 0 || light.y >= lit.height) {
+            continue;
+        }
+        int baked = lighting_set_light(&lit, index, &light);
+        ok = baked >= 0;
+        tiles += baked;
+    }
+    result->updateUs = (SDL_GetPerformanceCounter() - start) * 1e6 / frequency / BENCH_LIGHT_MOVES;
+    result->tilesPerUpdate = (double)tiles / BENCH_LIGHT_MOVES;
+
+    // A full bake of the final lights must give the same levels
+    size_t size = map_storage_size(&lit) * MAP_FACES;
+    Uint8 *incremental = ok ? (Uint8*)malloc(size) : NULL;
+    ok = incremental != NULL;
+    if (ok) {
+        memcpy(incremental, lit.light, size);
+        ok = lighting_bake(&lit);
+        result->matches = ok && memcmp(incremental, lit.light, size) == 0;
+    }
+    free(incremental);
+    map_destroy(&lit);
+    return ok;
+}
+
+// Save text to a file the way an editor does: written under another name and
+// moved into place
+static int bench_save_text(const char *path, const char *text, size_t length) {
+    char temp[512];
+    snprintf(temp, sizeof(temp), "%s.tmp", path);
+    FILE *file = fopen(temp, "wb");
+    if (!file) {
+        return 0;
+    }
+    int ok = fwrite(text, 1, length, file) == length;
+    if (fclose(file) != 0) {
+        ok = 0;
+    }
+    if (!ok || rename(temp, path) != 0) {
+        remove(temp);
+        return 0;
+    }
+    return 1;
+}
+
+// Check whether two maps of one layout hold the same tiles, distance field,
+// floors and light levels
+static int bench_same_map(const Map *a, const Map *b) {
+    size_t size = map_storage_size(a);
+    if (a->width != b->width || a->height != b->height || a->blockShift != b->blockShift ||
+        memcmp(a->tiles, b->tiles, size) != 0 || memcmp(a->distance, b->distance, size) != 0) {
+        return 0;
+    }
+    if ((a->floor != NULL) != (b->floor != NULL) ||
+        (a->floor && (memcmp(a->floor, b->floor, size) != 0 || memcmp(a->ceiling, b->ceiling, size) != 0))) {
+        return 0;
+    }
+    return (a->light != NULL) == (b->light != NULL) &&
+           (!a->light || memcmp(a->light, b->light, size * MAP_FACES) == 0);
+}
+
+// Save a lit copy of a map as a text file, load it through a catalog and watch
+// it, then save a series of edits, each adding or knocking out a block of walls
+// and every other one moving a light. Times the watcher reading each edit and
+// applying it to the loaded map against loading the file from scratch, and
+// checks the loaded map against a full load after every edit.
+static int bench_measure_reload(const Map *map, BenchReloadResult *result) {
+    double frequency = (double)SDL_GetPerformanceFrequency();
+    memset(result, 0, sizeof(BenchReloadResult));
+    Map edited;
+    if (!map_copy(&edited, map, map->blockShift)) {
+        return 0;
+    }
+
+    char path[512];
+    snprintf(path, sizeof(path), "%s/reload.map", BENCH_RELOAD_DIR);
+    bench_make_dir(BENCH_RELOAD_DIR);
+    size_t length;
+    char *text = bench_add_lights(&edited) ? bench_format_map(&edited, &length) : NULL;
+    int ok = text && bench_save_text(path, text, length);
+    free(text);
+
+    // The map as the game holds it: pinned in a catalog
+    MapCatalog catalog;
+    catalog_init(&catalog, 1);
+    Map *live = ok && catalog_scan(&catalog, BENCH_RELOAD_DIR) == 1 ? catalog_acquire(&catalog, 0) : NULL;
+    MapWatcher *watcher = live ? mapwatch_start(BENCH_RELOAD_DIR) : NULL;
+    ok = watcher != NULL;
+
+    Uint32 seed = 24680;
+    long tiles = 0;
+    for (int e = 0; ok && e < BENCH_RELOAD_EDITS; e++) {
+        seed = seed * 1664525u + 1013904223u;
+        int size = 1 + (int)((seed >> 8) % 4);
+        int x0 = 1 + (int)((seed >> 12) % (Uint32)(edited.width - size - 1));
+        seed = seed * 1664525u + 1013904223u;
+        int y0 = 1 + (int)((seed >> 8) % (Uint32)(edited.height - size - 1));
+        int tile = (seed >> 20) & 1 ? 1 + (int)((seed >> 24) % 4) : TILE_EMPTY;
+        for (int y = y0; y < y0 + size; y++) {
+            for (int x = x0; x < x0 + size; x++) {
+                map_set(&edited, x, y, tile);
+            }
+        }
+        if (e % 2 == 1 && edited.lightCount > 0) {
+            MapLight *light = &edited.lights[(seed >> 4) % (Uint32)edited.lightCount];
+            int x = light->x + (int)((seed >> 2) % 5) - 2;
+            if (x >= 0 && x < edited.width) {
+                light->x = x;
+            }
+        }
+
+        text = bench_format_map(&edited, &length);
+        ok = text && bench_save_text(path, text, length);
+        free(text);
+        Uint64 saved = SDL_GetPerformanceCounter();
+        while (ok && mapwatch_pending(watcher) == 0) {
+            if ((SDL_GetPerformanceCounter() - saved) * 1000.0 / frequency > BENCH_RELOAD_TIMEOUT_MS) {
+                fprintf(stderr, "The map watcher did not read %s\n", path);
+                ok = 0;
+            }
+            SDL_Delay(1);
+        }
+        result->readyMs += (SDL_GetPerformanceCounter() - saved) * 1000.0 / frequency;
+
+        MapReload reload;
+        if (!ok || !mapwatch_poll(watcher, &reload)) {
+            ok = 0;
+            break;
+        }
+        result->loadMs += reload.loadMs;
+        Uint64 start = SDL_GetPerformanceCounter();
+        int changed = catalog_update(&catalog, catalog_find_file(&catalog, reload.path), &reload.map);
+        result->applyMs += (SDL_GetPerformanceCounter() - start) * 1000.0 / frequency;
+        ok = changed >= 0;
+        tiles += changed;
+
+        // A full load of the same file must give the same map
+        Map full;
+        start = SDL_GetPerformanceCounter();
+        ok = ok && map_load_text(&full, path, MAP_BLOCK_SHIFT);
+        result->fullMs += (SDL_GetPerformanceCounter() - start) * 1000.0 / frequency;
+        if (ok) {
+            result->matches += bench_same_map(live, &full);
+            map_destroy(&full);
+        }
+        result->edits++;
+    }
+
+    if (result->edits > 0) {
+        result->tilesPerEdit = (double)tiles / result->edits;
+        result->readyMs /= result->edits;
+        result->loadMs /= result->edits;
+        result->applyMs /= result->edits;
+        result->fullMs /= result->edits;
+    }
+
+    mapwatch_stop(watcher);
+    if (live) {
+        catalog_release(&catalog, 0);
+    }
+    catalog_destroy(&catalog);
+    remove(path);
+    bench_remove_dir(BENCH_RELOAD_DIR);
+    map_destroy(&edited);
+    return ok;
+}
+
+// Time scanning a directory of count copies of a map and switching between them
+static int bench_measure_catalog(const Map *map, int count, BenchCatalogResult *result) {
+    double frequency = (double)SDL_GetPerformanceFrequency();
+
+    size_t length;
+    char *text = bench_format_map(map, &length);
+    if (!text) {
+        return 0;
+    }
+    if (!bench_make_dir(BENCH_CATALOG_DIR)) {
+        fprintf(stderr, "Could not create directory: %s\n", BENCH_CATALOG_DIR);
+        free(text);
+        return 0;
+    }
+
+    char path[512];
+    int written = 0;
+    for (; written < count; written++) {
+        snprintf(path, sizeof(path), "%s/map%07d.map", BENCH_CATALOG_DIR, written);
+        FILE *file = fopen(path, "wb");
+        if (!file) {
+            break;
+        }
+        size_t wrote = fwrite(text, 1, length, file);
+        fclose(file);
+        if (wrote != length) {
+            break;
+        }
+    }
+    free(text);
+
+    MapCatalog catalog;
+    catalog_init(&catalog, CATALOG_CACHE_MAPS);
+    int ok = written == count;
+    if (ok) {
+        Uint64 start = SDL_GetPerformanceCounter();
+        result->maps = catalog_scan(&catalog, BENCH_CATALOG_DIR);
+        result->scanMs = (SDL_GetPerformanceCounter() - start) * 1000.0 / frequency;
+
+        start = SDL_GetPerformanceCounter();
+        ok = catalog_acquire(&catalog, 0) != NULL;
+        result->firstUseMs = (SDL_GetPerformanceCounter() - start) * 1000.0 / frequency;
+    }
+
+    if (ok) {
+        // Fill the cache, then cycle through it the way number keys switch maps
+        int cached = catalog.cacheLimit < catalog.count ? catalog.cacheLimit : catalog.count;
+        int current = 0;
+        for (int i = 1; i < cached && ok; i++) {
+            ok = catalog_acquire(&catalog, i) != NULL;
+            catalog_release(&catalog, current);
+            current = i;
+        }
+
+        Uint64 start = SDL_GetPerformanceCounter();
+        for (int i = 0; i < BENCH_CATALOG_SWITCHES && ok; i++) {
+            int next = i % cached;
+            ok = catalog_acquire(&catalog, next) != NULL;
+            catalog_release(&catalog, current);
+            current = next;
+        }
+        result->switchUs = (SDL_GetPerformanceCounter() - start) * 1e6 / frequency / BENCH_CATALOG_SWITCHES;
+        catalog_release(&catalog, current);
+    }
+    catalog_destroy(&catalog);
+
+    for (int i = 0; i < written; i++) {
+        snprintf(path, sizeof(path), "%s/map%07d.map", BENCH_CATALOG_DIR, i);
+        remove(path);
+    }
+    bench_remove_dir(BENCH_CATALOG_DIR);
+    return ok;
+}
+
+// Walk forward from the start position, turning left whenever a wall blocks the way
+static int bench_build_walk(Engine *engine, Player *poses, int frames) {
+    Uint8 keys[SDL_NUM_SCANCODES];
+    memset(keys, 0, sizeof(keys));
+
+    engine_init_player(engine, engine->map->startX, engine->map->startY);
+    engine->keystate = keys;
+
+    int turning = 0;
+    for (int i = 0; i < frames; i++) {
+        poses[i] = engine->player;
+
+        keys[SDL_SCANCODE_W] = turning == 0;
+        keys[SDL_SCANCODE_A] = turning > 0;
+
+        double oldX = engine->player.posX;
+        double oldY = engine->player.posY;
+        engine_move_player(engine, BENCH_MOVE_DT);
+
+        if (turning > 0) {
+            turning--;
+        } else if (engine->player.posX == oldX && engine->player.posY == oldY) {
+            turning = BENCH_TURN_FRAMES;
+        }
+    }
+
+    engine->keystate = NULL;
+    return frames;
+}
+
+// Turn a full circle in place at the start position
+static int bench_build_spin(Engine *engine, Player *poses, int frames) {
+    for (int i = 0; i < frames; i++) {
+        poses[i] = engine->player;
+        bench_set_pose(&poses[i], engine->map->startX, engine->map->startY, 2.0 * M_PI * i / frames);
+    }
+    return frames;
+}
+
+// Strafe once around the map just inside the outer walls, looking obliquely at them
+static int bench_build_strafe(Engine *engine, Player *poses, int frames) {
+    const Map *map = engine->map;
+    double minX = BENCH_WALL_INSET, maxX = map->width - BENCH_WALL_INSET;
+    double minY = BENCH_WALL_INSET, maxY = map->height - BENCH_WALL_INSET;
+    double edgeX = maxX - minX;
+    double edgeY = maxY - minY;
+    double perimeter = 2.0 * (edgeX + edgeY);
+
+    int count = 0;
+    for (int i = 0; i < frames; i++) {
+        double d = perimeter * i / frames;
+        double x, y, travelAngle;
+
+        // Clockwise in screen space: top, right, bottom, left edge
+        if (d < edgeX) {
+            x = minX + d; y = minY; travelAngle = 0.0;
+        } else if (d < edgeX + edgeY) {
+            x = maxX; y = minY + (d - edgeX); travelAngle = M_PI / 2;
+        } else if (d < 2 * edgeX + edgeY) {
+            x = maxX - (d - edgeX - edgeY); y = maxY; travelAngle = M_PI;
+        } else {
+            x = minX; y = maxY - (d - 2 * edgeX - edgeY); travelAngle = 3 * M_PI / 2;
+        }
+
+        // Poses that would start inside a wall are skipped
+        if (!bench_is_open(map, x, y)) {
+            continue;
+        }
+
+        poses[count] = engine->player;
+        bench_set_pose(&poses[count], x, y, travelAngle - M_PI / 4);
+        count++;
+    }
+    return count;
+}
+
+// Sort helper for frame times
+static int bench_compare_double(const void *a, const void *b) {
+    double da = *(const double*)a;
+    double db = *(const double*)b;
+    return (da > db) - (da < db);
+}
+
+// Nearest-rank percentile of a sorted array
+static double bench_percentile(const double *sorted, int count, double p) {
+    int rank = (int)ceil(p * count) - 1;
+    if (rank < 0) rank = 0;
+    if (rank >= count) rank = count - 1;
+    return sorted[rank];
+}
+
+// Render every pose of a path and summarise the frame times
+static void bench_run_path(Engine *engine, const BenchPath *path, double *times, BenchResult *result) {
+    double frequency = (double)SDL_GetPerformanceFrequency();
+
+    // Warm caches and branch predictors before measuring
+    for (int i = 0; i < BENCH_WARMUP_FRAMES && i < path->count; i++) {
+        engine->player = path->poses[i];
+        engine_render_scene(engine);
+    }
+
+    double total = 0.0;
+    for (int i = 0; i < path->count; i++) {
+        engine->player = path->poses[i];
+
+        Uint64 start = SDL_GetPerformanceCounter();
+        engine_render_scene(engine);
+        Uint64 end = SDL_GetPerformanceCounter();
+
+        times[i] = (end - start) * 1000.0 / frequency;
+        total += times[i];
+    }
+
+    qsort(times, path->count, sizeof(double), bench_compare_double);
+    result->meanMs = total / path->count;
+    result->p50Ms = bench_percentile(times, path->count, 0.50);
+    result->p95Ms = bench_percentile(times, path->count, 0.95);
+    result->p99Ms = bench_percentile(times, path->count, 0.99);
+    result->fps = total > 0.0 ? path->count * 1000.0 / total : 0.0;
+}
+
+// Check whether two traced rays found the same hit
+static int bench_same_hit(const RayHit *a, const RayHit *b) {
+    return a->hit == b->hit && a->mapX == b->mapX && a->mapY == b->mapY && a->side == b->side &&
+           memcmp(&a->perpWallDist, &b->perpWallDist, sizeof(double)) == 0 &&
+           a->lineHeight == b->lineHeight;
+}
+
+// Trace every column of a pose with the scalar and the packet kernel, each with
+// and without empty-space skipping, and compare everything to plain scalar DDA;
+// then cast every floor row with both span kernels
+static void bench_verify_pose(const Map *map, const Player *player, int width, int height,
+                              BenchRayStats *stats) {
+    Map plainMap = *map;
+    plainMap.distance = NULL;
+
+    for (int x = 0; x + RAY_PACKET_SIZE <= width; x += RAY_PACKET_SIZE) {
+        RayPacket packet;
+        RayHit plain[RAY_PACKET_SIZE];
+        RayHit skip[RAY_PACKET_SIZE];
+        RayHit packedPlain[RAY_PACKET_SIZE];
+        RayHit packedSkip[RAY_PACKET_SIZE];
+
+        for (int lane = 0; lane < RAY_PACKET_SIZE; lane++) {
+            double cameraX = 2.0 * (x + lane) / (double)width - 1.0;
+            packet.posX[lane] = player->posX;
+            packet.posY[lane] = player->posY;
+            packet.dirX[lane] = player->dirX + player->planeX * cameraX;
+            packet.dirY[lane] = player->dirY + player->planeY * cameraX;
+            raycaster_cast(&plainMap, packet.posX[lane], packet.posY[lane], packet.dirX[lane],
+                           packet.dirY[lane], height, &plain[lane]);
+            raycaster_cast(map, packet.posX[lane], packet.posY[lane], packet.dirX[lane],
+                           packet.dirY[lane], height, &skip[lane]);
+        }
+        packet.projHeight = height;
+        packet.maxDist = INFINITY;
+        raycaster_cast_packet(&plainMap, &packet, packedPlain);
+        raycaster_cast_packet(map, &packet, packedSkip);
+
+        for (int lane = 0; lane < RAY_PACKET_SIZE; lane++) {
+            if (!bench_same_hit(&plain[lane], &packedPlain[lane]) ||
+                !bench_same_hit(&plain[lane], &packedSkip[lane])) {
+                stats->packetMismatches++;
+            }
+            if (!bench_same_hit(&plain[lane], &skip[lane])) {
+                stats->skipMismatches++;
+            }
+            stats->plainSteps += plain[lane].steps;
+            stats->skipSteps += skip[lane].steps;
+        }
+        stats->rays += RAY_PACKET_SIZE;
+    }
+
+    // Every floor row of the view, SIMD span against scalar span, at full size and at a mip level
+    Sint32 *tiles = (Sint32*)malloc(4 * width * sizeof(Sint32));
+    if (!tiles) {
+        return;
+    }
+    Sint32 *texels = tiles + width;
+    Sint32 *scalarTiles = tiles + 2 * width;
+    Sint32 *scalarTexels = tiles + 3 * width;
+    for (int y = height / 2; y < height; y++) {
+        FloorRow row;
+        floorcast_setup_row(player, y, width, height, &row);
+        for (int shift = 6; shift >= 4; shift -= 2) {
+            floorcast_span(map, &row, 0, width, shift, shift, tiles, texels);
+            floorcast_span_scalar(map, &row, 0, width, shift, shift, scalarTiles, scalarTexels);
+            if (memcmp(tiles, scalarTiles, width * sizeof(Sint32)) != 0 ||
+                memcmp(texels, scalarTexels, width * sizeof(Sint32)) != 0) {
+                stats->floorMismatches++;
+            }
+        }
+        stats->floorRows++;
+    }
+    free(tiles);
+}
+
+// Verify a sample of the poses of every path on the active map
+static void bench_verify_map(Engine *engine, Player *poses, int frames, int stride,
+                             int width, int height, BenchRayStats *stats) {
+    for (int p = 0; p < BENCH_PATH_COUNT; p++) {
+        int count = BENCH_PATH_BUILDERS[p](engine, poses, frames);
+        for (int i = 0; i < count; i += stride) {
+            bench_verify_pose(engine->map, &poses[i], width, height, stats);
+        }
+    }
+}
+
+// Rows [drawStart, drawEnd] a traced wall covers in a column, as the engine draws it
+static void bench_wall_rows(const RayHit *hit, int height, int *drawStart, int *drawEnd) {
+    *drawStart = -hit->lineHeight / 2 + height / 2;
+    if (*drawStart < 0) *drawStart = 0;
+    *drawEnd = hit->lineHeight / 2 + height / 2;
+    if (*drawEnd >= height) *drawEnd = height - 1;
+}
+
+// Trace every column of a pose in fixed point, with and without empty-space
+// skipping, and count the pixels whose drawn surface differs from the double path's
+static void bench_verify_fixed_pose(const Map *map, const Player *player, int width, int height,
+                                    RayFixedColumns *columns, BenchFixedStats *stats) {
+    Map plainMap = *map;
+    plainMap.distance = NULL;
+    if (!raycaster_fixed_columns_update(columns, player, width)) {
+        return;
+    }
+
+    Sint32 posX = (Sint32)floor(player->posX * 65536.0);
+    Sint32 posY = (Sint32)floor(player->posY * 65536.0);
+    Uint32 viewAngle = raycaster_fixed_view_angle(player->dirX, player->dirY);
+
+    long wrong = 0;
+    for (int x = 0; x < width; x++) {
+        double cameraX = 2.0 * x / (double)width - 1.0;
+        RayHit exact, fixed, fixedPlain;
+        raycaster_cast(map, player->posX, player->posY, player->dirX + player->planeX * cameraX,
+                       player->dirY + player->planeY * cameraX, height, &exact);
+
+        Uint32 angle = (viewAngle + (Uint32)columns->angle[x] + (1u << (RAY_FIXED_ANGLE_FRACTION - 1)))
+                       >> RAY_FIXED_ANGLE_FRACTION;
+        raycaster_cast_fixed(map, posX, posY, angle, columns->scale[x], height, &fixed);
+        raycaster_cast_fixed(&plainMap, posX, posY, angle, columns->scale[x], height, &fixedPlain);
+        if (!bench_same_hit(&fixed, &fixedPlain)) {
+            stats->skipMismatches++;
+        }
+        stats->rays++;
+
+        int exactStart, exactEnd, fixedStart, fixedEnd;
+        bench_wall_rows(&exact, height, &exactStart, &exactEnd);
+        bench_wall_rows(&fixed, height, &fixedStart, &fixedEnd);
+        if (!exact.hit) {
+            exactStart = height / 2;
+            exactEnd = exactStart - 1;
+        }
+        if (!fixed.hit) {
+            fixedStart = height / 2;
+            fixedEnd = fixedStart - 1;
+        }
+
+        // Another face: every wall row of either path can show something else
+        if (exact.hit != fixed.hit || exact.mapX != fixed.mapX || exact.mapY != fixed.mapY ||
+            exact.side != fixed.side) {
+            stats->faceMisses++;
+            int start = exactStart < fixedStart ? exactStart : fixedStart;
+            int end = exactEnd > fixedEnd ? exactEnd : fixedEnd;
+            wrong += end - start + 1;
+            continue;
+        }
+        if (!exact.hit) {
+            continue;
+        }
+
+        // The same face: rows between the two wall edges, or the whole slice if
+        // the texture is shifted by more than a texel column (they wrap at tile edges)
+        int texels = abs((int)(exact.wallX * TEX_WIDTH) - (int)(fixed.wallX * TEX_WIDTH));
+        if (texels > TEX_WIDTH / 2) texels = TEX_WIDTH - texels;
+        if (texels > 1) {
+            int start = exactStart < fixedStart ? exactStart : fixedStart;
+            int end = exactEnd > fixedEnd ? exactEnd : fixedEnd;
+            wrong += end - start + 1;
+        } else {
+            int top = abs(exactStart - fixedStart);
+            int bottom = abs(exactEnd - fixedEnd);
+            wrong += (top > 1 ? top - 1 : 0) + (bottom > 1 ? bottom - 1 : 0);
+        }
+    }
+
+    double error = (double)wrong / ((long)width * height);
+    if (error > stats->maxError) stats->maxError = error;
+    stats->wrongPixels += wrong;
+    stats->pixels += (long)width * height;
+    stats->frames++;
+}
+
+// Mark the cache lines of texels [first, last] of a texture column; returns the newly marked lines
+static long bench_mark_texels(const WallTexture *texture, Uint8 *marks, const Uint8 *first, const Uint8 *last) {
+    uintptr_t base = (uintptr_t)texture->indices / BENCH_CACHE_LINE;
+    long marked = 0;
+    for (uintptr_t line = (uintptr_t)first / BENCH_CACHE_LINE; line <= (uintptr_t)last / BENCH_CACHE_LINE; line++) {
+        if (!marks[line - base]) {
+            marks[line - base] = 1;
+            marked++;
+        }
+    }
+    return marked;
+}
+
+// Count the texel cache lines the wall columns of one pose read, sampling the
+// way the renderer does
+static long bench_texel_lines(Engine *engine, const Player *player, int width, int height, int mipmapping,
+                              Uint8 *marks[NUM_TEXTURES], size_t markSizes[NUM_TEXTURES], long *reads,
+                              long *columnLines) {
+    for (int t = 0; t < NUM_TEXTURES; t++) {
+        memset(marks[t], 0, markSizes[t]);
+    }
+
+    long lines = 0;
+    for (int x = 0; x < width; x++) {
+        double cameraX = 2.0 * x / (double)width - 1.0;
+        double rayDirX = player->dirX + player->planeX * cameraX;
+        double rayDirY = player->dirY + player->planeY * cameraX;
+        RayHit hit;
+        raycaster_cast(engine->map, player->posX, player->posY, rayDirX, rayDirY, height, &hit);
+        if (!hit.hit) {
+            continue;
+        }
+
+        int lineHeight = hit.lineHeight > 0 ? hit.lineHeight : 1;
+        int drawStart = -lineHeight / 2 + height / 2;
+        if (drawStart < 0) drawStart = 0;
+        int drawEnd = lineHeight / 2 + height / 2;
+        if (drawEnd >= height) drawEnd = height - 1;
+
+        int textureIndex = (map_get(engine->map, hit.mapX, hit.mapY) - 1) % NUM_TEXTURES;
+        const WallTexture *texture = &engine->textures.walls[textureIndex];
+        int level = mipmapping ? texture_select_level(texture, lineHeight) : 0;
+        int texWidth = texture->width >> level;
+        int texHeight = texture->height >> level;
+        int texX = (int)(hit.wallX * texWidth);
+        if ((hit.side == 0 && rayDirX > 0) || (hit.side == 1 && rayDirY < 0)) {
+            texX = texWidth - texX - 1;
+        }
+        const Uint8 *column = texture_index_column(texture, level, texX);
+
+        // First and last texel of the slice; a slice that wraps reads the whole column
+        Sint64 step = ((Sint64)texHeight << 16) / lineHeight;
+        Sint64 pos = (Sint64)(drawStart - height / 2 + lineHeight / 2) * step;
+        int first = (int)((pos >> 16) & (texHeight - 1));
+        int last = (int)(((pos + (drawEnd - drawStart) * step) >> 16) & (texHeight - 1));
+        if (last < first) {
+            first = 0;
+            last = texHeight - 1;
+        }
+
+        lines += bench_mark_texels(texture, marks[textureIndex], column + first, column + last);
+        *columnLines += (long)((uintptr_t)(column + last) / BENCH_CACHE_LINE -
+                               (uintptr_t)(column + first) / BENCH_CACHE_LINE + 1);
+        *reads += drawEnd - drawStart + 1;
+    }
+    return lines;
+}
+
+// Count texel cache lines per frame with and without mipmapping on a sample of the paths
+static int bench_measure_texels(Engine *engine, Player *poses, int frames, int stride,
+                                int width, int height, BenchTexelStats *stats) {
+    Uint8 *marks[NUM_TEXTURES];
+    size_t markSizes[NUM_TEXTURES];
+    int ok = 1;
+    for (int t = 0; t < NUM_TEXTURES; t++) {
+        const WallTexture *texture = &engine->textures.walls[t];
+        uintptr_t firstLine = (uintptr_t)texture->indices / BENCH_CACHE_LINE;
+        uintptr_t lastLine = (uintptr_t)(texture->indices + texture->texelCount - 1) / BENCH_CACHE_LINE;
+        markSizes[t] = (size_t)(lastLine - firstLine + 1);
+        marks[t] = (Uint8*)malloc(markSizes[t]);
+        ok = ok && marks[t];
+    }
+
+    for (int p = 0; p < BENCH_PATH_COUNT && ok; p++) {
+        int count = BENCH_PATH_BUILDERS[p](engine, poses, frames);
+        for (int i = 0; i < count; i += stride) {
+            long reads = 0;
+            stats->lines += bench_texel_lines(engine, &poses[i], width, height, 0, marks, markSizes, &reads,
+                                              &stats->columnLines);
+            stats->mipLines += bench_texel_lines(engine, &poses[i], width, height, 1, marks, markSizes, &reads,
+                                                 &stats->mipColumnLines);
+            stats->texelReads += reads / 2;
+            stats->frames++;
+        }
+    }
+
+    for (int t = 0; t < NUM_TEXTURES; t++) {
+        free(marks[t]);
+    }
+    return ok;
+}
+
+// Time the spin path on the active map with flat floors and with cast floors,
+// at BENCH_FLOOR_WIDTH x BENCH_FLOOR_HEIGHT with mipmapped walls on one thread
+static int bench_measure_floors(Engine *engine, Player *poses, double *times, int frames,
+                                BenchFloorResult *result) {
+    if (!engine->map->floor || !engine_set_resolution(engine, BENCH_FLOOR_WIDTH, BENCH_FLOOR_HEIGHT)) {
+        return 0;
+    }
+    engine_set_render_scale(engine, 1.0);
+    engine_set_frame_budget(engine, 0.0);
+    engine->texturedWalls = 1;
+    engine->mipmapping = 1;
+
+    // The spin sees the floor in every direction from one spot
+    BenchPath path;
+    path.name = "spin";
+    path.poses = poses;
+    path.count = bench_build_spin(engine, poses, frames);
+    if (path.count == 0) {
+        return 0;
+    }
+
+    BenchResult flat;
+    engine->texturedFloors = 0;
+    bench_run_path(engine, &path, times, &flat);
+    result->flatMs = flat.meanMs;
+
+    // The engine times its floor pass, the rest of the frame is the wall pass
+    engine->texturedFloors = 1;
+    for (int i = 0; i < BENCH_WARMUP_FRAMES && i < path.count; i++) {
+        engine->player = path.poses[i];
+        engine_render_scene(engine);
+    }
+    double frameMs = 0.0;
+    double floorMs = 0.0;
+    double floorPixels = 0.0;
+    for (int i = 0; i < path.count; i++) {
+        engine->player = path.poses[i];
+        engine_render_scene(engine);
+        frameMs += engine->lastRenderMs;
+        floorMs += engine->lastFloorMs;
+        floorPixels += engine->lastFloorPixels;
+    }
+
+    // Open rooms are mostly floor and ceiling, so the cost per pixel is
+    // compared as well as the cost per frame
+    double wallPixels = (double)engine->renderWidth * engine->renderHeight * path.count - floorPixels;
+    result->frameMs = frameMs / path.count;
+    result->floorMs = floorMs / path.count;
+    result->wallMs = result->frameMs - result->floorMs;
+    result->fraction = result->wallMs > 0.0 ? result->floorMs / result->wallMs : 0.0;
+    result->floorPixelNs = floorPixels > 0.0 ? floorMs * 1e6 / floorPixels : 0.0;
+    result->wallPixelNs = wallPixels > 0.0 ? (frameMs - floorMs) * 1e6 / wallPixels : 0.0;
+    result->pixelFraction = result->wallPixelNs > 0.0 ? result->floorPixelNs / result->wallPixelNs : 0.0;
+    return 1;
+}
+
+// Scatter count sprites over a map and time the spin path through them
+static int bench_measure_sprites(Engine *engine, Map *map, int count, Player *poses, double *times, int frames,
+                                 BenchSpriteResult *result) {
+    engine->map = map;
+    entity_clear(engine->entities);
+    if (!engine_scatter_sprites(engine, count, 777)) {
+        entity_clear(engine->entities);
+        return 0;
+    }
+
+    // The spin sees sprites in every direction from one spot
+    int poseCount = bench_build_spin(engine, poses, frames);
+    for (int i = 0; i < BENCH_WARMUP_FRAMES && i < poseCount; i++) {
+        engine->player = poses[i];
+        engine_render_scene(engine);
+    }
+    double total = 0.0;
+    double spriteMs = 0.0;
+    double visible = 0.0;
+    for (int i = 0; i < poseCount; i++) {
+        engine->player = poses[i];
+        engine_render_scene(engine);
+        times[i] = engine->lastRenderMs;
+        total += times[i];
+        spriteMs += engine->lastSpriteMs;
+        visible += engine->lastSpriteCount;
+    }
+    entity_clear(engine->entities);
+    if (poseCount == 0) {
+        return 0;
+    }
+
+    qsort(times, poseCount, sizeof(double), bench_compare_double);
+    result->meanMs = total / poseCount;
+    result->p95Ms = bench_percentile(times, poseCount, 0.95);
+    result->spriteMs = spriteMs / poseCount;
+    result->visible = visible / poseCount;
+    return 1;
+}
+
+// Count the agents whose circles overlap a wall tile by more than the sweep's skin
+static int bench_count_overlaps(const AgentStore *agents, const Map *map) {
+    double reach = agents->radius - 2 * AGENT_SKIN;
+    int overlapping = 0;
+    for (int i = 0; i < agents->count; i++) {
+        double x = agents->posX[i];
+        double y = agents->posY[i];
+        int found = 0;
+        for (int ty = (int)floor(y - reach); ty <= (int)floor(y + reach) && !found; ty++) {
+            for (int tx = (int)floor(x - reach); tx <= (int)floor(x + reach) && !found; tx++) {
+                int solid = tx < 0 || ty < 0 || tx >= map->width || ty >= map->height || map_get(map, tx, ty) > 0;
+                double gapX = x < tx ? tx - x : x > tx + 1 ? x - (tx + 1) : 0.0;
+                double gapY = y < ty ? ty - y : y > ty + 1 ? y - (ty + 1) : 0.0;
+                found = solid && gapX * gapX + gapY * gapY < reach * reach;
+            }
+        }
+        overlapping += found;
+    }
+    return overlapping;
+}
+
+// Scatter count agents over the open tiles of a map and time agent_update on
+// the engine's render pool; every agent walks, and turns at random now and then
+static int bench_measure_agents(Engine *engine, const Map *map, int count, BenchAgentResult *result) {
+    AgentStore agents;
+    agent_store_init(&agents);
+
+    // Kept off the tile edges so no agent starts in a wall; the same seed for every thread count
+    Uint32 seed = 4242;
+    for (int i = 0; i < count; i++) {
+        int x, y;
+        do {
+            seed = seed * 1664525u + 1013904223u;
+            x = (int)((seed >> 8) % (Uint32)map->width);
+            seed = seed * 1664525u + 1013904223u;
+            y = (int)((seed >> 8) % (Uint32)map->height);
+        } while (map_get(map, x, y) != 0);
+        seed = seed * 1664525u + 1013904223u;
+        double offsetX = 0.3 + 0.4 * ((seed >> 8) & 0xFF) / 255.0;
+        double offsetY = 0.3 + 0.4 * ((seed >> 16) & 0xFF) / 255.0;
+        if (agent_add(&agents, x + offsetX, y + offsetY, 2.0 * M_PI * (seed >> 24) / 256.0) < 0) {
+            agent_store_free(&agents);
+            return 0;
+        }
+    }
+
+    double frequency = (double)SDL_GetPerformanceFrequency();
+    double totalMs = 0.0;
+    for (int tick = 0; tick < BENCH_AGENT_WARMUP + BENCH_AGENT_TICKS; tick++) {
+        if (tick % BENCH_AGENT_TURN_TICKS == 0) {
+            for (int i = 0; i < agents.count; i++) {
+                seed = seed * 1664525u + 1013904223u;
+                int turn = (seed >> 16) % 4;
+                agents.keys[i] = (Uint8)(ENGINE_KEY_FORWARD | (turn == 1 ? ENGINE_KEY_LEFT : 0) |
+                                         (turn == 2 ? ENGINE_KEY_RIGHT : 0));
+            }
+        }
+
+        Uint64 start = SDL_GetPerformanceCounter();
+        agent_update(&agents, map, BENCH_MOVE_DT, engine->pool);
+        Uint64 end = SDL_GetPerformanceCounter();
+        if (tick >= BENCH_AGENT_WARMUP) {
+            totalMs += (end - start) * 1000.0 / frequency;
+        }
+    }
+
+    result->tickMs = totalMs / BENCH_AGENT_TICKS;
+    result->agentsPerMs = result->tickMs > 0.0 ? count / result->tickMs : 0.0;
+    result->overlapping = bench_count_overlaps(&agents, map);
+    agent_store_free(&agents);
+    return 1;
+}
+
+// Pick a random point on an open tile of a map, off the tile edges
+static void bench_random_open_point(const Map *map, Uint32 *seed, RayVector *point) {
+    int x, y;
+    do {
+        *seed = *seed * 1664525u + 1013904223u;
+        x = (int)((*seed >> 8) % (Uint32)map->width);
+        *seed = *seed * 1664525u + 1013904223u;
+        y = (int)((*seed >> 8) % (Uint32)map->height);
+    } while (map_get(map, x, y) != 0);
+    *seed = *seed * 1664525u + 1013904223u;
+    point->x = x + 0.1 + 0.8 * ((*seed >> 8) & 0xFF) / 255.0;
+    point->y = y + 0.1 + 0.8 * ((*seed >> 16) & 0xFF) / 255.0;
+}
+
+// Check a ray query's result against scalar DDA of the same ray on a map without a distance field
+static int bench_same_ray(const Map *plainMap, const RayVector *origin, const RayVector *dir, double maxDist,
+                          const RayResult *result) {
+    RayHit hit;
+    raycaster_cast_range(plainMap, origin->x, origin->y, dir->x, dir->y, maxDist, &hit);
+    if (hit.hit != result->hit) {
+        return 0;
+    }
+    return !hit.hit || (hit.mapX == result->mapX && hit.mapY == result->mapY && hit.side == result->side &&
+                        memcmp(&hit.perpWallDist, &result->distance, sizeof(double)) == 0);
+}
+
+// Time the fastest of BENCH_RAY_REPEATS runs of a ray query, in millions of rays per second
+static double bench_time_rays(Engine *engine, const RayVector *origins, const RayVector *dirs, double maxDist,
+                              int count, RayResult *results) {
+    double frequency = (double)SDL_GetPerformanceFrequency();
+    double bestMs = INFINITY;
+    for (int r = 0; r < BENCH_RAY_REPEATS; r++) {
+        Uint64 start = SDL_GetPerformanceCounter();
+        engine_cast_rays(engine, origins, dirs, maxDist, count, results);
+        double ms = (SDL_GetPerformanceCounter() - start) * 1000.0 / frequency;
+        if (ms < bestMs) {
+            bestMs = ms;
+        }
+    }
+    return bestMs > 0.0 ? count / (bestMs * 1000.0) : 0.0;
+}
+
+// Time count sensor rays and line of sight checks on the active map, on the
+// engine's render pool, and compare every result to scalar DDA
+static int bench_measure_rays(Engine *engine, int count, BenchRayQueryResult *result) {
+    const Map *map = engine->map;
+    RayVector *origins = (RayVector*)malloc((size_t)count * sizeof(RayVector));
+    RayVector *dirs = (RayVector*)malloc((size_t)count * sizeof(RayVector));
+    RayVector *targets = (RayVector*)malloc((size_t)count * sizeof(RayVector));
+    RayResult *results = (RayResult*)malloc((size_t)count * sizeof(RayResult));
+    Uint8 *visible = (Uint8*)malloc(count);
+    if (!origins || !dirs || !targets || !results || !visible) {
+        fprintf(stderr, "Failed to allocate %d rays!\n", count);
+        free(origins);
+        free(dirs);
+        free(targets);
+        free(results);
+        free(visible);
+        return 0;
+    }
+
+    // The same seed for every thread count
+    Uint32 seed = 2024;
+    for (int i = 0; i < count; i++) {
+        bench_random_open_point(map, &seed, &origins[i]);
+        bench_random_open_point(map, &seed, &targets[i]);
+        seed = seed * 1664525u + 1013904223u;
+        double angle = 2.0 * M_PI * (seed >> 8) / 16777216.0;
+        dirs[i].x = cos(angle);
+        dirs[i].y = sin(angle);
+    }
+
+    Map plainMap = *map;
+    plainMap.distance = NULL;
+    result->mismatches = 0;
+
+    result->castMrays = bench_time_rays(engine, origins, dirs, INFINITY, count, results);
+    for (int i = 0; i < count; i++) {
+        result->mismatches += !bench_same_ray(&plainMap, &origins[i], &dirs[i], INFINITY, &results[i]);
+    }
+
+    result->rangeMrays = bench_time_rays(engine, origins, dirs, BENCH_RAY_RANGE, count, results);
+    for (int i = 0; i < count; i++) {
+        result->mismatches += !bench_same_ray(&plainMap, &origins[i], &dirs[i], BENCH_RAY_RANGE, &results[i]);
+    }
+
+    double frequency = (double)SDL_GetPerformanceFrequency();
+    double bestMs = INFINITY;
+    for (int r = 0; r < BENCH_RAY_REPEATS; r++) {
+        Uint64 start = SDL_GetPerformanceCounter();
+        engine_check_visibility(engine, origins, targets, count, visible);
+        double ms = (SDL_GetPerformanceCounter() - start) * 1000.0 / frequency;
+        if (ms < bestMs) {
+            bestMs = ms;
+        }
+    }
+    result->losMrays = bestMs > 0.0 ? count / (bestMs * 1000.0) : 0.0;
+
+    int seen = 0;
+    for (int i = 0; i < count; i++) {
+        RayVector dir = { targets[i].x - origins[i].x, targets[i].y - origins[i].y };
+        RayHit hit;
+        raycaster_cast_range(&plainMap, origins[i].x, origins[i].y, dir.x, dir.y, 1.0, &hit);
+        result->mismatches += visible[i] != !hit.hit;
+        seen += visible[i];
+    }
+    result->visible = (double)seen / count;
+
+    free(origins);
+    free(dirs);
+    free(targets);
+    free(results);
+    free(visible);
+    return 1;
+}
+
+// Render count BENCH_VIEW_WIDTH x BENCH_VIEW_HEIGHT views from random open
+// points of the active map in one engine_render_views call, then one
+// engine_render_scene at a time, and compare their pixels
+static int bench_measure_views(Engine *engine, int count, BenchViewResult *result) {
+    const int pixelCount = BENCH_VIEW_WIDTH * BENCH_VIEW_HEIGHT;
+    EngineView *views = (EngineView*)malloc((size_t)count * sizeof(EngineView));
+    Uint32 *pixels = (Uint32*)malloc((size_t)count * pixelCount * sizeof(Uint32));
+    if (!views || !pixels || !engine_set_resolution(engine, BENCH_VIEW_WIDTH, BENCH_VIEW_HEIGHT)) {
+        fprintf(stderr, "Failed to allocate %d views!\n", count);
+        free(views);
+        free(pixels);
+        return 0;
+    }
+    engine_set_render_scale(engine, 1.0);
+    engine_set_frame_budget(engine, 0.0);
+
+    // The same seed for every thread count; every camera has the player's field of view
+    Uint32 seed = 777;
+    for (int i = 0; i < count; i++) {
+        RayVector point;
+        bench_random_open_point(engine->map, &seed, &point);
+        seed = seed * 1664525u + 1013904223u;
+        double angle = 2.0 * M_PI * (seed >> 8) / 16777216.0;
+        Player *camera = &views[i].camera;
+        *camera = engine->player;
+        camera->posX = point.x;
+        camera->posY = point.y;
+        camera->dirX = cos(angle);
+        camera->dirY = sin(angle);
+        camera->planeX = -camera->dirY * 0.66;
+        camera->planeY = camera->dirX * 0.66;
+        views[i].pixels = pixels + (size_t)i * pixelCount;
+        views[i].width = BENCH_VIEW_WIDTH;
+        views[i].height = BENCH_VIEW_HEIGHT;
+        views[i].pitch = BENCH_VIEW_WIDTH;
+    }
+
+    double frequency = (double)SDL_GetPerformanceFrequency();
+    result->batchMs = INFINITY;
+    for (int r = 0; r < BENCH_VIEW_REPEATS; r++) {
+        Uint64 start = SDL_GetPerformanceCounter();
+        if (!engine_render_views(engine, views, count)) {
+            free(views);
+            free(pixels);
+            return 0;
+        }
+        double ms = (SDL_GetPerformanceCounter() - start) * 1000.0 / frequency;
+        if (ms < result->batchMs) {
+            result->batchMs = ms;
+        }
+    }
+    result->viewsPerSec = result->batchMs > 0.0 ? count * 1000.0 / result->batchMs : 0.0;
+
+    // The single-view path over the same cameras, which must draw the same pixels
+    Player player = engine->player;
+    double loopMs = 0.0;
+    result->mismatches = 0;
+    for (int i = 0; i < count; i++) {
+        engine->player = views[i].camera;
+        Uint64 start = SDL_GetPerformanceCounter();
+        engine_render_scene(engine);
+        loopMs += (SDL_GetPerformanceCounter() - start) * 1000.0 / frequency;
+        result->mismatches += memcmp(engine->framebuffer, views[i].pixels, pixelCount * sizeof(Uint32)) != 0;
+    }
+    engine->player = player;
+    result->loopViewsPerSec = loopMs > 0.0 ? count * 1000.0 / loopMs : 0.0;
+
+    free(views);
+    free(pixels);
+    return 1;
+}
+
+// Encode the frames of count poses on the active map as one stream, with a
+// keyframe every BENCH_CODEC_KEYFRAMES frames, and decode each one again
+static int bench_measure_codec(Engine *engine, const Player *poses, int count, BenchCodecResult *result) {
+    int width = engine->renderWidth;
+    int height = engine->renderHeight;
+    size_t frameBytes = (size_t)width * height * sizeof(Uint32);
+    Uint8 *data = (Uint8*)malloc(framecodec_max_size(width, height));
+    Uint32 *decoded = (Uint32*)malloc(frameBytes);
+    if (!data || !decoded) {
+        fprintf(stderr, "Out of memory\n");
+        free(data);
+        free(decoded);
+        return 0;
+    }
+
+    FrameCodec encoder, decoder;
+    framecodec_init(&encoder);
+    framecodec_init(&decoder);
+    memset(result, 0, sizeof(BenchCodecResult));
+    double frequency = (double)SDL_GetPerformanceFrequency();
+    int keyframes = 0;
+    int ok = 1;
+    for (int i = 0; i < count; i++) {
+        engine->player = poses[i];
+        engine_render_scene(engine);
+
+        int keyframe = i % BENCH_CODEC_KEYFRAMES == 0;
+        Uint64 start = SDL_GetPerformanceCounter();
+        size_t size = framecodec_encode(&encoder, engine->framebuffer, width, height, width, keyframe, data);
+        Uint64 encoded = SDL_GetPerformanceCounter();
+        if (size == 0) {
+            ok = 0;
+            break;
+        }
+        int decodedOk = framecodec_decode(&decoder, data, size, decoded, width);
+        Uint64 end = SDL_GetPerformanceCounter();
+
+        result->encodeMs += (encoded - start) * 1000.0 / frequency;
+        result->decodeMs += (end - encoded) * 1000.0 / frequency;
+        result->mismatches += !decodedOk || memcmp(decoded, engine->framebuffer, frameBytes) != 0;
+        result->bytes += size;
+        if (keyframe) {
+            result->keyframeBytes += size;
+            keyframes++;
+        }
+        result->frames++;
+    }
+
+    if (result->frames > 0) {
+        result->rawBytes = (double)frameBytes;
+        result->bytes /= result->frames;
+        result->keyframeBytes /= keyframes;
+        result->encodeMs /= result->frames;
+        result->decodeMs /= result->frames;
+    }
+
+    framecodec_free(&encoder);
+    framecodec_free(&decoder);
+    free(data);
+    free(decoded);
+    return ok;
+}
+
+// Edit the active map a few tiles in front of the camera at poses along a
+// path, as a reloaded map file changes it, and bring the frame up to date with
+// engine_update_scene after each edit and after its undo; each frame must be
+// the same as the frame rendered whole
+static int bench_measure_incremental(Engine *engine, const Player *poses, int count,
+                                     BenchIncrementalResult *result) {
+    Map *map = engine->map;
+    Map edited;
+    size_t frameBytes = (size_t)engine->renderWidth * engine->renderHeight * sizeof(Uint32);
+    Uint32 *updated = (Uint32*)malloc(frameBytes);
+    if (!updated || !map_copy(&edited, map, map->blockShift)) {
+        fprintf(stderr, "Out of memory\n");
+        free(updated);
+        return 0;
+    }
+
+    memset(result, 0, sizeof(BenchIncrementalResult));
+    double frequency = (double)SDL_GetPerformanceFrequency();
+    Uint32 seed = 13579;
+    int stride = count > BENCH_INCREMENTAL_POSES ? count / BENCH_INCREMENTAL_POSES : 1;
+    int poseCount = 0;
+    int ok = 1;
+    for (int p = 0; ok && p < count; p += stride) {
+        const Player *pose = &poses[p];
+        engine->player = *pose;
+        Uint64 start = SDL_GetPerformanceCounter();
+        engine_render_scene(engine);
+        Uint64 rendered = SDL_GetPerformanceCounter();
+        result->idleColumns += engine_update_scene(engine);
+        result->fullMs += (rendered - start) * 1000.0 / frequency;
+        result->idleMs += (SDL_GetPerformanceCounter() - rendered) * 1000.0 / frequency;
+        poseCount++;
+
+        for (int e = 0; ok && e < BENCH_INCREMENTAL_EDITS; e++) {
+            // A tile in view between 1.5 and 9.5 tiles away, or the map's edge
+            // on the way there, never the camera's own
+            seed = seed * 1664525u + 1013904223u;
+            double cameraX = 2.0 * ((seed >> 8) & 0xFFFF) / 65535.0 - 1.0;
+            double distance = 1.5 + 8.0 * (seed >> 24) / 255.0;
+            int x = (int)floor(pose->posX + distance * (pose->dirX + pose->planeX * cameraX));
+            int y = (int)floor(pose->posY + distance * (pose->dirY + pose->planeY * cameraX));
+            x = x < 0 ? 0 : x >= map->width ? map->width - 1 : x;
+            y = y < 0 ? 0 : y >= map->height ? map->height - 1 : y;
+
+            // A wall added or removed, another wall or floor texture, or a light moved a tile
+            size_t tile = map_tile_index(&edited, x, y);
+            MapTile oldTile = edited.tiles[tile];
+            Uint8 oldFloor = edited.floor ? edited.floor[tile] : 0;
+            int light = edited.lightCount > 0 && (seed & 3) == 0 ? (int)((seed >> 2) % edited.lightCount) : -1;
+            MapLight oldLight;
+            memset(&oldLight, 0, sizeof(oldLight));
+            if (light >= 0) {
+                oldLight = edited.lights[light];
+                edited.lights[light].x += edited.lights[light].x + 1 < map->width ? 1 : -1;
+            } else if (oldTile > 0 && (seed & 4)) {
+                edited.tiles[tile] = (MapTile)(oldTile % 4 + 1);
+            } else if (oldTile == 0 && edited.floor && (seed & 4)) {
+                edited.floor[tile] = (Uint8)((oldFloor + 1) % (NUM_TEXTURES + 1));
+            } else {
+                edited.tiles[tile] = oldTile > 0 ? 0 : (MapTile)(1 + (seed >> 3) % 4);
+            }
+
+            for (int undo = 0; ok && undo < 2; undo++) {
+                if (undo) {
+                    edited.tiles[tile] = oldTile;
+                    if (edited.floor) {
+                        edited.floor[tile] = oldFloor;
+                    }
+                    if (light >= 0) {
+                        edited.lights[light] = oldLight;
+                    }
+                }
+                if (map_apply_changes(map, &edited) < 0) {
+                    ok = 0;
+                    break;
+                }
+
+                Uint64 updateStart = SDL_GetPerformanceCounter();
+                result->columns += engine_update_scene(engine);
+                result->updateMs += (SDL_GetPerformanceCounter() - updateStart) * 1000.0 / frequency;
+                memcpy(updated, engine->framebuffer, frameBytes);
+                engine_render_scene(engine);
+                result->mismatches += memcmp(updated, engine->framebuffer, frameBytes) != 0;
+                result->frames++;
+            }
+        }
+    }
+
+    if (poseCount > 0) {
+        result->fullMs /= poseCount;
+        result->idleMs /= poseCount;
+    }
+    if (result->frames > 0) {
+        result->updateMs /= result->frames;
+        result->columns /= result->frames;
+    }
+    map_destroy(&edited);
+    free(updated);
+    return ok;
+}
+
+// Write a string as a JSON literal
+static void bench_write_json_string(FILE *out, const char *str) {
+    fputc('"', out);
+    for (; *str; str++) {
+        if (*str == '"' || *str == '\\') {
+            fputc('\\', out);
+        }
+        if ((unsigned char)*str >= 0x20) {
+            fputc(*str, out);
+        }
+    }
+    fputc('"', out);
+}
+
+// Measure every camera path on the active map and write one result per path
+static void bench_run_map(BenchRun *run) {
+    Engine *engine = run->engine;
+    const BenchOptions *options = run->options;
+
+    for (int w = 0; w < options->wallModeCount; w++) {
+        int wallMode = options->wallModes[w];
+        engine->texturedWalls = wallMode != BENCH_WALLS_FLAT;
+        engine->mipmapping = wallMode == BENCH_WALLS_MIPMAPPED;
+
+        for (int p = 0; p < BENCH_PATH_COUNT; p++) {
+            BenchPath path;
+            path.name = BENCH_PATH_NAMES[p];
+            path.poses = run->poses;
+            path.count = BENCH_PATH_BUILDERS[p](engine, run->poses, options->frames);
+            if (path.count == 0) {
+                continue;
+            }
+
+            // Every path starts from the same scale so controller runs are comparable
+            engine_set_render_scale(engine, options->scale);
+            engine_set_frame_budget(engine, options->budgetMs);
+            int decisions = engine->scaleController.decisionCount;
+
+            BenchResult result;
+            bench_run_path(engine, &path, run->times, &result);
+
+            fprintf(run->out, "%s\n    {\"map\": ", run->first ? "" : ",");
+            bench_write_json_string(run->out, engine->map->name);
+            fprintf(run->out, ", \"layout\": \"%s\", \"walls\": \"%s\", \"path\": \"%s\", \"width\": %d, "
+                    "\"height\": %d, \"render_width\": %d, \"render_height\": %d, \"scale_changes\": %d, "
+                    "\"threads\": %d, \"frames\": %d, \"fps\": %.2f, \"mean_ms\": %.4f, \"p50_ms\": %.4f, "
+                    "\"p95_ms\": %.4f, \"p99_ms\": %.4f}",
+                    engine->map->blockShift ? "blocked" : "flat", BENCH_WALL_NAMES[wallMode], path.name,
+                    engine->windowWidth, engine->windowHeight, engine->renderWidth, engine->renderHeight,
+                    engine->scaleController.decisionCount - decisions, engine_get_thread_count(engine),
+                    path.count, result.fps, result.meanMs, result.p50Ms, result.p95Ms, result.p99Ms);
+            run->first = 0;
+        }
+    }
+}
+
+// Fold the pixels of the last rendered frame into an FNV-1a hash
+static Uint64 bench_hash_frame(const Engine *engine, Uint64 hash) {
+    const Uint8 *bytes = (const Uint8*)engine->framebuffer;
+    size_t size = (size_t)engine->renderWidth * engine->renderHeight * sizeof(Uint32);
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * BENCH_FNV_PRIME;
+    }
+    return hash;
+}
+
+// Replay a recording headless with threadCount render threads and write each
+// frame's render time and a hash of every frame rendered, and the frames
+// encoded to encodePath unless it is NULL; 0 if it cannot be replayed
+static int bench_run_replay(Engine *engine, const char *path, int threadCount, const char *encodePath, FILE *out) {
+    Replay *replay = replay_open(path);
+    if (!replay) {
+        return 0;
+    }
+    if (!engine_set_thread_count(engine, threadCount) || !engine_start_replay(engine, &replay->header)) {
+        replay_close(replay);
+        return 0;
+    }
+
+    int capacity = replay->header.frameCount > 0 ? (int)replay->header.frameCount : 1024;
+    double *times = (double*)malloc(capacity * sizeof(double));
+    if (!times) {
+        fprintf(stderr, "Out of memory\n");
+        replay_close(replay);
+        return 0;
+    }
+
+    // Frames are never rendered larger than the output resolution
+    FrameCodec encoder;
+    framecodec_init(&encoder);
+    FILE *encoded = NULL;
+    Uint8 *data = NULL;
+    Uint64 encodedBytes = 0;
+    Uint64 rawBytes = 0;
+    if (encodePath) {
+        encoded = fopen(encodePath, "wb");
+        data = (Uint8*)malloc(framecodec_max_size(engine->windowWidth, engine->windowHeight));
+        if (!encoded || !data) {
+            fprintf(stderr, "Could not open encoded frame file: %s\n", encodePath);
+            if (encoded) {
+                fclose(encoded);
+            }
+            free(data);
+            free(times);
+            replay_close(replay);
+            return 0;
+        }
+    }
+
+    // Pixels are hashed outside the timed render, so the hash costs the timings nothing
+    Uint64 hash = BENCH_FNV_OFFSET;
+    int count = 0;
+    int status;
+    ReplayFrame frame;
+    while ((status = replay_read_frame(replay, &frame)) == 1) {
+        if (count == capacity) {
+            double *grown = (double*)realloc(times, capacity * 2 * sizeof(double));
+            if (!grown) {
+                status = -1;
+                break;
+            }
+            times = grown;
+            capacity *= 2;
+        }
+        if (!engine_replay_frame(engine, &frame)) {
+            status = -1;
+            break;
+        }
+        times[count] = engine->lastRenderMs;
+        hash = bench_hash_frame(engine, hash);
+
+        if (encoded) {
+            size_t size = framecodec_encode(&encoder, engine->framebuffer, engine->renderWidth, engine->renderHeight,
+                                            engine->renderWidth, count % BENCH_CODEC_KEYFRAMES == 0, data);
+            if (size == 0 || fwrite(data, 1, size, encoded) != size) {
+                fprintf(stderr, "Could not write encoded frame file: %s\n", encodePath);
+                status = -1;
+                break;
+            }
+            encodedBytes += size;
+            rawBytes += (Uint64)engine->renderWidth * engine->renderHeight * sizeof(Uint32);
+        }
+        count++;
+    }
+    if (status < 0) {
+        fprintf(stderr, "Recording is damaged or uses maps that are missing: %s\n", path);
+    }
+
+    fprintf(out, "{\"replay\": ");
+    bench_write_json_string(out, path);
+    fprintf(out, ", \"map\": ");
+    bench_write_json_string(out, replay->header.mapName);
+    fprintf(out, ", \"frames\": %d, \"threads\": %d, \"sequence_hash\": \"%016llx\", \"frame_ms\": [",
+            count, engine_get_thread_count(engine), (unsigned long long)hash);
+    double total = 0.0;
+    for (int i = 0; i < count; i++) {
+        fprintf(out, "%s%.4f", i ? ", " : "", times[i]);
+        total += times[i];
+    }
+    fprintf(out, "]");
+    if (encoded) {
+        fprintf(out, ", \"raw_bytes\": %llu, \"encoded_bytes\": %llu, \"ratio\": %.1f",
+                (unsigned long long)rawBytes, (unsigned long long)encodedBytes,
+                encodedBytes > 0 ? (double)rawBytes / encodedBytes : 0.0);
+    }
+
+    if (count > 0) {
+        qsort(times, count, sizeof(double), bench_compare_double);
+        fprintf(out, ", \"mean_ms\": %.4f, \"p50_ms\": %.4f, \"p95_ms\": %.4f, \"p99_ms\": %.4f, "
+                "\"max_ms\": %.4f", total / count, bench_percentile(times, count, 0.50),
+                bench_percentile(times, count, 0.95), bench_percentile(times, count, 0.99), times[count - 1]);
+    }
+    fprintf(out, "}\n");
+
+    if (encoded && fclose(encoded) != 0) {
+        fprintf(stderr, "Could not write encoded frame file: %s\n", encodePath);
+        status = -1;
+    }
+    framecodec_free(&encoder);
+    free(data);
+    free(times);
+    replay_close(replay);
+    return status == 0;
+}
+
+// Read the lines of a golden file, "<hash or ms> <mode> <map name>"; returns
+// how many were read, -1 if the file does not exist
+static int bench_read_golden(const char *path, BenchGolden *entries, int capacity) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        return -1;
+    }
+
+    char line[256];
+    int count = 0;
+    while (count < capacity && fgets(line, sizeof(line), file)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        BenchGolden *entry = &entries[count];
+        char value[32];
+        int nameStart = 0;
+        if (line[0] == '#' || sscanf(line, "%31s %15s %n", value, entry->mode, &nameStart) != 2 ||
+            nameStart == 0) {
+            continue;
+        }
+
+        // The map name runs to the end of the line, it may hold spaces
+        snprintf(entry->map, sizeof(entry->map), "%s", line + nameStart);
+        entry->hash = (Uint64)strtoull(value, NULL, 16);
+        entry->ms = atof(value);
+        count++;
+    }
+    fclose(file);
+    return count;
+}
+
+// Write the frame hashes (or with timings the render times) of a regression check to a golden file
+static int bench_write_golden(const char *path, const BenchGolden *entries, int count, int timings) {
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        fprintf(stderr, "Could not write golden file: %s\n", path);
+        return 0;
+    }
+
+    fprintf(file, timings ? "# Mean of each pose's fastest render ms at %dx%d: ms, render mode, map\n"
+                          : "# FNV-1a hash of every frame at %dx%d: hash, render mode, map\n",
+            BENCH_GOLDEN_WIDTH, BENCH_GOLDEN_HEIGHT);
+    for (int i = 0; i < count; i++) {
+        if (timings) {
+            fprintf(file, "%.4f %s %s\n", entries[i].ms, entries[i].mode, entries[i].map);
+        } else {
+            fprintf(file, "%016llx %s %s\n", (unsigned long long)entries[i].hash, entries[i].mode, entries[i].map);
+        }
+    }
+    return fclose(file) == 0;
+}
+
+// Find the golden entry of a map in a render mode, NULL if there is none
+static const BenchGolden* bench_find_golden(const BenchGolden *entries, int count, const char *map,
+                                            const char *mode) {
+    for (int i = 0; i < count; i++) {
+        if (strcmp(entries[i].map, map) == 0 && strcmp(entries[i].mode, mode) == 0) {
+            return &entries[i];
+        }
+    }
+    return NULL;
+}
+
+// Render every pose in a render mode, hashing the frames, then time
+// BENCH_GOLDEN_REPEATS renders of each; returns the mean of each pose's fastest render
+static double bench_golden_render(Engine *engine, const BenchRenderMode *mode, const Player *poses, int count,
+                                  double *times, Uint64 *hash) {
+    engine->texturedWalls = mode->texturedWalls;
+    engine->texturedFloors = mode->texturedFloors;
+    engine->mipmapping = mode->mipmapping;
+    engine->fixedPoint = mode->fixedPoint;
+    entity_clear(engine->entities);
+    if (mode->sprites > 0) {
+        engine_scatter_sprites(engine, mode->sprites, 777);
+    }
+
+    // The hashing pass also warms the caches for the timed one
+    *hash = BENCH_FNV_OFFSET;
+    for (int i = 0; i < count; i++) {
+        engine->player = poses[i];
+        engine_render_scene(engine);
+        *hash = bench_hash_frame(engine, *hash);
+    }
+
+    // Other processes only ever add time, so the fastest of a few renders is the
+    // steadiest measure of a pose; the repeats sweep the whole path so a burst of
+    // load lands on one render of many poses rather than every render of one
+    for (int i = 0; i < count; i++) {
+        times[i] = INFINITY;
+    }
+    for (int r = 0; r < BENCH_GOLDEN_REPEATS; r++) {
+        for (int i = 0; i < count; i++) {
+            engine->player = poses[i];
+            engine_render_scene(engine);
+            if (engine->lastRenderMs < times[i]) {
+                times[i] = engine->lastRenderMs;
+            }
+        }
+    }
+    entity_clear(engine->entities);
+
+    double total = 0.0;
+    for (int i = 0; i < count; i++) {
+        total += times[i];
+    }
+    return count > 0 ? total / count : 0.0;
+}
+
+// Render fixed poses on every map in every render mode and compare the frame
+// hashes with the goldens and the render times with the baseline (or write
+// them); 0 if any frame differs or got slower than the tolerance allows
+static int bench_run_golden(Engine *engine, const BenchOptions *options, int mapCount, FILE *out) {
+    char framesPath[512];
+    char timingsPath[512];
+    snprintf(framesPath, sizeof(framesPath), "%s/%s", options->goldenDir, BENCH_GOLDEN_FRAMES);
+    snprintf(timingsPath, sizeof(timingsPath), "%s/%s", options->goldenDir, BENCH_GOLDEN_TIMINGS);
+
+    // A missing baseline only skips the timing check, timings belong to one machine
+    BenchGolden goldens[BENCH_MAX_GOLDEN];
+    BenchGolden baseline[BENCH_MAX_GOLDEN];
+    int goldenCount = options->updateGolden ? 0 : bench_read_golden(framesPath, goldens, BENCH_MAX_GOLDEN);
+    int baselineCount = options->updateBaseline ? 0 : bench_read_golden(timingsPath, baseline, BENCH_MAX_GOLDEN);
+    if (goldenCount < 0) {
+        fprintf(stderr, "No golden frame hashes in %s\n", options->goldenDir);
+    }
+
+    if (!engine_set_thread_count(engine, options->threadCounts[0]) ||
+        !engine_set_resolution(engine, BENCH_GOLDEN_WIDTH, BENCH_GOLDEN_HEIGHT)) {
+        return 0;
+    }
+    engine_set_render_scale(engine, 1.0);
+    engine_set_frame_budget(engine, 0.0);
+    engine->emptySkipping = 1;
+
+    Player *poses = (Player*)malloc(BENCH_PATH_COUNT * BENCH_GOLDEN_POSES * sizeof(Player));
+    double *times = (double*)malloc(BENCH_PATH_COUNT * BENCH_GOLDEN_POSES * sizeof(double));
+    if (!poses || !times) {
+        fprintf(stderr, "Out of memory\n");
+        free(poses);
+        free(times);
+        return 0;
+    }
+
+    fprintf(out, "{\"golden\": ");
+    bench_write_json_string(out, options->goldenDir);
+    fprintf(out, ", \"width\": %d, \"height\": %d, \"threads\": %d, \"tolerance\": %.2f, \"checks\": [",
+            BENCH_GOLDEN_WIDTH, BENCH_GOLDEN_HEIGHT, engine_get_thread_count(engine), options->tolerance);
+
+    BenchGolden results[BENCH_MAX_GOLDEN];
+    int resultCount = 0;
+    int mismatches = 0;
+    int slower = 0;
+    for (int m = 0; m < mapCount && resultCount < BENCH_MAX_GOLDEN; m++) {
+        if (!engine_set_map(engine, m)) {
+            continue;
+        }
+
+        // The first poses of every camera path, one after another
+        int count = 0;
+        for (int p = 0; p < BENCH_PATH_COUNT; p++) {
+            count += BENCH_PATH_BUILDERS[p](engine, poses + count, BENCH_GOLDEN_POSES);
+        }
+
+        for (int r = 0; r < BENCH_RENDER_MODE_COUNT && resultCount < BENCH_MAX_GOLDEN; r++) {
+            const BenchRenderMode *mode = &BENCH_RENDER_MODES[r];
+            BenchGolden *result = &results[resultCount++];
+            snprintf(result->map, sizeof(result->map), "%s", engine->map->name);
+            snprintf(result->mode, sizeof(result->mode), "%s", mode->name);
+            result->ms = bench_golden_render(engine, mode, poses, count, times, &result->hash);
+
+            const BenchGolden *golden = bench_find_golden(goldens, goldenCount, result->map, result->mode);
+            const BenchGolden *base = bench_find_golden(baseline, baselineCount, result->map, result->mode);
+            int hashOk = options->updateGolden || (golden && golden->hash == result->hash);
+            int timeOk = options->updateBaseline || !base || result->ms <= base->ms * (1.0 + options->tolerance);
+            if (!timeOk) {
+                // Measured once more before it counts, a burst of load can outlast a whole sweep
+                Uint64 hash;
+                double ms = bench_golden_render(engine, mode, poses, count, times, &hash);
+                if (ms < result->ms) {
+                    result->ms = ms;
+                }
+                timeOk = result->ms <= base->ms * (1.0 + options->tolerance);
+            }
+            mismatches += !hashOk;
+            slower += !timeOk;
+
+            fprintf(out, "%s\n    {\"map\": ", resultCount > 1 ? "," : "");
+            bench_write_json_string(out, result->map);
+            fprintf(out, ", \"mode\": \"%s\", \"frames\": %d, \"hash\": \"%016llx\", \"hash_ok\": %s, "
+                    "\"ms\": %.4f", mode->name, count, (unsigned long long)result->hash,
+                    hashOk ? "true" : "false", result->ms);
+            if (base) {
+                fprintf(out, ", \"baseline_ms\": %.4f, \"ratio\": %.3f", base->ms,
+                        base->ms > 0.0 ? result->ms / base->ms : 0.0);
+            }
+            fprintf(out, ", \"time_ok\": %s}", timeOk ? "true" : "false");
+        }
+    }
+    fprintf(out, "\n  ], \"mismatches\": %d, \"slower\": %d}\n", mismatches, slower);
+
+    engine->fixedPoint = options->fixedPoint;
+    free(poses);
+    free(times);
+
+    int ok = mismatches == 0 && slower == 0;
+    if (options->updateGolden && !bench_write_golden(framesPath, results, resultCount, 0)) {
+        ok = 0;
+    }
+    if (options->updateBaseline && !bench_write_golden(timingsPath, results, resultCount, 1)) {
+        ok = 0;
+    }
+    return ok;
+}
+
+// Print usage information
+static void bench_usage(const char *program) {
+    fprintf(stderr, "Usage: %s [--maps DIR] [--frames N] [--threads N[,N...]] [--res WxH[,WxH...]]\n"
+                    "       [--large N[,N...]] [--catalog N[,N...]] [--walls MODE[,MODE...]]\n"
+                    "       [--sprites N[,N...]] [--agents N[,N...]] [--rays N] [--views N[,N...]]\n"
+                    "       [--codec] [--reload] [--incremental] [--scale S] [--budget MS] [--no-skip]\n"
+                    "       [--fixed] [--verify-packets] [--verify-fixed] [--trace FILE] [--out FILE]\n"
+                    "       [--replay FILE [--encode FILE]] [--golden DIR [--update-golden] [--update-baseline] [--tolerance T]]\n",
+            program);
+}
+
+// Parse a comma separated list of thread counts
+static int bench_parse_thread_counts(const char *list, BenchOptions *options) {
+    options->threadCountCount = 0;
+    while (*list && options->threadCountCount < BENCH_MAX_THREAD_COUNTS) {
+        char *end;
+        long count = strtol(list, &end, 10);
+        if (end == list || count <= 0) {
+            fprintf(stderr, "Invalid thread count list: %s\n", list);
+            return 0;
+        }
+        options->threadCounts[options->threadCountCount++] = (int)count;
+        list = *end == ',' ? end + 1 : end;
+    }
+    return options->threadCountCount > 0;
+}
+
+// Parse a comma separated list of generated map sizes
+static int bench_parse_large_sizes(const char *list, BenchOptions *options) {
+    options->largeCount = 0;
+    while (*list && options->largeCount < BENCH_MAX_LARGE_MAPS) {
+        char *end;
+        long size = strtol(list, &end, 10);
+        if (end == list || size < 8) {
+            fprintf(stderr, "Invalid map size list: %s\n", list);
+            return 0;
+        }
+        options->largeSizes[options->largeCount++] = (int)size;
+        list = *end == ',' ? end + 1 : end;
+    }
+    return options->largeCount > 0;
+}
+
+// Parse a comma separated list of catalog sizes
+static int bench_parse_catalog_sizes(const char *list, BenchOptions *options) {
+    options->catalogCount = 0;
+    while (*list && options->catalogCount < BENCH_MAX_CATALOG_SIZES) {
+        char *end;
+        long count = strtol(list, &end, 10);
+        if (end == list || count <= 0) {
+            fprintf(stderr, "Invalid catalog size list: %s\n", list);
+            return 0;
+        }
+        options->catalogSizes[options->catalogCount++] = (int)count;
+        list = *end == ',' ? end + 1 : end;
+    }
+    return options->catalogCount > 0;
+}
+
+// Parse a comma separated list of sprite counts
+static int bench_parse_sprite_counts(const char *list, BenchOptions *options) {
+    options->spriteCountCount = 0;
+    while (*list && options->spriteCountCount < BENCH_MAX_SPRITE_COUNTS) {
+        char *end;
+        long count = strtol(list, &end, 10);
+        if (end == list || count <= 0) {
+            fprintf(stderr, "Invalid sprite count list: %s\n", list);
+            return 0;
+        }
+        options->spriteCounts[options->spriteCountCount++] = (int)count;
+        list = *end == ',' ? end + 1 : end;
+    }
+    return options->spriteCountCount > 0;
+}
+
+// Parse a comma separated list of agent counts
+static int bench_parse_agent_counts(const char *list, BenchOptions *options) {
+    options->agentCountCount = 0;
+    while (*list && options->agentCountCount < BENCH_MAX_AGENT_COUNTS) {
+        char *end;
+        long count = strtol(list, &end, 10);
+        if (end == list || count <= 0) {
+            fprintf(stderr, "Invalid agent count list: %s\n", list);
+            return 0;
+        }
+        options->agentCounts[options->agentCountCount++] = (int)count;
+        list = *end == ',' ? end + 1 : end;
+    }
+    return options->agentCountCount > 0;
+}
+
+// Parse a comma separated list of view counts
+static int bench_parse_view_counts(const char *list, BenchOptions *options) {
+    options->viewCountCount = 0;
+    while (*list && options->viewCountCount < BENCH_MAX_VIEW_COUNTS) {
+        char *end;
+        long count = strtol(list, &end, 10);
+        if (end == list || count <= 0) {
+            fprintf(stderr, "Invalid view count list: %s\n", list);
+            return 0;
+        }
+        options->viewCounts[options->viewCountCount++] = (int)count;
+        list = *end == ',' ? end + 1 : end;
+    }
+    return options->viewCountCount > 0;
+}
+
+// Parse a comma separated list of wall modes (flat, textured, mipmapped)
+static int bench_parse_wall_modes(const char *list, BenchOptions *options) {
+    options->wallModeCount = 0;
+    while (*list && options->wallModeCount < BENCH_WALL_MODE_COUNT) {
+        size_t length = strcspn(list, ",");
+        int mode = 0;
+        while (mode < BENCH_WALL_MODE_COUNT &&
+               (strlen(BENCH_WALL_NAMES[mode]) != length || strncmp(list, BENCH_WALL_NAMES[mode], length) != 0)) {
+            mode++;
+        }
+        if (mode == BENCH_WALL_MODE_COUNT) {
+            fprintf(stderr, "Invalid wall mode list: %s\n", list);
+            return 0;
+        }
+        options->wallModes[options->wallModeCount++] = mode;
+        list += length;
+        if (*list == ',') {
+            list++;
+        }
+    }
+    return options->wallModeCount > 0;
+}
+
+// Parse a comma separated list of WxH resolutions
+static int bench_parse_resolutions(const char *list, BenchOptions *options) {
+    options->resolutionCount = 0;
+    while (*list && options->resolutionCount < BENCH_MAX_RESOLUTIONS) {
+        int width, height, length;
+        if (sscanf(list, "%dx%d%n", &width, &height, &length) != 2 || width <= 0 || height <= 0) {
+            fprintf(stderr, "Invalid resolution list: %s\n", list);
+            return 0;
+        }
+        options->widths[options->resolutionCount] = width;
+        options->heights[options->resolutionCount] = height;
+        options->resolutionCount++;
+        list += length;
+        if (*list == ',') {
+            list++;
+        }
+    }
+    return options->resolutionCount > 0;
+}
+
+// Parse command line options
+static int bench_parse_args(int argc, char *argv[], BenchOptions *options) {
+    options->mapsDir = "maps";
+    options->outPath = NULL;
+    options->frames = BENCH_DEFAULT_FRAMES;
+    options->scale = 1.0;
+    options->budgetMs = 0.0;
+    options->largeCount = 0;
+    options->catalogCount = 0;
+    options->spriteCountCount = 0;
+    options->agentCountCount = 0;
+    options->rayCount = 0;
+    options->viewCountCount = 0;
+    options->codec = 0;
+    options->reload = 0;
+    options->incremental = 0;
+    options->noSkip = 0;
+
+    // The engine's default shading
+    options->wallModes[0] = BENCH_WALLS_MIPMAPPED;
+    options->wallModeCount = 1;
+    options->verifyPackets = 0;
+    options->verifyFixed = 0;
+    options->fixedPoint = ENGINE_FIXED_POINT;
+    options->tracePath = NULL;
+    options->replayPath = NULL;
+    options->encodePath = NULL;
+    options->goldenDir = NULL;
+    options->updateGolden = 0;
+    options->updateBaseline = 0;
+    options->tolerance = BENCH_GOLDEN_TOLERANCE;
+
+    options->widths[0] = SCREEN_WIDTH;
+    options->heights[0] = SCREEN_HEIGHT;
+    options->resolutionCount = 1;
+
+    // Single-threaded and one thread per core by default
+    options->threadCounts[0] = 1;
+    options->threadCountCount = 1;
+    if (SDL_GetCPUCount() > 1) {
+        options->threadCounts[options->threadCountCount++] = SDL_GetCPUCount();
+    }
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--maps") == 0 && i + 1 < argc) {
+            options->mapsDir = argv[++i];
+        } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            options->frames = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            if (!bench_parse_thread_counts(argv[++i], options)) {
+                return 0;
+            }
+        } else if (strcmp(argv[i], "--res") == 0 && i + 1 < argc) {
+            if (!bench_parse_resolutions(argv[++i], options)) {
+                return 0;
+            }
+        } else if (strcmp(argv[i], "--large") == 0 && i + 1 < argc) {
+            if (!bench_parse_large_sizes(argv[++i], options)) {
+                return 0;
+            }
+        } else if (strcmp(argv[i], "--catalog") == 0 && i + 1 < argc) {
+            if (!bench_parse_catalog_sizes(argv[++i], options)) {
+                return 0;
+            }
+        } else if (strcmp(argv[i], "--sprites") == 0 && i + 1 < argc) {
+            if (!bench_parse_sprite_counts(argv[++i], options)) {
+                return 0;
+            }
+        } else if (strcmp(argv[i], "--agents") == 0 && i + 1 < argc) {
+            if (!bench_parse_agent_counts(argv[++i], options)) {
+                return 0;
+            }
+        } else if (strcmp(argv[i], "--views") == 0 && i + 1 < argc) {
+            if (!bench_parse_view_counts(argv[++i], options)) {
+                return 0;
+            }
+        } else if (strcmp(argv[i], "--rays") == 0 && i + 1 < argc) {
+            options->rayCount = atoi(argv[++i]);
+            if (options->rayCount <= 0) {
+                fprintf(stderr, "Invalid ray count: %s\n", argv[i]);
+                return 0;
+            }
+        } else if (strcmp(argv[i], "--codec") == 0) {
+            options->codec = 1;
+        } else if (strcmp(argv[i], "--reload") == 0) {
+            options->reload = 1;
+        } else if (strcmp(argv[i], "--incremental") == 0) {
+            options->incremental = 1;
+        } else if (strcmp(argv[i], "--walls") == 0 && i + 1 < argc) {
+            if (!bench_parse_wall_modes(argv[++i], options)) {
+                return 0;
+            }
+        } else if (strcmp(argv[i], "--scale") == 0 && i + 1 < argc) {
+            options->scale = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--budget") == 0 && i + 1 < argc) {
+            options->budgetMs = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--no-skip") == 0) {
+            options->noSkip = 1;
+        } else if (strcmp(argv[i], "--verify-packets") == 0) {
+            options->verifyPackets = 1;
+        } else if (strcmp(argv[i], "--verify-fixed") == 0) {
+            options->verifyFixed = 1;
+        } else if (strcmp(argv[i], "--fixed") == 0) {
+            options->fixedPoint = 1;
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            options->tracePath = argv[++i];
+        } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            options->replayPath = argv[++i];
+        } else if (strcmp(argv[i], "--encode") == 0 && i + 1 < argc) {
+            options->encodePath = argv[++i];
+        } else if (strcmp(argv[i], "--golden") == 0 && i + 1 < argc) {
+            options->goldenDir = argv[++i];
+        } else if (strcmp(argv[i], "--update-golden") == 0) {
+            options->updateGolden = 1;
+        } else if (strcmp(argv[i], "--update-baseline") == 0) {
+            options->updateBaseline = 1;
+        } else if (strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc) {
+            options->tolerance = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+            options->outPath = argv[++i];
+        } else {
+            bench_usage(argv[0]);
+            return 0;
+        }
+    }
+
+    if (options->frames <= 0) {
+        fprintf(stderr, "Frame count must be positive\n");
+        return 0;
+    }
+    if (options->scale <= 0.0 || options->scale > 1.0) {
+        fprintf(stderr, "Render scale must be in (0, 1]\n");
+        return 0;
+    }
+
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    BenchOptions options;
+    if (!bench_parse_args(argc, argv, &options)) {
+        return 1;
+    }
+
+    Engine engine;
+    if (!engine_init_headless(&engine)) {
+        fprintf(stderr, "Failed to initialize engine!\n");
+        return 1;
+    }
+
+    Uint64 scanStart = SDL_GetPerformanceCounter();
+    int mapCount = engine_load_maps(&engine, options.mapsDir);
+    double scanMs = (SDL_GetPerformanceCounter() - scanStart) * 1000.0 / SDL_GetPerformanceFrequency();
+    if (mapCount <= 0) {
+        fprintf(stderr, "No maps found in %s\n", options.mapsDir);
+        engine_cleanup(&engine);
+        return 1;
+    }
+
+    FILE *out = stdout;
+    if (options.outPath) {
+        out = fopen(options.outPath, "w");
+        if (!out) {
+            fprintf(stderr, "Could not open output file: %s\n", options.outPath);
+            engine_cleanup(&engine);
+            return 1;
+        }
+    }
+
+    if (options.replayPath) {
+        // The first thread count only; the recording fixes resolution, scale and maps
+        int ok = bench_run_replay(&engine, options.replayPath, options.threadCounts[0], options.encodePath, out);
+        if (out != stdout) {
+            fclose(out);
+        }
+        engine_cleanup(&engine);
+        return ok ? 0 : 1;
+    }
+
+    if (options.goldenDir) {
+        // Hashes at the first thread count; the rendered images do not depend on it
+        int ok = bench_run_golden(&engine, &options, mapCount, out);
+        if (out != stdout) {
+            fclose(out);
+        }
+        engine_cleanup(&engine);
+        return ok ? 0 : 1;
+    }
+
+    Player *poses = (Player*)malloc(options.frames * sizeof(Player));
+    double *times = (double*)malloc(options.frames * sizeof(double));
+    if (!poses || !times) {
+        fprintf(stderr, "Out of memory\n");
+        free(poses);
+        free(times);
+        engine_cleanup(&engine);
+        return 1;
+    }
+
+    // Generated maps are measured in both layouts; the copies share one map
+    Map largeMaps[BENCH_MAX_LARGE_MAPS][2];
+    int largeCount = 0;
+    for (; largeCount < options.largeCount; largeCount++) {
+        Map *pair = largeMaps[largeCount];
+        if (!bench_generate_map(&pair[1], options.largeSizes[largeCount], MAP_BLOCK_SHIFT)) {
+            break;
+        }
+        if (!map_copy(&pair[0], &pair[1], 0)) {
+            map_destroy(&pair[1]);
+            break;
+        }
+    }
+
+    if (options.verifyPackets) {
+        // Every column of every path on every map, packet against scalar and
+        // skipping against plain DDA
+        BenchRayStats stats;
+        memset(&stats, 0, sizeof(stats));
+        for (int r = 0; r < options.resolutionCount; r++) {
+            for (int m = 0; m < mapCount; m++) {
+                engine_set_map(&engine, m);
+                bench_verify_map(&engine, poses, options.frames, 1, options.widths[r], options.heights[r], &stats);
+            }
+            for (int m = 0; m < largeCount; m++) {
+                engine.map = &largeMaps[m][1];
+                bench_verify_map(&engine, poses, options.frames, 1, options.widths[r], options.heights[r], &stats);
+            }
+        }
+
+        fprintf(out, "{\"verify\": \"packets\", \"simd\": \"%s\", \"rays\": %ld, \"mismatches\": %d, "
+                "\"skip_mismatches\": %d, \"floor_simd\": \"%s\", \"floor_rows\": %ld, \"floor_mismatches\": %d}\n",
+                RAYCASTER_SIMD, stats.rays, stats.packetMismatches, stats.skipMismatches,
+                FLOORCAST_SIMD, stats.floorRows, stats.floorMismatches);
+        int failed = stats.packetMismatches != 0 || stats.skipMismatches != 0 || stats.floorMismatches != 0;
+
+        engine_set_map(&engine, 0);
+        for (int m = 0; m < largeCount; m++) {
+            map_destroy(&largeMaps[m][0]);
+            map_destroy(&largeMaps[m][1]);
+        }
+        if (out != stdout) {
+            fclose(out);
+        }
+        free(poses);
+        free(times);
+        engine_cleanup(&engine);
+        return failed ? 1 : 0;
+    }
+
+    if (options.verifyFixed) {
+        // Every column of every path on every map, fixed point against doubles,
+        // one result per map so an error can be traced to its map
+        RayFixedColumns columns;
+        memset(&columns, 0, sizeof(columns));
+        int failed = 0;
+        fprintf(out, "{\"verify\": \"fixed\", \"angle_bits\": %d, \"max_error\": %.4f, \"max_mean_error\": %.4f, "
+                "\"maps\": [", RAY_FIXED_ANGLE_BITS, BENCH_FIXED_MAX_ERROR, BENCH_FIXED_MAX_MEAN_ERROR);
+        for (int m = 0; m < mapCount + largeCount; m++) {
+            if (m < mapCount) {
+                engine_set_map(&engine, m);
+            } else {
+                engine.map = &largeMaps[m - mapCount][1];
+            }
+
+            BenchFixedStats stats;
+            memset(&stats, 0, sizeof(stats));
+            for (int r = 0; r < options.resolutionCount; r++) {
+                for (int p = 0; p < BENCH_PATH_COUNT; p++) {
+                    int count = BENCH_PATH_BUILDERS[p](&engine, poses, options.frames);
+                    for (int i = 0; i < count; i++) {
+                        bench_verify_fixed_pose(engine.map, &poses[i], options.widths[r], options.heights[r],
+                                                &columns, &stats);
+                    }
+                }
+            }
+            if (stats.rays == 0) {
+                continue;
+            }
+
+            double meanError = (double)stats.wrongPixels / stats.pixels;
+            int passed = stats.maxError <= BENCH_FIXED_MAX_ERROR && meanError <= BENCH_FIXED_MAX_MEAN_ERROR &&
+                         stats.skipMismatches == 0;
+            failed |= !passed;
+
+            fprintf(out, "%s\n  {\"map\": ", m == 0 ? "" : ",");
+            bench_write_json_string(out, engine.map->name);
+            fprintf(out, ", \"frames\": %ld, \"rays\": %ld, \"face_misses\": %ld, \"mean_error\": %.6f, "
+                    "\"worst_error\": %.6f, \"skip_mismatches\": %d, \"passed\": %s}",
+                    stats.frames, stats.rays, stats.faceMisses, meanError, stats.maxError, stats.skipMismatches, passed ? "true" : "false");
+        }
+        fprintf(out, "\n]}\n");
+        raycaster_fixed_columns_free(&columns);
+
+        engine_set_map(&engine, 0);
+        for (int m = 0; m < largeCount; m++) {
+            map_destroy(&largeMaps[m][0]);
+            map_destroy(&largeMaps[m][1]);
+        }
+        if (out != stdout) {
+            fclose(out);
+        }
+        free(poses);
+        free(times);
+        engine_cleanup(&engine);
+        return failed ? 1 : 0;
+    }
+
+    fprintf(out, "{\n  \"benchmark\": \"raycaster\",\n");
+    fprintf(out, "  \"frames_per_path\": %d,\n", options.frames);
+    fprintf(out, "  \"simd\": \"%s\",\n", RAYCASTER_SIMD);
+    fprintf(out, "  \"budget_ms\": %.3f,\n", options.budgetMs);
+    fprintf(out, "  \"empty_skipping\": %s,\n", options.noSkip ? "false" : "true");
+    fprintf(out, "  \"fixed_point\": %s,\n", options.fixedPoint ? "true" : "false");
+    fprintf(out, "  \"maps\": %d,\n", mapCount);
+    fprintf(out, "  \"catalog_ms\": %.3f,\n", scanMs);
+    fprintf(out, "  \"results\": [");
+
+    engine.emptySkipping = !options.noSkip;
+    engine.fixedPoint = options.fixedPoint;
+
+    BenchRun run;
+    run.engine = &engine;
+    run.options = &options;
+    run.poses = poses;
+    run.times = times;
+    run.out = out;
+    run.first = 1;
+
+    // Profiling the timed runs adds its own cost to them; rings are sized for the most threads
+    if (options.tracePath) {
+        int workers = 1;
+        for (int t = 0; t < options.threadCountCount; t++) {
+            if (options.threadCounts[t] > workers) workers = options.threadCounts[t];
+        }
+        profiler_start(engine.profiler, workers);
+    }
+
+    for (int t = 0; t < options.threadCountCount; t++) {
+        if (!engine_set_thread_count(&engine, options.threadCounts[t])) {
+            break;
+        }
+
+        for (int r = 0; r < options.resolutionCount; r++) {
+            if (!engine_set_resolution(&engine, options.widths[r], options.heights[r])) {
+                break;
+            }
+
+            for (int m = 0; m < mapCount; m++) {
+                engine_set_map(&engine, m);
+                bench_run_map(&run);
+            }
+
+            for (int m = 0; m < largeCount; m++) {
+                for (int layout = 0; layout < 2; layout++) {
+                    engine.map = &largeMaps[m][layout];
+                    bench_run_map(&run);
+                }
+            }
+        }
+    }
+
+    fprintf(out, "\n  ],\n");
+
+    if (options.tracePath && profiler_capturing(engine.profiler)) {
+        profiler_stop(engine.profiler);
+        profiler_write_trace(engine.profiler, options.tracePath);
+    }
+
+    // DDA steps per ray with and without empty-space skipping, on a sample of
+    // the poses at the first resolution
+    fprintf(out, "  \"dda\": [");
+    int stride = options.frames / BENCH_DDA_SAMPLES + 1;
+    int firstDda = 1;
+    for (int m = 0; m < mapCount + largeCount; m++) {
+        if (m < mapCount) {
+            engine_set_map(&engine, m);
+        } else {
+            engine.map = &largeMaps[m - mapCount][1];
+        }
+
+        BenchRayStats stats;
+        memset(&stats, 0, sizeof(stats));
+        bench_verify_map(&engine, poses, options.frames, stride, options.widths[0], options.heights[0], &stats);
+        if (stats.rays == 0) {
+            continue;
+        }
+
+        fprintf(out, "%s\n    {\"map\": ", firstDda ? "" : ",");
+        firstDda = 0;
+        bench_write_json_string(out, engine.map->name);
+        fprintf(out, ", \"rays\": %ld, \"steps_per_ray\": %.2f, \"skip_steps_per_ray\": %.2f, "
+                "\"skip_mismatches\": %d}",
+                stats.rays, (double)stats.plainSteps / stats.rays, (double)stats.skipSteps / stats.rays,
+                stats.skipMismatches);
+    }
+    fprintf(out, "\n  ],\n");
+
+    // Texel cache lines read per frame with full-size textures and with mipmaps
+    fprintf(out, "  \"textures\": [");
+    int firstTextures = 1;
+    for (int m = 0; m < mapCount + largeCount; m++) {
+        if (m < mapCount) {
+            engine_set_map(&engine, m);
+        } else {
+            engine.map = &largeMaps[m - mapCount][1];
+        }
+
+        BenchTexelStats texels;
+        memset(&texels, 0, sizeof(texels));
+        if (!bench_measure_texels(&engine, poses, options.frames, stride, options.widths[0], options.heights[0],
+                                  &texels) || texels.frames == 0) {
+            continue;
+        }
+
+        fprintf(out, "%s\n    {\"map\": ", firstTextures ? "" : ",");
+        firstTextures = 0;
+        bench_write_json_string(out, engine.map->name);
+        fprintf(out, ", \"frames\": %ld, \"texel_reads_per_frame\": %ld, \"texel_bytes_per_frame\": %ld, "
+                "\"mip_texel_bytes_per_frame\": %ld, \"column_bytes_per_frame\": %ld, "
+                "\"mip_column_bytes_per_frame\": %ld}",
+                texels.frames, texels.texelReads / texels.frames,
+                texels.lines * BENCH_CACHE_LINE / texels.frames, texels.mipLines * BENCH_CACHE_LINE / texels.frames,
+                texels.columnLines * BENCH_CACHE_LINE / texels.frames,
+                texels.mipColumnLines * BENCH_CACHE_LINE / texels.frames);
+    }
+    fprintf(out, "\n  ],\n");
+
+    // Floor pass cost against the rest of the frame, on every map with floor textures
+    fprintf(out, "  \"floors\": [");
+    int firstFloors = 1;
+    engine_set_thread_count(&engine, 1);
+    for (int m = 0; m < mapCount + largeCount; m++) {
+        if (m < mapCount) {
+            engine_set_map(&engine, m);
+        } else {
+            engine.map = &largeMaps[m - mapCount][1];
+        }
+
+        BenchFloorResult floors;
+        if (!bench_measure_floors(&engine, poses, times, options.frames, &floors)) {
+            continue;
+        }
+
+        fprintf(out, "%s\n    {\"map\": ", firstFloors ? "" : ",");
+        firstFloors = 0;
+        bench_write_json_string(out, engine.map->name);
+        fprintf(out, ", \"width\": %d, \"height\": %d, \"flat_ms\": %.4f, \"frame_ms\": %.4f, "
+                "\"wall_ms\": %.4f, \"floor_ms\": %.4f, \"fraction\": %.3f, \"wall_ns_per_pixel\": %.3f, "
+                "\"floor_ns_per_pixel\": %.3f, \"pixel_fraction\": %.3f, \"budget\": %.2f, \"within_budget\": %s}",
+                BENCH_FLOOR_WIDTH, BENCH_FLOOR_HEIGHT, floors.flatMs, floors.frameMs, floors.wallMs,
+                floors.floorMs, floors.fraction, floors.wallPixelNs, floors.floorPixelNs, floors.pixelFraction,
+                BENCH_FLOOR_BUDGET, floors.pixelFraction <= BENCH_FLOOR_BUDGET ? "true" : "false");
+    }
+    fprintf(out, "\n  ],\n");
+
+    // Frame time against the number of sprites, on one generated map and thread
+    fprintf(out, "  \"sprites\": [");
+    Map spriteMap;
+    int firstSprites = 1;
+    if (options.spriteCountCount > 0 && bench_generate_map(&spriteMap, BENCH_SPRITE_MAP_SIZE, MAP_BLOCK_SHIFT)) {
+        for (int c = 0; c < options.spriteCountCount; c++) {
+            BenchSpriteResult sprites;
+            if (!bench_measure_sprites(&engine, &spriteMap, options.spriteCounts[c], poses, times, options.frames,
+                                       &sprites)) {
+                continue;
+            }
+
+            fprintf(out, "%s\n    {\"map\": ", firstSprites ? "" : ",");
+            firstSprites = 0;
+            bench_write_json_string(out, spriteMap.name);
+            fprintf(out, ", \"sprites\": %d, \"threads\": %d, \"visible_per_frame\": %.1f, \"mean_ms\": %.4f, "
+                    "\"p95_ms\": %.4f, \"sprite_ms\": %.4f}",
+                    options.spriteCounts[c], engine_get_thread_count(&engine), sprites.visible, sprites.meanMs,
+                    sprites.p95Ms, sprites.spriteMs);
+        }
+        engine_set_map(&engine, 0);
+        map_destroy(&spriteMap);
+    }
+    fprintf(out, "\n  ],\n");
+
+    // Agent update cost against the agent count and render thread count, on one generated map
+    fprintf(out, "  \"agents\": [");
+    Map agentMap;
+    int firstAgents = 1;
+    if (options.agentCountCount > 0 && bench_generate_map(&agentMap, BENCH_SPRITE_MAP_SIZE, MAP_BLOCK_SHIFT)) {
+        for (int t = 0; t < options.threadCountCount; t++) {
+            if (!engine_set_thread_count(&engine, options.threadCounts[t])) {
+                break;
+            }
+            for (int c = 0; c < options.agentCountCount; c++) {
+                BenchAgentResult agents;
+                if (!bench_measure_agents(&engine, &agentMap, options.agentCounts[c], &agents)) {
+                    continue;
+                }
+
+                fprintf(out, "%s\n    {\"map\": ", firstAgents ? "" : ",");
+                firstAgents = 0;
+                bench_write_json_string(out, agentMap.name);
+                fprintf(out, ", \"agents\": %d, \"threads\": %d, \"simd\": \"%s\", \"ticks\": %d, "
+                        "\"tick_ms\": %.4f, \"agents_per_ms\": %.0f, \"overlapping\": %d}",
+                        options.agentCounts[c], engine_get_thread_count(&engine), AGENT_SIMD, BENCH_AGENT_TICKS,
+                        agents.tickMs, agents.agentsPerMs, agents.overlapping);
+            }
+        }
+        map_destroy(&agentMap);
+    }
+    fprintf(out, "\n  ],\n");
+
+    // Batched ray queries against the render thread count, on every map
+    fprintf(out, "  \"rays\": [");
+    int firstRays = 1;
+    for (int t = 0; options.rayCount > 0 && t < options.threadCountCount; t++) {
+        if (!engine_set_thread_count(&engine, options.threadCounts[t])) {
+            break;
+        }
+        for (int m = 0; m < mapCount + largeCount; m++) {
+            if (m < mapCount) {
+                engine_set_map(&engine, m);
+            } else {
+                engine.map = &largeMaps[m - mapCount][1];
+            }
+
+            BenchRayQueryResult rays;
+            if (!bench_measure_rays(&engine, options.rayCount, &rays)) {
+                continue;
+            }
+
+            fprintf(out, "%s\n    {\"map\": ", firstRays ? "" : ",");
+            firstRays = 0;
+            bench_write_json_string(out, engine.map->name);
+            fprintf(out, ", \"rays\": %d, \"threads\": %d, \"cast_mrays_per_sec\": %.2f, "
+                    "\"sensor_mrays_per_sec\": %.2f, \"sensor_range\": %.1f, \"los_mrays_per_sec\": %.2f, "
+                    "\"visible\": %.3f, \"mismatches\": %d}",
+                    options.rayCount, engine_get_thread_count(&engine), rays.castMrays, rays.rangeMrays,
+                    BENCH_RAY_RANGE, rays.losMrays, rays.visible, rays.mismatches);
+        }
+    }
+    engine_set_map(&engine, 0);
+    fprintf(out, "\n  ],\n");
+
+    // Many small views per call against one at a time, on every installed map
+    fprintf(out, "  \"views\": [");
+    int firstViews = 1;
+    for (int t = 0; options.viewCountCount > 0 && t < options.threadCountCount; t++) {
+        if (!engine_set_thread_count(&engine, options.threadCounts[t])) {
+            break;
+        }
+        for (int m = 0; m < mapCount; m++) {
+            engine_set_map(&engine, m);
+            for (int c = 0; c < options.viewCountCount; c++) {
+                BenchViewResult views;
+                if (!bench_measure_views(&engine, options.viewCounts[c], &views)) {
+                    continue;
+                }
+
+                fprintf(out, "%s\n    {\"map\": ", firstViews ? "" : ",");
+                firstViews = 0;
+                bench_write_json_string(out, engine.map->name);
+                fprintf(out, ", \"views\": %d, \"width\": %d, \"height\": %d, \"threads\": %d, "
+                        "\"batch_ms\": %.3f, \"views_per_sec\": %.0f, \"loop_views_per_sec\": %.0f, "
+                        "\"speedup\": %.2f, \"mismatches\": %d}",
+                        options.viewCounts[c], BENCH_VIEW_WIDTH, BENCH_VIEW_HEIGHT, engine_get_thread_count(&engine),
+                        views.batchMs, views.viewsPerSec, views.loopViewsPerSec,
+                        views.loopViewsPerSec > 0.0 ? views.viewsPerSec / views.loopViewsPerSec : 0.0,
+                        views.mismatches);
+            }
+        }
+    }
+    engine_set_map(&engine, 0);
+    fprintf(out, "\n  ],\n");
+
+    // Encoded frame sizes of every camera path on every installed map, at the first resolution
+    // Codec and incremental round trips make the run fail when a frame comes back different
+    fprintf(out, "  \"codec\": [");
+    int firstCodec = 1;
+    int roundTripMismatches = 0;
+    if (options.codec && engine_set_resolution(&engine, options.widths[0], options.heights[0])) {
+        engine_set_render_scale(&engine, options.scale);
+        engine_set_frame_budget(&engine, 0.0);
+        for (int m = 0; m < mapCount; m++) {
+            engine_set_map(&engine, m);
+            for (int p = 0; p < BENCH_PATH_COUNT; p++) {
+                int count = BENCH_PATH_BUILDERS[p](&engine, poses, options.frames);
+                BenchCodecResult codec;
+                if (count == 0 || !bench_measure_codec(&engine, poses, count, &codec)) {
+                    continue;
+                }
+
+                fprintf(out, "%s\n    {\"map\": ", firstCodec ? "" : ",");
+                firstCodec = 0;
+                bench_write_json_string(out, engine.map->name);
+                fprintf(out, ", \"path\": \"%s\", \"width\": %d, \"height\": %d, \"frames\": %d, "
+                        "\"keyframe_interval\": %d, \"raw_bytes_per_frame\": %.0f, \"bytes_per_frame\": %.0f, "
+                        "\"keyframe_bytes\": %.0f, \"ratio\": %.1f, \"encode_ms\": %.3f, \"decode_ms\": %.3f, "
+                        "\"mismatches\": %d}",
+                        BENCH_PATH_NAMES[p], engine.renderWidth, engine.renderHeight, codec.frames,
+                        BENCH_CODEC_KEYFRAMES, codec.rawBytes, codec.bytes, codec.keyframeBytes,
+                        codec.bytes > 0.0 ? codec.rawBytes / codec.bytes : 0.0, codec.encodeMs, codec.decodeMs,
+                        codec.mismatches);
+                roundTripMismatches += codec.mismatches;
+            }
+        }
+        engine_set_map(&engine, 0);
+    }
+    fprintf(out, "\n  ],\n");
+
+    // Frames redrawn in part after small edits to every installed map, with
+    // sprites, on both DDA paths, at the first resolution
+    fprintf(out, "  \"incremental\": [");
+    int firstIncremental = 1;
+    if (options.incremental && engine_set_resolution(&engine, options.widths[0], options.heights[0])) {
+        engine_set_render_scale(&engine, options.scale);
+        engine_set_frame_budget(&engine, 0.0);
+        for (int m = 0; m < mapCount; m++) {
+            engine_set_map(&engine, m);
+            engine_scatter_sprites(&engine, BENCH_INCREMENTAL_SPRITES, 777);
+            int count = bench_build_walk(&engine, poses, options.frames);
+            for (int fixed = 0; fixed < 2; fixed++) {
+                engine.fixedPoint = fixed;
+                BenchIncrementalResult incremental;
+                if (count == 0 || !bench_measure_incremental(&engine, poses, count, &incremental)) {
+                    continue;
+                }
+
+                fprintf(out, "%s\n    {\"map\": ", firstIncremental ? "" : ",");
+                firstIncremental = 0;
+                bench_write_json_string(out, engine.map->name);
+                fprintf(out, ", \"dda\": \"%s\", \"width\": %d, \"height\": %d, \"frames\": %d, "
+                        "\"full_ms\": %.3f, \"idle_ms\": %.4f, \"idle_columns\": %d, \"update_ms\": %.3f, "
+                        "\"columns_per_update\": %.1f, \"reused\": %.3f, \"mismatches\": %d}",
+                        fixed ? "fixed" : "double", engine.renderWidth, engine.renderHeight, incremental.frames,
+                        incremental.fullMs, incremental.idleMs, incremental.idleColumns, incremental.updateMs,
+                        incremental.columns, 1.0 - incremental.columns / engine.renderWidth,
+                        incremental.mismatches);
+                roundTripMismatches += incremental.mismatches;
+            }
+            entity_clear(engine.entities);
+        }
+        engine.fixedPoint = options.fixedPoint;
+        engine_set_map(&engine, 0);
+    }
+    fprintf(out, "\n  ],\n");
+
+    // Load times of the generated maps as text and as compiled files
+    fprintf(out, "  \"load\": [");
+    for (int m = 0; m < largeCount; m++) {
+        BenchLoadResult load;
+        if (!bench_measure_load(&largeMaps[m][1], &load)) {
+            continue;
+        }
+
+        fprintf(out, "%s\n    {\"map\": ", m == 0 ? "" : ",");
+        bench_write_json_string(out, largeMaps[m][1].name);
+        fprintf(out, ", \"text_bytes\": %lu, \"text_ms\": %.3f, \"binary_bytes\": %lu, \"binary_ms\": %.3f}",
+                (unsigned long)load.textBytes, load.textMs, (unsigned long)load.binaryBytes, load.binaryMs);
+    }
+    fprintf(out, "\n  ],\n");
+
+    // Light baking and single-light updates on the generated maps
+    fprintf(out, "  \"lighting\": [");
+    int firstLighting = 1;
+    for (int m = 0; m < largeCount; m++) {
+        BenchLightResult lighting;
+        if (!bench_measure_lighting(&largeMaps[m][1], &lighting)) {
+            continue;
+        }
+
+        fprintf(out, "%s\n    {\"map\": ", firstLighting ? "" : ",");
+        firstLighting = 0;
+        bench_write_json_string(out, largeMaps[m][1].name);
+        fprintf(out, ", \"lights\": %d, \"bake_ms\": %.3f, \"update_us\": %.3f, \"tiles_per_update\": %.1f, "
+                "\"matches_full_bake\": %s}",
+                lighting.lights, lighting.bakeMs, lighting.updateUs, lighting.tilesPerUpdate,
+                lighting.matches ? "true" : "false");
+    }
+    fprintf(out, "\n  ],\n");
+
+    // Saved edits of the generated maps applied to them as loaded, against loading them again
+    fprintf(out, "  \"reload\": [");
+    int firstReload = 1;
+    for (int m = 0; options.reload && m < largeCount; m++) {
+        BenchReloadResult reload;
+        if (!bench_measure_reload(&largeMaps[m][1], &reload)) {
+            continue;
+        }
+
+        fprintf(out, "%s\n    {\"map\": ", firstReload ? "" : ",");
+        firstReload = 0;
+        bench_write_json_string(out, largeMaps[m][1].name);
+        fprintf(out, ", \"edits\": %d, \"tiles_per_edit\": %.1f, \"ready_ms\": %.3f, \"load_ms\": %.3f, "
+                "\"apply_ms\": %.3f, \"full_load_ms\": %.3f, \"matches_full_load\": %s}",
+                reload.edits, reload.tilesPerEdit, reload.readyMs, reload.loadMs, reload.applyMs, reload.fullMs,
+                reload.matches == reload.edits ? "true" : "false");
+    }
+    fprintf(out, "\n  ],\n");
+
+    // Catalog scan and map switch costs as the number of installed maps grows
+    fprintf(out, "  \"catalog\": [");
+    int firstCatalog = 1;
+    for (int c = 0; c < options.catalogCount; c++) {
+        BenchCatalogResult catalog;
+        engine_set_map(&engine, 0);
+        if (!bench_measure_catalog(engine.map, options.catalogSizes[c], &catalog)) {
+            continue;
+        }
+
+        fprintf(out, "%s\n    {\"maps\": %d, \"scan_ms\": %.3f, \"first_use_ms\": %.3f, \"switch_us\": %.4f}",
+                firstCatalog ? "" : ",", catalog.maps, catalog.scanMs, catalog.firstUseMs, catalog.switchUs);
+        firstCatalog = 0;
+    }
+    fprintf(out, "\n  ]\n}\n");
+
+    // The engine must not keep a view of the generated maps
+    engine_set_map(&engine, 0);
+    for (int m = 0; m < largeCount; m++) {
+        map_destroy(&largeMaps[m][0]);
+        map_destroy(&largeMaps[m][1]);
+    }
+
+    if (out != stdout) {
+        fclose(out);
+    }
+
+    free(poses);
+    free(times);
+    engine_cleanup(&engine);
+    return roundTripMismatches > 0 ? 1 : 0;
+}
@@ -0,0 +1,413 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+
+#include "catalog.h"
+#include "lighting.h"
+
+// Text map file extension
+#define CATALOG_TEXT_EXTENSION ".map"
+
+// ****************************************************
+// Private (static) function declarations
+// ****************************************************
+
+// Copy a string onto the heap
+static char* catalog_copy_string(const char *str);
+
+// qsort/bsearch comparison of two file names
+static int catalog_compare_names(const void *a, const void *b);
+
+// Check whether a sorted file list holds the compiled copy of a text map
+static int catalog_has_compiled(char **files, int fileCount, const char *filename);
+
+// Make room for one more entry
+static int catalog_reserve(MapCatalog *catalog);
+
+// Insert a cached entry at the newest end of the LRU list
+static void catalog_link_newest(MapCatalog *catalog, int index);
+
+// Remove a cached entry from the LRU list
+static void catalog_unlink(MapCatalog *catalog, int index);
+
+// Evict unpinned maps, least recently used first, until at most keep are cached
+static void catalog_trim(MapCatalog *catalog, int keep);
+
+// ****************************************************
+// Public API Implementation
+// ****************************************************
+
+// Initialize an empty catalog that keeps up to cacheLimit maps loaded
+void catalog_init(MapCatalog *catalog, int cacheLimit) {
+    memset(catalog, 0, sizeof(MapCatalog));
+    catalog->cacheLimit = cacheLimit > 0 ? cacheLimit : 1;
+    catalog->newest = -1;
+    catalog->oldest = -1;
+}
+
+// Free every entry and loaded map; no map may be in use
+void catalog_destroy(MapCatalog *catalog) {
+    for (int i = 0; i < catalog->count; i++) {
+        CatalogEntry *entry = &catalog->entries[i];
+        if (entry->map) {
+            map_destroy(entry->map);
+            free(entry->map);
+        }
+        free(entry->path);
+    }
+    free(catalog->entries);
+    catalog_init(catalog, catalog->cacheLimit);
+}
+
+// Add every map file in a directory, sorted by file name, without loading any of
+// them; a text map with a compiled copy is only added once. Returns the number added.
+int catalog_scan(MapCatalog *catalog, const char *directory) {
+    DIR *dir = opendir(directory);
+    if (!dir) {
+        fprintf(stderr, "Could not open directory: %s\n", directory);
+        return 0;
+    }
+
+    // Collect the file names first so the catalog order does not depend on the file system
+    char **files = NULL;
+    int fileCount = 0;
+    int fileCapacity = 0;
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL) {
+        if (!catalog_is_map_file(ent->d_name)) {
+            continue;
+        }
+
+        if (fileCount == fileCapacity) {
+            int capacity = fileCapacity ? fileCapacity * 2 : 64;
+            char **grown = (char**)realloc(files, capacity * sizeof(char*));
+            if (!grown) {
+                break;
+            }
+            files = grown;
+            fileCapacity = capacity;
+        }
+
+        files[fileCount] = catalog_copy_string(ent->d_name);
+        if (files[fileCount]) {
+            fileCount++;
+        }
+    }
+    closedir(dir);
+
+    if (fileCount > 1) {
+        qsort(files, fileCount, sizeof(char*), catalog_compare_names);
+    }
+
+    int added = 0;
+    for (int i = 0; i < fileCount; i++) {
+        // A text map that has been compiled is used through the compiled file
+        if (!catalog_has_compiled(files, fileCount, files[i])) {
+            char fullPath[512];
+            snprintf(fullPath, sizeof(fullPath), "%s/%s", directory, files[i]);
+            if (catalog_add_file(catalog, fullPath) >= 0) {
+                added++;
+            }
+        }
+    }
+
+    for (int i = 0; i < fileCount; i++) {
+        free(files[i]);
+    }
+    free(files);
+
+    return added;
+}
+
+// Add a map file without loading it; returns its index or -1
+int catalog_add_file(MapCatalog *catalog, const char *path) {
+    if (!catalog_reserve(catalog)) {
+        return -1;
+    }
+
+    CatalogEntry *entry = &catalog->entries[catalog->count];
+    memset(entry, 0, sizeof(CatalogEntry));
+    entry->path = catalog_copy_string(path);
+    if (!entry->path) {
+        return -1;
+    }
+    entry->newer = -1;
+    entry->older = -1;
+
+    // Name it after the file until the header is read
+    const char *base = strrchr(path, '/');
+    base = base ? base + 1 : path;
+    const char *ext = strrchr(base, '.');
+    int stem = ext ? (int)(ext - base) : (int)strlen(base);
+    snprintf(entry->name, sizeof(entry->name), "%.*s", stem, base);
+
+    return catalog->count++;
+}
+
+// Add a map built in memory, taking over its tiles; it stays loaded. Returns its index or -1
+int catalog_add_map(MapCatalog *catalog, const Map *map) {
+    if (!catalog_reserve(catalog)) {
+        return -1;
+    }
+
+    CatalogEntry *entry = &catalog->entries[catalog->count];
+    memset(entry, 0, sizeof(CatalogEntry));
+    entry->map = (Map*)malloc(sizeof(Map));
+    if (!entry->map) {
+        return -1;
+    }
+    *entry->map = *map;
+    memcpy(entry->name, map->name, sizeof(entry->name));
+    entry->nameRead = 1;
+    entry->newer = -1;
+    entry->older = -1;
+
+    return catalog->count++;
+}
+
+// Get the name of a map, reading only its header the first time
+const char* catalog_name(MapCatalog *catalog, int index) {
+    if (index < 0 || index >= catalog->count) {
+        return NULL;
+    }
+
+    CatalogEntry *entry = &catalog->entries[index];
+    if (!entry->nameRead) {
+        // Keep the file name if the file has none
+        map_read_name(entry->path, entry->name, sizeof(entry->name));
+        entry->nameRead = 1;
+    }
+    return entry->name;
+}
+
+// Get the size and starting position of a map, from the loaded map while it
+// is cached and from its file otherwise, without loading it; returns 0 if the
+// file cannot be read
+int catalog_size(MapCatalog *catalog, int index, int *width, int *height, double *startX, double *startY) {
+    if (index < 0 || index >= catalog->count) {
+        return 0;
+    }
+
+    const CatalogEntry *entry = &catalog->entries[index];
+    if (!entry->map) {
+        return map_read_size(entry->path, width, height, startX, startY);
+    }
+    *width = entry->map->width;
+    *height = entry->map->height;
+    *startX = entry->map->startX;
+    *startY = entry->map->startY;
+    return 1;
+}
+
+// Check whether a file name has a map file extension, text or compiled
+int catalog_is_map_file(const char *filename) {
+    const char *ext = strrchr(filename, '.');
+    return ext && (strcmp(ext, CATALOG_TEXT_EXTENSION) == 0 || strcmp(ext, MAP_FILE_EXTENSION) == 0);
+}
+
+// Find the entry loaded from a file path; returns its index or -1
+int catalog_find_file(MapCatalog *catalog, const char *path) {
+    for (int i = 0; i < catalog->count; i++) {
+        if (catalog->entries[i].path && strcmp(catalog->entries[i].path, path) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Bring the entry at index up to date with source, a newer version of its file
+// read with map_load_tiles, and take over source. A cached map is changed in
+// place with map_apply_changes, or replaced when its size changed, so its users
+// keep their pointer; a map that is not cached only forgets its name. A
+// replacement's distance field and light levels are built here unless source
+// already has them, which takes as long as a full load. Returns the number of
+// tiles changed, -1 on failure (the cached map is then unchanged or rebuilt whole).
+int catalog_update(MapCatalog *catalog, int index, Map *source) {
+    if (index < 0 || index >= catalog->count) {
+        map_destroy(source);
+        return -1;
+    }
+
+    CatalogEntry *entry = &catalog->entries[index];
+    if (!entry->map) {
+        // Loaded from the file when it is next used
+        entry->nameRead = 0;
+        map_destroy(source);
+        return 0;
+    }
+
+    int changed = map_apply_changes(entry->map, source);
+    if (changed < 0) {
+        // A new size or layout needs everything rebuilt, unless the watcher thread
+        // did it already; the map is swapped whole
+        if ((!source->distance && !map_build_distance(source)) ||
+            (!source->light && !lighting_bake(source))) {
+            map_destroy(source);
+            return -1;
+        }
+        // Renderers keeping a frame of the old map see it all changed
+        Uint32 damageCount = entry->map->damageCount;
+        changed = source->width * source->height;
+        map_destroy(entry->map);
+        *entry->map = *source;
+        entry->map->damageCount = damageCount;
+        map_mark_changed(entry->map, 0, 0, entry->map->width - 1, entry->map->height - 1);
+    } else {
+        map_destroy(source);
+    }
+    memcpy(entry->name, entry->map->name, sizeof(entry->name));
+    entry->nameRead = 1;
+    return changed;
+}
+
+// Get a map for use, loading it on a cache miss; pinned until catalog_release
+Map* catalog_acquire(MapCatalog *catalog, int index) {
+    if (index < 0 || index >= catalog->count) {
+        return NULL;
+    }
+
+    CatalogEntry *entry = &catalog->entries[index];
+    if (!entry->map) {
+        // Evict first so the cache never holds more than its limit
+        catalog_trim(catalog, catalog->cacheLimit - 1);
+
+        Map *map = (Map*)malloc(sizeof(Map));
+        if (!map) {
+            return NULL;
+        }
+        if (!map_load_file(map, entry->path)) {
+            free(map);
+            return NULL;
+        }
+
+        entry->map = map;
+        memcpy(entry->name, map->name, sizeof(entry->name));
+        entry->nameRead = 1;
+        catalog->cachedCount++;
+        catalog->loads++;
+        catalog_link_newest(catalog, index);
+    } else if (entry->path && catalog->newest != index) {
+        catalog_unlink(catalog, index);
+        catalog_link_newest(catalog, index);
+    }
+
+    entry->pins++;
+    return entry->map;
+}
+
+// Unpin a map taken with catalog_acquire; it stays cached until evicted
+void catalog_release(MapCatalog *catalog, int index) {
+    if (index < 0 || index >= catalog->count || catalog->entries[index].pins == 0) {
+        return;
+    }
+
+    catalog->entries[index].pins--;
+
+    // Maps loaded while everything was pinned can go now
+    catalog_trim(catalog, catalog->cacheLimit);
+}
+
+// Change the number of cached maps, evicting the least recently used ones
+void catalog_set_cache_limit(MapCatalog *catalog, int cacheLimit) {
+    catalog->cacheLimit = cacheLimit > 0 ? cacheLimit : 1;
+    catalog_trim(catalog, catalog->cacheLimit);
+}
+
+// ****************************************************
+// Private functions implementation
+// ****************************************************
+
+// Copy a string onto the heap
+static char* catalog_copy_string(const char *str) {
+    size_t length = strlen(str) + 1;
+    char *copy = (char*)malloc(length);
+    if (copy) {
+        memcpy(copy, str, length);
+    }
+    return copy;
+}
+
+// qsort/bsearch comparison of two file names
+static int catalog_compare_names(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// Check whether a sorted file list holds the compiled copy of a text map
+static int catalog_has_compiled(char **files, int fileCount, const char *filename) {
+    const char *ext = strrchr(filename, '.');
+    if (strcmp(ext, CATALOG_TEXT_EXTENSION) != 0) {
+        return 0;
+    }
+
+    char compiled[512];
+    snprintf(compiled, sizeof(compiled), "%.*s%s", (int)(ext - filename), filename, MAP_FILE_EXTENSION);
+    const char *key = compiled;
+    return bsearch(&key, files, fileCount, sizeof(char*), catalog_compare_names) != NULL;
+}
+
+// Make room for one more entry
+static int catalog_reserve(MapCatalog *catalog) {
+    if (catalog->count < catalog->capacity) {
+        return 1;
+    }
+
+    int capacity = catalog->capacity ? catalog->capacity * 2 : 16;
+    CatalogEntry *entries = (CatalogEntry*)realloc(catalog->entries, capacity * sizeof(CatalogEntry));
+    if (!entries) {
+        fprintf(stderr, "Failed to grow the map catalog!\n");
+        return 0;
+    }
+
+    catalog->entries = entries;
+    catalog->capacity = capacity;
+    return 1;
+}
+
+// Insert a cached entry at the newest end of the LRU list
+static void catalog_link_newest(MapCatalog *catalog, int index) {
+    CatalogEntry *entry = &catalog->entries[index];
+    entry->newer = -1;
+    entry->older = catalog->newest;
+    if (catalog->newest >= 0) {
+        catalog->entries[catalog->newest].newer = index;
+    } else {
+        catalog->oldest = index;
+    }
+    catalog->newest = index;
+}
+
+// Remove a cached entry from the LRU list
+static void catalog_unlink(MapCatalog *catalog, int index) {
+    CatalogEntry *entry = &catalog->entries[index];
+    if (entry->newer >= 0) {
+        catalog->entries[entry->newer].older = entry->older;
+    } else {
+        catalog->newest = entry->older;
+    }
+    if (entry->older >= 0) {
+        catalog->entries[entry->older].newer = entry->newer;
+    } else {
+        catalog->oldest = entry->newer;
+    }
+    entry->newer = -1;
+    entry->older = -1;
+}
+
+// Evict unpinned maps, least recently used first, until at most keep are cached
+static void catalog_trim(MapCatalog *catalog, int keep) {
+    int index = catalog->oldest;
+    while (catalog->cachedCount > keep && index >= 0) {
+        CatalogEntry *entry = &catalog->entries[index];
+        int next = entry->newer;
+        if (entry->pins == 0) {
+            catalog_unlink(catalog, index);
+            map_destroy(entry->map);
+            free(entry->map);
+            entry->map = NULL;
+            catalog->cachedCount--;
+            catalog->evictions++;
+        }
+        index = next;
+    }
+}
@@ -0,0 +1,89 @@
+#ifndef CATALOG_H
+#define CATALOG_H
+
+#include "map.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Maps from files kept loaded at once by default, the active one included
+#define CATALOG_CACHE_MAPS 4
+
+// One installed map: where it comes from and, while cached, its loaded tiles
+typedef struct CatalogEntry {
+    char *path;         // Source file, NULL for a map created in memory
+    char name[64];      // File name stem until the map's own name has been read
+    int nameRead;       // name holds the NAME of the map
+    Map *map;           // Loaded map, NULL while not cached
+    int pins;           // Users of the loaded map; a pinned map is never evicted
+    int newer;          // Neighbours in the LRU list of cached maps, -1 at the ends
+    int older;
+} CatalogEntry;
+
+// Directory of installed maps; maps are loaded on first use and cached in LRU order
+typedef struct MapCatalog {
+    CatalogEntry *entries;
+    int count;
+    int capacity;
+    int cacheLimit;     // Maps from files kept loaded at most, unless pinned
+    int cachedCount;    // Maps from files currently loaded
+    int newest;         // Most and least recently used cached maps, -1 when none
+    int oldest;
+    int loads;          // Maps loaded from files so far
+    int evictions;      // Cached maps dropped to stay within cacheLimit
+} MapCatalog;
+
+// Initialize an empty catalog that keeps up to cacheLimit maps loaded
+void catalog_init(MapCatalog *catalog, int cacheLimit);
+
+// Free every entry and loaded map; no map may be in use
+void catalog_destroy(MapCatalog *catalog);
+
+// Add every map file in a directory, sorted by file name, without loading any of
+// them; a text map with a compiled copy is only added once. Returns the number added.
+int catalog_scan(MapCatalog *catalog, const char *directory);
+
+// Add a map file without loading it; returns its index or -1
+int catalog_add_file(MapCatalog *catalog, const char *path);
+
+// Add a map built in memory, taking over its tiles; it stays loaded. Returns its index or -1
+int catalog_add_map(MapCatalog *catalog, const Map *map);
+
+// Get the name of a map, reading only its header the first time
+const char* catalog_name(MapCatalog *catalog, int index);
+
+// Get the size and starting position of a map, from the loaded map while it
+// is cached and from its file otherwise, without loading it; returns 0 if the
+// file cannot be read
+int catalog_size(MapCatalog *catalog, int index, int *width, int *height, double *startX, double *startY);
+
+// Check whether a file name has a map file extension, text or compiled
+int catalog_is_map_file(const char *filename);
+
+// Find the entry loaded from a file path; returns its index or -1
+int catalog_find_file(MapCatalog *catalog, const char *path);
+
+// Bring the entry at index up to date with source, a newer version of its file
+// read with map_load_tiles, and take over source. A cached map is changed in
+// place with map_apply_changes, or replaced when its size changed, so its users
+// keep their pointer; a map that is not cached only forgets its name. A
+// replacement's distance field and light levels are built here unless source
+// already has them, which takes as long as a full load. Returns the number of
+// tiles changed, -1 on failure (the cached map is then unchanged or rebuilt whole).
+int catalog_update(MapCatalog *catalog, int index, Map *source);
+
+// Get a map for use, loading it on a cache miss; pinned until catalog_release
+Map* catalog_acquire(MapCatalog *catalog, int index);
+
+// Unpin a map taken with catalog_acquire; it stays cached until evicted
+void catalog_release(MapCatalog *catalog, int index);
+
+// Change the number of cached maps, evicting the least recently used ones
+void catalog_set_cache_limit(MapCatalog *catalog, int cacheLimit);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CATALOG_H
@@ -2,9 +2,17 @@
 #include <stdlib.h>
 #include <math.h>
 #include <string.h>
-#include <dirent.h>
 
 #include "engine.h"
+#include "raycaster.h"
+#include "floorcast.h"
+#include "threadpool.h"
+#include "entity.h"
+#include "triplebuffer.h"
+#include "profiler.h"
+#include "replay.h"
+#include "agent.h"
+#include "mapwatch.h"
 
 // A simple 24x24 default map
 // 0 = empty space
@@ -36,37 +44,346 @@ static const int DEFAULT_MAP[MAP_HEIGHT][MAP_WIDTH] = {
     {1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1}
 };
 
-// Example maps collection
-#define MAX_MAPS 10
+// Columns per render task; small enough for work stealing to balance far and near walls
+#define RENDER_TILE_COLUMNS 16
 
-// Map format key codes for file parsing
-#define MAP_MARKER "MAP:"
-#define NAME_MARKER "NAME:"
-#define START_MARKER "START:"
-#define DATA_MARKER "DATA:"
+// Floor rows per render task, and columns cast per span so the buffers stay on the stack
+#define FLOOR_BAND_ROWS 8
+#define FLOOR_SPAN_COLUMNS 256
+
+// Columns per sprite task; every task walks the whole sorted sprite list
+#define SPRITE_BAND_COLUMNS 128
+
+// Rays per ray query task
+#define ENGINE_RAY_BATCH 1024
+
+// Longest the pipeline threads sleep before checking whether to stop, and the
+// ticks the simulation may fall behind before it drops them instead of catching up
+#define ENGINE_PIPELINE_WAIT_MS 10
+#define ENGINE_PIPELINE_MAX_LAG 8
+
+// Longest the main loop sleeps waiting for an event while its frame stands unchanged
+#define ENGINE_IDLE_WAIT_MS 16
+
+// Slack around a changed rectangle when finding the columns that show it, in
+// tiles: floor pixels step across their row in 16.16 and fixed-point rays turn
+// by fine angles, so a pixel may sample a tile just beside its column's ray
+#define ENGINE_DAMAGE_MARGIN 0.05
+#define ENGINE_DAMAGE_SLOPE (1.0 / 1024.0)  // Added per tile the ray went
+
+// Fixed palette entries: transparent texels, wall tiles 1-4 by value with gray
+// for the others, then the untextured ceiling (sky blue) and floor (gray)
+#define ENGINE_GRAY_ENTRY 5
+#define ENGINE_CEILING_ENTRY 6
+#define ENGINE_FLOOR_ENTRY 7
+#define ENGINE_FLAT_COLORS 8
+static const Uint32 engineFlatColors[ENGINE_FLAT_COLORS] = {
+    0x000000, 0xFF0000, 0x00FF00, 0x0000FF, 0xFFFF00, 0x808080, 0x6464AA, 0x505050
+};
 
 // ****************************************************
 // Private (static) function declarations
 // ****************************************************
 
-// Handle events (keyboard input, quit events)
-static int engine_handle_events(Engine *engine);
+// Work the event handler leaves to the loop, which does it between frames
+typedef struct EngineRequests {
+    int map;                // Map picked with the number keys, -1 for none
+    int trace;              // Start or stop a profiler capture (F2)
+    int present;            // The window needs the frame again, even if it did not change
+} EngineRequests;
+
+// Handle events (keyboard input, quit events); map switches and captures are
+// left in *requests rather than carried out
+static int engine_handle_events(Engine *engine, EngineRequests *requests);
+
+// Movement keys held in a keyboard state, as ENGINE_KEY_* bits
+static int engine_read_keys(const Uint8 *keystate);
+
+// Append the frame the loop is about to render to the recording, if one is running
+static void engine_record_frame(Engine *engine, int keys, double deltaTime, int mapIndex);
+
+// Move and turn a player by the held movement keys, with collision detection
+static void engine_step_player(const Map *map, Player *player, int keys, double deltaTime);
 
 // Calculate time delta for frame-rate independent movement
 static double engine_calculate_delta_time(Engine *engine);
 
-// Get wall color based on map value and side
-static void engine_get_wall_color(Engine *engine, int mapValue, int side, SDL_Color *color);
+// Palette entry of the flat color of a wall tile
+static inline int engine_wall_color_entry(int mapValue) {
+    return mapValue >= 1 && mapValue <= 4 ? mapValue : ENGINE_GRAY_ENTRY;
+}
+
+// Pack an opaque color into the framebuffer's ARGB8888 layout
+static inline Uint32 engine_pack_color(Uint8 r, Uint8 g, Uint8 b) {
+    return 0xFF000000u | ((Uint32)r << 16) | ((Uint32)g << 8) | (Uint32)b;
+}
+
+// Initialize framebuffer, maps, timing and player (shared by windowed and headless init)
+static int engine_init_state(Engine *engine);
+
+// Set the default output resolution at full render scale, with the controller off
+static void engine_init_resolution(Engine *engine);
+
+// Feed the last render time to the frame budget controller
+static void engine_update_render_scale(Engine *engine);
+
+// Fill rows [yStart, yEnd] of framebuffer column x with a solid color
+static void engine_fill_column(Uint32 *pixels, int pitch, int x, int yStart, int yEnd, Uint32 color);
+
+// World state the simulation publishes every tick; the render thread only reads it
+typedef struct EngineSnapshot {
+    Player player;
+    Map *map;
+    Uint32 tick;            // Simulation tick the state is from
+} EngineSnapshot;
+
+// A rendered frame waiting to be presented
+typedef struct EngineFrame {
+    Uint32 *pixels;         // windowWidth * windowHeight, width * height used
+    int width;
+    int height;
+} EngineFrame;
+
+// The pipelined loop: the simulation thread hands snapshots to the render
+// thread, which hands frames to the main thread, each through a triple buffer
+typedef struct EnginePipeline {
+    Engine *engine;
+    SDL_Thread *simThread;
+    SDL_Thread *renderThread;
+    SDL_atomic_t stop;          // Set to stop both threads
+    SDL_atomic_t keys;          // Movement keys held, ENGINE_KEY_* bits from the main thread
+    SDL_sem *snapshotReady;     // Posted on publish so the render thread can sleep in between
+    Uint32 frameEvent;          // Pushed on publish so the main thread can sleep in between; (Uint32)-1 if none
+    TripleBuffer snapshots;
+    EngineSnapshot snapshotSlots[3];
+    TripleBuffer frames;
+    EngineFrame frameSlots[3];
+    Uint32 *framebuffer;        // The engine's own framebuffer, restored when stopped
+    Player player;              // Simulated player, owned by the simulation thread while it runs
+    Uint32 ticks;               // Ticks simulated, frames rendered and frames presented
+    Uint32 framesRendered;
+    Uint32 framesPresented;
+} EnginePipeline;
+
+// Counters one render worker gathers during a frame, a cache line each
+typedef struct RenderStats {
+    Uint64 ddaSteps;
+    Uint64 texels;
+    int columns;
+    char padding[44];
+} RenderStats;
+
+// A floor row prepared once per frame and shared by every tile
+typedef struct FloorScanline {
+    FloorRow row;
+    int level;          // Mip level sampled along the row
+    int texShiftX;      // log2 of the level's size
+    int texShiftY;
+} FloorScanline;
+
+// Everything the column renderer reads, shared read-only by all workers of a frame
+typedef struct RenderView {
+    Engine *engine;
+    const Player *player;
+    const Map *map;
+    Uint32 *pixels;
+    int pitch;
+    int width;          // Columns to trace
+    int height;         // Rows per column
+    int packets;        // Trace columns in SIMD packets
+    int fixed;          // Trace columns with the fixed-point DDA
+    Sint32 fixedPosX;   // Player position in 16.16 and view angle in fine angles, for fixed
+    Sint32 fixedPosY;
+    Uint32 fixedAngle;
+    const RayFixedColumns *fixedColumns;
+    int textured;       // Sample wall textures instead of flat colors
+    const Uint32 (*colormap)[LIGHTING_COLORS];  // Palette entries by light level
+    int mipmapping;     // Pick the mip level from the wall height
+    int floors;         // Cast floor and ceiling rows instead of filling flat colors
+    Uint32 ceilingColor;    // Untextured ceiling and floor
+    Uint32 floorColor;
+    const FloorScanline *scanlines;  // Floor rows from the horizon down, when casting floors
+    int *ceilingRows;       // Ceiling and floor rows each column's wall leaves, written by its tile
+    int *floorStart;
+    float *wallDepth;       // Wall distance of each column, written by its tile when there are sprites
+    const EntityStore *entities;
+    const EntityView *sprites;  // Sprites to draw, back to front
+    const int *tiles;       // Tiles to render by task index when only some are, NULL for all
+    int tileCount;
+    const Uint8 *dirty;     // Per tile, 1 where it is rendered, when only some are
+    RenderStats *stats;     // Counters of each worker, by worker index
+    Profiler *profiler;
+    int profiling;          // A capture was running when the frame started; tiles record their phases
+} RenderView;
+
+// The frame last rendered into the framebuffer and what it was rendered from,
+// so engine_update_scene redraws only the tiles of columns that changed since
+typedef struct RenderCache {
+    int valid;              // The framebuffer holds a whole frame of the state below
+    Uint32 *framebuffer;
+    Player player;
+    const Map *map;
+    Uint32 damageCount;     // Changed rectangles of the map the frame shows
+    Uint32 entityRevision;
+    int settings;           // engine_render_settings of the frame
+    int width;              // Frame size, which the buffers are allocated for
+    int height;
+    int overlayColumns;     // Columns from the left the overlay was drawn over since
+    float *depth;           // Distance each column's ray went before it hit a wall, INFINITY for none
+    void *floorState;       // Scanlines, then ceiling rows and floor starts, kept for the next frame
+    Uint8 *dirty;           // Per tile of RENDER_TILE_COLUMNS columns: render it again
+    int *tiles;             // The tiles to render, in order
+    int tileCount;
+} RenderCache;
+
+// Size the render cache's buffers for width x height frames, keeping them
+// while the size is unchanged; returns 0 when out of memory
+static int engine_reserve_cache(RenderCache *cache, int width, int height);
+
+// Settings a frame is rendered with, as bits; frames with other settings look different
+static int engine_render_settings(const Engine *engine);
+
+// Start timing a frame: the time since the last one goes to the overlay; returns the start counter
+static Uint64 engine_start_frame(Engine *engine);
+
+// Render the frame started at start into the framebuffer: every tile, or with
+// partial set only the tiles the render cache lists, the others keeping what
+// the last frame left there
+static void engine_render_frame(Engine *engine, int partial, Uint64 start);
+
+// Mark the tiles of the render cache whose columns show a changed rectangle:
+// those whose ray crossed it before it stopped, and those a sprite standing in it covers
+static void engine_mark_damage(Engine *engine, const MapDamage *damage);
+
+// Check whether the ray from (posX, posY) along the unit direction (dirX, dirY)
+// meets rectangle [x0, x1] x [y0, y1] within reach tiles
+static int engine_ray_crosses(double posX, double posY, double dirX, double dirY, double reach,
+                              double x0, double y0, double x1, double y1);
+
+// Columns [*left, *left + *spriteWidth) a sprite covers from its screen column
+// and depth; it is one tile wide, columnsPerTile columns at depth 1
+static inline void engine_sprite_span(double columnsPerTile, float screenX, float depth, int *left, int *spriteWidth) {
+    int width = (int)(columnsPerTile / depth);
+    if (width < 1) width = 1;
+    *left = (int)floor(screenX - width / 2.0);
+    *spriteWidth = width;
+}
+
+// Direction of the ray through column x of a view width columns wide
+static void engine_column_ray(const Player *player, int x, int width, double *rayDirX, double *rayDirY);
+
+// Write ceiling, wall slice and floor of screen column x for a traced ray; the
+// ceiling covers rows [0, *ceilingRows) and the floor rows [*floorStart, height),
+// which are left to the floor pass when the view casts floors; returns the
+// number of wall texels read
+static int engine_draw_column(const RenderView *view, int x, const RayHit *hit, int *ceilingRows, int *floorStart);
+
+// Sample the wall texture into rows [drawStart, drawEnd] of screen column x,
+// shaded through the colormap row of the face's light level
+static void engine_draw_wall_texture(const RenderView *view, int x, int drawStart, int drawEnd, const RayHit *hit,
+                                     int face, const Uint32 *shades);
+
+// Set up the floor rows of a frame: row distance, world positions and mip level
+static void engine_setup_scanlines(const RenderView *view, FloorScanline *scanlines);
+
+// Texel of a floor or ceiling tile, or the flat color for texture 0, shaded by
+// the tile's light level; outside the map the flat color at full light
+static inline Uint32 engine_plane_texel(const RenderView *view, const Uint8 *plane, Sint32 tile, Sint32 texel,
+                                        const Uint8 *const *levelIndices, int flatEntry) {
+    if (tile < 0) {
+        return view->colormap[MAP_LIGHT_FULL][flatEntry];
+    }
+    int id = plane[tile];
+    const Uint32 *shades = view->colormap[lighting_tile_level(view->map, tile)];
+    return shades[id ? levelIndices[(id - 1) % NUM_TEXTURES][texel] : flatEntry];
+}
+
+// Cast floor row y and its mirrored ceiling row over count columns from xStart,
+// only where the columns' walls leave them uncovered; from row fullFloor and
+// fullCeiling on, every column needs the floor and ceiling
+static void engine_draw_floor_row(const RenderView *view, int y, int xStart, int count,
+                                  int fullFloor, int fullCeiling);
+
+// Thread pool task: cast FLOOR_BAND_ROWS floor rows below the horizon and the
+// ceiling rows mirrored above it
+static void engine_render_floor_band(void *context, int bandIndex, int workerIndex);
+
+// Thread pool task: render one tile of RENDER_TILE_COLUMNS columns
+static void engine_render_tile(void *context, int tileIndex, int workerIndex);
+
+// Thread pool task: draw the visible sprites over SPRITE_BAND_COLUMNS columns,
+// back to front, wherever they are nearer than the column's wall
+static void engine_render_sprite_band(void *context, int bandIndex, int workerIndex);
+
+// Draw a procedural sprite into a texture: 0 a lamp, 1 a barrel, 2 a figure
+static void engine_paint_sprite(WallTexture *texture, int sprite);
+
+// A batch of rays engine_cast_rays traces, shared by its tasks
+typedef struct RayQuery {
+    const Map *map;
+    const RayVector *origins;
+    const RayVector *dirs;
+    double maxDist;
+    int count;
+    int packets;            // Trace full packets with SIMD stepping
+    RayResult *results;
+} RayQuery;
+
+// Thread pool task: trace ENGINE_RAY_BATCH rays of a query
+static void engine_cast_ray_batch(void *context, int batchIndex, int workerIndex);
+
+// Fill in the settings a frame's view takes from the engine: which map is
+// traced, how walls, floors and sprites are drawn, and the worker counters
+static void engine_setup_view(Engine *engine, RenderView *view);
 
-// Get texture by index
-static SDL_Texture* engine_get_texture(Engine *engine, int index);
+// Buffers one worker reuses for every view of engine_render_views it renders
+typedef struct ViewScratch {
+    void *floorState;       // Scanlines, then ceiling rows and floor starts, as engine_render_scene lays them out
+    float *wallDepth;       // Wall distance of each column, when there are sprites
+    EntityView sprites;     // Sprites that survived culling for the view
+    RayFixedColumns fixedColumns;   // Column tables of the fixed-point path
+} ViewScratch;
 
-// Draw a textured vertical line
-static void engine_draw_textured_line(Engine *engine, int x, int drawStart, int drawEnd, 
-                            double wallX, int texNum, double perpWallDist, int side);
+// The views of one engine_render_views call, shared by its tasks
+typedef struct ViewBatch {
+    const RenderView *base;     // Engine settings every view shares
+    const EngineView *views;
+    ViewScratch *scratch;       // One per worker, by worker index
+} ViewBatch;
 
-// Load a map from a string buffer
-static int engine_load_map_from_buffer(Engine *engine, const char *buffer, Map *map);
+// Thread pool task: render one view of a batch whole: walls, floors and sprites
+static void engine_render_view_task(void *context, int viewIndex, int workerIndex);
+
+// Upload width x height pixels to the window and present them
+static void engine_present_pixels(Engine *engine, const Uint32 *pixels, int width, int height);
+
+// Print the frame budget controller's decision if it made one since *decisionsLogged
+static void engine_log_scale_decision(Engine *engine, int *decisionsLogged);
+
+// Draw the overlay over a frame if it is shown: frame times, the passes of
+// the last frame, its counters and the capture state
+static void engine_draw_hud(Engine *engine, Uint32 *pixels, int width, int height);
+
+// Start a profiler capture, or stop the running one and write it to the next trace file
+static void engine_toggle_capture(Engine *engine);
+
+// Simulation thread: step the player at the tick rate and publish snapshots
+static int engine_sim_main(void *data);
+
+// Render thread: render the newest snapshot into a free frame and publish it
+static int engine_render_main(void *data);
+
+// Start the simulation and render threads from the engine's player and map
+static int engine_pipeline_start(Engine *engine, EnginePipeline *pipeline);
+
+// Stop both threads and hand the simulated player back to the engine
+static void engine_pipeline_stop(EnginePipeline *pipeline);
+
+// Main loop with every stage in turn on the calling thread
+static int engine_run_sequential(Engine *engine);
+
+// Main loop with simulation and rendering on their own threads
+static int engine_run_pipelined(Engine *engine);
 
 // ****************************************************
 // Public API Implementation
@@ -74,6 +391,25 @@ static int engine_load_map_from_buffer(Engine *engine, const char *buffer, Map *
 
 // Initialize the engine with default settings
 int engine_init(Engine *engine) {
+    // Nothing is owned yet, so a failure below can run engine_cleanup safely
+    memset(&engine->textures, 0, sizeof(engine->textures));
+    engine->framebuffer = NULL;
+    engine->frameTexture = NULL;
+    catalog_init(&engine->maps, CATALOG_CACHE_MAPS);
+    engine->currentMapIndex = -1;
+    memset(&engine->defaultMap, 0, sizeof(engine->defaultMap));
+    engine->pool = NULL;
+    engine->renderStats = NULL;
+    engine->renderCache = NULL;
+    engine->profiler = NULL;
+    engine->recorder = NULL;
+    engine->watcher = NULL;
+    engine->fixedColumns = NULL;
+    engine->entities = NULL;
+    engine->visibleEntities = NULL;
+    engine->demoSprites = 0;
+    engine_init_resolution(engine);
+    
     // Initialize SDL
     if (SDL_Init(SDL_INIT_VIDEO) != 0) {
         fprintf(stderr, "SDL initialization failed: %s\n", SDL_GetError());
@@ -84,7 +420,7 @@ int engine_init(Engine *engine) {
     engine->window = SDL_CreateWindow(
         "Raycaster Demo",
         SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
-        SCREEN_WIDTH, SCREEN_HEIGHT,
+        engine->windowWidth, engine->windowHeight,
         SDL_WINDOW_SHOWN
     );
     
@@ -108,43 +444,123 @@ int engine_init(Engine *engine) {
         return 0;
     }
     
-    // Initialize map system
-    engine->availableMaps = NULL;
-    engine->mapCount = 0;
-    engine->currentMapIndex = 0;
-    
-    // Initialize timing system
-    engine->lastTime = SDL_GetTicks();
+    // Create the streaming texture the framebuffer is uploaded through
+    engine->frameTexture = SDL_CreateTexture(
+        engine->renderer,
+        SDL_PIXELFORMAT_ARGB8888,
+        SDL_TEXTUREACCESS_STREAMING,
+        engine->windowWidth, engine->windowHeight
+    );
     
-    // Initialize map
-    engine_init_map(engine);
+    if (engine->frameTexture == NULL) {
+        fprintf(stderr, "Frame texture creation failed: %s\n", SDL_GetError());
+        SDL_DestroyRenderer(engine->renderer);
+        SDL_DestroyWindow(engine->window);
+        SDL_Quit();
+        return 0;
+    }
     
-    // Initialize textures
-    if (!engine_init_textures(engine)) {
-        fprintf(stderr, "Failed to initialize textures!\n");
+    if (!engine_init_state(engine)) {
         engine_cleanup(engine);
         return 0;
     }
     
-    // Initialize player at starting position
-    engine_init_player(engine, engine->map.startX, engine->map.startY);
+    return 1;
+}
+
+// Initialize the engine without a window; frames are only rendered into the framebuffer
+int engine_init_headless(Engine *engine) {
+    // Only the core library is needed, no video subsystem
+    if (SDL_Init(0) != 0) {
+        fprintf(stderr, "SDL initialization failed: %s\n", SDL_GetError());
+        return 0;
+    }
     
-    // Set running flag
-    engine->running = 1;
+    memset(&engine->textures, 0, sizeof(engine->textures));
+    engine->window = NULL;
+    engine->renderer = NULL;
+    engine->frameTexture = NULL;
+    engine->framebuffer = NULL;
+    catalog_init(&engine->maps, CATALOG_CACHE_MAPS);
+    engine->currentMapIndex = -1;
+    memset(&engine->defaultMap, 0, sizeof(engine->defaultMap));
+    engine->pool = NULL;
+    engine->renderStats = NULL;
+    engine->renderCache = NULL;
+    engine->profiler = NULL;
+    engine->recorder = NULL;
+    engine->watcher = NULL;
+    engine->fixedColumns = NULL;
+    engine->entities = NULL;
+    engine->visibleEntities = NULL;
+    engine->demoSprites = 0;
+    engine_init_resolution(engine);
+    
+    if (!engine_init_state(engine)) {
+        engine_cleanup(engine);
+        return 0;
+    }
     
     return 1;
 }
 
 // Clean up resources allocated by the engine
 void engine_cleanup(Engine *engine) {
+    // Stop the workers first, nothing may render after this point
+    threadpool_destroy(engine->pool);
+    engine->pool = NULL;
+    free(engine->renderStats);
+    engine->renderStats = NULL;
+    if (engine->renderCache) {
+        free(engine->renderCache->depth);
+        free(engine->renderCache->floorState);
+        free(engine->renderCache->dirty);
+        free(engine->renderCache->tiles);
+        free(engine->renderCache);
+        engine->renderCache = NULL;
+    }
+    profiler_destroy(engine->profiler);
+    engine->profiler = NULL;
+    replay_close(engine->recorder);
+    engine->recorder = NULL;
+    mapwatch_stop(engine->watcher);
+    engine->watcher = NULL;
+    
     engine_cleanup_textures(engine);
     
-    // Clean up maps
-    if (engine->availableMaps) {
-        free(engine->availableMaps);
-        engine->availableMaps = NULL;
+    if (engine->fixedColumns) {
+        raycaster_fixed_columns_free(engine->fixedColumns);
+        free(engine->fixedColumns);
+        engine->fixedColumns = NULL;
+    }
+    
+    if (engine->entities) {
+        entity_store_free(engine->entities);
+        free(engine->entities);
+        engine->entities = NULL;
+    }
+    if (engine->visibleEntities) {
+        entity_view_free(engine->visibleEntities);
+        free(engine->visibleEntities);
+        engine->visibleEntities = NULL;
     }
     
+    if (engine->framebuffer) {
+        free(engine->framebuffer);
+        engine->framebuffer = NULL;
+    }
+    
+    if (engine->frameTexture) {
+        SDL_DestroyTexture(engine->frameTexture);
+        engine->frameTexture = NULL;
+    }
+    
+    // Clean up maps
+    engine->map = NULL;
+    engine->currentMapIndex = -1;
+    catalog_destroy(&engine->maps);
+    map_destroy(&engine->defaultMap);
+    
     if (engine->renderer) {
         SDL_DestroyRenderer(engine->renderer);
         engine->renderer = NULL;
@@ -171,354 +587,616 @@ void engine_init_player(Engine *engine, double posX, double posY) {
 }
 
 // Initialize the default map
-void engine_init_map(Engine *engine) {
-    engine->map.width = MAP_WIDTH;
-    engine->map.height = MAP_HEIGHT;
-    engine->map.startX = 22.0;
-    engine->map.startY = 12.0;
-    strcpy(engine->map.name, "Default Map");
+int engine_init_map(Engine *engine) {
+    if (!map_create(&engine->defaultMap, MAP_WIDTH, MAP_HEIGHT, MAP_BLOCK_SHIFT)) {
+        return 0;
+    }
+    engine->defaultMap.startX = 22.0;
+    engine->defaultMap.startY = 12.0;
+    strcpy(engine->defaultMap.name, "Default Map");
     
     // Copy default map
     for (int y = 0; y < MAP_HEIGHT; y++) {
         for (int x = 0; x < MAP_WIDTH; x++) {
-            engine->map.data[y][x] = DEFAULT_MAP[y][x];
+            map_set(&engine->defaultMap, x, y, DEFAULT_MAP[y][x]);
         }
     }
+    
+    if (!map_build_distance(&engine->defaultMap)) {
+        map_destroy(&engine->defaultMap);
+        return 0;
+    }
+    
+    engine->map = &engine->defaultMap;
+    return 1;
 }
 
 // Create a map with the given data
 int engine_create_map(Engine *engine, const int *mapData, int width, int height, 
                      double startX, double startY, const char *name) {
     // Validate input parameters
-    if (!mapData || width <= 0 || height <= 0 || width > MAP_WIDTH || height > MAP_HEIGHT) {
+    if (!mapData || width <= 0 || height <= 0) {
         return 0;
     }
     
-    // Expand map array if needed
-    if (engine->mapCount == 0) {
-        engine->availableMaps = (Map*)malloc(MAX_MAPS * sizeof(Map));
-        if (!engine->availableMaps) {
-            return 0;  // Memory allocation failed
-        }
-    } else if (engine->mapCount >= MAX_MAPS) {
-        return 0;  // Reached maximum map count
-    }
-    
     // Fill in the new map
-    Map *newMap = &engine->availableMaps[engine->mapCount];
-    newMap->width = width;
-    newMap->height = height;
-    newMap->startX = startX;
-    newMap->startY = startY;
-    strncpy(newMap->name, name, sizeof(newMap->name) - 1);
-    newMap->name[sizeof(newMap->name) - 1] = '\0';  // Ensure null termination
+    Map newMap;
+    if (!map_create(&newMap, width, height, MAP_BLOCK_SHIFT)) {
+        return 0;
+    }
+    newMap.startX = startX;
+    newMap.startY = startY;
+    strncpy(newMap.name, name, sizeof(newMap.name) - 1);
+    newMap.name[sizeof(newMap.name) - 1] = '\0';  // Ensure null termination
     
     // Copy the map data
     for (int y = 0; y < height; y++) {
         for (int x = 0; x < width; x++) {
-            newMap->data[y][x] = mapData[y * width + x];
+            int tile = mapData[y * width + x];
+            if (tile < 0 || tile > MAP_TILE_MAX) {
+                map_destroy(&newMap);
+                return 0;
+            }
+            map_set(&newMap, x, y, tile);
         }
     }
     
-    // Clear any remaining cells if the map is smaller than MAP_WIDTH/MAP_HEIGHT
-    for (int y = 0; y < MAP_HEIGHT; y++) {
-        for (int x = 0; x < MAP_WIDTH; x++) {
-            if (y >= height || x >= width) {
-                newMap->data[y][x] = 0;
-            }
-        }
+    if (!map_build_distance(&newMap)) {
+        map_destroy(&newMap);
+        return 0;
     }
     
-    engine->mapCount++;
+    // The catalog takes over the tiles
+    if (catalog_add_map(&engine->maps, &newMap) < 0) {
+        map_destroy(&newMap);
+        return 0;
+    }
     return 1;
 }
 
-// Load a specific map by index
+// Make a map active by index, loading it if it is not cached
 int engine_set_map(Engine *engine, int mapIndex) {
-    if (mapIndex < 0 || mapIndex >= engine->mapCount) {
+    // A cached map is only pinned, nothing is copied
+    Map *map = catalog_acquire(&engine->maps, mapIndex);
+    if (!map) {
         return 0;
     }
     
-    // Copy the selected map to the active map
-    Map *selectedMap = &engine->availableMaps[mapIndex];
-    memcpy(&engine->map, selectedMap, sizeof(Map));
+    // Unpin the previous map only now, switching to the same map must not evict it
+    catalog_release(&engine->maps, engine->currentMapIndex);
+    engine->map = map;
+    engine->currentMapIndex = mapIndex;
     
     // Reset player position to map's starting position
-    engine_init_player(engine, engine->map.startX, engine->map.startY);
+    engine_init_player(engine, engine->map->startX, engine->map->startY);
     
-    engine->currentMapIndex = mapIndex;
+    // Sprites belong to the world they were placed in
+    entity_clear(engine->entities);
+    if (engine->demoSprites > 0) {
+        engine_scatter_sprites(engine, engine->demoSprites, (Uint32)mapIndex + 1);
+    }
     return 1;
 }
 
-// Get a list of available map names
-const char** engine_get_map_names(Engine *engine) {
-    if (engine->mapCount == 0) {
-        return NULL;
+// Scatter count sprites over random open tiles of the active map
+int engine_scatter_sprites(Engine *engine, int count, Uint32 seed) {
+    const Map *map = engine->map;
+    int open = 0;
+    for (int y = 0; y < map->height; y++) {
+        for (int x = 0; x < map->width; x++) {
+            open += map_get(map, x, y) == 0;
+        }
+    }
+    if (open == 0) {
+        return 0;
     }
     
-    const char **names = (const char**)malloc(engine->mapCount * sizeof(char*));
-    if (!names) {
-        return NULL;
+    // Any open tile can take several sprites; they are kept off the tile edges
+    for (int i = 0; i < count; i++) {
+        int x, y;
+        do {
+            seed = seed * 1664525u + 1013904223u;
+            x = (int)((seed >> 8) % (Uint32)map->width);
+            seed = seed * 1664525u + 1013904223u;
+            y = (int)((seed >> 8) % (Uint32)map->height);
+        } while (map_get(map, x, y) != 0);
+        seed = seed * 1664525u + 1013904223u;
+        double offsetX = 0.2 + 0.6 * ((seed >> 8) & 0xFF) / 255.0;
+        double offsetY = 0.2 + 0.6 * ((seed >> 16) & 0xFF) / 255.0;
+        if (entity_add(engine->entities, x + offsetX, y + offsetY, (int)((seed >> 24) % NUM_SPRITES)) < 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Set the output resolution (window size); the render scale is kept
+int engine_set_resolution(Engine *engine, int width, int height) {
+    if (width <= 0 || height <= 0) {
+        return 0;
     }
     
-    for (int i = 0; i < engine->mapCount; i++) {
-        names[i] = engine->availableMaps[i].name;
+    Uint32 *framebuffer = (Uint32*)malloc(width * height * sizeof(Uint32));
+    if (!framebuffer) {
+        fprintf(stderr, "Failed to allocate framebuffer!\n");
+        return 0;
     }
     
-    return names;
+    if (engine->renderer) {
+        SDL_Texture *frameTexture = SDL_CreateTexture(engine->renderer, SDL_PIXELFORMAT_ARGB8888,
+                                                      SDL_TEXTUREACCESS_STREAMING, width, height);
+        if (!frameTexture) {
+            fprintf(stderr, "Frame texture creation failed: %s\n", SDL_GetError());
+            free(framebuffer);
+            return 0;
+        }
+        SDL_DestroyTexture(engine->frameTexture);
+        engine->frameTexture = frameTexture;
+        SDL_SetWindowSize(engine->window, width, height);
+    }
+    
+    free(engine->framebuffer);
+    engine->framebuffer = framebuffer;
+    engine->windowWidth = width;
+    engine->windowHeight = height;
+    engine_set_render_scale(engine, engine->renderScale);
+    return 1;
 }
 
-// Load a map from a file
-int engine_load_map_from_file(Engine *engine, const char *filename) {
-    FILE *file = fopen(filename, "r");
-    if (!file) {
-        fprintf(stderr, "Could not open map file: %s\n", filename);
+// Set the internal render scale relative to the output resolution, clamped to [RENDER_SCALE_MIN, 1]
+void engine_set_render_scale(Engine *engine, double scale) {
+    if (scale < RENDER_SCALE_MIN) scale = RENDER_SCALE_MIN;
+    if (scale > 1.0) scale = 1.0;
+    
+    // Snap to whole pixels so the scale always matches the resolution in use
+    int renderWidth = (int)(engine->windowWidth * scale + 0.5);
+    int renderHeight = (int)(engine->windowHeight * scale + 0.5);
+    if (renderWidth < 1) renderWidth = 1;
+    if (renderHeight < 1) renderHeight = 1;
+    
+    engine->renderWidth = renderWidth;
+    engine->renderHeight = renderHeight;
+    engine->renderScale = (double)renderWidth / engine->windowWidth;
+}
+
+// Hold the render time near budgetMs by adjusting the render scale (0 disables)
+void engine_set_frame_budget(Engine *engine, double budgetMs) {
+    ScaleController *controller = &engine->scaleController;
+    controller->budgetMs = budgetMs > 0.0 ? budgetMs : 0.0;
+    controller->smoothedMs = 0.0;
+    controller->cooldown = 0;
+}
+
+// Get the most recent render scale decision, or NULL if none was made yet
+const RenderScaleDecision* engine_get_scale_decision(Engine *engine) {
+    if (engine->scaleController.decisionCount == 0) {
+        return NULL;
+    }
+    return &engine->scaleController.lastDecision;
+}
+
+// Set the number of render threads (<= 0 uses one per CPU core)
+int engine_set_thread_count(Engine *engine, int threadCount) {
+    threadpool_destroy(engine->pool);
+    
+    engine->pool = threadpool_create(threadCount);
+    if (!engine->pool) {
+        fprintf(stderr, "Failed to create render thread pool!\n");
         return 0;
     }
     
-    // Read file into a buffer
-    fseek(file, 0, SEEK_END);
-    long fileSize = ftell(file);
-    rewind(file);
+    // One block of frame counters per worker
+    free(engine->renderStats);
+    engine->renderStats = (RenderStats*)calloc(engine->pool->workerCount, sizeof(RenderStats));
+    if (!engine->renderStats) {
+        fprintf(stderr, "Failed to allocate render counters!\n");
+        threadpool_destroy(engine->pool);
+        engine->pool = NULL;
+        return 0;
+    }
     
-    char *buffer = (char*)malloc(fileSize + 1);
-    if (!buffer) {
-        fclose(file);
+    return 1;
+}
+
+// Get the number of render threads, including the calling thread
+int engine_get_thread_count(Engine *engine) {
+    return engine->pool ? engine->pool->workerCount : 1;
+}
+
+// Cast count rays against the active map on the render threads, ray i from
+// origins[i] along dirs[i], no farther than maxDist (INFINITY for no limit);
+// rays that hit no wall in range, or leave the map, report maxDist. Do not call
+// while the engine is rendering on the same threads.
+int engine_cast_rays(Engine *engine, const RayVector *origins, const RayVector *dirs, double maxDist,
+                     int count, RayResult *results) {
+    if (count < 0 || !(maxDist >= 0.0)) {
+        fprintf(stderr, "Invalid ray query: %d rays, range %g\n", count, maxDist);
         return 0;
     }
     
-    size_t bytesRead = fread(buffer, 1, fileSize, file);
-    buffer[bytesRead] = '\0';  // Null terminate the string
-    fclose(file);
+    // Rays trace the same map the renderer does, with or without skipping
+    Map plainMap = *engine->map;
+    plainMap.distance = NULL;
     
-    // Load the map from the buffer into a new map
-    if (engine->mapCount >= MAX_MAPS) {
-        free(buffer);
-        return 0;  // Reached maximum map count
+    RayQuery query;
+    query.map = engine->emptySkipping ? engine->map : &plainMap;
+    query.origins = origins;
+    query.dirs = dirs;
+    query.maxDist = maxDist;
+    query.count = count;
+    query.packets = engine->rayPackets;
+    query.results = results;
+    
+    threadpool_run(engine->pool, (count + ENGINE_RAY_BATCH - 1) / ENGINE_RAY_BATCH, engine_cast_ray_batch, &query);
+    return 1;
+}
+
+// Check line of sight between count pairs of points: visible[i] is 1 when no
+// wall lies between from[i] and to[i]; tracing stops at the target
+int engine_check_visibility(Engine *engine, const RayVector *from, const RayVector *to, int count, Uint8 *visible) {
+    if (count <= 0) {
+        return count == 0;
     }
     
-    // If this is the first map, allocate the maps array
-    if (engine->mapCount == 0) {
-        engine->availableMaps = (Map*)malloc(MAX_MAPS * sizeof(Map));
-        if (!engine->availableMaps) {
-            free(buffer);
-            return 0;  // Memory allocation failed
-        }
+    // Each ray runs from a point to its target, which is one length of its direction away
+    RayVector *dirs = (RayVector*)malloc((size_t)count * sizeof(RayVector));
+    RayResult *results = (RayResult*)malloc((size_t)count * sizeof(RayResult));
+    if (!dirs || !results) {
+        fprintf(stderr, "Failed to allocate %d line of sight rays!\n", count);
+        free(dirs);
+        free(results);
+        return 0;
+    }
+    for (int i = 0; i < count; i++) {
+        dirs[i].x = to[i].x - from[i].x;
+        dirs[i].y = to[i].y - from[i].y;
+    }
+    
+    int ok = engine_cast_rays(engine, from, dirs, 1.0, count, results);
+    for (int i = 0; ok && i < count; i++) {
+        visible[i] = !results[i].hit;
     }
     
-    // Parse the map from the buffer
-    Map *newMap = &engine->availableMaps[engine->mapCount];
-    int result = engine_load_map_from_buffer(engine, buffer, newMap);
+    free(dirs);
+    free(results);
+    return ok;
+}
+
+// Get the number of maps in the catalog
+int engine_get_map_count(Engine *engine) {
+    return engine->maps.count;
+}
+
+// Get a list of available map names
+const char** engine_get_map_names(Engine *engine) {
+    if (engine->maps.count == 0) {
+        return NULL;
+    }
     
-    free(buffer);
+    const char **names = (const char**)malloc(engine->maps.count * sizeof(char*));
+    if (!names) {
+        return NULL;
+    }
     
-    if (result) {
-        engine->mapCount++;
-        return 1;
+    // Reads each map's header once, the maps themselves are not loaded
+    for (int i = 0; i < engine->maps.count; i++) {
+        names[i] = catalog_name(&engine->maps, i);
     }
     
-    return 0;
+    return names;
 }
 
-// Load maps from files in a directory
-int engine_load_maps(Engine *engine, const char *directory) {
-    DIR *dir;
-    struct dirent *ent;
-    
-    if ((dir = opendir(directory)) == NULL) {
-        fprintf(stderr, "Could not open directory: %s\n", directory);
+// Add a map file to the catalog; it is loaded when first used
+int engine_load_map_from_file(Engine *engine, const char *filename) {
+    FILE *file = fopen(filename, "rb");
+    if (!file) {
+        fprintf(stderr, "Could not open map file: %s\n", filename);
         return 0;
     }
+    fclose(file);
     
-    int mapsLoaded = 0;
-    
-    while ((ent = readdir(dir)) != NULL) {
-        // Skip . and ..
-        if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) {
+    return catalog_add_file(&engine->maps, filename) >= 0;
+}
+
+// Add the maps in a directory to the catalog; none is loaded until it is used
+int engine_load_maps(Engine *engine, const char *directory) {
+    return catalog_scan(&engine->maps, directory);
+}
+
+// Watch a map directory added with engine_load_maps: maps saved into it are
+// read on a thread of their own and applied by engine_apply_map_reloads
+int engine_watch_maps(Engine *engine, const char *directory) {
+    mapwatch_stop(engine->watcher);
+    engine->watcher = mapwatch_start(directory);
+    return engine->watcher != NULL;
+}
+
+// Apply the maps the watcher has read since the last call, each changed in
+// place in the catalog so only its edited tiles are redone; a map whose size
+// changed is built whole on the watcher thread and only swapped in here, and
+// a map that is not cached is loaded from its file when next used. Call
+// between frames. Returns the number of maps changed, cached or not.
+int engine_apply_map_reloads(Engine *engine) {
+    int applied = 0;
+    MapReload reload;
+    while (mapwatch_poll(engine->watcher, &reload)) {
+        // Files the catalog does not use, like a text map that has a compiled copy, are left alone
+        int index = catalog_find_file(&engine->maps, reload.path);
+        if (index < 0) {
+            map_destroy(&reload.map);
             continue;
         }
         
-        // Check if the file has a .map extension
-        char *ext = strrchr(ent->d_name, '.');
-        if (!ext || strcmp(ext, ".map") != 0) {
+        // A new size means building the map whole: that is left to the watcher
+        // thread, and the map is only swapped in once it comes back built
+        const Map *cached = engine->maps.entries[index].map;
+        if (cached && !reload.built &&
+            (reload.map.width != cached->width || reload.map.height != cached->height ||
+             reload.map.blockShift != cached->blockShift) &&
+            mapwatch_build(engine->watcher, &reload)) {
             continue;
         }
         
-        // Build the full path
-        char fullPath[512];
-        snprintf(fullPath, sizeof(fullPath), "%s/%s", directory, ent->d_name);
+        Uint64 start = profiler_begin(engine->profiler);
+        Uint64 counter = SDL_GetPerformanceCounter();
+        int changed = catalog_update(&engine->maps, index, &reload.map);
+        double applyMs = (double)(SDL_GetPerformanceCounter() - counter) * 1000.0 / SDL_GetPerformanceFrequency();
+        profiler_end(engine->profiler, PROFILER_THREAD_MAIN, "reload", start);
+        if (changed < 0) {
+            fprintf(stderr, "Failed to apply the new version of %s\n", reload.path);
+            continue;
+        }
+        if (cached) {
+            printf("Reloaded %s: %d tiles changed (read in %.2f ms, applied in %.2f ms)\n",
+                   reload.path, changed, reload.loadMs, applyMs);
+        } else {
+            printf("Reloaded %s: not loaded, will load on next use (read in %.2f ms)\n",
+                   reload.path, reload.loadMs);
+        }
+        applied++;
         
-        // Load the map
-        if (engine_load_map_from_file(engine, fullPath)) {
-            mapsLoaded++;
+        // A player the edit walled in, or left outside a smaller map, starts over
+        if (index == engine->currentMapIndex) {
+            const Map *map = engine->map;
+            int x = (int)engine->player.posX;
+            int y = (int)engine->player.posY;
+            if (x < 0 || y < 0 || x >= map->width || y >= map->height || map_get(map, x, y) > 0) {
+                engine_init_player(engine, map->startX, map->startY);
+            }
         }
     }
-    
-    closedir(dir);
-    return mapsLoaded;
+    return applied;
 }
 
 // ****************************************************
 // Private functions implementation
 // ****************************************************
 
-// Load a map from a string buffer
-static int engine_load_map_from_buffer(Engine *engine, const char *buffer, Map *map) {
-    // Default values
-    map->width = MAP_WIDTH;
-    map->height = MAP_HEIGHT;
-    map->startX = 22.0;
-    map->startY = 12.0;
-    strcpy(map->name, "Unnamed Map");
-    
-    // Clear the map data
-    memset(map->data, 0, sizeof(map->data));
+// Set the default output resolution at full render scale, with the controller off
+static void engine_init_resolution(Engine *engine) {
+    engine->windowWidth = SCREEN_WIDTH;
+    engine->windowHeight = SCREEN_HEIGHT;
+    engine->renderWidth = SCREEN_WIDTH;
+    engine->renderHeight = SCREEN_HEIGHT;
+    engine->renderScale = 1.0;
+    engine->lastRenderMs = 0.0;
+    engine->lastFloorMs = 0.0;
+    engine->lastFloorPixels = 0;
+    engine->lastSpriteMs = 0.0;
+    engine->lastSpriteCount = 0;
+    engine->lastFrameMs = 0.0;
+    engine->lastFrameStart = 0;
+    engine->lastDdaSteps = 0;
+    engine->lastColumns = 0;
+    engine->lastTexels = 0;
+    engine->frameCount = 0;
+    memset(&engine->scaleController, 0, sizeof(engine->scaleController));
+}
+
+// Feed the last render time to the frame budget controller
+static void engine_update_render_scale(Engine *engine) {
+    ScaleController *controller = &engine->scaleController;
+    if (controller->budgetMs <= 0.0) {
+        return;
+    }
     
-    // Parse the buffer line by line
-    char line[512];
-    int lineNum = 0;
-    int dataLine = 0;
-    int parsingData = 0;
+    // Smooth out single slow frames so the scale does not oscillate
+    if (controller->smoothedMs <= 0.0) {
+        controller->smoothedMs = engine->lastRenderMs;
+    } else {
+        controller->smoothedMs += 0.2 * (engine->lastRenderMs - controller->smoothedMs);
+    }
     
-    const char *bufferPtr = buffer;
+    if (controller->cooldown > 0) {
+        controller->cooldown--;
+        return;
+    }
     
-    while (*bufferPtr) {
-        // Read a line
-        int i = 0;
-        while (*bufferPtr && *bufferPtr != '\n' && i < sizeof(line) - 1) {
-            line[i++] = *bufferPtr++;
-        }
-        line[i] = '\0';
-        
-        // Skip the newline character
-        if (*bufferPtr == '\n') {
-            bufferPtr++;
-        }
-        
-        // Skip empty lines
-        if (strlen(line) == 0) {
-            continue;
-        }
-        
-        // Check for section markers
-        if (strncmp(line, NAME_MARKER, strlen(NAME_MARKER)) == 0) {
-            // Parse map name
-            strncpy(map->name, line + strlen(NAME_MARKER), sizeof(map->name) - 1);
-            map->name[sizeof(map->name) - 1] = '\0';  // Ensure null termination
-            continue;
-        } else if (strncmp(line, START_MARKER, strlen(START_MARKER)) == 0) {
-            // Parse starting position
-            sscanf(line + strlen(START_MARKER), "%lf,%lf", &map->startX, &map->startY);
-            continue;
-        } else if (strncmp(line, DATA_MARKER, strlen(DATA_MARKER)) == 0) {
-            // Start parsing map data
-            parsingData = 1;
-            dataLine = 0;
-            continue;
-        }
-        
-        if (parsingData && dataLine < MAP_HEIGHT) {
-            // Parse a row of map data
-            int col = 0;
-            char *token = strtok(line, " ,\t");
-            
-            while (token && col < MAP_WIDTH) {
-                map->data[dataLine][col++] = atoi(token);
-                token = strtok(NULL, " ,\t");
-            }
-            
-            dataLine++;
-        }
-        
-        lineNum++;
+    // Cost grows with the pixel count, which grows with the square of the scale;
+    // act only outside a dead band around the budget
+    double ratio = controller->budgetMs / controller->smoothedMs;
+    double scale = engine->renderScale;
+    if (controller->smoothedMs > controller->budgetMs * 1.05) {
+        scale *= sqrt(ratio);
+    } else if (controller->smoothedMs < controller->budgetMs * 0.8 && scale < 1.0) {
+        // Aim a little below the budget and grow at most 10% per step
+        double grow = sqrt(ratio * 0.9);
+        scale *= grow > 1.1 ? 1.1 : grow;
+    } else {
+        return;
     }
     
-    // Ensure the map has at least some data
-    if (dataLine == 0) {
-        return 0;
+    double oldScale = engine->renderScale;
+    engine_set_render_scale(engine, scale);
+    if (engine->renderScale == oldScale) {
+        return;
     }
     
-    map->height = dataLine;
-    return 1;
+    RenderScaleDecision *decision = &controller->lastDecision;
+    decision->frame = engine->frameCount;
+    decision->frameMs = controller->smoothedMs;
+    decision->budgetMs = controller->budgetMs;
+    decision->oldScale = oldScale;
+    decision->newScale = engine->renderScale;
+    decision->renderWidth = engine->renderWidth;
+    decision->renderHeight = engine->renderHeight;
+    controller->decisionCount++;
+    controller->cooldown = RENDER_SCALE_COOLDOWN;
 }
 
-// Get wall color based on map value and side
-static void engine_get_wall_color(Engine *engine, int mapValue, int side, SDL_Color *color) {
-    (void)engine; // Suppress unused parameter warning
-    
-    // Base colors for different wall types
-    switch (mapValue) {
-        case 1: // Red wall
-            color->r = 255;
-            color->g = 0;
-            color->b = 0;
-            break;
-        case 2: // Green wall
-            color->r = 0;
-            color->g = 255;
-            color->b = 0;
-            break;
-        case 3: // Blue wall
-            color->r = 0;
-            color->g = 0;
-            color->b = 255;
-            break;
-        case 4: // Yellow wall
-            color->r = 255;
-            color->g = 255;
-            color->b = 0;
-            break;
-        default: // Default gray
-            color->r = 128;
-            color->g = 128;
-            color->b = 128;
-            break;
-    }
-    
-    // Make sides darker to create 3D effect
-    if (side == 1) {
-        color->r = color->r / 2;
-        color->g = color->g / 2;
-        color->b = color->b / 2;
-    }
-    
-    color->a = 255; // Fully opaque
-}
-
-// Initialize textures system
-int engine_init_textures(Engine *engine) {
-    // Initialize SDL_image
-    int flags = IMG_INIT_PNG;
-    if (!(IMG_Init(flags) & flags)) {
-        fprintf(stderr, "SDL_image initialization failed: %s\n", IMG_GetError());
+// Initialize framebuffer, maps, timing and player (shared by windowed and headless init)
+static int engine_init_state(Engine *engine) {
+    // Allocate the CPU-side framebuffer every pixel of a frame is written to
+    engine->framebuffer = (Uint32*)malloc(engine->windowWidth * engine->windowHeight * sizeof(Uint32));
+    if (!engine->framebuffer) {
+        fprintf(stderr, "Failed to allocate framebuffer!\n");
         return 0;
     }
     
-    // For this template, we're just creating colorful textures programmatically
-    // In a real game, you would load image files instead
+    // Start one render worker per CPU core
+    if (!engine_set_thread_count(engine, 0)) {
+        return 0;
+    }
     
-    // Create surface for each texture
-    SDL_Surface *surfaces[NUM_TEXTURES];
+    // Nothing is rendered yet, so the first frame is rendered whole
+    engine->renderCache = (RenderCache*)calloc(1, sizeof(RenderCache));
+    if (!engine->renderCache) {
+        fprintf(stderr, "Failed to allocate the render cache!\n");
+        return 0;
+    }
     
-    for (int i = 0; i < NUM_TEXTURES; i++) {
-        surfaces[i] = SDL_CreateRGBSurface(0, TEX_WIDTH, TEX_HEIGHT, 32, 
-                                          0xFF000000, 0x00FF0000, 0x0000FF00, 0x000000FF);
-        
-        if (!surfaces[i]) {
-            fprintf(stderr, "Failed to create texture surface: %s\n", SDL_GetError());
-            
-            // Clean up already created surfaces
-            for (int j = 0; j < i; j++) {
-                SDL_FreeSurface(surfaces[j]);
-            }
-            
-            IMG_Quit();
-            return 0;
-        }
-        
-        // Fill with a pattern based on texture number
-        Uint32 *pixels = (Uint32*)surfaces[i]->pixels;
-        
+    // Trace columns in SIMD packets
+    engine->rayPackets = 1;
+    
+    // Fixed-point tables: fine angles now, columns when the first frame is rendered
+    raycaster_fixed_init();
+    engine->fixedColumns = (RayFixedColumns*)calloc(1, sizeof(RayFixedColumns));
+    if (!engine->fixedColumns) {
+        fprintf(stderr, "Failed to allocate fixed-point tables!\n");
+        return 0;
+    }
+    engine->fixedPoint = ENGINE_FIXED_POINT;
+    
+    // No sprites until some are added; their visible list grows with them
+    engine->entities = (EntityStore*)malloc(sizeof(EntityStore));
+    engine->visibleEntities = (EntityView*)calloc(1, sizeof(EntityView));
+    if (!engine->entities || !engine->visibleEntities) {
+        fprintf(stderr, "Failed to allocate entities!\n");
+        return 0;
+    }
+    entity_store_init(engine->entities);
+    
+    // Jump across open space using the maps' distance fields
+    engine->emptySkipping = 1;
+    
+    // Every stage on one thread unless asked to pipeline them
+    engine->pipelined = 0;
+    engine->tickRate = ENGINE_TICK_RATE;
+    
+    // Nothing is recorded until a capture is started, and the overlay starts hidden
+    engine->profiler = profiler_create();
+    if (!engine->profiler) {
+        return 0;
+    }
+    hud_init(&engine->hud);
+    engine->traceCount = 0;
+    
+    // Initialize textures; they live on the CPU, so headless engines get them too
+    if (!engine_init_textures(engine)) {
+        fprintf(stderr, "Failed to initialize textures!\n");
+        return 0;
+    }
+    
+    // Textured walls and floors, filtered down with distance
+    engine->texturedWalls = 1;
+    engine->texturedFloors = 1;
+    engine->mipmapping = 1;
+    
+    // Initialize timing system
+    engine->lastTime = SDL_GetPerformanceCounter();
+    engine->keystate = NULL;
+    
+    // Initialize map
+    if (!engine_init_map(engine)) {
+        return 0;
+    }
+    
+    // Initialize player at starting position
+    engine_init_player(engine, engine->map->startX, engine->map->startY);
+    
+    // Set running flag
+    engine->running = 1;
+    
+    return 1;
+}
+
+// Draw a procedural sprite into a texture: 0 a lamp, 1 a barrel, 2 a figure
+static void engine_paint_sprite(WallTexture *texture, int sprite) {
+    for (int y = 0; y < TEX_HEIGHT; y++) {
+        for (int x = 0; x < TEX_WIDTH; x++) {
+            // Texels outside the shape stay transparent (alpha 0)
+            Uint32 color = 0;
+            int dx = x - TEX_WIDTH / 2;
+            switch (sprite) {
+                case 0: // Lamp: a glowing globe on a thin post
+                    {
+                        int dy = y - TEX_HEIGHT / 4;
+                        int r2 = dx * dx + dy * dy;
+                        if (r2 < 12 * 12) {
+                            int glow = 255 - r2 / 2;
+                            color = engine_pack_color(255, (Uint8)(200 + glow / 5), (Uint8)(glow / 2));
+                        } else if (abs(dx) < 2 && y > TEX_HEIGHT / 4) {
+                            color = engine_pack_color(60, 60, 60);
+                        }
+                    }
+                    break;
+                case 1: // Barrel: brown staves with dark hoops
+                    if (abs(dx) < 14 && y >= TEX_HEIGHT / 3) {
+                        int hoop = (y - TEX_HEIGHT / 3) % 14 < 2;
+                        int shade = 150 - abs(dx) * 4;
+                        color = hoop ? engine_pack_color(50, 40, 30)
+                                     : engine_pack_color((Uint8)shade, (Uint8)(shade / 2), (Uint8)(shade / 5));
+                    }
+                    break;
+                case 2: // Figure: head, body and legs
+                default:
+                    {
+                        int dy = y - 12;
+                        if (dx * dx + dy * dy < 7 * 7) {
+                            color = engine_pack_color(230, 180, 140);
+                        } else if (y >= 20 && y < 46 && abs(dx) < 10) {
+                            color = engine_pack_color(40, 90, 170);
+                        } else if (y >= 46 && abs(dx) >= 2 && abs(dx) < 8) {
+                            color = engine_pack_color(50, 50, 60);
+                        }
+                    }
+                    break;
+            }
+            texture_set(texture, x, y, color);
+        }
+    }
+}
+
+// Initialize textures system
+int engine_init_textures(Engine *engine) {
+    // Initialize SDL_image
+    int flags = IMG_INIT_PNG;
+    if (!(IMG_Init(flags) & flags)) {
+        fprintf(stderr, "SDL_image initialization failed: %s\n", IMG_GetError());
+        return 0;
+    }
+    
+    // For this template, we're just creating colorful textures programmatically
+    // In a real game, you would load image files instead
+    
+    for (int i = 0; i < NUM_TEXTURES; i++) {
+        WallTexture *texture = &engine->textures.walls[i];
+        if (!texture_create(texture, TEX_WIDTH, TEX_HEIGHT)) {
+            engine_cleanup_textures(engine);
+            return 0;
+        }
+        
+        // Fill with a pattern based on texture number
         for (int y = 0; y < TEX_HEIGHT; y++) {
             for (int x = 0; x < TEX_WIDTH; x++) {
                 Uint8 r, g, b;
@@ -554,29 +1232,49 @@ int engine_init_textures(Engine *engine) {
                         break;
                 }
                 
-                pixels[y * TEX_WIDTH + x] = SDL_MapRGBA(surfaces[i]->format, r, g, b, 255);
+                // Stored in the framebuffer's format so texels are copied as they are
+                texture_set(texture, x, y, engine_pack_color(r, g, b));
             }
         }
         
-        // Create texture from surface
-        engine->textures.textures[i] = SDL_CreateTextureFromSurface(engine->renderer, surfaces[i]);
-        
-        // Free the surface as it's no longer needed
-        SDL_FreeSurface(surfaces[i]);
-        
-        if (!engine->textures.textures[i]) {
-            fprintf(stderr, "Failed to create texture: %s\n", SDL_GetError());
-            
-            // Clean up already created textures
-            for (int j = 0; j < i; j++) {
-                SDL_DestroyTexture(engine->textures.textures[j]);
-                engine->textures.textures[j] = NULL;
-            }
-            
-            IMG_Quit();
+        // Prefiltered smaller versions for distant walls
+        texture_build_mips(texture);
+    }
+    
+    // Sprites have the same size and mip chains, with transparent texels around them
+    for (int i = 0; i < NUM_SPRITES; i++) {
+        WallTexture *texture = &engine->textures.sprites[i];
+        if (!texture_create(texture, TEX_WIDTH, TEX_HEIGHT)) {
+            engine_cleanup_textures(engine);
+            return 0;
+        }
+        engine_paint_sprite(texture, i);
+        texture_build_mips(texture);
+    }
+    
+    // Texels become palette entries, so shading a pixel is one colormap lookup;
+    // the flat colors keep exact entries of their own
+    WallTexture *all[NUM_TEXTURES + NUM_SPRITES];
+    for (int i = 0; i < NUM_TEXTURES; i++) {
+        all[i] = &engine->textures.walls[i];
+    }
+    for (int i = 0; i < NUM_SPRITES; i++) {
+        all[NUM_TEXTURES + i] = &engine->textures.sprites[i];
+    }
+    int colors = texture_build_palette((const WallTexture *const *)all, NUM_TEXTURES + NUM_SPRITES,
+                                       engineFlatColors, ENGINE_FLAT_COLORS, engine->textures.palette,
+                                       LIGHTING_COLORS);
+    if (!colors) {
+        engine_cleanup_textures(engine);
+        return 0;
+    }
+    for (int i = 0; i < NUM_TEXTURES + NUM_SPRITES; i++) {
+        if (!texture_build_indices(all[i], engine->textures.palette, colors)) {
+            engine_cleanup_textures(engine);
             return 0;
         }
     }
+    lighting_build_colormap(engine->textures.palette, colors, engine->textures.colormap);
     
     return 1;
 }
@@ -584,25 +1282,18 @@ int engine_init_textures(Engine *engine) {
 // Cleanup textures
 void engine_cleanup_textures(Engine *engine) {
     for (int i = 0; i < NUM_TEXTURES; i++) {
-        if (engine->textures.textures[i]) {
-            SDL_DestroyTexture(engine->textures.textures[i]);
-            engine->textures.textures[i] = NULL;
-        }
+        texture_destroy(&engine->textures.walls[i]);
+    }
+    for (int i = 0; i < NUM_SPRITES; i++) {
+        texture_destroy(&engine->textures.sprites[i]);
     }
     
     IMG_Quit();
 }
 
-// Get texture by index
-static SDL_Texture* engine_get_texture(Engine *engine, int index) {
-    if (index >= 0 && index < NUM_TEXTURES) {
-        return engine->textures.textures[index];
-    }
-    return NULL;
-}
-
-// Handle events (keyboard input, quit events)
-static int engine_handle_events(Engine *engine) {
+// Handle events (keyboard input, quit events); map switches and captures are
+// left in *requests rather than carried out
+static int engine_handle_events(Engine *engine, EngineRequests *requests) {
     SDL_Event event;
     
     while (SDL_PollEvent(&event)) {
@@ -620,12 +1311,24 @@ static int engine_handle_events(Engine *engine) {
             // Map switching with number keys
             if (event.key.keysym.sym >= SDLK_1 && 
                 event.key.keysym.sym <= SDLK_9 && 
-                (event.key.keysym.sym - SDLK_1) < engine->mapCount) {
+                (event.key.keysym.sym - SDLK_1) < engine->maps.count) {
                 
-                int mapIndex = event.key.keysym.sym - SDLK_1;
-                engine_set_map(engine, mapIndex);
+                requests->map = event.key.keysym.sym - SDLK_1;
+            }
+            
+            // F1 shows or hides the overlay, F2 starts or stops a profiler capture
+            if (event.key.keysym.sym == SDLK_F1) {
+                SDL_AtomicSet(&engine->hud.visible, !SDL_AtomicGet(&engine->hud.visible));
+            }
+            if (event.key.keysym.sym == SDLK_F2) {
+                requests->trace = 1;
             }
         }
+        
+        // A window shown, resized or uncovered shows the frame again
+        if (event.type == SDL_WINDOWEVENT) {
+            requests->present = 1;
+        }
     }
     
     // Get current keyboard state
@@ -636,298 +1339,1423 @@ static int engine_handle_events(Engine *engine) {
 
 // Calculate time delta for frame-rate independent movement
 static double engine_calculate_delta_time(Engine *engine) {
-    Uint32 currentTime = SDL_GetTicks();
-    double deltaTime = (currentTime - engine->lastTime) / 1000.0;  // Convert to seconds
+    Uint64 currentTime = SDL_GetPerformanceCounter();
+    double deltaTime = (double)(currentTime - engine->lastTime) / SDL_GetPerformanceFrequency();
     
-    // Cap delta time to avoid large jumps
+    // Cap delta time to avoid large jumps; only movement is capped, the
+    // profiler and the overlay see the real frame times
     if (deltaTime > 0.05) {
         deltaTime = 0.05;
     }
     
+    // Whole microseconds, as recordings store them, so a replay moves exactly alike
+    deltaTime = floor(deltaTime * 1e6 + 0.5) / 1e6;
+    
     engine->lastTime = currentTime;
     return deltaTime;
 }
 
 // Update player position based on input with collision detection
 void engine_move_player(Engine *engine, double deltaTime) {
-    const Uint8 *keystate = engine->keystate;
-    Player *player = &engine->player;
-    
-    if (!keystate) {
+    if (!engine->keystate) {
         return;  // No keyboard state available
     }
     
-    // Move forward if W key is pressed
-    if (keystate[SDL_SCANCODE_W]) {
-        // Calculate new position
-        double newX = player->posX + player->dirX * player->moveSpeed * deltaTime;
-        double newY = player->posY + player->dirY * player->moveSpeed * deltaTime;
-        
-        // Check for collision with map boundaries
-        if (newX < 0 || newX >= engine->map.width || 
-            newY < 0 || newY >= engine->map.height) {
-            return; // Don't move, we'd go out of bounds
-        }
-        
-        // Check for collision with walls
-        int mapX = (int)newX;
-        int mapY = (int)newY;
-        
-        // Only move if new position is not inside a wall
-        if (mapX < engine->map.width && mapY < engine->map.height && 
-            engine->map.data[mapY][mapX] == 0) {
-            player->posX = newX;
-            player->posY = newY;
-        }
+    engine_step_player(engine->map, &engine->player, engine_read_keys(engine->keystate), deltaTime);
+}
+
+// Start recording every frame of the sequential loop to a file
+int engine_start_recording(Engine *engine, const char *path) {
+    replay_close(engine->recorder);
+    engine->recorder = replay_create(path, engine);
+    return engine->recorder != NULL;
+}
+
+// Put the engine in the state a recording starts from: its resolution, render
+// scale, map, sprites and pose; the frame budget is disabled
+int engine_start_replay(Engine *engine, const struct ReplayHeader *header) {
+    engine_set_frame_budget(engine, 0.0);
+    engine->demoSprites = header->demoSprites;
+    engine->fixedPoint = header->fixedPoint;
+    if (!engine_set_resolution(engine, header->windowWidth, header->windowHeight)) {
+        return 0;
     }
+    engine_set_render_scale(engine, header->renderScale);
     
-    // Move backward if S key is pressed
-    if (keystate[SDL_SCANCODE_S]) {
-        double newX = player->posX - player->dirX * player->moveSpeed * deltaTime;
-        double newY = player->posY - player->dirY * player->moveSpeed * deltaTime;
-        
-        // Check for collision with map boundaries
-        if (newX < 0 || newX >= engine->map.width || 
-            newY < 0 || newY >= engine->map.height) {
-            return; // Don't move, we'd go out of bounds
-        }
-        
-        // Check for collision with walls
-        int mapX = (int)newX;
-        int mapY = (int)newY;
-        
-        // Only move if new position is not inside a wall
-        if (mapX < engine->map.width && mapY < engine->map.height && 
-            engine->map.data[mapY][mapX] == 0) {
-            player->posX = newX;
-            player->posY = newY;
-        }
+    if (header->mapIndex >= 0 && !engine_set_map(engine, header->mapIndex)) {
+        return 0;
+    }
+    if (strcmp(engine->map->name, header->mapName) != 0) {
+        fprintf(stderr, "Recording was made on map %s, not %s\n", header->mapName, engine->map->name);
+        return 0;
+    }
+    engine->player = header->player;
+    return 1;
+}
+
+// Apply one recorded frame: switch maps and render scale as it did, step the
+// player by its keys and delta time, and render the scene
+int engine_replay_frame(Engine *engine, const struct ReplayFrame *frame) {
+    if (frame->mapIndex >= 0 && !engine_set_map(engine, frame->mapIndex)) {
+        return 0;
+    }
+    engine_set_render_scale(engine, frame->renderScale);
+    engine_step_player(engine->map, &engine->player, frame->keys, frame->deltaTime);
+    engine_render_scene(engine);
+    return 1;
+}
+
+// Append the frame the loop is about to render to the recording, if one is running
+static void engine_record_frame(Engine *engine, int keys, double deltaTime, int mapIndex) {
+    if (!engine->recorder) {
+        return;
     }
     
-    // Rotate right if D key is pressed (clockwise)
-    if (keystate[SDL_SCANCODE_D]) {
-        double oldDirX = player->dirX;
-        double rotSpeed = player->rotSpeed * deltaTime;
-        
-        // Rotate direction vector
-        player->dirX = player->dirX * cos(-rotSpeed) - player->dirY * sin(-rotSpeed);
-        player->dirY = oldDirX * sin(-rotSpeed) + player->dirY * cos(-rotSpeed);
-        
-        // Rotate camera plane
-        double oldPlaneX = player->planeX;
-        player->planeX = player->planeX * cos(-rotSpeed) - player->planeY * sin(-rotSpeed);
-        player->planeY = oldPlaneX * sin(-rotSpeed) + player->planeY * cos(-rotSpeed);
+    ReplayFrame frame = { keys, deltaTime, mapIndex, engine->renderScale };
+    if (!replay_write_frame(engine->recorder, &frame)) {
+        // Keep what was written so far usable
+        replay_close(engine->recorder);
+        engine->recorder = NULL;
+    }
+}
+
+// Movement keys held in a keyboard state, as ENGINE_KEY_* bits
+static int engine_read_keys(const Uint8 *keystate) {
+    if (!keystate) {
+        return 0;
     }
     
-    // Rotate left if A key is pressed (counter-clockwise)
-    if (keystate[SDL_SCANCODE_A]) {
-        double oldDirX = player->dirX;
-        double rotSpeed = player->rotSpeed * deltaTime;
+    int keys = 0;
+    if (keystate[SDL_SCANCODE_W]) keys |= ENGINE_KEY_FORWARD;
+    if (keystate[SDL_SCANCODE_S]) keys |= ENGINE_KEY_BACKWARD;
+    if (keystate[SDL_SCANCODE_A]) keys |= ENGINE_KEY_LEFT;
+    if (keystate[SDL_SCANCODE_D]) keys |= ENGINE_KEY_RIGHT;
+    return keys;
+}
+
+// Move and turn a player by the held movement keys, with collision detection
+static void engine_step_player(const Map *map, Player *player, int keys, double deltaTime) {
+    // Forward and backward together cancel, as do left and right
+    double step = (((keys & ENGINE_KEY_FORWARD) != 0) - ((keys & ENGINE_KEY_BACKWARD) != 0)) *
+                  player->moveSpeed * deltaTime;
+    double turn = (((keys & ENGINE_KEY_LEFT) != 0) - ((keys & ENGINE_KEY_RIGHT) != 0)) *
+                  player->rotSpeed * deltaTime;
+    
+    // Move along the direction, sliding along any wall in the way
+    if (step != 0.0) {
+        agent_sweep(map, ENGINE_PLAYER_RADIUS, &player->posX, &player->posY,
+                    player->dirX * step, player->dirY * step);
+    }
+    
+    // Rotate the direction and the camera plane, counter-clockwise for left
+    if (turn != 0.0) {
+        double cosTurn = cos(turn);
+        double sinTurn = sin(turn);
         
-        // Rotate direction vector
-        player->dirX = player->dirX * cos(rotSpeed) - player->dirY * sin(rotSpeed);
-        player->dirY = oldDirX * sin(rotSpeed) + player->dirY * cos(rotSpeed);
+        double oldDirX = player->dirX;
+        player->dirX = player->dirX * cosTurn - player->dirY * sinTurn;
+        player->dirY = oldDirX * sinTurn + player->dirY * cosTurn;
         
-        // Rotate camera plane
         double oldPlaneX = player->planeX;
-        player->planeX = player->planeX * cos(rotSpeed) - player->planeY * sin(rotSpeed);
-        player->planeY = oldPlaneX * sin(rotSpeed) + player->planeY * cos(rotSpeed);
+        player->planeX = player->planeX * cosTurn - player->planeY * sinTurn;
+        player->planeY = oldPlaneX * sinTurn + player->planeY * cosTurn;
     }
 }
 
-// Draw a textured vertical line
-static void engine_draw_textured_line(Engine *engine, int x, int drawStart, int drawEnd, 
-                             double wallX, int texNum, double perpWallDist, int side) {
-    // Ensure valid texture number
-    if (texNum < 0 || texNum >= NUM_TEXTURES || !engine->textures.textures[texNum]) {
-        return;
+// Fill rows [yStart, yEnd] of framebuffer column x with a solid color
+static void engine_fill_column(Uint32 *pixels, int pitch, int x, int yStart, int yEnd, Uint32 color) {
+    Uint32 *pixel = pixels + yStart * pitch + x;
+    for (int y = yStart; y <= yEnd; y++) {
+        *pixel = color;
+        pixel += pitch;
+    }
+}
+
+// Direction of the ray through column x of a view width columns wide
+static void engine_column_ray(const Player *player, int x, int width, double *rayDirX, double *rayDirY) {
+    double cameraX = 2.0 * x / (double)width - 1.0; // x-coordinate in camera space
+    *rayDirX = player->dirX + player->planeX * cameraX;
+    *rayDirY = player->dirY + player->planeY * cameraX;
+}
+
+// Write ceiling, wall slice and floor of screen column x for a traced ray; the
+// ceiling covers rows [0, *ceilingRows) and the floor rows [*floorStart, height),
+// which are left to the floor pass when the view casts floors; returns the
+// number of wall texels read
+static int engine_draw_column(const RenderView *view, int x, const RayHit *hit, int *ceilingRows, int *floorStart) {
+    Uint32 *pixels = view->pixels;
+    const int pitch = view->pitch;
+    const int height = view->height;
+    const Uint32 ceilingColor = view->ceilingColor;
+    const Uint32 floorColor = view->floorColor;
+    
+    // Sprites are drawn wherever they are nearer than the wall
+    if (view->wallDepth) {
+        view->wallDepth[x] = hit->hit ? (float)hit->perpWallDist : INFINITY;
     }
     
-    // Texture X coordinate
-    int texX = (int)(wallX * (double)TEX_WIDTH);
-    
-    // Flip texture coordinate for correct direction
-    if ((side == 0 && perpWallDist > 0) || (side == 1 && perpWallDist < 0)) {
-        texX = TEX_WIDTH - texX - 1;
+    // Columns without a wall only show ceiling and floor
+    if (!hit->hit) {
+        *ceilingRows = height / 2;
+        *floorStart = height / 2;
+        if (!view->floors) {
+            engine_fill_column(pixels, pitch, x, 0, height / 2 - 1, ceilingColor);
+            engine_fill_column(pixels, pitch, x, height / 2, height - 1, floorColor);
+        }
+        return 0;
     }
     
-    // Height of the wall slice to draw
-    int lineHeight = drawEnd - drawStart;
+    // Calculate lowest and highest pixel to fill in current stripe
+    int lineHeight = hit->lineHeight;
+    int drawStart = -lineHeight / 2 + height / 2;
+    if (drawStart < 0) drawStart = 0;
+    
+    int drawEnd = lineHeight / 2 + height / 2;
+    if (drawEnd >= height) drawEnd = height - 1;
     
-    // Draw the vertical textured line
-    SDL_Rect srcRect = { texX, 0, 1, TEX_HEIGHT };
-    SDL_Rect dstRect = { x, drawStart, 1, lineHeight };
+    // Write ceiling, wall slice and floor of this column; the ceiling ends
+    // where the wall starts, the floor starts at the horizon or below the wall
+    *ceilingRows = drawStart;
+    *floorStart = drawEnd + 1 > height / 2 ? drawEnd + 1 : height / 2;
+    if (!view->floors) {
+        engine_fill_column(pixels, pitch, x, 0, drawStart - 1, ceilingColor);
+    }
     
-    // Adjust brightness based on side and distance
-    int alpha = 255;
-    if (side == 1) {
-        alpha = 192; // Make y-sides slightly darker
+    // The face the ray entered the tile through picks the light level
+    double rayDirX, rayDirY;
+    engine_column_ray(view->player, x, view->width, &rayDirX, &rayDirY);
+    int face = hit->side == 0 ? (rayDirX > 0 ? MAP_FACE_X_MIN : MAP_FACE_X_MAX)
+                              : (rayDirY > 0 ? MAP_FACE_Y_MIN : MAP_FACE_Y_MAX);
+    const Uint32 *shades = view->colormap[lighting_face_level(view->map, hit->mapX, hit->mapY, hit->side, face)];
+    int texels = 0;
+    if (view->textured) {
+        engine_draw_wall_texture(view, x, drawStart, drawEnd, hit, face, shades);
+        texels = drawEnd - drawStart + 1;
+    } else {
+        int entry = engine_wall_color_entry(map_get(view->map, hit->mapX, hit->mapY));
+        engine_fill_column(pixels, pitch, x, drawStart, drawEnd, shades[entry]);
+    }
+    if (!view->floors) {
+        engine_fill_column(pixels, pitch, x, *floorStart, height - 1, floorColor);
+    }
+    return texels;
+}
+
+// Sample the wall texture into rows [drawStart, drawEnd] of screen column x,
+// shaded through the colormap row of the face's light level
+static void engine_draw_wall_texture(const RenderView *view, int x, int drawStart, int drawEnd, const RayHit *hit,
+                                     int face, const Uint32 *shades) {
+    // Tiles are 1-indexed, textures repeat for tile values past NUM_TEXTURES
+    int tile = map_get(view->map, hit->mapX, hit->mapY);
+    const WallTexture *texture = &view->engine->textures.walls[(tile - 1) % NUM_TEXTURES];
+    
+    // Far walls read a smaller level, so neighbouring pixels read neighbouring texels
+    int lineHeight = hit->lineHeight > 0 ? hit->lineHeight : 1;
+    int level = view->mipmapping ? texture_select_level(texture, lineHeight) : 0;
+    int texWidth = texture->width >> level;
+    int texHeight = texture->height >> level;
+    
+    // Mirror the texture on faces seen from the other side so it never reads backwards
+    int texX = (int)(hit->wallX * texWidth);
+    if (face == MAP_FACE_X_MIN || face == MAP_FACE_Y_MAX) {
+        texX = texWidth - texX - 1;
+    }
+    const Uint8 *column = texture_index_column(texture, level, texX);
+    
+    // Walk down the texel column in 16.16 fixed point from the first visible row
+    Sint64 step = ((Sint64)texHeight << 16) / lineHeight;
+    Sint64 pos = (Sint64)(drawStart - view->height / 2 + lineHeight / 2) * step;
+    int mask = texHeight - 1;
+    
+    Uint32 *pixel = view->pixels + drawStart * view->pitch + x;
+    for (int y = drawStart; y <= drawEnd; y++) {
+        *pixel = shades[column[(pos >> 16) & mask]];
+        pixel += view->pitch;
+        pos += step;
     }
+}
+
+// Set up the floor rows of a frame: row distance, world positions and mip level
+static void engine_setup_scanlines(const RenderView *view, FloorScanline *scanlines) {
+    const WallTexture *texture = &view->engine->textures.walls[0];
     
-    // Apply distance fog effect
-    if (perpWallDist > 5.0) {
-        alpha = (int)(alpha * (10.0 - perpWallDist) / 5.0);
-        if (alpha < 0) alpha = 0;
+    for (int y = view->height / 2; y < view->height; y++) {
+        FloorScanline *scanline = &scanlines[y - view->height / 2];
+        floorcast_setup_row(view->player, y, view->width, view->height, &scanline->row);
+        
+        // One level for the whole row, from the texels between neighbouring pixels;
+        // every texture has the same size, so texel offsets work for all of them
+        int level = 0;
+        if (view->mipmapping) {
+            Uint32 stepX = (Uint32)abs(scanline->row.stepX);
+            Uint32 stepY = (Uint32)abs(scanline->row.stepY);
+            Uint32 step = stepX > stepY ? stepX : stepY;
+            if (step > 0xFFFFFFFFu / TEX_WIDTH) step = 0xFFFFFFFFu / TEX_WIDTH;
+            level = texture_select_footprint_level(texture, step * TEX_WIDTH);
+        }
+        scanline->level = level;
+        scanline->texShiftX = 0;
+        scanline->texShiftY = 0;
+        while ((texture->width >> level) > (1 << scanline->texShiftX)) scanline->texShiftX++;
+        while ((texture->height >> level) > (1 << scanline->texShiftY)) scanline->texShiftY++;
+    }
+}
+
+// Cast floor row y and its mirrored ceiling row over count columns from xStart,
+// only where the columns' walls leave them uncovered; from row fullFloor and
+// fullCeiling on, every column needs the floor and ceiling
+static void engine_draw_floor_row(const RenderView *view, int y, int xStart, int count,
+                                  int fullFloor, int fullCeiling) {
+    const Map *map = view->map;
+    const WallTexture *textures = view->engine->textures.walls;
+    const FloorScanline *scanline = &view->scanlines[y - view->height / 2];
+    const int *floorStart = view->floorStart + xStart;
+    const int *ceilingRows = view->ceilingRows + xStart;
+    
+    Sint32 tiles[FLOOR_SPAN_COLUMNS];
+    Sint32 texels[FLOOR_SPAN_COLUMNS];
+    floorcast_span(map, &scanline->row, xStart, count, scanline->texShiftX, scanline->texShiftY, tiles, texels);
+    
+    const Uint8 *levelIndices[NUM_TEXTURES];
+    for (int t = 0; t < NUM_TEXTURES; t++) {
+        levelIndices[t] = texture_index_column(&textures[t], scanline->level, 0);
     }
     
-    // Set the blending mode and alpha
-    SDL_SetTextureAlphaMod(engine->textures.textures[texNum], alpha);
+    Uint32 *floorPixel = view->pixels + y * view->pitch + xStart;
+    if (y >= fullFloor) {
+        for (int i = 0; i < count; i++) {
+            floorPixel[i] = engine_plane_texel(view, map->floor, tiles[i], texels[i], levelIndices, ENGINE_FLOOR_ENTRY);
+        }
+    } else {
+        for (int i = 0; i < count; i++) {
+            if (y >= floorStart[i]) {
+                floorPixel[i] = engine_plane_texel(view, map->floor, tiles[i], texels[i], levelIndices, ENGINE_FLOOR_ENTRY);
+            }
+        }
+    }
     
-    // Render the texture line
-    SDL_RenderCopy(engine->renderer, engine->textures.textures[texNum], &srcRect, &dstRect);
+    // The ceiling row as far above the horizon sees the same tiles and texels
+    int ceilingY = view->height - 1 - y;
+    Uint32 *ceilingPixel = view->pixels + ceilingY * view->pitch + xStart;
+    if (y >= fullCeiling) {
+        for (int i = 0; i < count; i++) {
+            ceilingPixel[i] = engine_plane_texel(view, map->ceiling, tiles[i], texels[i], levelIndices,
+                                                 ENGINE_CEILING_ENTRY);
+        }
+    } else {
+        for (int i = 0; i < count; i++) {
+            if (ceilingY < ceilingRows[i]) {
+                ceilingPixel[i] = engine_plane_texel(view, map->ceiling, tiles[i], texels[i], levelIndices,
+                                                     ENGINE_CEILING_ENTRY);
+            }
+        }
+    }
 }
 
-// Render the current scene using raycasting
-void engine_render_scene(Engine *engine) {
-    // Draw ceiling (top half of screen)
-    SDL_SetRenderDrawColor(engine->renderer, 100, 100, 170, 255);  // Sky blue color
-    SDL_Rect ceilingRect = {0, 0, SCREEN_WIDTH, SCREEN_HEIGHT / 2};
-    SDL_RenderFillRect(engine->renderer, &ceilingRect);
-    
-    // Draw floor (bottom half of screen)
-    SDL_SetRenderDrawColor(engine->renderer, 80, 80, 80, 255);  // Floor gray color
-    SDL_Rect floorRect = {0, SCREEN_HEIGHT / 2, SCREEN_WIDTH, SCREEN_HEIGHT / 2};
-    SDL_RenderFillRect(engine->renderer, &floorRect);
-    
-    // Get player pointer for convenience
-    Player *player = &engine->player;
-    
-    // For each vertical column of the screen
-    for (int x = 0; x < SCREEN_WIDTH; x++) {
-        // Calculate ray position and direction
-        double cameraX = 2.0 * x / (double)SCREEN_WIDTH - 1.0; // x-coordinate in camera space
-        double rayDirX = player->dirX + player->planeX * cameraX;
-        double rayDirY = player->dirY + player->planeY * cameraX;
-        
-        // Which box of the map we're in
-        int mapX = (int)player->posX;
-        int mapY = (int)player->posY;
-        
-        // Length of ray from current position to next x or y-side
-        double sideDistX;
-        double sideDistY;
-        
-        // Length of ray from one x or y-side to next x or y-side
-        double deltaDistX = fabs(1.0 / rayDirX);
-        double deltaDistY = fabs(1.0 / rayDirY);
-        double perpWallDist;
-        
-        // Direction to step in x or y direction (either +1 or -1)
-        int stepX;
-        int stepY;
-        
-        // Was a wall hit?
-        int hit = 0;
-        // Was it a NS or EW wall?
-        int side;
-        
-        // Calculate step and initial sideDist
-        if (rayDirX < 0) {
-            stepX = -1;
-            sideDistX = (player->posX - mapX) * deltaDistX;
-        } else {
-            stepX = 1;
-            sideDistX = (mapX + 1.0 - player->posX) * deltaDistX;
+// Thread pool task: cast FLOOR_BAND_ROWS floor rows below the horizon and the
+// ceiling rows mirrored above it
+static void engine_render_floor_band(void *context, int bandIndex, int workerIndex) {
+    (void)workerIndex;
+    const RenderView *view = (const RenderView*)context;
+    const int height = view->height;
+    
+    int yStart = height / 2 + bandIndex * FLOOR_BAND_ROWS;
+    int yEnd = yStart + FLOOR_BAND_ROWS < height ? yStart + FLOOR_BAND_ROWS : height;
+    
+    // Spans of FLOOR_SPAN_COLUMNS, or the tiles rendered when only some are;
+    // each pixel's floor position does not depend on where its span starts
+    int spanCount = view->tiles ? view->tileCount : (view->width + FLOOR_SPAN_COLUMNS - 1) / FLOOR_SPAN_COLUMNS;
+    for (int span = 0; span < spanCount; span++) {
+        int xStart = view->tiles ? view->tiles[span] * RENDER_TILE_COLUMNS : span * FLOOR_SPAN_COLUMNS;
+        int spanColumns = view->tiles ? RENDER_TILE_COLUMNS : FLOOR_SPAN_COLUMNS;
+        int count = view->width - xStart < spanColumns ? view->width - xStart : spanColumns;
+        
+        // Rows above the lowest wall end of every column in the span need no work at all;
+        // below the highest one, no column has to be checked
+        int firstRow = height;
+        int fullFloor = 0;
+        int fullCeiling = 0;
+        for (int x = xStart; x < xStart + count; x++) {
+            int ceilingStart = height - view->ceilingRows[x];
+            if (view->floorStart[x] < firstRow) firstRow = view->floorStart[x];
+            if (ceilingStart < firstRow) firstRow = ceilingStart;
+            if (view->floorStart[x] > fullFloor) fullFloor = view->floorStart[x];
+            if (ceilingStart > fullCeiling) fullCeiling = ceilingStart;
         }
         
-        if (rayDirY < 0) {
-            stepY = -1;
-            sideDistY = (player->posY - mapY) * deltaDistY;
-        } else {
-            stepY = 1;
-            sideDistY = (mapY + 1.0 - player->posY) * deltaDistY;
+        for (int y = yStart > firstRow ? yStart : firstRow; y < yEnd; y++) {
+            engine_draw_floor_row(view, y, xStart, count, fullFloor, fullCeiling);
         }
+    }
+}
+
+// Thread pool task: render one tile of RENDER_TILE_COLUMNS columns
+static void engine_render_tile(void *context, int tileIndex, int workerIndex) {
+    const RenderView *view = (const RenderView*)context;
+    const Player *player = view->player;
+    RenderStats *stats = &view->stats[workerIndex];
+    
+    int xStart = (view->tiles ? view->tiles[tileIndex] : tileIndex) * RENDER_TILE_COLUMNS;
+    int xEnd = xStart + RENDER_TILE_COLUMNS;
+    if (xEnd > view->width) {
+        xEnd = view->width;
+    }
+    
+    // While profiling, the ray setup, DDA and column fill times of the tile are added up
+    Uint64 tileStart = view->profiling ? SDL_GetPerformanceCounter() : 0;
+    Uint64 phaseTicks[3] = { 0, 0, 0 };
+    
+    for (int x = xStart; x < xEnd; x += RAY_PACKET_SIZE) {
+        RayHit hits[RAY_PACKET_SIZE];
+        int lanes = xEnd - x < RAY_PACKET_SIZE ? xEnd - x : RAY_PACKET_SIZE;
+        Uint64 setupStart = view->profiling ? SDL_GetPerformanceCounter() : 0;
         
-        // Perform DDA (Digital Differential Analysis)
-        while (hit == 0) {
-            // Jump to next map square
-            if (sideDistX < sideDistY) {
-                sideDistX += deltaDistX;
-                mapX += stepX;
-                side = 0;
+        // Each column's ray: its direction, or its fine angle on the fixed-point path
+        RayPacket packet;
+        Uint32 angles[RAY_PACKET_SIZE];
+        for (int lane = 0; lane < lanes; lane++) {
+            if (view->fixed) {
+                angles[lane] = (view->fixedAngle + (Uint32)view->fixedColumns->angle[x + lane] +
+                                (1u << (RAY_FIXED_ANGLE_FRACTION - 1))) >> RAY_FIXED_ANGLE_FRACTION;
             } else {
-                sideDistY += deltaDistY;
-                mapY += stepY;
-                side = 1;
+                packet.posX[lane] = player->posX;
+                packet.posY[lane] = player->posY;
+                engine_column_ray(player, x + lane, view->width, &packet.dirX[lane], &packet.dirY[lane]);
             }
-            
-            // Check if ray has hit a wall
-            if (mapX < 0 || mapX >= engine->map.width || mapY < 0 || mapY >= engine->map.height) {
-                // Out of bounds, break loop
-                break;
+        }
+        Uint64 ddaStart = view->profiling ? SDL_GetPerformanceCounter() : 0;
+        
+        if (view->fixed) {
+            // Integer DDA, each column's ray from the view angle and its table entries
+            for (int lane = 0; lane < lanes; lane++) {
+                raycaster_cast_fixed(view->map, view->fixedPosX, view->fixedPosY, angles[lane],
+                                     view->fixedColumns->scale[x + lane], view->height, &hits[lane]);
             }
-            
-            if (engine->map.data[mapY][mapX] > 0) {
-                hit = 1;
+        } else if (view->packets && lanes == RAY_PACKET_SIZE) {
+            // Neighbouring columns are coherent, trace them together
+            packet.projHeight = view->height;
+            packet.maxDist = INFINITY;
+            raycaster_cast_packet(view->map, &packet, hits);
+        } else {
+            for (int lane = 0; lane < lanes; lane++) {
+                raycaster_cast(view->map, player->posX, player->posY, packet.dirX[lane], packet.dirY[lane],
+                               view->height, &hits[lane]);
             }
         }
+        Uint64 fillStart = view->profiling ? SDL_GetPerformanceCounter() : 0;
         
-        // Calculate distance projected on camera direction
-        if (!hit) {
-            continue;  // Skip this ray if we didn't hit anything
+        for (int lane = 0; lane < lanes; lane++) {
+            int ceilingRows, floorStart;
+            stats->texels += engine_draw_column(view, x + lane, &hits[lane], &ceilingRows, &floorStart);
+            stats->ddaSteps += hits[lane].steps;
+            if (view->floors) {
+                view->ceilingRows[x + lane] = ceilingRows;
+                view->floorStart[x + lane] = floorStart;
+            }
         }
+        stats->columns += lanes;
         
-        if (side == 0) {
-            perpWallDist = (mapX - player->posX + (1 - stepX) / 2) / rayDirX;
-        } else {
-            perpWallDist = (mapY - player->posY + (1 - stepY) / 2) / rayDirY;
+        if (view->profiling) {
+            phaseTicks[0] += ddaStart - setupStart;
+            phaseTicks[1] += fillStart - ddaStart;
+            phaseTicks[2] += SDL_GetPerformanceCounter() - fillStart;
+        }
+    }
+    
+    // The phases interleave column by column, so each is shown as one span of
+    // its total time, one after the other inside the tile
+    if (view->profiling) {
+        static const char *const phaseNames[3] = { "ray setup", "dda", "column fill" };
+        int thread = PROFILER_THREAD_WORKERS + workerIndex;
+        Uint64 phaseStart = tileStart;
+        profiler_record(view->profiler, thread, "tile", PROFILER_SCOPE, tileStart,
+                        SDL_GetPerformanceCounter() - tileStart);
+        for (int i = 0; i < 3; i++) {
+            profiler_record(view->profiler, thread, phaseNames[i], PROFILER_SCOPE, phaseStart, phaseTicks[i]);
+            phaseStart += phaseTicks[i];
+        }
+    }
+}
+
+// Thread pool task: draw the visible sprites over SPRITE_BAND_COLUMNS columns,
+// back to front, wherever they are nearer than the column's wall
+static void engine_render_sprite_band(void *context, int bandIndex, int workerIndex) {
+    const RenderView *view = (const RenderView*)context;
+    RenderStats *stats = &view->stats[workerIndex];
+    const EntityStore *entities = view->entities;
+    const EntityView *sprites = view->sprites;
+    const Player *player = view->player;
+    
+    int xStart = bandIndex * SPRITE_BAND_COLUMNS;
+    int xEnd = xStart + SPRITE_BAND_COLUMNS < view->width ? xStart + SPRITE_BAND_COLUMNS : view->width;
+    
+    // A sprite is one tile wide and as high as a wall at the same depth
+    double planeLength = sqrt(player->planeX * player->planeX + player->planeY * player->planeY);
+    double columnsPerTile = view->width / (2.0 * planeLength);
+    
+    for (int i = 0; i < sprites->count; i++) {
+        float depth = sprites->depth[i];
+        int left, spriteWidth;
+        engine_sprite_span(columnsPerTile, sprites->screenX[i], depth, &left, &spriteWidth);
+        int first = left > xStart ? left : xStart;
+        int last = left + spriteWidth < xEnd ? left + spriteWidth : xEnd;
+        if (first >= last) {
+            continue;
         }
         
-        // Calculate height of line to draw on screen
-        int lineHeight = (int)(SCREEN_HEIGHT / perpWallDist);
+        int entity = sprites->index[i];
+        const WallTexture *texture = &view->engine->textures.sprites[entities->sprite[entity] % NUM_SPRITES];
+        int spriteHeight = (int)(view->height / depth);
+        if (spriteHeight < 1) spriteHeight = 1;
+        int level = view->mipmapping ? texture_select_level(texture, spriteHeight) : 0;
+        int texWidth = texture->width >> level;
+        int texHeight = texture->height >> level;
         
-        // Calculate lowest and highest pixel to fill in current stripe
-        int drawStart = -lineHeight / 2 + SCREEN_HEIGHT / 2;
+        int drawStart = -spriteHeight / 2 + view->height / 2;
         if (drawStart < 0) drawStart = 0;
+        int drawEnd = spriteHeight / 2 + view->height / 2;
+        if (drawEnd >= view->height) drawEnd = view->height - 1;
+        Sint64 step = ((Sint64)texHeight << 16) / spriteHeight;
+        Sint64 startPos = (Sint64)(drawStart - view->height / 2 + spriteHeight / 2) * step;
+        int mask = texHeight - 1;
         
-        int drawEnd = lineHeight / 2 + SCREEN_HEIGHT / 2;
-        if (drawEnd >= SCREEN_HEIGHT) drawEnd = SCREEN_HEIGHT - 1;
-        
-        // Choose wall color
-        SDL_Color wallColor;
-        engine_get_wall_color(engine, engine->map.data[mapY][mapX], side, &wallColor);
+        // Lit like the floor under it
+        size_t tile = map_tile_index(view->map, (int)entities->posX[entity], (int)entities->posY[entity]);
+        const Uint32 *shades = view->colormap[lighting_tile_level(view->map, tile)];
         
-        // Draw the vertical line
-        SDL_SetRenderDrawColor(engine->renderer, wallColor.r, wallColor.g, wallColor.b, wallColor.a);
-        SDL_RenderDrawLine(engine->renderer, x, drawStart, x, drawEnd);
+        for (int x = first; x < last; x++) {
+            if (depth >= view->wallDepth[x] || (view->dirty && !view->dirty[x / RENDER_TILE_COLUMNS])) {
+                continue;
+            }
+            int texX = (int)((Sint64)(x - left) * texWidth / spriteWidth);
+            const Uint8 *column = texture_index_column(texture, level, texX);
+            stats->texels += drawEnd - drawStart + 1;
+            Sint64 pos = startPos;
+            Uint32 *pixel = view->pixels + drawStart * view->pitch + x;
+            for (int y = drawStart; y <= drawEnd; y++) {
+                Uint8 entry = column[(pos >> 16) & mask];
+                if (entry != TEXTURE_CLEAR_ENTRY) {
+                    *pixel = shades[entry];
+                }
+                pixel += view->pitch;
+                pos += step;
+            }
+        }
+    }
+}
+
+// Thread pool task: trace ENGINE_RAY_BATCH rays of a query
+static void engine_cast_ray_batch(void *context, int batchIndex, int workerIndex) {
+    (void)workerIndex;
+    const RayQuery *query = (const RayQuery*)context;
+    int first = batchIndex * ENGINE_RAY_BATCH;
+    int last = first + ENGINE_RAY_BATCH < query->count ? first + ENGINE_RAY_BATCH : query->count;
+    
+    for (int i = first; i < last; i += RAY_PACKET_SIZE) {
+        RayHit hits[RAY_PACKET_SIZE];
+        int lanes = last - i < RAY_PACKET_SIZE ? last - i : RAY_PACKET_SIZE;
         
-        // For texture mapping, calculate where the wall was hit
-        double wallX;
-        if (side == 0) {
-            wallX = player->posY + perpWallDist * rayDirY;
+        if (query->packets && lanes == RAY_PACKET_SIZE) {
+            // Rays of a query need not be coherent; lanes that finish early idle until the packet is done
+            RayPacket packet;
+            for (int lane = 0; lane < lanes; lane++) {
+                packet.posX[lane] = query->origins[i + lane].x;
+                packet.posY[lane] = query->origins[i + lane].y;
+                packet.dirX[lane] = query->dirs[i + lane].x;
+                packet.dirY[lane] = query->dirs[i + lane].y;
+            }
+            packet.projHeight = 0.0;
+            packet.maxDist = query->maxDist;
+            raycaster_cast_packet(query->map, &packet, hits);
         } else {
-            wallX = player->posX + perpWallDist * rayDirX;
+            for (int lane = 0; lane < lanes; lane++) {
+                raycaster_cast_range(query->map, query->origins[i + lane].x, query->origins[i + lane].y,
+                                     query->dirs[i + lane].x, query->dirs[i + lane].y, query->maxDist, &hits[lane]);
+            }
         }
-        wallX -= floor(wallX);  // Only fractional part
         
-        // For textured version (uncomment if you want to use textures)
-        // int texNum = engine->map.data[mapY][mapX] - 1;  // 1-indexed to 0-indexed for texture
-        // engine_draw_textured_line(engine, x, drawStart, drawEnd, wallX, texNum, perpWallDist, side);
+        for (int lane = 0; lane < lanes; lane++) {
+            const RayVector *origin = &query->origins[i + lane];
+            const RayVector *dir = &query->dirs[i + lane];
+            RayResult *result = &query->results[i + lane];
+            result->hit = hits[lane].hit;
+            result->mapX = hits[lane].mapX;
+            result->mapY = hits[lane].mapY;
+            result->side = hits[lane].side;
+            result->distance = hits[lane].hit ? hits[lane].perpWallDist : query->maxDist;
+            
+            // An axis the ray does not move along keeps its coordinate, even at infinite range
+            result->hitX = dir->x != 0.0 ? origin->x + dir->x * result->distance : origin->x;
+            result->hitY = dir->y != 0.0 ? origin->y + dir->y * result->distance : origin->y;
+        }
+    }
+}
+
+// Fill in the settings a frame's view takes from the engine: which map is
+// traced, how walls, floors and sprites are drawn, and the worker counters
+static void engine_setup_view(Engine *engine, RenderView *view) {
+    memset(view, 0, sizeof(RenderView));
+    view->engine = engine;
+    view->map = engine->map;
+    view->packets = engine->rayPackets;
+    view->fixed = engine->fixedPoint && engine->map->width <= RAY_FIXED_MAX_MAP &&
+                  engine->map->height <= RAY_FIXED_MAX_MAP;
+    view->textured = engine->texturedWalls;
+    view->colormap = (const Uint32 (*)[LIGHTING_COLORS])engine->textures.colormap;
+    view->mipmapping = engine->mipmapping;
+    view->floors = engine->texturedFloors && engine->map->width <= FLOORCAST_MAX_COORD &&
+                   engine->map->height <= FLOORCAST_MAX_COORD;
+    
+    // Ceiling and floor colors (sky blue and gray)
+    view->ceilingColor = 0xFF000000u | engineFlatColors[ENGINE_CEILING_ENTRY];
+    view->floorColor = 0xFF000000u | engineFlatColors[ENGINE_FLOOR_ENTRY];
+    
+    view->entities = engine->entities;
+    view->stats = engine->renderStats;
+    view->profiler = engine->profiler;
+}
+
+// Thread pool task: render one view of a batch whole: walls, floors and sprites
+static void engine_render_view_task(void *context, int viewIndex, int workerIndex) {
+    const ViewBatch *batch = (const ViewBatch*)context;
+    const EngineView *target = &batch->views[viewIndex];
+    ViewScratch *scratch = &batch->scratch[workerIndex];
+    const Player *camera = &target->camera;
+    
+    RenderView view = *batch->base;
+    view.player = camera;
+    view.pixels = target->pixels;
+    view.pitch = target->pitch;
+    view.width = target->width;
+    view.height = target->height;
+    
+    // Views of the same size and field of view reuse the worker's column tables
+    view.fixed = view.fixed && raycaster_fixed_columns_update(&scratch->fixedColumns, camera, view.width);
+    view.fixedColumns = &scratch->fixedColumns;
+    view.fixedPosX = (Sint32)floor(camera->posX * 65536.0);
+    view.fixedPosY = (Sint32)floor(camera->posY * 65536.0);
+    view.fixedAngle = raycaster_fixed_view_angle(camera->dirX, camera->dirY);
+    
+    int scanlineCount = view.height - view.height / 2;
+    view.scanlines = (const FloorScanline*)scratch->floorState;
+    view.ceilingRows = view.floors ? (int*)((FloorScanline*)scratch->floorState + scanlineCount) : NULL;
+    view.floorStart = view.floors ? view.ceilingRows + view.width : NULL;
+    view.wallDepth = scratch->wallDepth;
+    view.sprites = &scratch->sprites;
+    
+    // The same passes as engine_render_scene, one after another on this worker
+    int tileCount = (view.width + RENDER_TILE_COLUMNS - 1) / RENDER_TILE_COLUMNS;
+    for (int i = 0; i < tileCount; i++) {
+        engine_render_tile(&view, i, workerIndex);
+    }
+    
+    if (view.floors) {
+        engine_setup_scanlines(&view, (FloorScanline*)scratch->floorState);
+        int bandCount = (scanlineCount + FLOOR_BAND_ROWS - 1) / FLOOR_BAND_ROWS;
+        for (int i = 0; i < bandCount; i++) {
+            engine_render_floor_band(&view, i, workerIndex);
+        }
+    }
+    
+    if (view.wallDepth &&
+        entity_cull(view.engine->entities, view.map, camera, view.width, &scratch->sprites) > 0) {
+        entity_sort(&scratch->sprites);
+        int bandCount = (view.width + SPRITE_BAND_COLUMNS - 1) / SPRITE_BAND_COLUMNS;
+        for (int i = 0; i < bandCount; i++) {
+            engine_render_sprite_band(&view, i, workerIndex);
+        }
+    }
+}
+
+// Size the render cache's buffers for width x height frames, keeping them
+// while the size is unchanged; returns 0 when out of memory
+static int engine_reserve_cache(RenderCache *cache, int width, int height) {
+    if (cache->depth && cache->width == width && cache->height == height) {
+        return 1;
+    }
+    
+    free(cache->depth);
+    free(cache->floorState);
+    free(cache->dirty);
+    free(cache->tiles);
+    int tileCount = (width + RENDER_TILE_COLUMNS - 1) / RENDER_TILE_COLUMNS;
+    int scanlineCount = height - height / 2;
+    cache->depth = (float*)malloc(width * sizeof(float));
+    cache->floorState = malloc(scanlineCount * sizeof(FloorScanline) + 2 * width * sizeof(int));
+    cache->dirty = (Uint8*)malloc(tileCount);
+    cache->tiles = (int*)malloc(tileCount * sizeof(int));
+    cache->valid = 0;
+    if (!cache->depth || !cache->floorState || !cache->dirty || !cache->tiles) {
+        fprintf(stderr, "Failed to allocate the render cache for %dx%d!\n", width, height);
+        free(cache->depth);
+        free(cache->floorState);
+        free(cache->dirty);
+        free(cache->tiles);
+        memset(cache, 0, sizeof(RenderCache));
+        return 0;
+    }
+    cache->width = width;
+    cache->height = height;
+    return 1;
+}
+
+// Settings a frame is rendered with, as bits; frames with other settings look different
+static int engine_render_settings(const Engine *engine) {
+    return (engine->rayPackets ? 1 : 0) | (engine->fixedPoint ? 2 : 0) | (engine->emptySkipping ? 4 : 0) |
+           (engine->texturedWalls ? 8 : 0) | (engine->texturedFloors ? 16 : 0) | (engine->mipmapping ? 32 : 0) |
+           (engine->map->floor ? 64 : 0);
+}
+
+// Start timing a frame: the time since the last one goes to the overlay; returns the start counter
+static Uint64 engine_start_frame(Engine *engine) {
+    Uint64 start = SDL_GetPerformanceCounter();
+    double frequency = (double)SDL_GetPerformanceFrequency();
+    engine->lastFrameMs = engine->lastFrameStart ? (start - engine->lastFrameStart) * 1000.0 / frequency : 0.0;
+    engine->lastFrameStart = start;
+    hud_add_frame(&engine->hud, engine->lastFrameMs);
+    return start;
+}
+
+// Render the frame started at start into the framebuffer: every tile, or with
+// partial set only the tiles the render cache lists, the others keeping what
+// the last frame left there
+static void engine_render_frame(Engine *engine, int partial, Uint64 start) {
+    RenderCache *cache = engine->renderCache;
+    
+    // Without skipping, rays trace a view of the map that has no distance field
+    Map plainMap = *engine->map;
+    plainMap.distance = NULL;
+    
+    RenderView view;
+    engine_setup_view(engine, &view);
+    view.map = engine->emptySkipping ? engine->map : &plainMap;
+    view.floors = view.floors && view.map->floor != NULL;
+    view.player = &engine->player;
+    view.pixels = engine->framebuffer;
+    view.pitch = engine->renderWidth;
+    view.width = engine->renderWidth;
+    view.height = engine->renderHeight;
+    
+    // The fixed-point path needs 16.16 positions and the column tables for this view
+    view.fixed = view.fixed && raycaster_fixed_columns_update(engine->fixedColumns, &engine->player, view.width);
+    view.fixedColumns = engine->fixedColumns;
+    view.fixedPosX = (Sint32)floor(engine->player.posX * 65536.0);
+    view.fixedPosY = (Sint32)floor(engine->player.posY * 65536.0);
+    view.fixedAngle = raycaster_fixed_view_angle(engine->player.dirX, engine->player.dirY);
+    
+    // The floor state (one scanline per row below the horizon, two rows per
+    // column) and every column's wall distance are kept in the render cache,
+    // where the next frame finds those of the columns it does not render
+    int scanlineCount = view.height - view.height / 2;
+    int cached = engine_reserve_cache(cache, view.width, view.height);
+    view.floors = view.floors && cached;
+    view.scanlines = cached ? (const FloorScanline*)cache->floorState : NULL;
+    view.ceilingRows = view.floors ? (int*)((FloorScanline*)cache->floorState + scanlineCount) : NULL;
+    view.floorStart = view.floors ? view.ceilingRows + view.width : NULL;
+    if (partial) {
+        view.tiles = cache->tiles;
+        view.tileCount = cache->tileCount;
+        view.dirty = cache->dirty;
+    }
+    
+    // Sprites are clipped against the wall distance of every column
+    view.sprites = engine->visibleEntities;
+    view.wallDepth = cached ? cache->depth : NULL;
+    
+    // Counters are gathered per worker and added up after the frame
+    int workerCount = engine->pool->workerCount;
+    memset(engine->renderStats, 0, workerCount * sizeof(RenderStats));
+    view.profiling = profiler_capturing(engine->profiler);
+    double frequency = (double)SDL_GetPerformanceFrequency();
+    
+    // Columns only read the player and map, so tiles can be rendered in any order
+    int tileCount = partial ? view.tileCount : (view.width + RENDER_TILE_COLUMNS - 1) / RENDER_TILE_COLUMNS;
+    threadpool_run(engine->pool, tileCount, engine_render_tile, &view);
+    
+    // The walls have left each column's floor and ceiling rows; cast those a
+    // band of whole rows at a time, with the row distances computed once; a
+    // partial frame has the pose of the last one and keeps its scanlines
+    Uint64 floorStartTicks = SDL_GetPerformanceCounter();
+    engine->lastFloorPixels = 0;
+    if (view.floors) {
+        for (int x = 0; x < view.width; x++) {
+            if (!partial || view.dirty[x / RENDER_TILE_COLUMNS]) {
+                engine->lastFloorPixels += view.ceilingRows[x] + view.height - view.floorStart[x];
+            }
+        }
+        if (!partial) {
+            engine_setup_scanlines(&view, (FloorScanline*)cache->floorState);
+        }
+        int bandCount = (scanlineCount + FLOOR_BAND_ROWS - 1) / FLOOR_BAND_ROWS;
+        threadpool_run(engine->pool, bandCount, engine_render_floor_band, &view);
+    }
+    
+    // Sprites go over walls and floors: skip whole grid cells outside the view,
+    // sort the rest back to front and draw them in bands of columns; a partial
+    // frame draws the sprites the last one culled over its tiles
+    Uint64 spriteStartTicks = SDL_GetPerformanceCounter();
+    engine->lastSpriteCount = 0;
+    if (view.wallDepth && engine->entities->count > 0) {
+        int visible = partial ? engine->visibleEntities->count :
+                      entity_cull(engine->entities, view.map, view.player, view.width, engine->visibleEntities);
+        if (visible > 0) {
+            if (!partial) {
+                entity_sort(engine->visibleEntities);
+            }
+            int bandCount = (view.width + SPRITE_BAND_COLUMNS - 1) / SPRITE_BAND_COLUMNS;
+            threadpool_run(engine->pool, bandCount, engine_render_sprite_band, &view);
+            engine->lastSpriteCount = visible;
+        }
+    }
+    
+    Uint64 end = SDL_GetPerformanceCounter();
+    engine->lastRenderMs = (end - start) * 1000.0 / frequency;
+    engine->lastFloorMs = (spriteStartTicks - floorStartTicks) * 1000.0 / frequency;
+    engine->lastSpriteMs = (end - spriteStartTicks) * 1000.0 / frequency;
+    
+    // Floor pixels read one texel each when cast
+    engine->lastDdaSteps = 0;
+    engine->lastColumns = 0;
+    engine->lastTexels = view.floors ? (Uint64)engine->lastFloorPixels : 0;
+    for (int i = 0; i < workerCount; i++) {
+        engine->lastDdaSteps += engine->renderStats[i].ddaSteps;
+        engine->lastColumns += engine->renderStats[i].columns;
+        engine->lastTexels += engine->renderStats[i].texels;
+    }
+    engine->lastColumnsReused = view.width - engine->lastColumns;
+    
+    // The frame's passes and counters, on the ring of the thread that rendered it
+    if (view.profiling) {
+        int thread = PROFILER_THREAD_WORKERS;
+        profiler_record(engine->profiler, thread, "walls", PROFILER_SCOPE, start, floorStartTicks - start);
+        profiler_record(engine->profiler, thread, "floors", PROFILER_SCOPE, floorStartTicks,
+                        spriteStartTicks - floorStartTicks);
+        profiler_record(engine->profiler, thread, "sprites", PROFILER_SCOPE, spriteStartTicks, end - spriteStartTicks);
+        profiler_counter(engine->profiler, thread, "dda steps", engine->lastDdaSteps);
+        profiler_counter(engine->profiler, thread, "columns", (Uint64)engine->lastColumns);
+        profiler_counter(engine->profiler, thread, "columns reused", (Uint64)engine->lastColumnsReused);
+        profiler_counter(engine->profiler, thread, "texels", engine->lastTexels);
+    }
+    
+    // What the frame shows, for engine_update_scene to compare the next one with
+    cache->valid = cached;
+    cache->framebuffer = engine->framebuffer;
+    cache->player = engine->player;
+    cache->map = engine->map;
+    cache->damageCount = engine->map->damageCount;
+    cache->entityRevision = engine->entities->revision;
+    cache->settings = engine_render_settings(engine);
+    cache->overlayColumns = 0;
+    engine->frameCount++;
+    
+    // A partial frame says nothing of what a whole one costs
+    if (!partial) {
+        engine_update_render_scale(engine);
+    }
+}
+
+// Mark the tiles of the render cache whose columns show a changed rectangle:
+// those whose ray crossed it before it stopped, and those a sprite standing in it covers
+static void engine_mark_damage(Engine *engine, const MapDamage *damage) {
+    RenderCache *cache = engine->renderCache;
+    const Player *player = &engine->player;
+    
+    // A ray that left the map without a hit shows nothing past its far edge
+    double mapReach = (double)engine->map->width + engine->map->height;
+    for (int x = 0; x < cache->width; x++) {
+        if (cache->dirty[x / RENDER_TILE_COLUMNS]) {
+            continue;
+        }
+        double rayDirX, rayDirY;
+        engine_column_ray(player, x, cache->width, &rayDirX, &rayDirY);
+        double length = sqrt(rayDirX * rayDirX + rayDirY * rayDirY);
+        double reach = cache->depth[x] * length < mapReach ? cache->depth[x] * length : mapReach;
+        double margin = ENGINE_DAMAGE_MARGIN + reach * ENGINE_DAMAGE_SLOPE;
+        if (engine_ray_crosses(player->posX, player->posY, rayDirX / length, rayDirY / length, reach,
+                               damage->x0 - margin, damage->y0 - margin,
+                               damage->x1 + 1 + margin, damage->y1 + 1 + margin)) {
+            cache->dirty[x / RENDER_TILE_COLUMNS] = 1;
+        }
+    }
+    
+    // Sprites are lit like the floor under them
+    const EntityStore *entities = engine->entities;
+    const EntityView *sprites = engine->visibleEntities;
+    if (entities->count == 0 || sprites->count == 0) {
+        return;
+    }
+    double planeLength = sqrt(player->planeX * player->planeX + player->planeY * player->planeY);
+    double columnsPerTile = cache->width / (2.0 * planeLength);
+    for (int i = 0; i < sprites->count; i++) {
+        int entity = sprites->index[i];
+        int tileX = (int)entities->posX[entity];
+        int tileY = (int)entities->posY[entity];
+        if (tileX < damage->x0 || tileX > damage->x1 || tileY < damage->y0 || tileY > damage->y1) {
+            continue;
+        }
+        int left, spriteWidth;
+        engine_sprite_span(columnsPerTile, sprites->screenX[i], sprites->depth[i], &left, &spriteWidth);
+        for (int x = left > 0 ? left : 0; x < left + spriteWidth && x < cache->width; x++) {
+            cache->dirty[x / RENDER_TILE_COLUMNS] = 1;
+        }
+    }
+}
+
+// Check whether the ray from (posX, posY) along the unit direction (dirX, dirY)
+// meets rectangle [x0, x1] x [y0, y1] within reach tiles
+static int engine_ray_crosses(double posX, double posY, double dirX, double dirY, double reach,
+                              double x0, double y0, double x1, double y1) {
+    const double origin[2] = { posX, posY };
+    const double dir[2] = { dirX, dirY };
+    const double low[2] = { x0, y0 };
+    const double high[2] = { x1, y1 };
+    
+    // Clip the ray to the rectangle's slab in each axis in turn
+    double enter = 0.0;
+    double leave = reach;
+    for (int axis = 0; axis < 2; axis++) {
+        if (dir[axis] == 0.0) {
+            if (origin[axis] < low[axis] || origin[axis] > high[axis]) {
+                return 0;
+            }
+            continue;
+        }
+        double t0 = (low[axis] - origin[axis]) / dir[axis];
+        double t1 = (high[axis] - origin[axis]) / dir[axis];
+        if (t0 > t1) {
+            double swap = t0;
+            t0 = t1;
+            t1 = swap;
+        }
+        if (t0 > enter) enter = t0;
+        if (t1 < leave) leave = t1;
+    }
+    return enter <= leave;
+}
+
+// Render the current scene using raycasting into the framebuffer
+void engine_render_scene(Engine *engine) {
+    engine_render_frame(engine, 0, engine_start_frame(engine));
+}
+
+// Bring the framebuffer up to date with the scene, redrawing only what changed
+// since the last frame rendered into it: nothing while the pose, the map, the
+// sprites and the settings stay as they were, and only the columns whose rays
+// crossed tiles the map marked changed (see map_mark_changed) when that is all.
+// Returns the number of columns rendered, 0 when the last frame still stands.
+int engine_update_scene(Engine *engine) {
+    RenderCache *cache = engine->renderCache;
+    const Map *map = engine->map;
+    const Player *player = &engine->player;
+    Uint64 start = engine_start_frame(engine);
+    
+    // Any other change reaches every column, and so do more changed rectangles
+    // than the map remembers
+    int unchanged = cache->valid && cache->framebuffer == engine->framebuffer && cache->map == map &&
+                    cache->width == engine->renderWidth && cache->height == engine->renderHeight &&
+                    cache->player.posX == player->posX && cache->player.posY == player->posY &&
+                    cache->player.dirX == player->dirX && cache->player.dirY == player->dirY &&
+                    cache->player.planeX == player->planeX && cache->player.planeY == player->planeY &&
+                    cache->entityRevision == engine->entities->revision &&
+                    cache->settings == engine_render_settings(engine) &&
+                    map->damageCount - cache->damageCount <= MAP_DAMAGE_LOG;
+    if (!unchanged) {
+        engine_render_frame(engine, 0, start);
+        return engine->lastColumns;
+    }
+    
+    // Tiles the overlay was drawn over, and those whose columns show a change
+    int tileCount = (cache->width + RENDER_TILE_COLUMNS - 1) / RENDER_TILE_COLUMNS;
+    memset(cache->dirty, 0, tileCount);
+    for (int x = 0; x < cache->overlayColumns && x < cache->width; x += RENDER_TILE_COLUMNS) {
+        cache->dirty[x / RENDER_TILE_COLUMNS] = 1;
+    }
+    for (Uint32 i = cache->damageCount; i != map->damageCount; i++) {
+        engine_mark_damage(engine, &map->damage[i % MAP_DAMAGE_LOG]);
+    }
+    cache->tileCount = 0;
+    for (int i = 0; i < tileCount; i++) {
+        if (cache->dirty[i]) {
+            cache->tiles[cache->tileCount++] = i;
+        }
+    }
+    if (cache->tileCount > 0) {
+        engine_render_frame(engine, 1, start);
+        return engine->lastColumns;
+    }
+    
+    // The frame stands as it is; only the counters change
+    cache->damageCount = map->damageCount;
+    engine->lastRenderMs = (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+    engine->lastFloorMs = 0.0;
+    engine->lastFloorPixels = 0;
+    engine->lastSpriteMs = 0.0;
+    engine->lastDdaSteps = 0;
+    engine->lastColumns = 0;
+    engine->lastColumnsReused = cache->width;
+    engine->lastTexels = 0;
+    if (profiler_capturing(engine->profiler)) {
+        profiler_counter(engine->profiler, PROFILER_THREAD_WORKERS, "columns", 0);
+        profiler_counter(engine->profiler, PROFILER_THREAD_WORKERS, "columns reused", (Uint64)cache->width);
+    }
+    return 0;
+}
+
+// Make the next engine_update_scene render the whole frame, after something
+// other than the engine drew into the framebuffer
+void engine_invalidate_scene(Engine *engine) {
+    if (engine->renderCache) {
+        engine->renderCache->valid = 0;
     }
 }
 
-// Main game loop
+// Render count views of the active map in one call, each exactly as
+// engine_render_scene would render its camera at its size. Views are
+// scheduled across the render threads, each rendered whole by one worker, so
+// many small views share the map and textures while they are in cache.
+// Does not touch the framebuffer or the frame counters.
+int engine_render_views(Engine *engine, const EngineView *views, int count) {
+    // Scratch buffers are sized once for the largest view
+    int maxWidth = 0;
+    int maxHeight = 0;
+    for (int i = 0; i < count; i++) {
+        if (!views[i].pixels || views[i].width <= 0 || views[i].height <= 0 || views[i].pitch < views[i].width) {
+            fprintf(stderr, "Invalid view %d: %dx%d, pitch %d\n", i, views[i].width, views[i].height, views[i].pitch);
+            return 0;
+        }
+        if (views[i].width > maxWidth) maxWidth = views[i].width;
+        if (views[i].height > maxHeight) maxHeight = views[i].height;
+    }
+    if (count <= 0) {
+        return count == 0;
+    }
+    
+    // Without skipping, rays trace a view of the map that has no distance field
+    Map plainMap = *engine->map;
+    plainMap.distance = NULL;
+    
+    RenderView base;
+    engine_setup_view(engine, &base);
+    base.map = engine->emptySkipping ? engine->map : &plainMap;
+    base.floors = base.floors && base.map->floor != NULL;
+    base.sprites = NULL;
+    base.wallDepth = NULL;
+    base.profiling = 0;
+    
+    // Workers cull sprites at the same time, so the grid must not need rebuilding in entity_cull
+    int sprites = engine->entities->count > 0;
+    if (sprites && !entity_build_grid(engine->entities, base.map)) {
+        return 0;
+    }
+    
+    int workerCount = engine->pool->workerCount;
+    ViewScratch *scratch = (ViewScratch*)calloc(workerCount, sizeof(ViewScratch));
+    int ok = scratch != NULL;
+    size_t floorBytes = (maxHeight - maxHeight / 2) * sizeof(FloorScanline) + 2 * maxWidth * sizeof(int);
+    for (int i = 0; ok && i < workerCount; i++) {
+        scratch[i].floorState = base.floors ? malloc(floorBytes) : NULL;
+        scratch[i].wallDepth = sprites ? (float*)malloc(maxWidth * sizeof(float)) : NULL;
+        ok = (!base.floors || scratch[i].floorState) && (!sprites || scratch[i].wallDepth);
+    }
+    
+    if (ok) {
+        memset(engine->renderStats, 0, workerCount * sizeof(RenderStats));
+        ViewBatch batch;
+        batch.base = &base;
+        batch.views = views;
+        batch.scratch = scratch;
+        Uint64 start = profiler_begin(engine->profiler);
+        threadpool_run(engine->pool, count, engine_render_view_task, &batch);
+        profiler_end(engine->profiler, PROFILER_THREAD_WORKERS, "views", start);
+    } else {
+        fprintf(stderr, "Failed to allocate buffers for %d views!\n", count);
+    }
+    
+    for (int i = 0; scratch && i < workerCount; i++) {
+        free(scratch[i].floorState);
+        free(scratch[i].wallDepth);
+        entity_view_free(&scratch[i].sprites);
+        raycaster_fixed_columns_free(&scratch[i].fixedColumns);
+    }
+    free(scratch);
+    return ok;
+}
+
+// Upload the framebuffer to the window and present it (no-op when headless)
+void engine_present_frame(Engine *engine) {
+    engine_present_pixels(engine, engine->framebuffer, engine->renderWidth, engine->renderHeight);
+}
+
+// Upload width x height pixels to the window and present them
+static void engine_present_pixels(Engine *engine, const Uint32 *pixels, int width, int height) {
+    if (!engine->renderer || !engine->frameTexture) {
+        return;
+    }
+    
+    // One upload and one copy per frame, independent of resolution; the
+    // internal resolution is stretched over the whole window
+    Uint64 uploadStart = profiler_begin(engine->profiler);
+    SDL_Rect source = { 0, 0, width, height };
+    SDL_UpdateTexture(engine->frameTexture, &source, pixels, width * sizeof(Uint32));
+    SDL_RenderCopy(engine->renderer, engine->frameTexture, &source, NULL);
+    profiler_end(engine->profiler, PROFILER_THREAD_MAIN, "upload", uploadStart);
+    
+    Uint64 presentStart = profiler_begin(engine->profiler);
+    SDL_RenderPresent(engine->renderer);
+    profiler_end(engine->profiler, PROFILER_THREAD_MAIN, "present", presentStart);
+}
+
+// Draw the overlay over a frame if it is shown: frame times, the passes of
+// the last frame, its counters and the capture state
+static void engine_draw_hud(Engine *engine, Uint32 *pixels, int width, int height) {
+    if (!SDL_AtomicGet(&engine->hud.visible)) {
+        return;
+    }
+    
+    double meanMs, maxMs;
+    hud_frame_stats(&engine->hud, &meanMs, &maxMs);
+    double wallMs = engine->lastRenderMs - engine->lastFloorMs - engine->lastSpriteMs;
+    char lines[4][96];
+    snprintf(lines[0], sizeof(lines[0]), "FPS %.0f  FRAME %.2f MS  MAX %.2f MS",
+             meanMs > 0.0 ? 1000.0 / meanMs : 0.0, meanMs, maxMs);
+    snprintf(lines[1], sizeof(lines[1]), "WALLS %.2f  FLOORS %.2f  SPRITES %.2f MS",
+             wallMs, engine->lastFloorMs, engine->lastSpriteMs);
+    snprintf(lines[2], sizeof(lines[2]), "COLUMNS %d  REUSED %d  DDA %llu  TEXELS %llu", engine->lastColumns,
+             engine->lastColumnsReused, (unsigned long long)engine->lastDdaSteps,
+             (unsigned long long)engine->lastTexels);
+    if (profiler_capturing(engine->profiler)) {
+        snprintf(lines[3], sizeof(lines[3]), "REC %d EVENTS  F2 STOP", profiler_event_count(engine->profiler));
+    } else {
+        snprintf(lines[3], sizeof(lines[3]), "F2 RECORD TRACE");
+    }
+    
+    // Twice the size on large frames so the text stays readable
+    int scale = width >= 800 ? 2 : 1;
+    int lineHeight = (HUD_GLYPH_HEIGHT + 3) * scale;
+    int panelWidth = 0;
+    for (int i = 0; i < 4; i++) {
+        int lineWidth = (int)strlen(lines[i]) * (HUD_GLYPH_WIDTH + 1) * scale;
+        if (lineWidth > panelWidth) panelWidth = lineWidth;
+    }
+    hud_draw_panel(pixels, width, width, height, 0, 0, panelWidth + 8 * scale, 4 * lineHeight + 6 * scale);
+    
+    // The panel's columns are rendered again before the frame is reused
+    if (pixels == engine->framebuffer && engine->renderCache) {
+        engine->renderCache->overlayColumns = panelWidth + 8 * scale;
+    }
+    for (int i = 0; i < 4; i++) {
+        Uint32 color = i == 3 && profiler_capturing(engine->profiler) ? 0xFFFF4040u : 0xFFFFFFFFu;
+        hud_draw_text(pixels, width, width, height, 4 * scale, 4 * scale + i * lineHeight, scale, lines[i], color);
+    }
+}
+
+// Start a profiler capture, or stop the running one and write it to the next trace file
+static void engine_toggle_capture(Engine *engine) {
+    if (!profiler_capturing(engine->profiler)) {
+        if (profiler_start(engine->profiler, engine_get_thread_count(engine))) {
+            printf("Profiler capture started\n");
+        }
+        return;
+    }
+    
+    profiler_stop(engine->profiler);
+    char path[64];
+    snprintf(path, sizeof(path), "raycaster-trace-%d.json", ++engine->traceCount);
+    if (profiler_write_trace(engine->profiler, path)) {
+        printf("Wrote %d profiler events to %s\n", profiler_event_count(engine->profiler), path);
+    }
+}
+
+// Print the frame budget controller's decision if it made one since *decisionsLogged
+static void engine_log_scale_decision(Engine *engine, int *decisionsLogged) {
+    if (engine->scaleController.decisionCount == *decisionsLogged) {
+        return;
+    }
+    
+    const RenderScaleDecision *decision = engine_get_scale_decision(engine);
+    printf("Frame %u: render %.2f ms (budget %.2f ms), scale %.2f -> %.2f, %dx%d\n",
+           decision->frame, decision->frameMs, decision->budgetMs,
+           decision->oldScale, decision->newScale, decision->renderWidth, decision->renderHeight);
+    *decisionsLogged = engine->scaleController.decisionCount;
+}
+
+// Main game loop: one thread handles input, moves the player, renders and
+// presents in turn, or with pipelined set the player is simulated at a fixed
+// tick and rendered on threads of their own while this thread presents
 int engine_run(Engine *engine) {
+    return engine->pipelined ? engine_run_pipelined(engine) : engine_run_sequential(engine);
+}
+
+// Main loop with every stage in turn on the calling thread
+static int engine_run_sequential(Engine *engine) {
+    int decisionsLogged = engine->scaleController.decisionCount;
+    
     while (engine->running) {
         // Handle events (keyboard, mouse, quit)
-        engine_handle_events(engine);
+        Uint64 eventsStart = profiler_begin(engine->profiler);
+        EngineRequests requests = { -1, 0, 0 };
+        engine_handle_events(engine, &requests);
+        if (requests.map >= 0 && !engine_set_map(engine, requests.map)) {
+            requests.map = -1;
+        }
+        if (requests.trace) {
+            engine_toggle_capture(engine);
+        }
+        profiler_end(engine->profiler, PROFILER_THREAD_MAIN, "events", eventsStart);
+    
+        // Maps saved since the last frame, read by the watcher thread
+        engine_apply_map_reloads(engine);
         
         // Calculate time delta for frame-rate independent movement
+        Uint64 simulateStart = profiler_begin(engine->profiler);
         double deltaTime = engine_calculate_delta_time(engine);
         
         // Update player position based on input
         engine_move_player(engine, deltaTime);
+        engine_record_frame(engine, engine_read_keys(engine->keystate), deltaTime, requests.map);
+        profiler_end(engine->profiler, PROFILER_THREAD_MAIN, "simulate", simulateStart);
         
-        // Clear screen
-        SDL_SetRenderDrawColor(engine->renderer, 0, 0, 0, 255);
-        SDL_RenderClear(engine->renderer);
+        // Perform raycasting where the scene changed since the last frame
+        Uint64 renderStart = profiler_begin(engine->profiler);
+        int columns = engine_update_scene(engine);
+        engine_draw_hud(engine, engine->framebuffer, engine->renderWidth, engine->renderHeight);
+        profiler_end(engine->profiler, PROFILER_THREAD_MAIN, "render", renderStart);
         
-        // Perform raycasting and render the scene
-        engine_render_scene(engine);
+        // Upload and present the rendered scene; while nothing changes, sleep
+        // until an event arrives instead of presenting the same frame again
+        if (columns > 0 || requests.present) {
+            engine_present_frame(engine);
+        } else {
+            SDL_WaitEventTimeout(NULL, ENGINE_IDLE_WAIT_MS);
+        }
         
-        // Present the rendered scene
-        SDL_RenderPresent(engine->renderer);
+        // Log render scale changes made by the frame budget controller
+        engine_log_scale_decision(engine, &decisionsLogged);
     }
     
+    // A capture still running at exit is written out
+    if (profiler_capturing(engine->profiler)) {
+        engine_toggle_capture(engine);
+    }
     return 0;
-} 
\ No newline at end of file
+}
+
+// Main loop with simulation and rendering on their own threads
+static int engine_run_pipelined(Engine *engine) {
+    EnginePipeline pipeline;
+    memset(&pipeline, 0, sizeof(pipeline));
+    pipeline.frameEvent = SDL_RegisterEvents(1);
+    if (!engine_pipeline_start(engine, &pipeline)) {
+        fprintf(stderr, "Failed to start the pipeline, running sequentially\n");
+        return engine_run_sequential(engine);
+    }
+    
+    // The front frame can be shown again once one was presented since the last start
+    int frontReady = 0;
+    while (engine->running) {
+        // Events must be pumped on this thread; the simulation only sees the keys
+        Uint64 eventsStart = profiler_begin(engine->profiler);
+        EngineRequests requests = { -1, 0, 0 };
+        engine_handle_events(engine, &requests);
+        SDL_AtomicSet(&pipeline.keys, engine_read_keys(engine->keystate));
+        profiler_end(engine->profiler, PROFILER_THREAD_MAIN, "events", eventsStart);
+        
+        // Switching maps loads it and scatters sprites, a trace is read from
+        // rings the threads write and a reloaded map changes tiles they read,
+        // so both threads are stopped around them
+        int reloads = mapwatch_pending(engine->watcher) > 0;
+        if (requests.map >= 0 || requests.trace || reloads) {
+            engine_pipeline_stop(&pipeline);
+            if (requests.map >= 0) {
+                engine_set_map(engine, requests.map);
+            }
+            if (reloads) {
+                engine_apply_map_reloads(engine);
+            }
+            if (requests.trace) {
+                engine_toggle_capture(engine);
+            }
+            if (!engine_pipeline_start(engine, &pipeline)) {
+                fprintf(stderr, "Failed to restart the pipeline\n");
+                return 1;
+            }
+            frontReady = 0;
+        }
+        
+        // Present the newest frame; with vsync this blocks only this thread
+        if (triplebuffer_acquire(&pipeline.frames)) {
+            const EngineFrame *frame = &pipeline.frameSlots[pipeline.frames.front];
+            engine_present_pixels(engine, frame->pixels, frame->width, frame->height);
+            pipeline.framesPresented++;
+            frontReady = 1;
+        } else if (requests.present && frontReady) {
+            const EngineFrame *frame = &pipeline.frameSlots[pipeline.frames.front];
+            engine_present_pixels(engine, frame->pixels, frame->width, frame->height);
+        } else if (pipeline.frameEvent != (Uint32)-1) {
+            // Nothing new to show: sleep until an event arrives or the render
+            // thread publishes a frame, as the sequential loop does
+            SDL_WaitEventTimeout(NULL, ENGINE_IDLE_WAIT_MS);
+        } else {
+            SDL_Delay(1);
+        }
+    }
+    
+    engine_pipeline_stop(&pipeline);
+    if (profiler_capturing(engine->profiler)) {
+        engine_toggle_capture(engine);
+    }
+    printf("Pipelined: %u ticks simulated, %u frames rendered, %u presented\n",
+           pipeline.ticks, pipeline.framesRendered, pipeline.framesPresented);
+    return 0;
+}
+
+// Start the simulation and render threads from the engine's player and map
+static int engine_pipeline_start(Engine *engine, EnginePipeline *pipeline) {
+    pipeline->engine = engine;
+    pipeline->player = engine->player;
+    pipeline->framebuffer = engine->framebuffer;
+    SDL_AtomicSet(&pipeline->stop, 0);
+    triplebuffer_init(&pipeline->snapshots);
+    triplebuffer_init(&pipeline->frames);
+    
+    // Frames are sized for the window, the largest the render scale allows
+    size_t pixels = (size_t)engine->windowWidth * engine->windowHeight;
+    int ok = 1;
+    for (int i = 0; i < 3; i++) {
+        pipeline->frameSlots[i].pixels = (Uint32*)malloc(pixels * sizeof(Uint32));
+        pipeline->frameSlots[i].width = 0;
+        pipeline->frameSlots[i].height = 0;
+        ok = ok && pipeline->frameSlots[i].pixels != NULL;
+    }
+    pipeline->snapshotReady = SDL_CreateSemaphore(0);
+    if (!ok || !pipeline->snapshotReady) {
+        fprintf(stderr, "Failed to allocate pipeline frames!\n");
+        engine_pipeline_stop(pipeline);
+        return 0;
+    }
+    
+    pipeline->simThread = SDL_CreateThread(engine_sim_main, "raycaster-sim", pipeline);
+    pipeline->renderThread = SDL_CreateThread(engine_render_main, "raycaster-render", pipeline);
+    if (!pipeline->simThread || !pipeline->renderThread) {
+        fprintf(stderr, "Failed to create pipeline thread: %s\n", SDL_GetError());
+        engine_pipeline_stop(pipeline);
+        return 0;
+    }
+    return 1;
+}
+
+// Stop both threads and hand the simulated player back to the engine
+static void engine_pipeline_stop(EnginePipeline *pipeline) {
+    Engine *engine = pipeline->engine;
+    SDL_AtomicSet(&pipeline->stop, 1);
+    if (pipeline->simThread) {
+        SDL_WaitThread(pipeline->simThread, NULL);
+        pipeline->simThread = NULL;
+    }
+    if (pipeline->renderThread) {
+        SDL_WaitThread(pipeline->renderThread, NULL);
+        pipeline->renderThread = NULL;
+    }
+    
+    engine->player = pipeline->player;
+    engine->framebuffer = pipeline->framebuffer;
+    engine_invalidate_scene(engine);
+    for (int i = 0; i < 3; i++) {
+        free(pipeline->frameSlots[i].pixels);
+        pipeline->frameSlots[i].pixels = NULL;
+    }
+    if (pipeline->snapshotReady) {
+        SDL_DestroySemaphore(pipeline->snapshotReady);
+        pipeline->snapshotReady = NULL;
+    }
+}
+
+// Simulation thread: step the player at the tick rate and publish snapshots
+static int engine_sim_main(void *data) {
+    EnginePipeline *pipeline = (EnginePipeline*)data;
+    Map *map = pipeline->engine->map;
+    double tickSeconds = 1.0 / (pipeline->engine->tickRate > 0 ? pipeline->engine->tickRate : ENGINE_TICK_RATE);
+    Uint64 frequency = SDL_GetPerformanceFrequency();
+    Uint64 tickCounts = (Uint64)(frequency * tickSeconds);
+    Uint64 next = SDL_GetPerformanceCounter();
+    Player published;
+    int publishedAny = 0;
+    int publishedOverlay = 0;
+    
+    while (!SDL_AtomicGet(&pipeline->stop)) {
+        // Fixed steps keep the simulation independent of how fast frames are drawn
+        Uint64 simulateStart = profiler_begin(pipeline->engine->profiler);
+        engine_step_player(map, &pipeline->player, SDL_AtomicGet(&pipeline->keys), tickSeconds);
+        pipeline->ticks++;
+        
+        // A pose already published is not published again, so the render
+        // thread sleeps while the player stands still, unless the overlay
+        // has frame times to draw or was just hidden
+        int overlay = SDL_AtomicGet(&pipeline->engine->hud.visible);
+        if (!publishedAny || memcmp(&published, &pipeline->player, sizeof(Player)) != 0 ||
+            overlay || overlay != publishedOverlay) {
+            EngineSnapshot *snapshot = &pipeline->snapshotSlots[pipeline->snapshots.back];
+            snapshot->player = pipeline->player;
+            snapshot->map = map;
+            snapshot->tick = pipeline->ticks;
+            triplebuffer_publish(&pipeline->snapshots);
+            if (SDL_SemValue(pipeline->snapshotReady) == 0) {
+                SDL_SemPost(pipeline->snapshotReady);
+            }
+            published = pipeline->player;
+            publishedAny = 1;
+            publishedOverlay = overlay;
+        }
+        profiler_end(pipeline->engine->profiler, PROFILER_THREAD_SIM, "simulate", simulateStart);
+        
+        // Sleep until the next tick; after a long stall drop the missed ticks
+        next += tickCounts;
+        Uint64 now = SDL_GetPerformanceCounter();
+        if (now > next + ENGINE_PIPELINE_MAX_LAG * tickCounts) {
+            next = now;
+        } else if (next > now) {
+            SDL_Delay((Uint32)((next - now) * 1000 / frequency));
+        }
+    }
+    return 0;
+}
+
+// Render thread: render the newest snapshot into a free frame and publish it
+static int engine_render_main(void *data) {
+    EnginePipeline *pipeline = (EnginePipeline*)data;
+    Engine *engine = pipeline->engine;
+    int decisionsLogged = engine->scaleController.decisionCount;
+    
+    while (!SDL_AtomicGet(&pipeline->stop)) {
+        if (SDL_SemWaitTimeout(pipeline->snapshotReady, ENGINE_PIPELINE_WAIT_MS) != 0 ||
+            !triplebuffer_acquire(&pipeline->snapshots)) {
+            continue;
+        }
+        
+        // Only this thread renders while the pipeline runs, so it may point the
+        // engine at the snapshot and the frame; the controller may change the
+        // resolution after the frame, so its size is taken before
+        Uint64 renderStart = profiler_begin(engine->profiler);
+        const EngineSnapshot *snapshot = &pipeline->snapshotSlots[pipeline->snapshots.front];
+        EngineFrame *frame = &pipeline->frameSlots[pipeline->frames.back];
+        engine->player = snapshot->player;
+        engine->map = snapshot->map;
+        engine->framebuffer = frame->pixels;
+        frame->width = engine->renderWidth;
+        frame->height = engine->renderHeight;
+        engine_render_scene(engine);
+        engine_draw_hud(engine, frame->pixels, frame->width, frame->height);
+        profiler_end(engine->profiler, PROFILER_THREAD_RENDER, "render", renderStart);
+        triplebuffer_publish(&pipeline->frames);
+        pipeline->framesRendered++;
+        if (pipeline->frameEvent != (Uint32)-1) {
+            SDL_Event event;
+            memset(&event, 0, sizeof(event));
+            event.type = pipeline->frameEvent;
+            SDL_PushEvent(&event);
+        }
+        
+        engine_log_scale_decision(engine, &decisionsLogged);
+    }
+    return 0;
+}
@@ -4,29 +4,50 @@
 #include <SDL.h>
 #include <SDL_image.h>
 
+#include "map.h"
+#include "catalog.h"
+#include "texture.h"
+#include "lighting.h"
+#include "hud.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-// Screen dimensions
+// Default screen dimensions; the resolution can be changed at runtime
 #define SCREEN_WIDTH 1024
 #define SCREEN_HEIGHT 768
 
+// Render scale limits and controller tuning
+#define RENDER_SCALE_MIN 0.25
+#define RENDER_SCALE_COOLDOWN 8     // Frames to wait after a change before deciding again
+
+// Default of engine->fixedPoint: rays are traced in double unless built with
+// make FIXED_POINT=1, which starts the engine on the 16.16 fixed-point DDA for
+// targets without a fast FPU. Both paths are always compiled in.
+#ifndef ENGINE_FIXED_POINT
+#define ENGINE_FIXED_POINT 0
+#endif
+
+// Simulation ticks per second of the pipelined loop
+#define ENGINE_TICK_RATE 120
+
+// Movement keys, as the simulation steps the player with them and recordings store them
+#define ENGINE_KEY_FORWARD 1
+#define ENGINE_KEY_BACKWARD 2
+#define ENGINE_KEY_LEFT 4
+#define ENGINE_KEY_RIGHT 8
+
+// Collision radius of the player, in tiles
+#define ENGINE_PLAYER_RADIUS 0.2
+
 // Texture dimensions
 #define TEX_WIDTH 64
 #define TEX_HEIGHT 64
 #define NUM_TEXTURES 5
 
-// Map dimensions
-#define MAP_WIDTH 24
-#define MAP_HEIGHT 24
-
-// Map tile types
-#define TILE_EMPTY 0
-#define TILE_WALL 1
-#define TILE_WALL2 2
-#define TILE_WALL3 3
-#define TILE_WALL4 4
+// Sprite textures, TEX_WIDTH x TEX_HEIGHT with transparent texels
+#define NUM_SPRITES 3
 
 // Structure representing the player.
 typedef struct Player {
@@ -40,34 +61,127 @@ typedef struct Player {
     double rotSpeed;  // Rotation speed
 } Player;
 
-// Structure representing the map
-typedef struct Map {
-    int data[MAP_HEIGHT][MAP_WIDTH];
+// Result of tracing one ray through the map
+typedef struct RayHit {
+    int hit;            // 1 if a wall was hit, 0 if the ray left the map
+    int mapX;           // Tile the ray stopped in
+    int mapY;
+    int side;           // 0 for an x-side (EW) wall, 1 for a y-side (NS) wall
+    int steps;          // DDA steps taken
+    int lineHeight;     // Projected wall height in pixels (when projection was requested)
+    double perpWallDist;  // Distance to the wall projected on the ray direction
+    double wallX;       // Where along the wall the ray hit, in [0, 1)
+} RayHit;
+
+// A point or direction in map space, in tiles
+typedef struct RayVector {
+    double x;
+    double y;
+} RayVector;
+
+// Result of one ray of a query. Distances are in lengths of the ray's direction,
+// so with a unit direction they are in tiles.
+typedef struct RayResult {
+    int hit;            // 1 if a wall was hit within range, 0 otherwise
+    int mapX;           // Wall tile that was hit
+    int mapY;
+    int side;           // 0 for an x-side (EW) wall, 1 for a y-side (NS) wall
+    double distance;    // Distance to the wall, the range on a miss
+    double hitX;        // Point the ray stopped at: on the wall, or at its range on a miss
+    double hitY;
+} RayResult;
+
+// One camera of engine_render_views: the pose it sees from and the pixels it is rendered into
+typedef struct EngineView {
+    Player camera;      // Position, direction and camera plane; the speeds are not used
+    Uint32 *pixels;     // ARGB8888, pitch * height pixels
     int width;
     int height;
-    double startX;  // Starting X position for player
-    double startY;  // Starting Y position for player
-    char name[64];  // Map name
-} Map;
+    int pitch;          // Pixels from one row to the next
+} EngineView;
+
+// A render scale change made by the frame budget controller
+typedef struct RenderScaleDecision {
+    Uint32 frame;       // Frame the decision was made on
+    double frameMs;     // Smoothed render time that triggered it
+    double budgetMs;    // Target render time
+    double oldScale;
+    double newScale;
+    int renderWidth;    // Internal resolution after the change
+    int renderHeight;
+} RenderScaleDecision;
+
+// Frame budget controller: raises or lowers the render scale to hold a target render time
+typedef struct ScaleController {
+    double budgetMs;    // Target render time, 0 when disabled
+    double smoothedMs;  // Exponential moving average of the render time
+    int cooldown;       // Frames left before the next decision
+    int decisionCount;  // Number of decisions made so far
+    RenderScaleDecision lastDecision;
+} ScaleController;
 
-// Structure for the textures
+// Structure for the textures: wall textures with their mip chains, sampled on the CPU
+// through a shared palette, and that palette shaded at every light level
 typedef struct Textures {
-    SDL_Texture* textures[NUM_TEXTURES];
+    WallTexture walls[NUM_TEXTURES];
+    WallTexture sprites[NUM_SPRITES];
+    Uint32 palette[LIGHTING_COLORS];
+    LightingColormap colormap;
 } Textures;
 
 // Structure holding the engine state and configuration.
 typedef struct Engine {
     SDL_Window *window;
     SDL_Renderer *renderer;
+    SDL_Texture *frameTexture;  // Streaming texture the framebuffer is uploaded to (NULL when headless)
+    Uint32 *framebuffer;    // CPU-side ARGB8888 pixels, renderWidth * renderHeight used per frame
+    int windowWidth;        // Output resolution the frame is upscaled to
+    int windowHeight;
+    int renderWidth;        // Internal resolution: columns traced and rows written per frame
+    int renderHeight;
+    double renderScale;     // Internal resolution relative to the output resolution
+    double lastRenderMs;    // Time spent in the last engine_render_scene
+    double lastFloorMs;     // Time spent casting floors in the last frame, part of lastRenderMs
+    int lastFloorPixels;    // Floor and ceiling pixels cast in the last frame
+    double lastSpriteMs;    // Time spent culling, sorting and drawing sprites in the last frame
+    int lastSpriteCount;    // Sprites that survived culling in the last frame
+    double lastFrameMs;     // Time between the starts of the last two frames, unclamped
+    Uint64 lastFrameStart;  // Performance counter at the start of the last frame
+    Uint64 lastDdaSteps;    // DDA steps of every ray of the last frame
+    int lastColumns;        // Columns traced in the last frame
+    int lastColumnsReused;  // Columns the last frame kept from the frame before
+    Uint64 lastTexels;      // Texels read for walls, floors and sprites in the last frame
+    Uint32 frameCount;      // Frames rendered so far
+    ScaleController scaleController;
     Player player;
-    Map map;
+    Map *map;               // Active map: defaultMap or a map pinned in the catalog
+    Map defaultMap;         // Built-in map, owns its tiles
     Textures textures;
-    Uint32 lastTime;  // For timing
+    Uint64 lastTime;  // Performance counter at the last movement step, for timing
     const Uint8 *keystate;  // For input
     int running;  // Game state
-    Map *availableMaps;     // Array of available maps
-    int mapCount;           // Number of available maps
-    int currentMapIndex;    // Index of currently loaded map
+    MapCatalog maps;        // Installed maps, loaded on first use
+    int currentMapIndex;    // Catalog index of the active map, -1 for the default map
+    struct ThreadPool *pool;  // Render workers, columns are split into tiles across them
+    struct RenderStats *renderStats;  // Frame counters of each render worker
+    struct RenderCache *renderCache;  // What the framebuffer was last rendered from, for engine_update_scene
+    int rayPackets;         // Trace columns in SIMD packets instead of one ray at a time
+    int fixedPoint;         // Trace columns with the fixed-point DDA instead of doubles
+    struct RayFixedColumns *fixedColumns;  // Per-column tables of the fixed-point path
+    int emptySkipping;      // Let rays jump across open space using the map's distance field
+    int texturedWalls;      // Sample wall textures instead of flat colors
+    int texturedFloors;     // Cast floor and ceiling textures on maps that have them
+    int mipmapping;         // Sample distant walls and floors from smaller mip levels
+    struct EntityStore *entities;       // Billboarded sprites in the world
+    struct EntityView *visibleEntities; // Sprites that survived culling, back to front
+    int demoSprites;        // Sprites scattered over each map as it becomes active
+    int pipelined;          // Simulate, render and present on separate threads in engine_run
+    int tickRate;           // Simulation ticks per second when pipelined
+    struct Profiler *profiler;  // Scoped timers and counters, recorded while a capture runs
+    Hud hud;                // Overlay with frame times and counters, toggled with F1
+    int traceCount;         // Captures written so far, numbering the trace files
+    struct Replay *recorder;    // Recording of the sequential loop's frames, NULL when not recording
+    struct MapWatcher *watcher; // Thread reading map files as they are saved, NULL when not watching
 } Engine;
 
 // PUBLIC API:
@@ -75,6 +189,9 @@ typedef struct Engine {
 // Initialize the engine with default settings
 int engine_init(Engine *engine);
 
+// Initialize the engine without a window; frames are only rendered into the framebuffer
+int engine_init_headless(Engine *engine);
+
 // Clean up resources allocated by the engine
 void engine_cleanup(Engine *engine);
 
@@ -82,7 +199,7 @@ void engine_cleanup(Engine *engine);
 void engine_init_player(Engine *engine, double posX, double posY);
 
 // Initialize the default map
-void engine_init_map(Engine *engine);
+int engine_init_map(Engine *engine);
 
 // Initialize textures system
 int engine_init_textures(Engine *engine);
@@ -93,25 +210,109 @@ void engine_cleanup_textures(Engine *engine);
 // Update player position based on input with collision detection
 void engine_move_player(Engine *engine, double deltaTime);
 
-// Render the current scene using raycasting
+// Render the current scene using raycasting into the framebuffer
 void engine_render_scene(Engine *engine);
 
-// Main game loop
+// Bring the framebuffer up to date with the scene, redrawing only what changed
+// since the last frame rendered into it: nothing while the pose, the map, the
+// sprites and the settings stay as they were, and only the columns whose rays
+// crossed tiles the map marked changed (see map_mark_changed) when that is all.
+// Returns the number of columns rendered, 0 when the last frame still stands.
+int engine_update_scene(Engine *engine);
+
+// Make the next engine_update_scene render the whole frame, after something
+// other than the engine drew into the framebuffer
+void engine_invalidate_scene(Engine *engine);
+
+// Render count views of the active map in one call, each exactly as
+// engine_render_scene would render its camera at its size. Views are
+// scheduled across the render threads, each rendered whole by one worker, so
+// many small views share the map and textures while they are in cache.
+// Does not touch the framebuffer or the frame counters.
+int engine_render_views(Engine *engine, const EngineView *views, int count);
+
+// Upload the framebuffer to the window and present it (no-op when headless)
+void engine_present_frame(Engine *engine);
+
+// Main game loop: one thread handles input, moves the player, renders and
+// presents in turn, or with pipelined set the player is simulated at a fixed
+// tick and rendered on threads of their own while this thread presents
 int engine_run(Engine *engine);
 
-// Load maps from files in a directory
+// Add the maps in a directory to the catalog; none is loaded until it is used
 int engine_load_maps(Engine *engine, const char *directory);
 
-// Load a map from a file
+// Add a map file to the catalog; it is loaded when first used
 int engine_load_map_from_file(Engine *engine, const char *filename);
 
-// Load a specific map by index
+// Watch a map directory added with engine_load_maps: maps saved into it are
+// read on a thread of their own and applied by engine_apply_map_reloads
+int engine_watch_maps(Engine *engine, const char *directory);
+
+// Apply the maps the watcher has read since the last call, each changed in
+// place in the catalog so only its edited tiles are redone; a map whose size
+// changed is built whole on the watcher thread and only swapped in here, and
+// a map that is not cached is loaded from its file when next used. Call
+// between frames. Returns the number of maps changed, cached or not.
+int engine_apply_map_reloads(Engine *engine);
+
+// Make a map active by index, loading it if it is not cached
 int engine_set_map(Engine *engine, int mapIndex);
 
+// Scatter count sprites over random open tiles of the active map
+int engine_scatter_sprites(Engine *engine, int count, Uint32 seed);
+
 // Create a map with the given data
 int engine_create_map(Engine *engine, const int *mapData, int width, int height, 
                       double startX, double startY, const char *name);
 
+// Set the output resolution (window size); the render scale is kept
+int engine_set_resolution(Engine *engine, int width, int height);
+
+// Set the internal render scale relative to the output resolution, clamped to [RENDER_SCALE_MIN, 1]
+void engine_set_render_scale(Engine *engine, double scale);
+
+// Hold the render time near budgetMs by adjusting the render scale (0 disables)
+void engine_set_frame_budget(Engine *engine, double budgetMs);
+
+// Get the most recent render scale decision, or NULL if none was made yet
+const RenderScaleDecision* engine_get_scale_decision(Engine *engine);
+
+// Set the number of render threads (<= 0 uses one per CPU core)
+int engine_set_thread_count(Engine *engine, int threadCount);
+
+// Get the number of render threads, including the calling thread
+int engine_get_thread_count(Engine *engine);
+
+// Recording header and frame, see replay.h
+struct ReplayHeader;
+struct ReplayFrame;
+
+// Start recording every frame of the sequential loop to a file
+int engine_start_recording(Engine *engine, const char *path);
+
+// Put the engine in the state a recording starts from: its resolution, render
+// scale, map, sprites and pose; the frame budget is disabled
+int engine_start_replay(Engine *engine, const struct ReplayHeader *header);
+
+// Apply one recorded frame: switch maps and render scale as it did, step the
+// player by its keys and delta time, and render the scene
+int engine_replay_frame(Engine *engine, const struct ReplayFrame *frame);
+
+// Cast count rays against the active map on the render threads, ray i from
+// origins[i] along dirs[i], no farther than maxDist (INFINITY for no limit);
+// rays that hit no wall in range, or leave the map, report maxDist. Do not call
+// while the engine is rendering on the same threads.
+int engine_cast_rays(Engine *engine, const RayVector *origins, const RayVector *dirs, double maxDist,
+                     int count, RayResult *results);
+
+// Check line of sight between count pairs of points: visible[i] is 1 when no
+// wall lies between from[i] and to[i]; tracing stops at the target
+int engine_check_visibility(Engine *engine, const RayVector *from, const RayVector *to, int count, Uint8 *visible);
+
+// Get the number of maps in the catalog
+int engine_get_map_count(Engine *engine);
+
 // Get a list of available map names
 const char** engine_get_map_names(Engine *engine);
 
@@ -0,0 +1,331 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "entity.h"
+
+// Bits sorted per radix sort pass
+#define ENTITY_RADIX_BITS 8
+#define ENTITY_RADIX_BUCKETS (1 << ENTITY_RADIX_BITS)
+
+// ****************************************************
+// Private (static) function declarations
+// ****************************************************
+
+// Grow a store's arrays to hold at least capacity entities
+static int entity_reserve(EntityStore *store, int capacity);
+
+// Grow a view's arrays to hold at least capacity entities
+static int entity_view_reserve(EntityView *view, int capacity);
+
+// Resize one array of 4-byte elements; on failure it is kept and *ok cleared
+static void* entity_grow(void *array, int capacity, int *ok);
+
+// Sort key of a depth: farther entities get smaller keys, so they are drawn first
+static inline Uint32 entity_depth_key(float depth);
+
+// ****************************************************
+// Public API Implementation
+// ****************************************************
+
+// Start an empty store
+void entity_store_init(EntityStore *store) {
+    memset(store, 0, sizeof(EntityStore));
+}
+
+// Free a store's arrays and grid
+void entity_store_free(EntityStore *store) {
+    free(store->posX);
+    free(store->posY);
+    free(store->sprite);
+    free(store->cellStart);
+    free(store->cellEntities);
+    memset(store, 0, sizeof(EntityStore));
+}
+
+// Add an entity at (x, y) showing a sprite texture; returns its index, -1 when out of memory
+int entity_add(EntityStore *store, double x, double y, int sprite) {
+    if (store->count == store->capacity &&
+        !entity_reserve(store, store->capacity ? 2 * store->capacity : 64)) {
+        fprintf(stderr, "Failed to allocate entities!\n");
+        return -1;
+    }
+
+    int index = store->count++;
+    store->posX[index] = (float)x;
+    store->posY[index] = (float)y;
+    store->sprite[index] = (Uint8)sprite;
+    store->gridDirty = 1;
+    store->revision++;
+    return index;
+}
+
+// Move an entity; the grid is rebuilt before the next cull
+void entity_move(EntityStore *store, int index, double x, double y) {
+    store->posX[index] = (float)x;
+    store->posY[index] = (float)y;
+    store->gridDirty = 1;
+    store->revision++;
+}
+
+// Remove every entity
+void entity_clear(EntityStore *store) {
+    store->count = 0;
+    store->gridDirty = 1;
+    store->revision++;
+}
+
+// Group the entities by the grid cells of a map; entities outside it are dropped from the grid
+int entity_build_grid(EntityStore *store, const Map *map) {
+    int gridWidth = (map->width + (1 << ENTITY_CELL_SHIFT) - 1) >> ENTITY_CELL_SHIFT;
+    int gridHeight = (map->height + (1 << ENTITY_CELL_SHIFT) - 1) >> ENTITY_CELL_SHIFT;
+    int cells = gridWidth * gridHeight;
+
+    if (gridWidth != store->gridWidth || gridHeight != store->gridHeight || !store->cellStart) {
+        int *cellStart = (int*)realloc(store->cellStart, (cells + 1) * sizeof(int));
+        if (!cellStart) {
+            fprintf(stderr, "Failed to allocate entity grid!\n");
+            return 0;
+        }
+        store->cellStart = cellStart;
+        store->gridWidth = gridWidth;
+        store->gridHeight = gridHeight;
+    }
+    int *cellEntities = (int*)realloc(store->cellEntities, (store->capacity ? store->capacity : 1) * sizeof(int));
+    if (!cellEntities) {
+        fprintf(stderr, "Failed to allocate entity grid!\n");
+        return 0;
+    }
+    store->cellEntities = cellEntities;
+
+    // Counting sort by cell: count, turn counts into offsets, then place
+    int *cellStart = store->cellStart;
+    memset(cellStart, 0, (cells + 1) * sizeof(int));
+    for (int i = 0; i < store->count; i++) {
+        int x = (int)floorf(store->posX[i]);
+        int y = (int)floorf(store->posY[i]);
+        if (x >= 0 && x < map->width && y >= 0 && y < map->height) {
+            cellStart[(y >> ENTITY_CELL_SHIFT) * gridWidth + (x >> ENTITY_CELL_SHIFT) + 1]++;
+        }
+    }
+    for (int c = 0; c < cells; c++) {
+        cellStart[c + 1] += cellStart[c];
+    }
+    for (int i = 0; i < store->count; i++) {
+        int x = (int)floorf(store->posX[i]);
+        int y = (int)floorf(store->posY[i]);
+        if (x >= 0 && x < map->width && y >= 0 && y < map->height) {
+            int cell = (y >> ENTITY_CELL_SHIFT) * gridWidth + (x >> ENTITY_CELL_SHIFT);
+            cellEntities[cellStart[cell]++] = i;
+        }
+    }
+
+    // Placing advanced every offset to the start of the next cell; shift them back
+    for (int c = cells; c > 0; c--) {
+        cellStart[c] = cellStart[c - 1];
+    }
+    cellStart[0] = 0;
+    store->gridDirty = 0;
+    return 1;
+}
+
+// Collect the entities whose sprites overlap a view width columns wide: whole grid
+// cells outside the view frustum are skipped, then each entity is tested;
+// returns the number found, -1 when out of memory
+int entity_cull(EntityStore *store, const Map *map, const Player *player, int width, EntityView *view) {
+    view->count = 0;
+    if (store->count == 0) {
+        return 0;
+    }
+    int gridWidth = (map->width + (1 << ENTITY_CELL_SHIFT) - 1) >> ENTITY_CELL_SHIFT;
+    int gridHeight = (map->height + (1 << ENTITY_CELL_SHIFT) - 1) >> ENTITY_CELL_SHIFT;
+    if ((store->gridDirty || gridWidth != store->gridWidth || gridHeight != store->gridHeight) &&
+        !entity_build_grid(store, map)) {
+        return -1;
+    }
+    if (!entity_view_reserve(view, store->count)) {
+        return -1;
+    }
+
+    // Camera space: depth along the view direction and offset along the camera
+    // plane, where the screen edges are at offset = +-depth
+    double invDet = 1.0 / (player->planeX * player->dirY - player->dirX * player->planeY);
+    double planeLength = sqrt(player->planeX * player->planeX + player->planeY * player->planeY);
+    double halfScreen = width / 2.0;
+
+    // A sprite is one tile wide, so it reaches half a tile around its position
+    const double reach = 0.5;
+    const int cellSize = 1 << ENTITY_CELL_SHIFT;
+
+    for (int cy = 0; cy < gridHeight; cy++) {
+        for (int cx = 0; cx < gridWidth; cx++) {
+            int cell = cy * gridWidth + cx;
+            int first = store->cellStart[cell];
+            int last = store->cellStart[cell + 1];
+            if (first == last) {
+                continue;
+            }
+
+            // A cell is outside when all four corners of its area, grown by the
+            // sprite reach, are behind the near plane or beyond one screen edge
+            int front = 0, left = 0, right = 0;
+            for (int corner = 0; corner < 4; corner++) {
+                double dx = (cx * cellSize + ((corner & 1) ? cellSize + reach : -reach)) - player->posX;
+                double dy = (cy * cellSize + ((corner & 2) ? cellSize + reach : -reach)) - player->posY;
+                double depth = invDet * (-player->planeY * dx + player->planeX * dy);
+                double offset = invDet * (player->dirY * dx - player->dirX * dy);
+                front += depth > ENTITY_NEAR;
+                left += offset < -depth;
+                right += offset > depth;
+            }
+            if (front == 0 || left == 4 || right == 4) {
+                continue;
+            }
+
+            for (int i = first; i < last; i++) {
+                int entity = store->cellEntities[i];
+                double dx = store->posX[entity] - player->posX;
+                double dy = store->posY[entity] - player->posY;
+                double depth = invDet * (-player->planeY * dx + player->planeX * dy);
+                if (depth <= ENTITY_NEAR) {
+                    continue;
+                }
+                double offset = invDet * (player->dirY * dx - player->dirX * dy);
+                double screenX = halfScreen * (1.0 + offset / depth);
+                double halfWidth = halfScreen * reach / (planeLength * depth);
+                if (screenX + halfWidth < 0.0 || screenX - halfWidth >= width) {
+                    continue;
+                }
+
+                int slot = view->count++;
+                view->index[slot] = entity;
+                view->depth[slot] = (float)depth;
+                view->screenX[slot] = (float)screenX;
+            }
+        }
+    }
+    return view->count;
+}
+
+// Sort a view's entities back to front with an LSD radix sort on their depth
+void entity_sort(EntityView *view) {
+    int count = view->count;
+    for (int i = 0; i < count; i++) {
+        view->keys[i] = entity_depth_key(view->depth[i]);
+    }
+
+    for (int shift = 0; shift < 32; shift += ENTITY_RADIX_BITS) {
+        int offsets[ENTITY_RADIX_BUCKETS];
+        memset(offsets, 0, sizeof(offsets));
+        for (int i = 0; i < count; i++) {
+            offsets[(view->keys[i] >> shift) & (ENTITY_RADIX_BUCKETS - 1)]++;
+        }
+
+        // Entities at similar depths share their high digits; a pass that would
+        // leave every key in one bucket changes nothing
+        if (count == 0 || offsets[(view->keys[0] >> shift) & (ENTITY_RADIX_BUCKETS - 1)] == count) {
+            continue;
+        }
+        int total = 0;
+        for (int b = 0; b < ENTITY_RADIX_BUCKETS; b++) {
+            int bucket = offsets[b];
+            offsets[b] = total;
+            total += bucket;
+        }
+
+        // Stable scatter into the scratch arrays, which then become the current ones
+        for (int i = 0; i < count; i++) {
+            int to = offsets[(view->keys[i] >> shift) & (ENTITY_RADIX_BUCKETS - 1)]++;
+            view->scratchKeys[to] = view->keys[i];
+            view->scratchIndex[to] = view->index[i];
+            view->scratchDepth[to] = view->depth[i];
+            view->scratchScreenX[to] = view->screenX[i];
+        }
+        Uint32 *keys = view->keys;
+        view->keys = view->scratchKeys;
+        view->scratchKeys = keys;
+        int *index = view->index;
+        view->index = view->scratchIndex;
+        view->scratchIndex = index;
+        float *depth = view->depth;
+        view->depth = view->scratchDepth;
+        view->scratchDepth = depth;
+        float *screenX = view->screenX;
+        view->screenX = view->scratchScreenX;
+        view->scratchScreenX = screenX;
+    }
+}
+
+// Free a view's arrays
+void entity_view_free(EntityView *view) {
+    free(view->index);
+    free(view->depth);
+    free(view->screenX);
+    free(view->keys);
+    free(view->scratchKeys);
+    free(view->scratchIndex);
+    free(view->scratchDepth);
+    free(view->scratchScreenX);
+    memset(view, 0, sizeof(EntityView));
+}
+
+// ****************************************************
+// Private functions implementation
+// ****************************************************
+
+// Grow a store's arrays to hold at least capacity entities
+static int entity_reserve(EntityStore *store, int capacity) {
+    float *posX = (float*)realloc(store->posX, capacity * sizeof(float));
+    if (posX) store->posX = posX;
+    float *posY = (float*)realloc(store->posY, capacity * sizeof(float));
+    if (posY) store->posY = posY;
+    Uint8 *sprite = (Uint8*)realloc(store->sprite, capacity);
+    if (sprite) store->sprite = sprite;
+    if (!posX || !posY || !sprite) {
+        return 0;
+    }
+    store->capacity = capacity;
+    return 1;
+}
+
+// Grow a view's arrays to hold at least capacity entities
+static int entity_view_reserve(EntityView *view, int capacity) {
+    if (capacity <= view->capacity) {
+        return 1;
+    }
+
+    int ok = 1;
+    view->index = (int*)entity_grow(view->index, capacity, &ok);
+    view->depth = (float*)entity_grow(view->depth, capacity, &ok);
+    view->screenX = (float*)entity_grow(view->screenX, capacity, &ok);
+    view->keys = (Uint32*)entity_grow(view->keys, capacity, &ok);
+    view->scratchKeys = (Uint32*)entity_grow(view->scratchKeys, capacity, &ok);
+    view->scratchIndex = (int*)entity_grow(view->scratchIndex, capacity, &ok);
+    view->scratchDepth = (float*)entity_grow(view->scratchDepth, capacity, &ok);
+    view->scratchScreenX = (float*)entity_grow(view->scratchScreenX, capacity, &ok);
+    if (!ok) {
+        fprintf(stderr, "Failed to allocate visible entities!\n");
+        return 0;
+    }
+    view->capacity = capacity;
+    return 1;
+}
+
+// Resize one array of 4-byte elements; on failure it is kept and *ok cleared
+static void* entity_grow(void *array, int capacity, int *ok) {
+    void *grown = realloc(array, (size_t)capacity * 4);
+    if (!grown) {
+        *ok = 0;
+        return array;
+    }
+    return grown;
+}
+
+// Sort key of a depth: farther entities get smaller keys, so they are drawn first
+static inline Uint32 entity_depth_key(float depth) {
+    // Positive floats order like their bit patterns
+    Uint32 bits;
+    memcpy(&bits, &depth, sizeof(bits));
+    return ~bits;
+}
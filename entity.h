@@ -0,0 +1,80 @@
+#ifndef ENTITY_H
+#define ENTITY_H
+
+#include "engine.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Culling grid cells are (1 << ENTITY_CELL_SHIFT) tiles per side
+#define ENTITY_CELL_SHIFT 3
+
+// Nearest camera depth a sprite is drawn at, in tiles
+#define ENTITY_NEAR 0.05
+
+// Entities as parallel arrays (structure of arrays): culling streams through
+// the positions only, and drawing reads the rest by index. A coarse grid
+// groups entity indices by cell so culling can reject whole cells at once.
+typedef struct EntityStore {
+    float *posX;
+    float *posY;
+    Uint8 *sprite;          // Sprite texture of each entity
+    int count;
+    int capacity;
+    int *cellStart;         // First entry of each cell in cellEntities, one more entry than cells
+    int *cellEntities;      // Entity indices grouped by cell
+    int gridWidth;          // Grid size in cells, from the map it was built for
+    int gridHeight;
+    int gridDirty;          // Entities were added or moved since the grid was built
+    Uint32 revision;        // Bumped by every add, move and clear
+} EntityStore;
+
+// Entities of one frame that survived culling, as parallel arrays sorted back to front
+typedef struct EntityView {
+    int count;
+    int capacity;
+    int *index;             // Entity index
+    float *depth;           // Distance in front of the camera plane
+    float *screenX;         // Column of the sprite's centre
+    Uint32 *keys;           // Radix sort keys, and scratch copies of all four arrays
+    Uint32 *scratchKeys;
+    int *scratchIndex;
+    float *scratchDepth;
+    float *scratchScreenX;
+} EntityView;
+
+// Start an empty store
+void entity_store_init(EntityStore *store);
+
+// Free a store's arrays and grid
+void entity_store_free(EntityStore *store);
+
+// Add an entity at (x, y) showing a sprite texture; returns its index, -1 when out of memory
+int entity_add(EntityStore *store, double x, double y, int sprite);
+
+// Move an entity; the grid is rebuilt before the next cull
+void entity_move(EntityStore *store, int index, double x, double y);
+
+// Remove every entity
+void entity_clear(EntityStore *store);
+
+// Group the entities by the grid cells of a map; entities outside it are dropped from the grid
+int entity_build_grid(EntityStore *store, const Map *map);
+
+// Collect the entities whose sprites overlap a view width columns wide: whole
+// grid cells outside the view frustum are skipped, then each entity is tested;
+// returns the number found, -1 when out of memory
+int entity_cull(EntityStore *store, const Map *map, const Player *player, int width, EntityView *view);
+
+// Sort a view's entities back to front with an LSD radix sort on their depth
+void entity_sort(EntityView *view);
+
+// Free a view's arrays
+void entity_view_free(EntityView *view);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ENTITY_H
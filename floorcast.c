@@ -0,0 +1,152 @@
+#include <math.h>
+
+#include "floorcast.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// ****************************************************
+// Private (static) function declarations
+// ****************************************************
+
+// Convert a world coordinate or step to 16.16 fixed point, clamped to range
+static Sint32 floorcast_fixed(double value);
+
+#if defined(__SSE2__)
+// Multiply 32-bit lanes keeping the low halves (SSE2 has no pmulld)
+static inline __m128i floorcast_mullo(__m128i a, __m128i b);
+#endif
+
+// ****************************************************
+// Public API Implementation
+// ****************************************************
+
+// Set up floor row y (at or below the horizon) of a width x height view; the
+// row distance is computed once here, the span kernels only add steps
+void floorcast_setup_row(const Player *player, int y, int width, int height, FloorRow *row) {
+    // A wall at distance d ends height / (2 d) rows below the horizon, so the
+    // floor seen through the centre of row y is at the inverse of that
+    double below = y - height / 2 + 0.5;
+    double rowDistance = 0.5 * height / below;
+
+    // Rays through the left and right edges of the view span the whole row
+    double rayDirX0 = player->dirX - player->planeX;
+    double rayDirY0 = player->dirY - player->planeY;
+    row->posX = floorcast_fixed(player->posX + rowDistance * rayDirX0);
+    row->posY = floorcast_fixed(player->posY + rowDistance * rayDirY0);
+    row->stepX = floorcast_fixed(rowDistance * 2.0 * player->planeX / width);
+    row->stepY = floorcast_fixed(rowDistance * 2.0 * player->planeY / width);
+}
+
+// For count pixels of a row starting at column xStart, find the map tile under
+// each pixel (its index in the tile layout, -1 outside the map) and the texel
+// offset within a mip level of (1 << texShiftX) x (1 << texShiftY) texels
+void floorcast_span(const Map *map, const FloorRow *row, int xStart, int count,
+                    int texShiftX, int texShiftY, Sint32 *tiles, Sint32 *texels) {
+    int done = 0;
+
+#if defined(__SSE2__)
+    const int shift = map->blockShift;
+    const __m128i blockShift = _mm_cvtsi32_si128(shift);
+    const __m128i blockRowShift = _mm_cvtsi32_si128(2 * shift);
+    const __m128i blockMask = _mm_set1_epi32((1 << shift) - 1);
+    const __m128i blocksPerRow = _mm_set1_epi32(map->blocksPerRow);
+    const __m128i minusOne = _mm_set1_epi32(-1);
+    const __m128i width = _mm_set1_epi32(map->width);
+    const __m128i height = _mm_set1_epi32(map->height);
+    const __m128i texelShiftX = _mm_cvtsi32_si128(16 - texShiftX);
+    const __m128i texelShiftY = _mm_cvtsi32_si128(16 - texShiftY);
+    const __m128i columnShift = _mm_cvtsi32_si128(texShiftY);
+    const __m128i texMaskX = _mm_set1_epi32((1 << texShiftX) - 1);
+    const __m128i texMaskY = _mm_set1_epi32((1 << texShiftY) - 1);
+
+    // World position of each lane; positions wrap like the scalar Uint32 sums
+    const __m128i lanes = _mm_set_epi32(3, 2, 1, 0);
+    const __m128i stepX = _mm_set1_epi32(row->stepX);
+    const __m128i stepY = _mm_set1_epi32(row->stepY);
+    __m128i posX = _mm_add_epi32(_mm_set1_epi32((Sint32)((Uint32)row->posX + (Uint32)xStart * (Uint32)row->stepX)),
+                                 floorcast_mullo(lanes, stepX));
+    __m128i posY = _mm_add_epi32(_mm_set1_epi32((Sint32)((Uint32)row->posY + (Uint32)xStart * (Uint32)row->stepY)),
+                                 floorcast_mullo(lanes, stepY));
+    const __m128i strideX = _mm_slli_epi32(stepX, 2);
+    const __m128i strideY = _mm_slli_epi32(stepY, 2);
+
+    for (; done + FLOORCAST_LANES <= count; done += FLOORCAST_LANES) {
+        // Tile under each pixel, -1 where the floor lies outside the map
+        __m128i cellX = _mm_srai_epi32(posX, 16);
+        __m128i cellY = _mm_srai_epi32(posY, 16);
+        __m128i inside = _mm_and_si128(
+            _mm_and_si128(_mm_cmpgt_epi32(cellX, minusOne), _mm_cmplt_epi32(cellX, width)),
+            _mm_and_si128(_mm_cmpgt_epi32(cellY, minusOne), _mm_cmplt_epi32(cellY, height)));
+
+        // Inside the map both factors fit in 16 bits, so one pmaddwd multiplies them
+        __m128i block = _mm_add_epi32(_mm_madd_epi16(_mm_srl_epi32(cellY, blockShift), blocksPerRow),
+                                      _mm_srl_epi32(cellX, blockShift));
+        __m128i tile = _mm_or_si128(_mm_sll_epi32(block, blockRowShift),
+                                    _mm_or_si128(_mm_sll_epi32(_mm_and_si128(cellY, blockMask), blockShift),
+                                                 _mm_and_si128(cellX, blockMask)));
+        tile = _mm_or_si128(_mm_and_si128(inside, tile), _mm_andnot_si128(inside, minusOne));
+        _mm_storeu_si128((__m128i*)(tiles + done), tile);
+
+        // Texel from the fraction of the position, textures are column-major
+        __m128i texX = _mm_and_si128(_mm_srl_epi32(posX, texelShiftX), texMaskX);
+        __m128i texY = _mm_and_si128(_mm_srl_epi32(posY, texelShiftY), texMaskY);
+        _mm_storeu_si128((__m128i*)(texels + done), _mm_or_si128(_mm_sll_epi32(texX, columnShift), texY));
+
+        posX = _mm_add_epi32(posX, strideX);
+        posY = _mm_add_epi32(posY, strideY);
+    }
+#endif
+
+    // Pixels left over after the last full group of lanes
+    if (done < count) {
+        floorcast_span_scalar(map, row, xStart + done, count - done, texShiftX, texShiftY,
+                              tiles + done, texels + done);
+    }
+}
+
+// Scalar version of floorcast_span (the reference path); results are identical
+void floorcast_span_scalar(const Map *map, const FloorRow *row, int xStart, int count,
+                           int texShiftX, int texShiftY, Sint32 *tiles, Sint32 *texels) {
+    Uint32 texMaskX = (1u << texShiftX) - 1;
+    Uint32 texMaskY = (1u << texShiftY) - 1;
+
+    for (int i = 0; i < count; i++) {
+        Uint32 posX = (Uint32)row->posX + (Uint32)(xStart + i) * (Uint32)row->stepX;
+        Uint32 posY = (Uint32)row->posY + (Uint32)(xStart + i) * (Uint32)row->stepY;
+
+        int cellX = (Sint32)posX >> 16;
+        int cellY = (Sint32)posY >> 16;
+        if (cellX >= 0 && cellX < map->width && cellY >= 0 && cellY < map->height) {
+            tiles[i] = (Sint32)map_tile_index(map, cellX, cellY);
+        } else {
+            tiles[i] = -1;
+        }
+
+        Uint32 texX = (posX >> (16 - texShiftX)) & texMaskX;
+        Uint32 texY = (posY >> (16 - texShiftY)) & texMaskY;
+        texels[i] = (Sint32)((texX << texShiftY) | texY);
+    }
+}
+
+// ****************************************************
+// Private functions implementation
+// ****************************************************
+
+// Convert a world coordinate or step to 16.16 fixed point, clamped to range
+static Sint32 floorcast_fixed(double value) {
+    if (value > FLOORCAST_MAX_COORD) value = FLOORCAST_MAX_COORD;
+    if (value < -FLOORCAST_MAX_COORD) value = -FLOORCAST_MAX_COORD;
+    return (Sint32)floor(value * 65536.0);
+}
+
+#if defined(__SSE2__)
+// Multiply 32-bit lanes keeping the low halves (SSE2 has no pmulld)
+static inline __m128i floorcast_mullo(__m128i a, __m128i b) {
+    __m128i even = _mm_mul_epu32(a, b);
+    __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                              _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+#endif
@@ -0,0 +1,53 @@
+#ifndef FLOORCAST_H
+#define FLOORCAST_H
+
+#include "engine.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Pixels the span kernel steps together
+#define FLOORCAST_LANES 4
+
+// Farthest world coordinate a 16.16 position can hold; the span kernel also
+// multiplies tile rows as 16-bit values, so maps with a longer edge are drawn
+// with flat floors
+#define FLOORCAST_MAX_COORD 32767.0
+
+// Instruction set the span kernel was compiled for
+#if defined(__SSE2__)
+#define FLOORCAST_SIMD "sse2"
+#else
+#define FLOORCAST_SIMD "scalar"
+#endif
+
+// One screen row of the floor: the world position under its first pixel and
+// the step to the next pixel, in 16.16 fixed point. The ceiling row mirrored
+// about the horizon sees the same positions.
+typedef struct FloorRow {
+    Sint32 posX;
+    Sint32 posY;
+    Sint32 stepX;
+    Sint32 stepY;
+} FloorRow;
+
+// Set up floor row y (at or below the horizon) of a width x height view; the
+// row distance is computed once here, the span kernels only add steps
+void floorcast_setup_row(const Player *player, int y, int width, int height, FloorRow *row);
+
+// For count pixels of a row starting at column xStart, find the map tile under
+// each pixel (its index in the tile layout, -1 outside the map) and the texel
+// offset within a mip level of (1 << texShiftX) x (1 << texShiftY) texels
+void floorcast_span(const Map *map, const FloorRow *row, int xStart, int count,
+                    int texShiftX, int texShiftY, Sint32 *tiles, Sint32 *texels);
+
+// Scalar version of floorcast_span (the reference path); results are identical
+void floorcast_span_scalar(const Map *map, const FloorRow *row, int xStart, int count,
+                           int texShiftX, int texShiftY, Sint32 *tiles, Sint32 *texels);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FLOORCAST_H
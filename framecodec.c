@@ -0,0 +1,368 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "framecodec.h"
+
+// Slots of the encoder's color hash, a power of two well above the table size
+#define FRAMECODEC_SLOT_BITS 15
+#define FRAMECODEC_SLOTS (1 << FRAMECODEC_SLOT_BITS)
+
+// Longest run a token's first byte holds on its own
+#define FRAMECODEC_SHORT_RUN 63
+
+// Largest token of one pixel: the first byte, a new color's reference and its four bytes
+#define FRAMECODEC_MAX_PIXEL_BYTES 6
+
+// Pixels of the square blocks frames are transposed in; eight rows of a block
+// fit one cache set even when the pitch is a power of two
+#define FRAMECODEC_TILE 8
+
+// ****************************************************
+// Private (static) function declarations
+// ****************************************************
+
+// Size the frame buffers for width x height; a new size forgets the last frame
+static int framecodec_resize(FrameCodec *codec, int width, int height, int encoding);
+
+// Copy a rows x columns block of pixels to dst with rows and columns swapped,
+// in tiles so both sides are read and written a cache line at a time
+static void framecodec_transpose(const Uint32 *src, int srcPitch, Uint32 *dst, int dstPitch, int rows, int columns);
+
+// Write a token's first byte and the rest of its length; returns the byte after them
+static Uint8* framecodec_put_run(Uint8 *out, int kind, long length);
+
+// Write a color reference, adding a new color to the table while it has room
+static Uint8* framecodec_put_color(FrameCodec *codec, Uint8 *out, Uint32 color);
+
+// Write a varint
+static Uint8* framecodec_put_varint(Uint8 *out, Uint32 value);
+
+// Read a varint; returns 0 if it runs past end or does not fit 32 bits
+static int framecodec_get_varint(const Uint8 **data, const Uint8 *end, Uint32 *value);
+
+// Damaged frames leave no reference, so the frames after them are refused until the next keyframe
+static int framecodec_damaged(FrameCodec *codec);
+
+// Hash slot a color's search starts at
+static inline Uint32 framecodec_slot(Uint32 color) {
+    return (color * 2654435761u) >> (32 - FRAMECODEC_SLOT_BITS);
+}
+
+// ****************************************************
+// Public API Implementation
+// ****************************************************
+
+// Start a codec with no reference frame; buffers are allocated by the first frame
+void framecodec_init(FrameCodec *codec) {
+    memset(codec, 0, sizeof(FrameCodec));
+}
+
+// Free a codec's buffers
+void framecodec_free(FrameCodec *codec) {
+    free(codec->reference);
+    free(codec->current);
+    free(codec->slots);
+    framecodec_init(codec);
+}
+
+// Largest encoded size of a width x height frame, header included
+size_t framecodec_max_size(int width, int height) {
+    return sizeof(FrameCodecHeader) + (size_t)width * height * FRAMECODEC_MAX_PIXEL_BYTES;
+}
+
+// Encode a width x height ARGB8888 frame (pitch pixels per row) into out,
+// which holds at least framecodec_max_size bytes, as a change from the last
+// frame encoded. The first frame, a size change or keyframe set makes a
+// keyframe. Returns the bytes written, 0 on failure.
+size_t framecodec_encode(FrameCodec *codec, const Uint32 *pixels, int width, int height, int pitch,
+                         int keyframe, Uint8 *out) {
+    if (width <= 0 || height <= 0 || width > 0xFFFF || height > 0xFFFF) {
+        fprintf(stderr, "Cannot encode a %dx%d frame!\n", width, height);
+        return 0;
+    }
+    if (!codec->slots) {
+        codec->slots = (Uint16*)malloc(FRAMECODEC_SLOTS * sizeof(Uint16));
+        if (!codec->slots) {
+            fprintf(stderr, "Failed to allocate the color table!\n");
+            return 0;
+        }
+    }
+    if (!framecodec_resize(codec, width, height, 1)) {
+        return 0;
+    }
+
+    // A keyframe starts the color table over, so a stream can be joined at any keyframe
+    keyframe = keyframe || !codec->hasReference;
+    if (keyframe) {
+        codec->colorCount = 0;
+        memset(codec->slots, 0, FRAMECODEC_SLOTS * sizeof(Uint16));
+    }
+
+    // Take the longest token at each step; skips and copies cost no color, so they win ties
+    const Uint32 *current = codec->current;
+    const Uint32 *reference = codec->reference;
+    const long total = (long)width * height;
+    framecodec_transpose(pixels, pitch, codec->current, height, height, width);
+    Uint8 *next = out + sizeof(FrameCodecHeader);
+    for (long i = 0; i < total;) {
+        Uint32 color = current[i];
+        long skip = 0, left = 0, run = 1;
+        if (!keyframe) {
+            while (i + skip < total && current[i + skip] == reference[i + skip]) skip++;
+        }
+        if (i >= height) {
+            while (i + left < total && current[i + left] == current[i + left - height]) left++;
+        }
+        while (i + run < total && current[i + run] == color) run++;
+
+        if (skip >= left && skip >= run) {
+            next = framecodec_put_run(next, FRAMECODEC_SKIP, skip);
+            i += skip;
+        } else if (left >= run) {
+            next = framecodec_put_run(next, FRAMECODEC_LEFT, left);
+            i += left;
+        } else {
+            next = framecodec_put_run(next, FRAMECODEC_RUN, run);
+            next = framecodec_put_color(codec, next, color);
+            i += run;
+        }
+    }
+
+    codec->current = codec->reference;
+    codec->reference = (Uint32*)current;
+    codec->hasReference = 1;
+
+    FrameCodecHeader header;
+    memcpy(header.magic, FRAMECODEC_MAGIC, sizeof(header.magic));
+    header.version = FRAMECODEC_VERSION;
+    header.flags = keyframe ? FRAMECODEC_KEYFRAME : 0;
+    header.width = (Uint16)width;
+    header.height = (Uint16)height;
+    header.size = (Uint32)(next - out - sizeof(FrameCodecHeader));
+    memcpy(out, &header, sizeof(header));
+    return (size_t)(next - out);
+}
+
+// Decode an encoded frame of size bytes into pixels (pitch pixels per row,
+// width x height from framecodec_frame_size). Returns 1 on success, 0 if the
+// data is damaged or is not a keyframe and follows no frame of its size.
+int framecodec_decode(FrameCodec *codec, const Uint8 *data, size_t size, Uint32 *pixels, int pitch) {
+    int width, height;
+    size_t frameBytes;
+    if (!framecodec_frame_size(data, size, &width, &height, &frameBytes) || frameBytes > size) {
+        return framecodec_damaged(codec);
+    }
+
+    FrameCodecHeader header;
+    memcpy(&header, data, sizeof(header));
+    int keyframe = (header.flags & FRAMECODEC_KEYFRAME) != 0;
+    if (!keyframe && (!codec->hasReference || codec->width != width || codec->height != height)) {
+        fprintf(stderr, "Encoded frame follows no %dx%d frame!\n", width, height);
+        return 0;
+    }
+    if (!framecodec_resize(codec, width, height, 0)) {
+        return 0;
+    }
+    if (keyframe) {
+        codec->colorCount = 0;
+    }
+
+    // Tokens are applied to the reference in place: skipped pixels keep the
+    // last frame's colors, and the column to the left is already this frame's
+    Uint32 *reference = codec->reference;
+    const Uint8 *next = data + sizeof(FrameCodecHeader);
+    const Uint8 *end = data + frameBytes;
+    const long total = (long)width * height;
+    long i = 0;
+    while (next < end) {
+        int kind = *next >> 6;
+        Uint32 length = *next & FRAMECODEC_SHORT_RUN;
+        next++;
+        if (length == FRAMECODEC_SHORT_RUN) {
+            if (!framecodec_get_varint(&next, end, &length) || length > (Uint32)(total - i)) {
+                return framecodec_damaged(codec);
+            }
+            length += FRAMECODEC_SHORT_RUN;
+        }
+        length++;
+        if ((long)length > total - i || (kind == FRAMECODEC_SKIP && keyframe) ||
+            (kind == FRAMECODEC_LEFT && i < height)) {
+            return framecodec_damaged(codec);
+        }
+
+        if (kind == FRAMECODEC_RUN) {
+            Uint32 index;
+            Uint32 color;
+            if (!framecodec_get_varint(&next, end, &index)) {
+                return framecodec_damaged(codec);
+            }
+            if (index == 0) {
+                if (end - next < 4) {
+                    return framecodec_damaged(codec);
+                }
+                color = (Uint32)next[0] | (Uint32)next[1] << 8 | (Uint32)next[2] << 16 | (Uint32)next[3] << 24;
+                next += 4;
+                if (codec->colorCount < FRAMECODEC_MAX_COLORS) {
+                    codec->colors[codec->colorCount++] = color;
+                }
+            } else if (index <= (Uint32)codec->colorCount) {
+                color = codec->colors[index - 1];
+            } else {
+                return framecodec_damaged(codec);
+            }
+            for (Uint32 k = 0; k < length; k++) {
+                reference[i + k] = color;
+            }
+        } else if (kind == FRAMECODEC_LEFT) {
+            // A run longer than a column copies pixels it wrote itself, so it goes front to back
+            for (Uint32 k = 0; k < length; k++) {
+                reference[i + k] = reference[i + k - height];
+            }
+        } else if (kind != FRAMECODEC_SKIP) {
+            return framecodec_damaged(codec);
+        }
+        i += length;
+    }
+    if (i != total) {
+        return framecodec_damaged(codec);
+    }
+    codec->hasReference = 1;
+
+    framecodec_transpose(reference, height, pixels, pitch, width, height);
+    return 1;
+}
+
+// Read the size of an encoded frame and the bytes it takes, header included,
+// from the first size bytes of data; returns 0 if they hold no whole header
+int framecodec_frame_size(const Uint8 *data, size_t size, int *width, int *height, size_t *frameBytes) {
+    FrameCodecHeader header;
+    if (size < sizeof(header)) {
+        return 0;
+    }
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, FRAMECODEC_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != FRAMECODEC_VERSION || header.width == 0 || header.height == 0) {
+        return 0;
+    }
+
+    *width = header.width;
+    *height = header.height;
+    *frameBytes = sizeof(header) + header.size;
+    return 1;
+}
+
+// ****************************************************
+// Private functions implementation
+// ****************************************************
+
+// Size the frame buffers for width x height; a new size forgets the last frame
+static int framecodec_resize(FrameCodec *codec, int width, int height, int encoding) {
+    if (codec->reference && (codec->current || !encoding) && codec->width == width && codec->height == height) {
+        return 1;
+    }
+
+    size_t bytes = (size_t)width * height * sizeof(Uint32);
+    Uint32 *reference = (Uint32*)realloc(codec->reference, bytes);
+    if (reference) {
+        codec->reference = reference;
+    }
+    Uint32 *current = encoding ? (Uint32*)realloc(codec->current, bytes) : codec->current;
+    if (current) {
+        codec->current = current;
+    }
+    if (!reference || (encoding && !current)) {
+        fprintf(stderr, "Failed to allocate a %dx%d reference frame!\n", width, height);
+        codec->hasReference = 0;
+        return 0;
+    }
+    codec->width = width;
+    codec->height = height;
+    codec->hasReference = 0;
+    return 1;
+}
+
+// Copy a rows x columns block of pixels to dst with rows and columns swapped,
+// in tiles so both sides are read and written a cache line at a time
+static void framecodec_transpose(const Uint32 *src, int srcPitch, Uint32 *dst, int dstPitch, int rows, int columns) {
+    for (int row = 0; row < rows; row += FRAMECODEC_TILE) {
+        int lastRow = row + FRAMECODEC_TILE < rows ? row + FRAMECODEC_TILE : rows;
+        for (int column = 0; column < columns; column += FRAMECODEC_TILE) {
+            int lastColumn = column + FRAMECODEC_TILE < columns ? column + FRAMECODEC_TILE : columns;
+            for (int r = row; r < lastRow; r++) {
+                const Uint32 *from = src + (size_t)r * srcPitch;
+                for (int c = column; c < lastColumn; c++) {
+                    dst[(size_t)c * dstPitch + r] = from[c];
+                }
+            }
+        }
+    }
+}
+
+// Write a token's first byte and the rest of its length; returns the byte after them
+static Uint8* framecodec_put_run(Uint8 *out, int kind, long length) {
+    if (length - 1 < FRAMECODEC_SHORT_RUN) {
+        *out++ = (Uint8)(kind << 6 | (length - 1));
+        return out;
+    }
+    *out++ = (Uint8)(kind << 6 | FRAMECODEC_SHORT_RUN);
+    return framecodec_put_varint(out, (Uint32)(length - 1 - FRAMECODEC_SHORT_RUN));
+}
+
+// Write a color reference, adding a new color to the table while it has room
+static Uint8* framecodec_put_color(FrameCodec *codec, Uint8 *out, Uint32 color) {
+    Uint32 slot = framecodec_slot(color);
+    while (codec->slots[slot] != 0) {
+        if (codec->colors[codec->slots[slot] - 1] == color) {
+            return framecodec_put_varint(out, codec->slots[slot]);
+        }
+        slot = (slot + 1) & (FRAMECODEC_SLOTS - 1);
+    }
+
+    if (codec->colorCount < FRAMECODEC_MAX_COLORS) {
+        codec->colors[codec->colorCount++] = color;
+        codec->slots[slot] = (Uint16)codec->colorCount;
+    }
+    *out++ = 0;
+    out[0] = (Uint8)color;
+    out[1] = (Uint8)(color >> 8);
+    out[2] = (Uint8)(color >> 16);
+    out[3] = (Uint8)(color >> 24);
+    return out + 4;
+}
+
+// Write a varint
+static Uint8* framecodec_put_varint(Uint8 *out, Uint32 value) {
+    while (value >= 0x80) {
+        *out++ = (Uint8)(value | 0x80);
+        value >>= 7;
+    }
+    *out++ = (Uint8)value;
+    return out;
+}
+
+// Read a varint; returns 0 if it runs past end or does not fit 32 bits
+static int framecodec_get_varint(const Uint8 **data, const Uint8 *end, Uint32 *value) {
+    const Uint8 *next = *data;
+    Uint32 result = 0;
+    for (int shift = 0; shift < 32; shift += 7) {
+        if (next == end) {
+            return 0;
+        }
+        Uint8 byte = *next++;
+        result |= (Uint32)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            *data = next;
+            *value = result;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Damaged frames leave no reference, so the frames after them are refused until the next keyframe
+static int framecodec_damaged(FrameCodec *codec) {
+    fprintf(stderr, "Encoded frame is damaged!\n");
+    codec->hasReference = 0;
+    return 0;
+}
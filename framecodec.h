@@ -0,0 +1,85 @@
+#ifndef FRAMECODEC_H
+#define FRAMECODEC_H
+
+#include <stddef.h>
+
+#include <SDL.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Encoded frame identification
+#define FRAMECODEC_MAGIC "RCFC"
+#define FRAMECODEC_VERSION 1
+
+// Flags of an encoded frame
+#define FRAMECODEC_KEYFRAME 1       // Decodes on its own: no skips, and the color table starts empty
+
+// Colors the table of a stream holds at most; later new colors are sent whole every time
+#define FRAMECODEC_MAX_COLORS 16383
+
+// Kinds of token, in the top two bits of a token's first byte. Tokens cover
+// the frame in column order, top to bottom and then left to right, the order
+// the renderer draws in, and a run may go on into the next column.
+#define FRAMECODEC_SKIP 0           // Pixels unchanged since the previous frame
+#define FRAMECODEC_LEFT 1           // Pixels the same as the column to their left
+#define FRAMECODEC_RUN 2            // Pixels of one color: a color reference follows
+
+// Header of an encoded frame, in host byte order; size bytes of tokens follow.
+// A run's length is the low six bits of its first byte plus one, or when they
+// are all set, 64 plus a varint (seven bits a byte, low bits first) after it.
+// A color reference is a varint: 0 for a new color, whose four ARGB bytes
+// follow and which is added to the table, or the table index plus one.
+typedef struct FrameCodecHeader {
+    char magic[4];          // FRAMECODEC_MAGIC
+    Uint16 version;         // FRAMECODEC_VERSION
+    Uint16 flags;           // FRAMECODEC_KEYFRAME
+    Uint16 width;
+    Uint16 height;
+    Uint32 size;            // Bytes of tokens after the header
+} FrameCodecHeader;
+
+// One end of a stream of frames: an encoder or a decoder keeps the frame it
+// last saw and the color table, which later frames refer to
+typedef struct FrameCodec {
+    Uint32 *reference;      // Last frame encoded or decoded, column by column, width * height
+    Uint32 *current;        // Encoder only: the frame being encoded, column by column
+    int width;
+    int height;
+    int hasReference;       // A frame was seen since the last size change
+    Uint32 colors[FRAMECODEC_MAX_COLORS];
+    int colorCount;
+    Uint16 *slots;          // Encoder only: hash of colors to table index plus one
+} FrameCodec;
+
+// Start a codec with no reference frame; buffers are allocated by the first frame
+void framecodec_init(FrameCodec *codec);
+
+// Free a codec's buffers
+void framecodec_free(FrameCodec *codec);
+
+// Largest encoded size of a width x height frame, header included
+size_t framecodec_max_size(int width, int height);
+
+// Encode a width x height ARGB8888 frame (pitch pixels per row) into out,
+// which holds at least framecodec_max_size bytes, as a change from the last
+// frame encoded. The first frame, a size change or keyframe set makes a
+// keyframe. Returns the bytes written, 0 on failure.
+size_t framecodec_encode(FrameCodec *codec, const Uint32 *pixels, int width, int height, int pitch,
+                         int keyframe, Uint8 *out);
+
+// Decode an encoded frame of size bytes into pixels (pitch pixels per row,
+// width x height from framecodec_frame_size). Returns 1 on success, 0 if the
+// data is damaged or is not a keyframe and follows no frame of its size.
+int framecodec_decode(FrameCodec *codec, const Uint8 *data, size_t size, Uint32 *pixels, int pitch);
+
+// Read the size of an encoded frame and the bytes it takes, header included,
+// from the first size bytes of data; returns 0 if they hold no whole header
+int framecodec_frame_size(const Uint8 *data, size_t size, int *width, int *height, size_t *frameBytes);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FRAMECODEC_H
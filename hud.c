@@ -0,0 +1,125 @@
+#include <string.h>
+
+#include "hud.h"
+
+// Rows of each glyph from ' ' to 'Z', the high bit of the low five the leftmost pixel
+static const Uint8 hudFont['Z' - ' ' + 1][HUD_GLYPH_HEIGHT] = {
+    ['%' - ' '] = { 0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03 },
+    ['(' - ' '] = { 0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02 },
+    [')' - ' '] = { 0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08 },
+    ['+' - ' '] = { 0x00, 0x04, 0x04, 0x1F, 0x04, 0x04, 0x00 },
+    ['-' - ' '] = { 0x00, 0x00, 0x00, 0x1F, 0x00, 0x00, 0x00 },
+    ['.' - ' '] = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C },
+    ['/' - ' '] = { 0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00 },
+    ['0' - ' '] = { 0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E },
+    ['1' - ' '] = { 0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E },
+    ['2' - ' '] = { 0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F },
+    ['3' - ' '] = { 0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E },
+    ['4' - ' '] = { 0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02 },
+    ['5' - ' '] = { 0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E },
+    ['6' - ' '] = { 0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E },
+    ['7' - ' '] = { 0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08 },
+    ['8' - ' '] = { 0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E },
+    ['9' - ' '] = { 0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C },
+    [':' - ' '] = { 0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x0C, 0x00 },
+    ['=' - ' '] = { 0x00, 0x00, 0x1F, 0x00, 0x1F, 0x00, 0x00 },
+    ['A' - ' '] = { 0x0E, 0x11, 0x11, 0x11, 0x1F, 0x11, 0x11 },
+    ['B' - ' '] = { 0x1E, 0x11, 0x11, 0x1E, 0x11, 0x11, 0x1E },
+    ['C' - ' '] = { 0x0E, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0E },
+    ['D' - ' '] = { 0x1C, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1C },
+    ['E' - ' '] = { 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x1F },
+    ['F' - ' '] = { 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x10 },
+    ['G' - ' '] = { 0x0E, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0F },
+    ['H' - ' '] = { 0x11, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11 },
+    ['I' - ' '] = { 0x0E, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E },
+    ['J' - ' '] = { 0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0C },
+    ['K' - ' '] = { 0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11 },
+    ['L' - ' '] = { 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1F },
+    ['M' - ' '] = { 0x11, 0x1B, 0x15, 0x15, 0x11, 0x11, 0x11 },
+    ['N' - ' '] = { 0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11 },
+    ['O' - ' '] = { 0x0E, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E },
+    ['P' - ' '] = { 0x1E, 0x11, 0x11, 0x1E, 0x10, 0x10, 0x10 },
+    ['Q' - ' '] = { 0x0E, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0D },
+    ['R' - ' '] = { 0x1E, 0x11, 0x11, 0x1E, 0x14, 0x12, 0x11 },
+    ['S' - ' '] = { 0x0F, 0x10, 0x10, 0x0E, 0x01, 0x01, 0x1E },
+    ['T' - ' '] = { 0x1F, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04 },
+    ['U' - ' '] = { 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E },
+    ['V' - ' '] = { 0x11, 0x11, 0x11, 0x11, 0x11, 0x0A, 0x04 },
+    ['W' - ' '] = { 0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0A },
+    ['X' - ' '] = { 0x11, 0x11, 0x0A, 0x04, 0x0A, 0x11, 0x11 },
+    ['Y' - ' '] = { 0x11, 0x11, 0x11, 0x0A, 0x04, 0x04, 0x04 },
+    ['Z' - ' '] = { 0x1F, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1F },
+};
+
+// ****************************************************
+// Public API Implementation
+// ****************************************************
+
+// Start hidden with no frames
+void hud_init(Hud *hud) {
+    SDL_AtomicSet(&hud->visible, 0);
+    memset(hud->frameMs, 0, sizeof(hud->frameMs));
+    hud->frameCount = 0;
+}
+
+// Add the time of a frame, unclamped, to the history
+void hud_add_frame(Hud *hud, double frameMs) {
+    hud->frameMs[hud->frameCount % HUD_HISTORY] = frameMs;
+    hud->frameCount++;
+}
+
+// Mean and worst frame time of the history
+void hud_frame_stats(const Hud *hud, double *meanMs, double *maxMs) {
+    int count = hud->frameCount < HUD_HISTORY ? hud->frameCount : HUD_HISTORY;
+    double total = 0.0;
+    double worst = 0.0;
+    for (int i = 0; i < count; i++) {
+        total += hud->frameMs[i];
+        if (hud->frameMs[i] > worst) worst = hud->frameMs[i];
+    }
+    *meanMs = count > 0 ? total / count : 0.0;
+    *maxMs = worst;
+}
+
+// Darken the rectangle at (x, y) of w x h pixels, clipped to the frame, as a backdrop for text
+void hud_draw_panel(Uint32 *pixels, int pitch, int width, int height, int x, int y, int w, int h) {
+    int x0 = x > 0 ? x : 0;
+    int y0 = y > 0 ? y : 0;
+    int x1 = x + w < width ? x + w : width;
+    int y1 = y + h < height ? y + h : height;
+
+    // A quarter of the brightness: each channel shifted down twice
+    for (int row = y0; row < y1; row++) {
+        Uint32 *pixel = pixels + row * pitch;
+        for (int column = x0; column < x1; column++) {
+            pixel[column] = 0xFF000000u | ((pixel[column] >> 2) & 0x3F3F3Fu);
+        }
+    }
+}
+
+// Draw text with the built-in font, each font pixel scale x scale pixels, clipped to the
+// frame; lowercase letters are drawn as capitals and characters without a glyph as spaces
+void hud_draw_text(Uint32 *pixels, int pitch, int width, int height, int x, int y, int scale,
+                   const char *text, Uint32 color) {
+    for (; *text; text++, x += (HUD_GLYPH_WIDTH + 1) * scale) {
+        int c = *text >= 'a' && *text <= 'z' ? *text - 'a' + 'A' : *text;
+        if (c <= ' ' || c > 'Z') {
+            continue;
+        }
+
+        const Uint8 *glyph = hudFont[c - ' '];
+        for (int row = 0; row < HUD_GLYPH_HEIGHT * scale; row++) {
+            int py = y + row;
+            if (py < 0 || py >= height) {
+                continue;
+            }
+            Uint8 bits = glyph[row / scale];
+            for (int column = 0; column < HUD_GLYPH_WIDTH * scale; column++) {
+                int px = x + column;
+                if (px >= 0 && px < width && (bits & (0x10 >> (column / scale)))) {
+                    pixels[py * pitch + px] = color;
+                }
+            }
+        }
+    }
+}
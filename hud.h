@@ -0,0 +1,45 @@
+#ifndef HUD_H
+#define HUD_H
+
+#include <SDL.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Size of a glyph of the built-in font, in pixels before scaling
+#define HUD_GLYPH_WIDTH 5
+#define HUD_GLYPH_HEIGHT 7
+
+// Frame times the overlay averages over
+#define HUD_HISTORY 64
+
+// On-screen overlay: whether it is shown and the recent frame times it summarises
+typedef struct Hud {
+    SDL_atomic_t visible;       // Toggled by the event thread, read by the thread that draws
+    double frameMs[HUD_HISTORY];
+    int frameCount;             // Frames added so far; the newest is at (frameCount - 1) % HUD_HISTORY
+} Hud;
+
+// Start hidden with no frames
+void hud_init(Hud *hud);
+
+// Add the time of a frame, unclamped, to the history
+void hud_add_frame(Hud *hud, double frameMs);
+
+// Mean and worst frame time of the history
+void hud_frame_stats(const Hud *hud, double *meanMs, double *maxMs);
+
+// Darken the rectangle at (x, y) of w x h pixels, clipped to the frame, as a backdrop for text
+void hud_draw_panel(Uint32 *pixels, int pitch, int width, int height, int x, int y, int w, int h);
+
+// Draw text with the built-in font, each font pixel scale x scale pixels, clipped to the
+// frame; lowercase letters are drawn as capitals and characters without a glyph as spaces
+void hud_draw_text(Uint32 *pixels, int pitch, int width, int height, int x, int y, int scale,
+                   const char *text, Uint32 color);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HUD_H
@@ -0,0 +1,348 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "lighting.h"
+
+// Offset from a face to the point its light is measured at, just outside the wall
+#define LIGHTING_FACE_OFFSET 1e-3
+
+// Changed tiles lighting_update_tiles sorts into separate regions at most; more
+// are baked as one rectangle around them all
+#define LIGHTING_MAX_REGIONS 1024
+
+// Light sums of one tile's faces while baking
+typedef struct LightSums {
+    int face[MAP_FACES];
+} LightSums;
+
+// ****************************************************
+// Private (static) function declarations
+// ****************************************************
+
+// Check whether the segment from (x0, y0) to (x1, y1) crosses no wall tile
+static int lighting_visible(const Map *map, double x0, double y0, double x1, double y1);
+
+// Level a light adds at point (px, py), seen along outward normal (nx, ny)
+// (0, 0 for floors); 0 when out of range or blocked
+static int lighting_contribution(const Map *map, const MapLight *light, double px, double py,
+                                 double nx, double ny);
+
+// Add the light's contributions to the tiles of rectangle [x0, x1] x [y0, y1]
+static void lighting_add_light(const Map *map, const MapLight *light, int x0, int y0, int x1, int y1,
+                               LightSums *sums);
+
+// Bake the tiles of rectangle [x0, x1] x [y0, y1] from the ambient level and every light
+static int lighting_bake_rect(Map *map, int x0, int y0, int x1, int y1);
+
+// Rectangle of tiles a change to tile (x, y) can re-light, as x0, y0, x1, y1
+static void lighting_tile_region(const Map *map, int x, int y, int *region);
+
+// ****************************************************
+// Public API Implementation
+// ****************************************************
+
+// Bake the light level of every face of every tile from the map's ambient level
+// and lights; maps without lights at full ambient stay unlit (light == NULL)
+int lighting_bake(Map *map) {
+    if (map->lightCount == 0 && map->ambient >= MAP_LIGHT_FULL) {
+        if (map->light) {
+            free(map->light);
+            map->light = NULL;
+            map_mark_changed(map, 0, 0, map->width - 1, map->height - 1);
+        }
+        return 1;
+    }
+
+    // An unlit map was drawn at full ambient, which a new level of 0 does not show
+    if (!map->light) {
+        map->light = (Uint8*)calloc(map_storage_size(map), MAP_FACES);
+        if (!map->light) {
+            fprintf(stderr, "Failed to allocate light levels for map %s\n", map->name);
+            return 0;
+        }
+        map_mark_changed(map, 0, 0, map->width - 1, map->height - 1);
+    }
+    return lighting_bake_rect(map, 0, 0, map->width - 1, map->height - 1);
+}
+
+// Replace light index of a lit map and re-bake only the tiles the old or the
+// new light reaches; returns the number of tiles baked, -1 on failure
+int lighting_set_light(Map *map, int index, const MapLight *light) {
+    if (index < 0 || index >= map->lightCount || !map->light) {
+        return -1;
+    }
+
+    // The bounding box of both versions' reach covers every tile that can change
+    const MapLight *old = &map->lights[index];
+    int x0 = old->x - old->radius < light->x - light->radius ? old->x - old->radius : light->x - light->radius;
+    int y0 = old->y - old->radius < light->y - light->radius ? old->y - old->radius : light->y - light->radius;
+    int x1 = old->x + old->radius > light->x + light->radius ? old->x + old->radius : light->x + light->radius;
+    int y1 = old->y + old->radius > light->y + light->radius ? old->y + old->radius : light->y + light->radius;
+    if (x0 < 0) x0 = 0;
+    if (y0 < 0) y0 = 0;
+    if (x1 >= map->width) x1 = map->width - 1;
+    if (y1 >= map->height) y1 = map->height - 1;
+
+    map->lights[index] = *light;
+    if (x0 > x1 || y0 > y1) {
+        return 0;
+    }
+    if (!lighting_bake_rect(map, x0, y0, x1, y1)) {
+        return -1;
+    }
+    return (x1 - x0 + 1) * (y1 - y0 + 1);
+}
+
+// Re-bake a lit map after count tiles (x, y pairs in tiles) turned from wall to
+// empty or back: their neighbours, whose faces they show or hide, and every
+// tile a light reaching them lights; returns the number of tiles baked, -1 on failure
+int lighting_update_tiles(Map *map, const int *tiles, int count) {
+    if (!map->light || count <= 0) {
+        return 0;
+    }
+
+    int regionCount = count < LIGHTING_MAX_REGIONS ? count : 1;
+    int *regions = (int*)malloc((size_t)regionCount * 4 * sizeof(int));
+    if (!regions) {
+        fprintf(stderr, "Failed to update light levels for map %s\n", map->name);
+        return -1;
+    }
+    for (int i = 0; i < count; i++) {
+        int region[4];
+        lighting_tile_region(map, tiles[i * 2], tiles[i * 2 + 1], region);
+        int *into = &regions[(regionCount == 1 ? 0 : i) * 4];
+        if (regionCount == 1 && i > 0) {
+            if (region[0] < into[0]) into[0] = region[0];
+            if (region[1] < into[1]) into[1] = region[1];
+            if (region[2] > into[2]) into[2] = region[2];
+            if (region[3] > into[3]) into[3] = region[3];
+        } else {
+            memcpy(into, region, sizeof(region));
+        }
+    }
+
+    // Merge overlapping regions so no tile is baked twice
+    for (int merged = 1; merged; ) {
+        merged = 0;
+        for (int i = 0; i < regionCount; i++) {
+            for (int j = i + 1; j < regionCount; j++) {
+                int *a = &regions[i * 4];
+                int *b = &regions[j * 4];
+                if (a[0] > b[2] || b[0] > a[2] || a[1] > b[3] || b[1] > a[3]) {
+                    continue;
+                }
+                if (b[0] < a[0]) a[0] = b[0];
+                if (b[1] < a[1]) a[1] = b[1];
+                if (b[2] > a[2]) a[2] = b[2];
+                if (b[3] > a[3]) a[3] = b[3];
+                memcpy(b, &regions[(regionCount - 1) * 4], 4 * sizeof(int));
+                regionCount--;
+                j--;
+                merged = 1;
+            }
+        }
+    }
+
+    int baked = 0;
+    for (int i = 0; i < regionCount; i++) {
+        const int *region = &regions[i * 4];
+        if (!lighting_bake_rect(map, region[0], region[1], region[2], region[3])) {
+            free(regions);
+            return -1;
+        }
+        baked += (region[2] - region[0] + 1) * (region[3] - region[1] + 1);
+    }
+    free(regions);
+    return baked;
+}
+
+// Shade each of colors palette entries at every light level
+void lighting_build_colormap(const Uint32 *palette, int colors, LightingColormap colormap) {
+    for (int level = 0; level < MAP_LIGHT_LEVELS; level++) {
+        for (int i = 0; i < LIGHTING_COLORS; i++) {
+            Uint32 color = i < colors ? palette[i] : 0;
+            Uint32 r = ((color >> 16) & 0xFF) * (level + 1) / MAP_LIGHT_LEVELS;
+            Uint32 g = ((color >> 8) & 0xFF) * (level + 1) / MAP_LIGHT_LEVELS;
+            Uint32 b = (color & 0xFF) * (level + 1) / MAP_LIGHT_LEVELS;
+            colormap[level][i] = 0xFF000000u | (r << 16) | (g << 8) | b;
+        }
+    }
+}
+
+// ****************************************************
+// Private functions implementation
+// ****************************************************
+
+// Check whether the segment from (x0, y0) to (x1, y1) crosses no wall tile
+static int lighting_visible(const Map *map, double x0, double y0, double x1, double y1) {
+    int mapX = (int)floor(x0);
+    int mapY = (int)floor(y0);
+    int endX = (int)floor(x1);
+    int endY = (int)floor(y1);
+    double dirX = x1 - x0;
+    double dirY = y1 - y0;
+
+    // Walk the tiles the segment crosses, as the renderer's DDA does
+    double deltaX = dirX != 0.0 ? fabs(1.0 / dirX) : INFINITY;
+    double deltaY = dirY != 0.0 ? fabs(1.0 / dirY) : INFINITY;
+    int stepX = dirX < 0 ? -1 : 1;
+    int stepY = dirY < 0 ? -1 : 1;
+    double sideX = dirX < 0 ? (x0 - mapX) * deltaX : (mapX + 1.0 - x0) * deltaX;
+    double sideY = dirY < 0 ? (y0 - mapY) * deltaY : (mapY + 1.0 - y0) * deltaY;
+
+    while (mapX != endX || mapY != endY) {
+        if (sideX < sideY) {
+            if (sideX > 1.0) break;
+            sideX += deltaX;
+            mapX += stepX;
+        } else {
+            if (sideY > 1.0) break;
+            sideY += deltaY;
+            mapY += stepY;
+        }
+        if (mapX < 0 || mapX >= map->width || mapY < 0 || mapY >= map->height ||
+            map_get(map, mapX, mapY) > 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Level a light adds at point (px, py), seen along outward normal (nx, ny)
+// (0, 0 for floors); 0 when out of range or blocked
+static int lighting_contribution(const Map *map, const MapLight *light, double px, double py,
+                                 double nx, double ny) {
+    double lightX = light->x + 0.5;
+    double lightY = light->y + 0.5;
+    double dx = lightX - px;
+    double dy = lightY - py;
+    double distance = sqrt(dx * dx + dy * dy);
+    if (distance >= light->radius) {
+        return 0;
+    }
+
+    // Walls facing away from the light get none, others by the cosine of the angle
+    double facing = 1.0;
+    if (nx != 0.0 || ny != 0.0) {
+        facing = distance > 0.0 ? (dx * nx + dy * ny) / distance : 0.0;
+        if (facing <= 0.0) {
+            return 0;
+        }
+    }
+
+    if (!lighting_visible(map, lightX, lightY, px + nx * LIGHTING_FACE_OFFSET, py + ny * LIGHTING_FACE_OFFSET)) {
+        return 0;
+    }
+    return (int)(light->level * (1.0 - distance / light->radius) * facing + 0.5);
+}
+
+// Add the light's contributions to the tiles of rectangle [x0, x1] x [y0, y1]
+static void lighting_add_light(const Map *map, const MapLight *light, int x0, int y0, int x1, int y1,
+                               LightSums *sums) {
+    // Only the square the light reaches, clipped to the rectangle
+    int fromX = light->x - light->radius > x0 ? light->x - light->radius : x0;
+    int fromY = light->y - light->radius > y0 ? light->y - light->radius : y0;
+    int toX = light->x + light->radius < x1 ? light->x + light->radius : x1;
+    int toY = light->y + light->radius < y1 ? light->y + light->radius : y1;
+    int width = x1 - x0 + 1;
+
+    for (int y = fromY; y <= toY; y++) {
+        for (int x = fromX; x <= toX; x++) {
+            LightSums *tile = &sums[(y - y0) * width + (x - x0)];
+            if (map_get(map, x, y) == 0) {
+                tile->face[0] += lighting_contribution(map, light, x + 0.5, y + 0.5, 0.0, 0.0);
+                continue;
+            }
+
+            // Wall faces, each lit from the open tile in front of it
+            if (x > 0 && map_get(map, x - 1, y) == 0) {
+                tile->face[MAP_FACE_X_MIN] += lighting_contribution(map, light, x, y + 0.5, -1.0, 0.0);
+            }
+            if (x + 1 < map->width && map_get(map, x + 1, y) == 0) {
+                tile->face[MAP_FACE_X_MAX] += lighting_contribution(map, light, x + 1.0, y + 0.5, 1.0, 0.0);
+            }
+            if (y > 0 && map_get(map, x, y - 1) == 0) {
+                tile->face[MAP_FACE_Y_MIN] += lighting_contribution(map, light, x + 0.5, y, 0.0, -1.0);
+            }
+            if (y + 1 < map->height && map_get(map, x, y + 1) == 0) {
+                tile->face[MAP_FACE_Y_MAX] += lighting_contribution(map, light, x + 0.5, y + 1.0, 0.0, 1.0);
+            }
+        }
+    }
+}
+
+// Bake the tiles of rectangle [x0, x1] x [y0, y1] from the ambient level and every light
+static int lighting_bake_rect(Map *map, int x0, int y0, int x1, int y1) {
+    int width = x1 - x0 + 1;
+    int height = y1 - y0 + 1;
+    LightSums *sums = (LightSums*)calloc((size_t)width * height, sizeof(LightSums));
+    if (!sums) {
+        fprintf(stderr, "Failed to bake light levels for map %s\n", map->name);
+        return 0;
+    }
+
+    for (int i = 0; i < map->lightCount; i++) {
+        const MapLight *light = &map->lights[i];
+        if (light->x + light->radius >= x0 && light->x - light->radius <= x1 &&
+            light->y + light->radius >= y0 && light->y - light->radius <= y1) {
+            lighting_add_light(map, light, x0, y0, x1, y1, sums);
+        }
+    }
+
+    // Y faces get half the light, as flat shading always gave them; renderers
+    // are told the rectangle of the tiles whose levels changed
+    int changedX0 = x1 + 1, changedY0 = y1 + 1, changedX1 = x0 - 1, changedY1 = y0 - 1;
+    for (int y = y0; y <= y1; y++) {
+        for (int x = x0; x <= x1; x++) {
+            const LightSums *tile = &sums[(y - y0) * width + (x - x0)];
+            Uint8 *levels = &map->light[map_tile_index(map, x, y) * MAP_FACES];
+            int wall = map_get(map, x, y) > 0;
+            int changed = 0;
+            for (int face = 0; face < MAP_FACES; face++) {
+                int level = map->ambient + tile->face[wall ? face : 0];
+                if (level > MAP_LIGHT_FULL) level = MAP_LIGHT_FULL;
+                if (wall && face >= MAP_FACE_Y_MIN) level = (level + 1) / 2 - 1;
+                if (level < 0) level = 0;
+                changed |= levels[face] != level;
+                levels[face] = (Uint8)level;
+            }
+            if (changed) {
+                if (x < changedX0) changedX0 = x;
+                if (y < changedY0) changedY0 = y;
+                if (x > changedX1) changedX1 = x;
+                if (y > changedY1) changedY1 = y;
+            }
+        }
+    }
+
+    free(sums);
+    if (changedX0 <= changedX1) {
+        map_mark_changed(map, changedX0, changedY0, changedX1, changedY1);
+    }
+    return 1;
+}
+
+// Rectangle of tiles a change to tile (x, y) can re-light, as x0, y0, x1, y1
+static void lighting_tile_region(const Map *map, int x, int y, int *region) {
+    // Its neighbours' faces, and everything lit along a path through it: such a
+    // path ends within the light's reach, so the whole reach
+    region[0] = x - 1;
+    region[1] = y - 1;
+    region[2] = x + 1;
+    region[3] = y + 1;
+    for (int i = 0; i < map->lightCount; i++) {
+        const MapLight *light = &map->lights[i];
+        if (abs(light->x - x) <= light->radius && abs(light->y - y) <= light->radius) {
+            if (light->x - light->radius < region[0]) region[0] = light->x - light->radius;
+            if (light->y - light->radius < region[1]) region[1] = light->y - light->radius;
+            if (light->x + light->radius > region[2]) region[2] = light->x + light->radius;
+            if (light->y + light->radius > region[3]) region[3] = light->y + light->radius;
+        }
+    }
+    if (region[0] < 0) region[0] = 0;
+    if (region[1] < 0) region[1] = 0;
+    if (region[2] >= map->width) region[2] = map->width - 1;
+    if (region[3] >= map->height) region[3] = map->height - 1;
+}
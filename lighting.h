@@ -0,0 +1,50 @@
+#ifndef LIGHTING_H
+#define LIGHTING_H
+
+#include "map.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Entries of the palette textures are indexed into
+#define LIGHTING_COLORS 256
+
+// Colormap: every palette color at every light level, ARGB8888
+typedef Uint32 LightingColormap[MAP_LIGHT_LEVELS][LIGHTING_COLORS];
+
+// Bake the light level of every face of every tile from the map's ambient level
+// and lights; maps without lights at full ambient stay unlit (light == NULL)
+int lighting_bake(Map *map);
+
+// Replace light index of a lit map and re-bake only the tiles the old or the
+// new light reaches; returns the number of tiles baked, -1 on failure
+int lighting_set_light(Map *map, int index, const MapLight *light);
+
+// Re-bake a lit map after count tiles (x, y pairs in tiles) turned from wall to
+// empty or back: their neighbours, whose faces they show or hide, and every
+// tile a light reaching them lights; returns the number of tiles baked, -1 on failure
+int lighting_update_tiles(Map *map, const int *tiles, int count);
+
+// Shade each of colors palette entries at every light level
+void lighting_build_colormap(const Uint32 *palette, int colors, LightingColormap colormap);
+
+// Light level of a face of wall tile (x, y), hit on side (0 for x, 1 for y);
+// unlit maps keep the flat look, y faces at half light
+static inline int lighting_face_level(const Map *map, int x, int y, int side, int face) {
+    if (!map->light) {
+        return side ? MAP_LIGHT_HALF : MAP_LIGHT_FULL;
+    }
+    return map_light(map, x, y, face);
+}
+
+// Light level of the floor and ceiling of the tile at index tile in the tile layout
+static inline int lighting_tile_level(const Map *map, size_t tile) {
+    return map->light ? map->light[tile * MAP_FACES] : MAP_LIGHT_FULL;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LIGHTING_H
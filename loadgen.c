@@ -0,0 +1,491 @@
+// Sockets, shared memory, descriptor passing and clock_gettime are POSIX, not C99
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
+#include "server.h"
+
+#ifndef _WIN32
+
+// Defaults: a handful of connections, each keeping a few small batches in flight
+#define LOADGEN_CONNECTIONS 4
+#define LOADGEN_REQUESTS 2000       // Per connection
+#define LOADGEN_VIEWS 16            // Per request
+#define LOADGEN_WIDTH 64
+#define LOADGEN_HEIGHT 48
+#define LOADGEN_DEPTH 4             // Requests in flight per connection
+#define LOADGEN_TIMEOUT_MS 10000    // Longest wait for a reply before giving up
+
+// Ring check: one request filling 15/32 of the ring (30 MB of 64), released,
+// then one filling 5/8 (40 MB); together they do not fit, one after the other they must
+#define LOADGEN_RING_WIDTH 1024
+#define LOADGEN_RING_HEIGHT 768
+
+// Command line options
+typedef struct LoadOptions {
+    const char *socketPath;
+    const char *outPath;    // JSON output file (stdout when NULL)
+    int connections;
+    int requests;
+    int views;
+    int width;
+    int height;
+    int depth;
+    int mapIndex;           // Map every request renders, -1 to go through all of them
+    int ringCheck;          // Check on a connection of its own that an emptied ring takes any request
+} LoadOptions;
+
+// One connection to the server and the requests it has sent
+typedef struct LoadConnection {
+    int fd;
+    const Uint8 *ring;
+    Uint64 ringBytes;
+    int sent;
+    int done;
+    double *sentAt;         // Send time of each request, by id
+    Uint8 input[sizeof(ServerReply) * 64];
+    size_t inputUsed;
+} LoadConnection;
+
+// The server's maps, from the connection handshake
+static ServerMapInfo *loadMaps = NULL;
+static int loadMapCount = 0;
+
+// Current time in milliseconds from a monotonic clock
+static double loadgen_now_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000.0 + now.tv_nsec / 1e6;
+}
+
+// Write all of a buffer to a blocking socket
+static int loadgen_send_all(int fd, const void *data, size_t size) {
+    const Uint8 *bytes = (const Uint8*)data;
+    while (size > 0) {
+        ssize_t sent = send(fd, bytes, size, 0);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            return 0;
+        }
+        bytes += sent;
+        size -= (size_t)sent;
+    }
+    return 1;
+}
+
+// Read exactly size bytes from a blocking socket
+static int loadgen_receive_all(int fd, void *data, size_t size) {
+    Uint8 *bytes = (Uint8*)data;
+    while (size > 0) {
+        ssize_t received = recv(fd, bytes, size, 0);
+        if (received <= 0) {
+            if (received < 0 && errno == EINTR) continue;
+            return 0;
+        }
+        bytes += received;
+        size -= (size_t)received;
+    }
+    return 1;
+}
+
+// Connect to the server, map the ring that comes with its hello and read its map list
+static int loadgen_connect(const char *path, LoadConnection *connection) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+
+    connection->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (connection->fd < 0 || connect(connection->fd, (struct sockaddr*)&address, sizeof(address)) < 0) {
+        fprintf(stderr, "Failed to connect to %s: %s\n", path, strerror(errno));
+        return 0;
+    }
+
+    // The hello arrives alone with the ring's descriptor attached
+    ServerHello hello;
+    char control[CMSG_SPACE(sizeof(int))];
+    struct iovec part = { &hello, sizeof(hello) };
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &part;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    ssize_t received = recvmsg(connection->fd, &message, 0);
+    struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+    if (received != (ssize_t)sizeof(hello) || memcmp(hello.magic, SERVER_MAGIC, 4) != 0 ||
+        hello.version != SERVER_VERSION || !header || header->cmsg_type != SCM_RIGHTS) {
+        fprintf(stderr, "Not a render server, or another version: %s\n", path);
+        return 0;
+    }
+    int ringFd;
+    memcpy(&ringFd, CMSG_DATA(header), sizeof(int));
+    void *ring = mmap(NULL, hello.ringBytes, PROT_READ, MAP_SHARED, ringFd, 0);
+    close(ringFd);
+    if (ring == MAP_FAILED) {
+        fprintf(stderr, "Failed to map the frame ring: %s\n", strerror(errno));
+        return 0;
+    }
+    connection->ring = (const Uint8*)ring;
+    connection->ringBytes = hello.ringBytes;
+
+    ServerMapInfo *maps = (ServerMapInfo*)malloc((hello.mapCount ? hello.mapCount : 1) * sizeof(ServerMapInfo));
+    if (!maps || !loadgen_receive_all(connection->fd, maps, hello.mapCount * sizeof(ServerMapInfo))) {
+        fprintf(stderr, "Failed to read the map list\n");
+        free(maps);
+        return 0;
+    }
+    if (!loadMaps) {
+        loadMaps = maps;
+        loadMapCount = (int)hello.mapCount;
+    } else {
+        free(maps);
+    }
+    return 1;
+}
+
+// Send request id of a connection: cameras spread around the map's starting
+// position, turned a little further with every request
+static int loadgen_send_request(const LoadOptions *options, LoadConnection *connection, Uint8 *buffer) {
+    int id = connection->sent;
+    ServerRequest request;
+    memset(&request, 0, sizeof(request));
+    request.type = SERVER_RENDER;
+    request.id = (Uint32)id;
+    request.mapIndex = options->mapIndex >= 0 ? options->mapIndex : id % loadMapCount;
+    request.width = (Uint16)options->width;
+    request.height = (Uint16)options->height;
+    request.viewCount = (Uint32)options->views;
+    memcpy(buffer, &request, sizeof(request));
+
+    const ServerMapInfo *map = &loadMaps[request.mapIndex];
+    for (int v = 0; v < options->views; v++) {
+        double angle = id * 2.399963 + v * 2.0 * M_PI / options->views;
+        ServerPose pose;
+        pose.posX = map->startX;
+        pose.posY = map->startY;
+        pose.dirX = cos(angle);
+        pose.dirY = sin(angle);
+        pose.planeX = -pose.dirY * 0.66;
+        pose.planeY = pose.dirX * 0.66;
+        memcpy(buffer + sizeof(request) + v * sizeof(ServerPose), &pose, sizeof(pose));
+    }
+
+    connection->sentAt[id] = loadgen_now_ms();
+    connection->sent++;
+    return loadgen_send_all(connection->fd, buffer, sizeof(request) + options->views * sizeof(ServerPose));
+}
+
+// Send one render request of views cameras at the first map's starting
+// position and wait for its reply; returns 0 if none came or it failed
+static int loadgen_render_once(LoadConnection *connection, Uint32 id, int width, int height, int views) {
+    size_t size = sizeof(ServerRequest) + views * sizeof(ServerPose);
+    Uint8 *buffer = (Uint8*)malloc(size);
+    if (!buffer) {
+        return 0;
+    }
+    ServerRequest request;
+    memset(&request, 0, sizeof(request));
+    request.type = SERVER_RENDER;
+    request.id = id;
+    request.mapIndex = 0;
+    request.width = (Uint16)width;
+    request.height = (Uint16)height;
+    request.viewCount = (Uint32)views;
+    memcpy(buffer, &request, sizeof(request));
+    for (int v = 0; v < views; v++) {
+        double angle = v * 2.0 * M_PI / views;
+        ServerPose pose;
+        pose.posX = loadMaps[0].startX;
+        pose.posY = loadMaps[0].startY;
+        pose.dirX = cos(angle);
+        pose.dirY = sin(angle);
+        pose.planeX = -pose.dirY * 0.66;
+        pose.planeY = pose.dirX * 0.66;
+        memcpy(buffer + sizeof(request) + v * sizeof(ServerPose), &pose, sizeof(pose));
+    }
+    int ok = loadgen_send_all(connection->fd, buffer, size);
+    free(buffer);
+
+    struct pollfd fds;
+    fds.fd = connection->fd;
+    fds.events = POLLIN;
+    ServerReply reply;
+    if (!ok || poll(&fds, 1, LOADGEN_TIMEOUT_MS) <= 0 ||
+        !loadgen_receive_all(connection->fd, &reply, sizeof(reply))) {
+        fprintf(stderr, "No reply to a request of %d views of %dx%d in %d ms\n", views, width, height,
+                LOADGEN_TIMEOUT_MS);
+        return 0;
+    }
+    if (reply.type != SERVER_FRAMES || reply.id != id || reply.status != SERVER_OK) {
+        fprintf(stderr, "A request of %d views of %dx%d failed with status %u\n", views, width, height,
+                reply.status);
+        return 0;
+    }
+    return 1;
+}
+
+// Render a request taking 15/32 of the ring and release it, then one taking
+// 5/8: the second only fits if the server starts over in its emptied ring
+static int loadgen_check_ring(const char *path) {
+    LoadConnection connection;
+    memset(&connection, 0, sizeof(connection));
+    if (!loadgen_connect(path, &connection)) {
+        return 0;
+    }
+    Uint64 frameBytes = (Uint64)LOADGEN_RING_WIDTH * LOADGEN_RING_HEIGHT * sizeof(Uint32);
+    int first = (int)(connection.ringBytes * 15 / 32 / frameBytes);
+    int second = (int)(connection.ringBytes * 5 / 8 / frameBytes);
+
+    ServerRequest release;
+    memset(&release, 0, sizeof(release));
+    release.type = SERVER_RELEASE;
+    release.id = 0;
+    int ok = first > 0 && loadgen_render_once(&connection, 0, LOADGEN_RING_WIDTH, LOADGEN_RING_HEIGHT, first) &&
+             loadgen_send_all(connection.fd, &release, sizeof(release)) &&
+             loadgen_render_once(&connection, 1, LOADGEN_RING_WIDTH, LOADGEN_RING_HEIGHT, second);
+    close(connection.fd);
+    munmap((void*)connection.ring, connection.ringBytes);
+    return ok;
+}
+
+// Compare two doubles for qsort
+static int loadgen_compare_double(const void *a, const void *b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Value at fraction p of sorted values
+static double loadgen_percentile(const double *sorted, int count, double p) {
+    int index = (int)ceil(p * count) - 1;
+    if (index < 0) index = 0;
+    if (index >= count) index = count - 1;
+    return sorted[index];
+}
+
+// Print usage information
+static void loadgen_usage(const char *program) {
+    fprintf(stderr, "Usage: %s [--socket PATH] [--connections N] [--requests N] [--views N]\n"
+                    "       [--res WxH] [--depth N] [--map N] [--ring-check] [--out FILE]\n", program);
+}
+
+// Parse the command line; returns 0 on bad arguments
+static int loadgen_parse_args(int argc, char *argv[], LoadOptions *options) {
+    options->socketPath = "raycaster.sock";
+    options->outPath = NULL;
+    options->connections = LOADGEN_CONNECTIONS;
+    options->requests = LOADGEN_REQUESTS;
+    options->views = LOADGEN_VIEWS;
+    options->width = LOADGEN_WIDTH;
+    options->height = LOADGEN_HEIGHT;
+    options->depth = LOADGEN_DEPTH;
+    options->mapIndex = -1;
+    options->ringCheck = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc) {
+            options->socketPath = argv[++i];
+        } else if (strcmp(argv[i], "--connections") == 0 && i + 1 < argc) {
+            options->connections = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--requests") == 0 && i + 1 < argc) {
+            options->requests = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--views") == 0 && i + 1 < argc) {
+            options->views = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--res") == 0 && i + 1 < argc &&
+                   sscanf(argv[i + 1], "%dx%d", &options->width, &options->height) == 2) {
+            i++;
+        } else if (strcmp(argv[i], "--depth") == 0 && i + 1 < argc) {
+            options->depth = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--map") == 0 && i + 1 < argc) {
+            options->mapIndex = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--ring-check") == 0) {
+            options->ringCheck = 1;
+        } else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+            options->outPath = argv[++i];
+        } else {
+            return 0;
+        }
+    }
+    return options->connections > 0 && options->connections <= SERVER_MAX_CLIENTS && options->requests > 0 &&
+           options->views > 0 && options->views <= SERVER_MAX_VIEWS && options->depth > 0 &&
+           options->width > 0 && options->width <= SERVER_MAX_SIZE &&
+           options->height > 0 && options->height <= SERVER_MAX_SIZE;
+}
+
+int main(int argc, char *argv[]) {
+    LoadOptions options;
+    if (!loadgen_parse_args(argc, argv, &options)) {
+        loadgen_usage(argv[0]);
+        return 1;
+    }
+
+    LoadConnection *connections = (LoadConnection*)calloc(options.connections, sizeof(LoadConnection));
+    Uint8 *buffer = (Uint8*)malloc(sizeof(ServerRequest) + options.views * sizeof(ServerPose));
+    double *latencies = (double*)malloc((size_t)options.connections * options.requests * sizeof(double));
+    if (!connections || !buffer || !latencies) {
+        fprintf(stderr, "Failed to allocate the load generator!\n");
+        return 1;
+    }
+    for (int c = 0; c < options.connections; c++) {
+        connections[c].sentAt = (double*)malloc(options.requests * sizeof(double));
+        if (!connections[c].sentAt || !loadgen_connect(options.socketPath, &connections[c])) {
+            return 1;
+        }
+    }
+    if (loadMapCount == 0 || options.mapIndex >= loadMapCount) {
+        fprintf(stderr, "The server has %d maps, map %d was asked for\n", loadMapCount, options.mapIndex);
+        return 1;
+    }
+    if (options.ringCheck && !loadgen_check_ring(options.socketPath)) {
+        return 1;
+    }
+
+    // Keep depth requests in flight on every connection; each reply is checked,
+    // timed and released
+    int total = options.connections * options.requests;
+    int completed = 0;
+    int errors = 0;
+    Uint64 checksum = 0;
+    struct pollfd fds[SERVER_MAX_CLIENTS];
+    double start = loadgen_now_ms();
+    while (completed < total) {
+        for (int c = 0; c < options.connections; c++) {
+            LoadConnection *connection = &connections[c];
+            while (connection->sent < options.requests && connection->sent - connection->done < options.depth) {
+                if (!loadgen_send_request(&options, connection, buffer)) {
+                    fprintf(stderr, "Lost the connection to the server\n");
+                    return 1;
+                }
+            }
+            fds[c].fd = connection->fd;
+            fds[c].events = POLLIN;
+        }
+
+        int ready = poll(fds, options.connections, LOADGEN_TIMEOUT_MS);
+        if (ready == 0) {
+            fprintf(stderr, "No reply from the server in %d ms\n", LOADGEN_TIMEOUT_MS);
+            return 1;
+        }
+        for (int c = 0; ready > 0 && c < options.connections; c++) {
+            if (!(fds[c].revents & (POLLIN | POLLHUP | POLLERR))) {
+                continue;
+            }
+            LoadConnection *connection = &connections[c];
+            ssize_t received = recv(connection->fd, connection->input + connection->inputUsed,
+                                    sizeof(connection->input) - connection->inputUsed, 0);
+            if (received <= 0) {
+                fprintf(stderr, "Lost the connection to the server\n");
+                return 1;
+            }
+            connection->inputUsed += (size_t)received;
+
+            size_t used = 0;
+            double now = loadgen_now_ms();
+            for (; connection->inputUsed - used >= sizeof(ServerReply); used += sizeof(ServerReply)) {
+                ServerReply reply;
+                memcpy(&reply, connection->input + used, sizeof(reply));
+                if (reply.type != SERVER_FRAMES || reply.id >= (Uint32)connection->sent) {
+                    fprintf(stderr, "Unexpected reply from the server\n");
+                    return 1;
+                }
+                latencies[completed++] = now - connection->sentAt[reply.id];
+                connection->done++;
+
+                // Every frame is opaque; a pixel of each also goes into a checksum,
+                // weighted by request and view so the order replies arrive in does not matter
+                if (reply.status != SERVER_OK || reply.offset + reply.viewCount * reply.frameBytes > connection->ringBytes) {
+                    errors++;
+                    continue;
+                }
+                for (Uint32 v = 0; v < reply.viewCount; v++) {
+                    const Uint32 *frame = (const Uint32*)(connection->ring + reply.offset + v * reply.frameBytes);
+                    Uint32 pixel = frame[(reply.height / 2) * reply.width + reply.width / 2];
+                    errors += (frame[0] >> 24) != 0xFF;
+                    checksum += (Uint64)pixel * (reply.id * (Uint64)reply.viewCount + v + 1);
+                }
+
+                ServerRequest release;
+                memset(&release, 0, sizeof(release));
+                release.type = SERVER_RELEASE;
+                release.id = reply.id;
+                if (!loadgen_send_all(connection->fd, &release, sizeof(release))) {
+                    fprintf(stderr, "Lost the connection to the server\n");
+                    return 1;
+                }
+            }
+            memmove(connection->input, connection->input + used, connection->inputUsed - used);
+            connection->inputUsed -= used;
+        }
+    }
+    double seconds = (loadgen_now_ms() - start) / 1000.0;
+
+    qsort(latencies, total, sizeof(double), loadgen_compare_double);
+    double latencyTotal = 0.0;
+    for (int i = 0; i < total; i++) {
+        latencyTotal += latencies[i];
+    }
+    double frames = (double)total * options.views;
+    double frameBytes = (double)options.width * options.height * sizeof(Uint32);
+
+    FILE *out = options.outPath ? fopen(options.outPath, "w") : stdout;
+    if (!out) {
+        fprintf(stderr, "Failed to open %s\n", options.outPath);
+        return 1;
+    }
+    fprintf(out, "{\n");
+    fprintf(out, "  \"connections\": %d,\n", options.connections);
+    fprintf(out, "  \"depth\": %d,\n", options.depth);
+    fprintf(out, "  \"views_per_request\": %d,\n", options.views);
+    fprintf(out, "  \"width\": %d,\n", options.width);
+    fprintf(out, "  \"height\": %d,\n", options.height);
+    fprintf(out, "  \"requests\": %d,\n", total);
+    fprintf(out, "  \"seconds\": %.3f,\n", seconds);
+    fprintf(out, "  \"requests_per_sec\": %.0f,\n", total / seconds);
+    fprintf(out, "  \"frames_per_sec\": %.0f,\n", frames / seconds);
+    fprintf(out, "  \"mbytes_per_sec\": %.1f,\n", frames * frameBytes / seconds / 1e6);
+    fprintf(out, "  \"latency_ms\": {\"mean\": %.3f, \"p50\": %.3f, \"p95\": %.3f, \"p99\": %.3f, \"max\": %.3f},\n",
+            latencyTotal / total, loadgen_percentile(latencies, total, 0.50),
+            loadgen_percentile(latencies, total, 0.95), loadgen_percentile(latencies, total, 0.99),
+            latencies[total - 1]);
+    fprintf(out, "  \"ring_check\": \"%s\",\n", options.ringCheck ? "passed" : "skipped");
+    fprintf(out, "  \"checksum\": \"%016llx\",\n", (unsigned long long)checksum);
+    fprintf(out, "  \"errors\": %d\n", errors);
+    fprintf(out, "}\n");
+    if (out != stdout) {
+        fclose(out);
+    }
+
+    for (int c = 0; c < options.connections; c++) {
+        close(connections[c].fd);
+        munmap((void*)connections[c].ring, connections[c].ringBytes);
+        free(connections[c].sentAt);
+    }
+    free(connections);
+    free(buffer);
+    free(latencies);
+    free(loadMaps);
+    return errors > 0;
+}
+
+#else
+
+int main(void) {
+    fprintf(stderr, "The load generator needs Unix domain sockets\n");
+    return 1;
+}
+
+#endif
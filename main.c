@@ -1,32 +1,125 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "engine.h"
+#include "server.h"
 
 int main(int argc, char *argv[]) {
-    (void)argc; // Unused parameter
-    (void)argv; // Unused parameter
+    // Render threads, 0 means one per CPU core
+    int threadCount = 0;
+    int width = SCREEN_WIDTH;
+    int height = SCREEN_HEIGHT;
+    double renderScale = 1.0;
+    double budgetMs = 0.0;
+    int sprites = 0;
+    int pipelined = 0;
+    int tickRate = ENGINE_TICK_RATE;
+    const char *recordPath = NULL;
+    const char *servePath = NULL;
+    
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threadCount = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc &&
+                   sscanf(argv[i + 1], "%dx%d", &width, &height) == 2) {
+            i++;
+        } else if (strcmp(argv[i], "--scale") == 0 && i + 1 < argc) {
+            renderScale = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--budget") == 0 && i + 1 < argc) {
+            budgetMs = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--sprites") == 0 && i + 1 < argc) {
+            sprites = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--pipeline") == 0) {
+            pipelined = 1;
+        } else if (strcmp(argv[i], "--tick") == 0 && i + 1 < argc) {
+            tickRate = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            recordPath = argv[++i];
+        } else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc) {
+            servePath = argv[++i];
+        } else {
+            fprintf(stderr, "Usage: %s [--threads N] [--size WxH] [--scale S] [--budget MS] [--sprites N]\n"
+                    "       [--pipeline] [--tick HZ] [--record FILE] [--serve SOCKET]\n", argv[0]);
+            return 1;
+        }
+    }
+    
+    // Recordings hold the frames of the sequential loop; pipelined ticks are not kept
+    if (recordPath && pipelined) {
+        fprintf(stderr, "--record cannot be combined with --pipeline\n");
+        return 1;
+    }
 
     // Create and initialize the engine
     Engine engine;
     
+    // Render server: no window, frames are rendered on request for clients of the socket
+    if (servePath) {
+        if (!engine_init_headless(&engine)) {
+            fprintf(stderr, "Failed to initialize engine!\n");
+            return 1;
+        }
+        if (threadCount > 0 && !engine_set_thread_count(&engine, threadCount)) {
+            engine_cleanup(&engine);
+            return 1;
+        }
+        engine.demoSprites = sprites;
+        engine_load_maps(&engine, "maps");
+        engine_watch_maps(&engine, "maps");
+        int result = server_run(&engine, servePath);
+        engine_cleanup(&engine);
+        return result;
+    }
+    
     // Initialize the raycasting engine
     if (!engine_init(&engine)) {
         fprintf(stderr, "Failed to initialize engine!\n");
         return 1;
     }
     
+    if (threadCount > 0 && !engine_set_thread_count(&engine, threadCount)) {
+        engine_cleanup(&engine);
+        return 1;
+    }
+    
+    if ((width != SCREEN_WIDTH || height != SCREEN_HEIGHT) &&
+        !engine_set_resolution(&engine, width, height)) {
+        engine_cleanup(&engine);
+        return 1;
+    }
+    
+    // Internal resolution, optionally adjusted every frame to hold a render time
+    engine_set_render_scale(&engine, renderScale);
+    engine_set_frame_budget(&engine, budgetMs);
+    
+    // Sprites scattered over every map as it becomes active
+    engine.demoSprites = sprites;
+    
+    // Simulation and rendering on threads of their own, the simulation at a fixed tick
+    engine.pipelined = pipelined;
+    engine.tickRate = tickRate > 0 ? tickRate : ENGINE_TICK_RATE;
+    
     // Load maps from the maps directory
     int mapsLoaded = engine_load_maps(&engine, "maps");
     if (mapsLoaded > 0) {
-        printf("Loaded %d maps\n", mapsLoaded);
-        printf("Press 1-%d keys to switch between maps\n", mapsLoaded);
+        printf("Found %d maps\n", mapsLoaded);
+        printf("Press 1-%d keys to switch between maps\n", mapsLoaded < 9 ? mapsLoaded : 9);
         
         // Set the first map as active
         engine_set_map(&engine, 1);
+        
+        // Maps saved while the game runs are applied as they change
+        engine_watch_maps(&engine, "maps");
     } else {
         printf("No maps loaded, using default map\n");
     }
     
+    // Input of every frame from here on, for raycaster-bench --replay
+    if (recordPath && !engine_start_recording(&engine, recordPath)) {
+        engine_cleanup(&engine);
+        return 1;
+    }
+    
     // Run the main game loop
     int result = engine_run(&engine);
     
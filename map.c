@@ -0,0 +1,1311 @@
+// mmap and friends are POSIX, not C99
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#else
+#include <malloc.h>
+#endif
+
+#include "map.h"
+#include "lighting.h"
+
+// Map format key codes for file parsing
+#define NAME_MARKER "NAME:"
+#define START_MARKER "START:"
+#define DATA_MARKER "DATA:"
+#define FLOOR_MARKER "FLOOR:"
+#define CEILING_MARKER "CEILING:"
+#define AMBIENT_MARKER "AMBIENT:"
+#define LIGHT_MARKER "LIGHT:"
+
+// Separators between the tiles of a data row
+#define MAP_SEPARATORS " ,\t\r"
+
+// FNV-1a 64-bit parameters
+#define MAP_FNV_OFFSET 0xcbf29ce484222325ULL
+#define MAP_FNV_PRIME 0x100000001b3ULL
+
+// Tiles waiting in a distance update or changed by map_apply_changes, as x, y pairs
+typedef struct MapQueue {
+    int *tiles;
+    int count;
+    int capacity;
+} MapQueue;
+
+// ****************************************************
+// Private (static) function declarations
+// ****************************************************
+
+// Allocate a zeroed plane of storage size bytes aligned to MAP_ALIGNMENT
+static Uint8* map_alloc_plane(const Map *map, void **storage);
+
+// Map a whole file as a private writable (copy-on-write) mapping; edits never
+// reach the file. Returns NULL on failure
+static void* map_map_file(const char *filename, size_t *size);
+
+// Release a file mapped with map_map_file
+static void map_unmap_file(void *data, size_t size);
+
+// Fold data into an FNV-1a checksum, eight bytes at a time
+static Uint64 map_checksum(Uint64 hash, const Uint8 *data, size_t size);
+
+// Round a file offset up to MAP_ALIGNMENT
+static Uint64 map_align_offset(Uint64 offset);
+
+// Check that a section starts aligned at or after *end and fits in the file;
+// moves *end past it
+static int map_section_fits(Uint64 offset, Uint64 sectionSize, size_t fileSize, Uint64 *end);
+
+// Find the end of the line starting at line (its newline or terminator)
+static const char* map_line_end(const char *line);
+
+// Check whether a line holds nothing but whitespace
+static int map_line_is_blank(const char *line, const char *end);
+
+// Check whether a line starts with the given section marker
+static int map_line_has_marker(const char *line, const char *end, const char *marker);
+
+// Check whether a line starts a grid section (DATA:, FLOOR: or CEILING:)
+static int map_line_starts_grid(const char *line, const char *end);
+
+// Count the tiles of a data row
+static int map_row_length(const char *line, const char *end);
+
+// Store the values of a row in row y of a plane; values past the map are
+// dropped. Returns 0 on an invalid value.
+static int map_parse_row(Map *map, Uint8 *plane, int y, const char *line, const char *end);
+
+// Store the rows of a grid section starting at text in a plane, up to the next
+// grid section; returns 0 on an invalid value
+static int map_parse_grid(Map *map, Uint8 *plane, const char *text);
+
+// Parse a LIGHT:x,y,radius,level line and append it to a growing array;
+// returns 0 on an invalid light or when out of memory
+static int map_parse_light(const char *line, MapLight **lights, int *count, int *capacity);
+
+// Parse a text map, building its distance field and light levels if derived is set
+static int map_parse_text(Map *map, const char *text, int blockShift, int derived);
+
+// Read a text map file, building its distance field and light levels if derived is set
+static int map_read_text(Map *map, const char *filename, int blockShift, int derived);
+
+// Read a whole file into a null-terminated buffer the caller frees; NULL on failure
+static char* map_read_all(const char *filename);
+
+// Find the size and starting position of a text map as map_parse_text would,
+// without storing any tile; returns 0 when it has no data
+static int map_measure_text(const char *text, int *width, int *height, double *startX, double *startY);
+
+// Map a compiled map file; with derived set, a missing distance field is built
+// and the light levels are baked
+static int map_open_binary(Map *map, const char *filename, int derived);
+
+// Distance from tile (x, y) to the outside of the map, capped at MAP_DISTANCE_MAX:
+// the most its distance to a wall can be
+static int map_edge_distance(const Map *map, int x, int y);
+
+// Append tile (x, y) to a queue; returns 0 when out of memory
+static int map_queue_push(MapQueue *queue, int x, int y);
+
+// Check whether a plane chunk differs from the same chunk of another plane; a
+// missing plane reads as all 0
+static int map_chunk_differs(const Uint8 *a, const Uint8 *b, size_t offset, size_t size);
+
+// Update the distance field after the count tiles (x, y pairs) in tiles turned
+// from wall to empty or back, visiting only the tiles whose distance changes
+// and their neighbours; returns 0 when out of memory
+static int map_update_distance(Map *map, const int *tiles, int count);
+
+// ****************************************************
+// Public API Implementation
+// ****************************************************
+
+// Allocate an empty (all TILE_EMPTY) width x height map with the given block layout
+int map_create(Map *map, int width, int height, int blockShift) {
+    memset(map, 0, sizeof(Map));
+    if (width <= 0 || height <= 0 || blockShift < 0 || blockShift > 8) {
+        return 0;
+    }
+
+    // Round both dimensions up to whole blocks
+    int edge = 1 << blockShift;
+    int blocksPerRow = (width + edge - 1) >> blockShift;
+
+    map->width = width;
+    map->height = height;
+    map->blockShift = blockShift;
+    map->blocksPerRow = blocksPerRow;
+    map->ambient = MAP_LIGHT_FULL;
+    strcpy(map->name, "Unnamed Map");
+
+    map->tiles = map_alloc_plane(map, &map->storage);
+    if (!map->tiles) {
+        fprintf(stderr, "Failed to allocate %dx%d map!\n", width, height);
+        return 0;
+    }
+    return 1;
+}
+
+// Free the tile storage of a map
+void map_destroy(Map *map) {
+    if (map->mapping) {
+        map_unmap_file(map->mapping, map->mappingSize);
+        map->mapping = NULL;
+        map->mappingSize = 0;
+    }
+    free(map->storage);
+    free(map->distanceStorage);
+    free(map->floorStorage);
+    free(map->ceilingStorage);
+    free(map->lights);
+    free(map->light);
+    map->storage = NULL;
+    map->tiles = NULL;
+    map->distanceStorage = NULL;
+    map->distance = NULL;
+    map->floorStorage = NULL;
+    map->floor = NULL;
+    map->ceilingStorage = NULL;
+    map->ceiling = NULL;
+    map->lights = NULL;
+    map->lightCount = 0;
+    map->light = NULL;
+}
+
+// Create dst as a copy of src stored with a different block layout
+int map_copy(Map *dst, const Map *src, int blockShift) {
+    if (!map_create(dst, src->width, src->height, blockShift)) {
+        return 0;
+    }
+
+    for (int y = 0; y < src->height; y++) {
+        for (int x = 0; x < src->width; x++) {
+            map_set(dst, x, y, map_get(src, x, y));
+        }
+    }
+
+    dst->startX = src->startX;
+    dst->startY = src->startY;
+    memcpy(dst->name, src->name, sizeof(dst->name));
+
+    if (src->floor) {
+        if (!map_create_floors(dst)) {
+            map_destroy(dst);
+            return 0;
+        }
+        for (int y = 0; y < src->height; y++) {
+            for (int x = 0; x < src->width; x++) {
+                dst->floor[map_tile_index(dst, x, y)] = (Uint8)map_floor(src, x, y);
+                dst->ceiling[map_tile_index(dst, x, y)] = (Uint8)map_ceiling(src, x, y);
+            }
+        }
+    }
+
+    if (src->distance && !map_build_distance(dst)) {
+        map_destroy(dst);
+        return 0;
+    }
+
+    // Light levels follow the tile layout, so they are baked again
+    dst->ambient = src->ambient;
+    if (src->lightCount > 0) {
+        dst->lights = (MapLight*)malloc(src->lightCount * sizeof(MapLight));
+        if (!dst->lights) {
+            map_destroy(dst);
+            return 0;
+        }
+        memcpy(dst->lights, src->lights, src->lightCount * sizeof(MapLight));
+        dst->lightCount = src->lightCount;
+    }
+    if (!lighting_bake(dst)) {
+        map_destroy(dst);
+        return 0;
+    }
+    return 1;
+}
+
+// Add floor and ceiling texture planes to a map, all 0 (flat color)
+int map_create_floors(Map *map) {
+    if (map->floor) {
+        return 1;
+    }
+
+    map->floor = map_alloc_plane(map, &map->floorStorage);
+    map->ceiling = map->floor ? map_alloc_plane(map, &map->ceilingStorage) : NULL;
+    if (!map->ceiling) {
+        fprintf(stderr, "Failed to allocate floor planes for map %s\n", map->name);
+        free(map->floorStorage);
+        map->floorStorage = NULL;
+        map->floor = NULL;
+        return 0;
+    }
+    return 1;
+}
+
+// Parse a map in the text format (NAME:, START:, DATA: sections, optional
+// FLOOR: and CEILING: sections of the same shape); the grid is sized from the
+// longest data row and the number of data rows
+int map_parse(Map *map, const char *text, int blockShift) {
+    return map_parse_text(map, text, blockShift, 1);
+}
+
+// Read a map from a text file
+int map_load_text(Map *map, const char *filename, int blockShift) {
+    return map_read_text(map, filename, blockShift, 1);
+}
+
+// Map a compiled map file into memory and use its tiles and distance field in place
+int map_load_binary(Map *map, const char *filename) {
+    return map_open_binary(map, filename, 1);
+}
+
+// Load a map file in either format, chosen by its extension
+int map_load_file(Map *map, const char *filename) {
+    // Compiled maps are used in place, text maps are parsed
+    const char *ext = strrchr(filename, '.');
+    if (ext && strcmp(ext, MAP_FILE_EXTENSION) == 0) {
+        return map_load_binary(map, filename);
+    }
+    return map_load_text(map, filename, MAP_BLOCK_SHIFT);
+}
+
+// Load only the tiles, floors and lights of a map file, as map_load_file would
+// lay them out, without building the distance field or baking light levels (a
+// compiled map still brings the distance field it was saved with)
+int map_load_tiles(Map *map, const char *filename) {
+    const char *ext = strrchr(filename, '.');
+    if (ext && strcmp(ext, MAP_FILE_EXTENSION) == 0) {
+        return map_open_binary(map, filename, 0);
+    }
+    return map_read_text(map, filename, MAP_BLOCK_SHIFT, 0);
+}
+// Read the name of a text or compiled map file without loading the map
+int map_read_name(const char *filename, char *name, size_t size) {
+    FILE *file = fopen(filename, "rb");
+    if (!file || size == 0) {
+        if (file) {
+            fclose(file);
+        }
+        return 0;
+    }
+
+    int found = 0;
+    const char *ext = strrchr(filename, '.');
+    if (ext && strcmp(ext, MAP_FILE_EXTENSION) == 0) {
+        // Only the header is read
+        MapFileHeader header;
+        if (fread(&header, sizeof(header), 1, file) == 1 &&
+            memcmp(header.magic, MAP_FILE_MAGIC, sizeof(header.magic)) == 0) {
+            header.name[sizeof(header.name) - 1] = '\0';
+            snprintf(name, size, "%s", header.name);
+            found = 1;
+        }
+    } else {
+        // The header lines come before the data, stop there
+        char line[256];
+        while (!found && fgets(line, sizeof(line), file)) {
+            if (strncmp(line, DATA_MARKER, strlen(DATA_MARKER)) == 0) {
+                break;
+            }
+            if (strncmp(line, NAME_MARKER, strlen(NAME_MARKER)) == 0) {
+                line[strcspn(line, "\r\n")] = '\0';
+                snprintf(name, size, "%s", line + strlen(NAME_MARKER));
+                found = 1;
+            }
+        }
+    }
+
+    fclose(file);
+    return found;
+}
+
+// Read the size and starting position of a text or compiled map file without
+// loading the map; the rows of a text map are counted, not parsed
+int map_read_size(const char *filename, int *width, int *height, double *startX, double *startY) {
+    const char *ext = strrchr(filename, '.');
+    if (ext && strcmp(ext, MAP_FILE_EXTENSION) == 0) {
+        // Only the header is read; older versions have the same fields
+        FILE *file = fopen(filename, "rb");
+        if (!file) {
+            return 0;
+        }
+        MapFileHeader header;
+        int found = fread(&header, MAP_FILE_HEADER_V1, 1, file) == 1 &&
+                    memcmp(header.magic, MAP_FILE_MAGIC, sizeof(header.magic)) == 0;
+        fclose(file);
+        if (found) {
+            *width = header.width;
+            *height = header.height;
+            *startX = header.startX;
+            *startY = header.startY;
+        }
+        return found;
+    }
+
+    char *text = map_read_all(filename);
+    if (!text) {
+        return 0;
+    }
+    int found = map_measure_text(text, width, height, startX, startY);
+    free(text);
+    return found;
+}
+
+// Write a map as a compiled map file, including its distance field if built,
+// its floor and ceiling textures if it has them and its lights; an existing
+// file is replaced at once, never left half written
+int map_save_binary(const Map *map, const char *filename) {
+    MapFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MAP_FILE_MAGIC, 4);
+    header.version = MAP_FILE_VERSION;
+    header.headerSize = sizeof(header);
+    header.width = map->width;
+    header.height = map->height;
+    header.tileBytes = sizeof(MapTile);
+    header.blockShift = (Uint32)map->blockShift;
+    header.startX = map->startX;
+    header.startY = map->startY;
+    memcpy(header.name, map->name, sizeof(header.name));
+    header.lightCount = (Uint32)map->lightCount;
+    header.ambient = map->ambient;
+
+    // Lay the sections out one after the other, each aligned for use in place;
+    // the light levels are not stored, they are baked on load
+    header.sectionSize = map_storage_size(map);
+    const Uint8 *sections[] = {map->tiles, map->distance, map->floor, map->ceiling,
+                               map->lightCount > 0 ? (const Uint8*)map->lights : NULL};
+    Uint64 *offsets[] = {&header.tileOffset, &header.distanceOffset, &header.floorOffset, &header.ceilingOffset,
+                         &header.lightOffset};
+    Uint64 sizes[] = {header.sectionSize, header.sectionSize, header.sectionSize, header.sectionSize,
+                      (Uint64)map->lightCount * sizeof(MapLight)};
+    const int sectionCount = (int)(sizeof(sections) / sizeof(sections[0]));
+    header.checksum = MAP_FNV_OFFSET;
+    Uint64 end = sizeof(header);
+    for (int i = 0; i < sectionCount; i++) {
+        if (sections[i]) {
+            *offsets[i] = map_align_offset(end);
+            header.checksum = map_checksum(header.checksum, sections[i], sizes[i]);
+            end = *offsets[i] + sizes[i];
+        }
+    }
+    if (map->distance) {
+        header.flags |= MAP_FILE_DISTANCE;
+    }
+    if (map->floor) {
+        header.flags |= MAP_FILE_FLOOR;
+    }
+    if (map->lightCount > 0) {
+        header.flags |= MAP_FILE_LIGHTS;
+    }
+
+    // Write a new file and move it over the old one, which a running game may
+    // have mapped: truncating a mapped file would fault its readers
+    char tempName[512];
+    snprintf(tempName, sizeof(tempName), "%s.tmp", filename);
+    FILE *file = fopen(tempName, "wb");
+    if (!file) {
+        fprintf(stderr, "Could not create map file: %s\n", filename);
+        return 0;
+    }
+
+    static const Uint8 zeros[MAP_ALIGNMENT];
+    int ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    end = sizeof(header);
+    for (int i = 0; ok && i < sectionCount; i++) {
+        if (sections[i]) {
+            Uint64 padding = *offsets[i] - end;
+            ok = fwrite(zeros, 1, padding, file) == padding &&
+                 fwrite(sections[i], 1, sizes[i], file) == sizes[i];
+            end = *offsets[i] + sizes[i];
+        }
+    }
+    if (fclose(file) != 0) {
+        ok = 0;
+    }
+#ifdef _WIN32
+    if (ok) {
+        remove(filename);
+    }
+#endif
+    if (ok && rename(tempName, filename) != 0) {
+        ok = 0;
+    }
+
+    if (!ok) {
+        fprintf(stderr, "Failed to write map file: %s\n", filename);
+        remove(tempName);
+    }
+    return ok;
+}
+
+// Number of bytes of tile storage, including block padding
+size_t map_storage_size(const Map *map) {
+    int edge = 1 << map->blockShift;
+    size_t blockRows = (size_t)((map->height + edge - 1) >> map->blockShift);
+    return blockRows * map->blocksPerRow << (2 * map->blockShift);
+}
+
+// Build the empty-space distance field: for every tile, the Chebyshev distance
+// (capped at MAP_DISTANCE_MAX) to the closest wall, counting everything outside
+// the map as wall. A tile at distance d is the centre of an empty square of
+// radius d - 1 that lies entirely inside the map.
+int map_build_distance(Map *map) {
+    if (!map->distance) {
+        map->distance = map_alloc_plane(map, &map->distanceStorage);
+        if (!map->distance) {
+            fprintf(stderr, "Failed to allocate distance field for map %s\n", map->name);
+            return 0;
+        }
+    }
+
+    int width = map->width;
+    int height = map->height;
+    Uint8 *distance = map->distance;
+
+    // Walls are at 0, empty tiles start at their distance to the outside of the map
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            int d = map_get(map, x, y) == TILE_EMPTY ? map_edge_distance(map, x, y) : 0;
+            distance[map_tile_index(map, x, y)] = (Uint8)d;
+        }
+    }
+
+    // Two chamfer passes over the 8-neighbourhood give the exact chessboard distance:
+    // forward from the left and top neighbours, backward from the right and bottom ones
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            int d = map_distance(map, x, y);
+            if (x > 0 && map_distance(map, x - 1, y) + 1 < d) d = map_distance(map, x - 1, y) + 1;
+            if (y > 0) {
+                for (int nx = x - 1; nx <= x + 1; nx++) {
+                    if (nx >= 0 && nx < width && map_distance(map, nx, y - 1) + 1 < d) {
+                        d = map_distance(map, nx, y - 1) + 1;
+                    }
+                }
+            }
+            distance[map_tile_index(map, x, y)] = (Uint8)d;
+        }
+    }
+
+    for (int y = height - 1; y >= 0; y--) {
+        for (int x = width - 1; x >= 0; x--) {
+            int d = map_distance(map, x, y);
+            if (x < width - 1 && map_distance(map, x + 1, y) + 1 < d) d = map_distance(map, x + 1, y) + 1;
+            if (y < height - 1) {
+                for (int nx = x - 1; nx <= x + 1; nx++) {
+                    if (nx >= 0 && nx < width && map_distance(map, nx, y + 1) + 1 < d) {
+                        d = map_distance(map, nx, y + 1) + 1;
+                    }
+                }
+            }
+            distance[map_tile_index(map, x, y)] = (Uint8)d;
+        }
+    }
+
+    return 1;
+}
+
+// Bring a loaded map up to date with source, a newer version of the same file
+// read with map_load_tiles. Only the tiles that differ are written, in place,
+// and the distance field and light levels are repaired around them instead of
+// being rebuilt. Returns the number of tiles changed, -1 if the maps differ in
+// size or layout or when out of memory.
+int map_apply_changes(Map *map, const Map *source) {
+    if (source->width != map->width || source->height != map->height ||
+        source->blockShift != map->blockShift) {
+        return -1;
+    }
+    if (source->floor && !map_create_floors(map)) {
+        return -1;
+    }
+
+    // Compare a cache line at a time; most of an edited map is unchanged
+    MapQueue flipped = {NULL, 0, 0};
+    size_t storage = map_storage_size(map);
+    int changed = 0;
+    int ok = 1;
+    int shift = map->blockShift;
+    size_t blockMask = ((size_t)1 << (2 * shift)) - 1;
+    for (size_t chunk = 0; ok && chunk < storage; chunk += MAP_ALIGNMENT) {
+        size_t size = storage - chunk < MAP_ALIGNMENT ? storage - chunk : MAP_ALIGNMENT;
+        if (!map_chunk_differs(map->tiles, source->tiles, chunk, size) &&
+            (!map->floor || (!map_chunk_differs(map->floor, source->floor, chunk, size) &&
+                             !map_chunk_differs(map->ceiling, source->ceiling, chunk, size)))) {
+            continue;
+        }
+
+        // Renderers are told the rectangle of the tiles changed in the chunk
+        int x0 = map->width, y0 = map->height, x1 = -1, y1 = -1;
+        for (size_t i = chunk; ok && i < chunk + size; i++) {
+            // Tile position from its place in the block layout; padding is skipped
+            size_t block = i >> (2 * shift);
+            size_t within = i & blockMask;
+            int x = (int)((block % map->blocksPerRow) << shift | (within & ((1u << shift) - 1)));
+            int y = (int)((block / map->blocksPerRow) << shift | (within >> shift));
+            if (x >= map->width || y >= map->height) {
+                continue;
+            }
+
+            int tile = source->tiles[i];
+            int floor = source->floor ? source->floor[i] : 0;
+            int ceiling = source->floor ? source->ceiling[i] : 0;
+            int wasWall = map->tiles[i] > 0;
+            if (map->tiles[i] == tile && (!map->floor || (map->floor[i] == floor && map->ceiling[i] == ceiling))) {
+                continue;
+            }
+
+            map->tiles[i] = (MapTile)tile;
+            if (map->floor) {
+                map->floor[i] = (Uint8)floor;
+                map->ceiling[i] = (Uint8)ceiling;
+            }
+            changed++;
+            if (x < x0) x0 = x;
+            if (y < y0) y0 = y;
+            if (x > x1) x1 = x;
+            if (y > y1) y1 = y;
+            if (wasWall != (tile > 0)) {
+                ok = map_queue_push(&flipped, x, y);
+            }
+        }
+        if (x1 >= 0) {
+            map_mark_changed(map, x0, y0, x1, y1);
+        }
+    }
+
+    // A failed repair falls back to a full rebuild
+    if (ok && map->distance && flipped.count > 0 &&
+        !map_update_distance(map, flipped.tiles, flipped.count)) {
+        ok = map_build_distance(map);
+    }
+
+    map->startX = source->startX;
+    map->startY = source->startY;
+    memcpy(map->name, source->name, sizeof(map->name));
+
+    // Lights that only moved or changed are re-baked one by one; a different
+    // set of lights or ambient level bakes the whole map again
+    if (ok && (source->lightCount != map->lightCount || source->ambient != map->ambient || !map->light)) {
+        MapLight *lights = NULL;
+        if (source->lightCount > 0) {
+            lights = (MapLight*)malloc(source->lightCount * sizeof(MapLight));
+            ok = lights != NULL;
+            if (ok) {
+                memcpy(lights, source->lights, source->lightCount * sizeof(MapLight));
+            }
+        }
+        if (ok) {
+            free(map->lights);
+            map->lights = lights;
+            map->lightCount = source->lightCount;
+            map->ambient = source->ambient;
+            ok = lighting_bake(map);
+        }
+    } else if (ok) {
+        for (int i = 0; ok && i < map->lightCount; i++) {
+            if (memcmp(&map->lights[i], &source->lights[i], sizeof(MapLight)) != 0) {
+                ok = lighting_set_light(map, i, &source->lights[i]) >= 0;
+            }
+        }
+        if (ok && flipped.count > 0) {
+            ok = lighting_update_tiles(map, flipped.tiles, flipped.count) >= 0;
+        }
+    }
+
+    free(flipped.tiles);
+    return ok ? changed : -1;
+}
+
+// Record that the tiles, floors or light levels of [x0, x1] x [y0, y1] changed,
+// so a renderer that kept its last frame redraws what shows them
+void map_mark_changed(Map *map, int x0, int y0, int x1, int y1) {
+    MapDamage *damage = &map->damage[map->damageCount % MAP_DAMAGE_LOG];
+    damage->x0 = x0;
+    damage->y0 = y0;
+    damage->x1 = x1;
+    damage->y1 = y1;
+    map->damageCount++;
+}
+
+// ****************************************************
+// Private functions implementation
+// ****************************************************
+
+// Map a whole file as a private writable (copy-on-write) mapping; edits never
+// reach the file. Returns NULL on failure
+static void* map_map_file(const char *filename, size_t *size) {
+#ifndef _WIN32
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size <= 0) {
+        close(fd);
+        return NULL;
+    }
+
+    // A private writable mapping lets the map be edited in memory without
+    // touching the file; pages are only copied when written
+    void *data = mmap(NULL, (size_t)info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return NULL;
+    }
+
+    *size = (size_t)info.st_size;
+    return data;
+#else
+    // No mmap here: read the file into an aligned heap block instead
+    FILE *file = fopen(filename, "rb");
+    if (!file) {
+        return NULL;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long fileSize = ftell(file);
+    rewind(file);
+
+    void *data = fileSize > 0 ? _aligned_malloc((size_t)fileSize, MAP_ALIGNMENT) : NULL;
+    if (!data || fread(data, 1, (size_t)fileSize, file) != (size_t)fileSize) {
+        _aligned_free(data);
+        fclose(file);
+        return NULL;
+    }
+    fclose(file);
+
+    *size = (size_t)fileSize;
+    return data;
+#endif
+}
+
+// Release a file mapped with map_map_file
+static void map_unmap_file(void *data, size_t size) {
+#ifndef _WIN32
+    munmap(data, size);
+#else
+    (void)size;
+    _aligned_free(data);
+#endif
+}
+
+// Fold data into an FNV-1a checksum, eight bytes at a time
+static Uint64 map_checksum(Uint64 hash, const Uint8 *data, size_t size) {
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        Uint64 word;
+        memcpy(&word, data + i, sizeof(word));
+        hash = (hash ^ word) * MAP_FNV_PRIME;
+    }
+    for (; i < size; i++) {
+        hash = (hash ^ data[i]) * MAP_FNV_PRIME;
+    }
+    return hash;
+}
+
+// Round a file offset up to MAP_ALIGNMENT
+static Uint64 map_align_offset(Uint64 offset) {
+    return (offset + MAP_ALIGNMENT - 1) & ~(Uint64)(MAP_ALIGNMENT - 1);
+}
+
+// Check that a section starts aligned at or after *end and fits in the file;
+// moves *end past it
+static int map_section_fits(Uint64 offset, Uint64 sectionSize, size_t fileSize, Uint64 *end) {
+    if (offset % MAP_ALIGNMENT != 0 || offset < *end || offset > fileSize || fileSize - offset < sectionSize) {
+        return 0;
+    }
+    *end = offset + sectionSize;
+    return 1;
+}
+
+// Allocate a zeroed plane of storage size bytes aligned to MAP_ALIGNMENT
+static Uint8* map_alloc_plane(const Map *map, void **storage) {
+    *storage = calloc(1, map_storage_size(map) + MAP_ALIGNMENT - 1);
+    if (!*storage) {
+        return NULL;
+    }
+
+    uintptr_t address = ((uintptr_t)*storage + MAP_ALIGNMENT - 1) & ~(uintptr_t)(MAP_ALIGNMENT - 1);
+    return (Uint8*)address;
+}
+
+// Find the end of the line starting at line (its newline or terminator)
+static const char* map_line_end(const char *line) {
+    while (*line && *line != '\n') {
+        line++;
+    }
+    return line;
+}
+
+// Check whether a line holds nothing but whitespace
+static int map_line_is_blank(const char *line, const char *end) {
+    for (; line < end; line++) {
+        if (*line != ' ' && *line != '\t' && *line != '\r') {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Check whether a line starts with the given section marker
+static int map_line_has_marker(const char *line, const char *end, const char *marker) {
+    size_t length = strlen(marker);
+    return (size_t)(end - line) >= length && strncmp(line, marker, length) == 0;
+}
+
+// Check whether a line starts a grid section (DATA:, FLOOR: or CEILING:)
+static int map_line_starts_grid(const char *line, const char *end) {
+    return map_line_has_marker(line, end, DATA_MARKER) ||
+           map_line_has_marker(line, end, FLOOR_MARKER) ||
+           map_line_has_marker(line, end, CEILING_MARKER);
+}
+
+// Count the tiles of a data row
+static int map_row_length(const char *line, const char *end) {
+    int count = 0;
+    while (line < end) {
+        line += strspn(line, MAP_SEPARATORS);
+        if (line >= end) {
+            break;
+        }
+        count++;
+        while (line < end && !strchr(MAP_SEPARATORS, *line)) {
+            line++;
+        }
+    }
+    return count;
+}
+
+// Store the values of a row in row y of a plane; values past the map are
+// dropped. Returns 0 on an invalid value.
+static int map_parse_row(Map *map, Uint8 *plane, int y, const char *line, const char *end) {
+    int x = 0;
+    while (line < end) {
+        line += strspn(line, MAP_SEPARATORS);
+        if (line >= end) {
+            break;
+        }
+
+        long value = strtol(line, NULL, 10);
+        if (value < 0 || value > MAP_TILE_MAX) {
+            return 0;
+        }
+        if (x < map->width && y < map->height) {
+            plane[map_tile_index(map, x, y)] = (Uint8)value;
+        }
+        x++;
+
+        while (line < end && !strchr(MAP_SEPARATORS, *line)) {
+            line++;
+        }
+    }
+    return 1;
+}
+
+// Store the rows of a grid section starting at text in a plane, up to the next
+// grid section; returns 0 on an invalid value
+static int map_parse_grid(Map *map, Uint8 *plane, const char *text) {
+    int y = 0;
+    for (const char *line = text; *line; ) {
+        const char *end = map_line_end(line);
+
+        if (map_line_starts_grid(line, end)) {
+            break;
+        }
+        if (!map_line_is_blank(line, end) &&
+            !map_line_has_marker(line, end, NAME_MARKER) &&
+            !map_line_has_marker(line, end, START_MARKER)) {
+            if (!map_parse_row(map, plane, y, line, end)) {
+                fprintf(stderr, "Invalid tile in row %d of map %s\n", y, map->name);
+                return 0;
+            }
+            y++;
+        }
+
+        line = *end ? end + 1 : end;
+    }
+    return 1;
+}
+
+// Parse a LIGHT:x,y,radius,level line and append it to a growing array;
+// returns 0 on an invalid light or when out of memory
+static int map_parse_light(const char *line, MapLight **lights, int *count, int *capacity) {
+    MapLight light;
+    if (sscanf(line + strlen(LIGHT_MARKER), "%d,%d,%d,%d", &light.x, &light.y, &light.radius, &light.level) != 4 ||
+        light.x < 0 || light.y < 0 || light.radius <= 0 || light.level < 0 || light.level > MAP_LIGHT_FULL) {
+        return 0;
+    }
+
+    if (*count == *capacity) {
+        int grown = *capacity ? 2 * *capacity : 8;
+        MapLight *resized = (MapLight*)realloc(*lights, grown * sizeof(MapLight));
+        if (!resized) {
+            return 0;
+        }
+        *lights = resized;
+        *capacity = grown;
+    }
+    (*lights)[(*count)++] = light;
+    return 1;
+}
+
+// Parse a text map, building its distance field and light levels if derived is set
+static int map_parse_text(Map *map, const char *text, int blockShift, int derived) {
+
+    char name[sizeof(map->name)] = "Unnamed Map";
+    double startX = 22.0;
+    double startY = 12.0;
+
+    // First pass: read the header lines, find the grid sections and measure the
+    // last DATA: section
+    const char *data = NULL;
+    const char *floor = NULL;
+    const char *ceiling = NULL;
+    int inData = 0;
+    int width = 0;
+    int height = 0;
+    int ambient = MAP_LIGHT_FULL;
+    MapLight *lights = NULL;
+    int lightCount = 0;
+    int lightCapacity = 0;
+
+    for (const char *line = text; *line; ) {
+        const char *end = map_line_end(line);
+
+        if (map_line_is_blank(line, end)) {
+            // Skip empty lines
+        } else if (map_line_has_marker(line, end, NAME_MARKER)) {
+            size_t length = end - line - strlen(NAME_MARKER);
+            if (length >= sizeof(name)) {
+                length = sizeof(name) - 1;
+            }
+            memcpy(name, line + strlen(NAME_MARKER), length);
+            name[length] = '\0';
+        } else if (map_line_has_marker(line, end, START_MARKER)) {
+            sscanf(line + strlen(START_MARKER), "%lf,%lf", &startX, &startY);
+        } else if (map_line_has_marker(line, end, AMBIENT_MARKER)) {
+            ambient = atoi(line + strlen(AMBIENT_MARKER));
+            if (ambient < 0) ambient = 0;
+            if (ambient > MAP_LIGHT_FULL) ambient = MAP_LIGHT_FULL;
+        } else if (map_line_has_marker(line, end, LIGHT_MARKER)) {
+            if (!map_parse_light(line, &lights, &lightCount, &lightCapacity)) {
+                fprintf(stderr, "Invalid light in map %s\n", name);
+                free(lights);
+                return 0;
+            }
+        } else if (map_line_has_marker(line, end, DATA_MARKER)) {
+            // A new section replaces any earlier one of the same kind
+            data = *end ? end + 1 : end;
+            inData = 1;
+            width = 0;
+            height = 0;
+        } else if (map_line_has_marker(line, end, FLOOR_MARKER)) {
+            floor = *end ? end + 1 : end;
+            inData = 0;
+        } else if (map_line_has_marker(line, end, CEILING_MARKER)) {
+            ceiling = *end ? end + 1 : end;
+            inData = 0;
+        } else if (inData) {
+            int length = map_row_length(line, end);
+            if (length > width) {
+                width = length;
+            }
+            height++;
+        }
+
+        line = *end ? end + 1 : end;
+    }
+
+    // Ensure the map has at least some data
+    if (width == 0 || height == 0 || !map_create(map, width, height, blockShift)) {
+        free(lights);
+        return 0;
+    }
+    map->startX = startX;
+    map->startY = startY;
+    memcpy(map->name, name, sizeof(map->name));
+    map->ambient = ambient;
+    map->lights = lights;
+    map->lightCount = lightCount;
+
+    // Second pass: fill the grids; short rows leave the rest of the row empty
+    int ok = map_parse_grid(map, map->tiles, data);
+    if (ok && (floor || ceiling)) {
+        ok = map_create_floors(map) &&
+             (!floor || map_parse_grid(map, map->floor, floor)) &&
+             (!ceiling || map_parse_grid(map, map->ceiling, ceiling));
+    }
+    if (!ok) {
+        map_destroy(map);
+        return 0;
+    }
+
+    if (derived && (!map_build_distance(map) || !lighting_bake(map))) {
+        map_destroy(map);
+        return 0;
+    }
+    return 1;
+}
+
+// Read a text map file, building its distance field and light levels if derived is set
+static int map_read_text(Map *map, const char *filename, int blockShift, int derived) {
+    char *buffer = map_read_all(filename);
+    if (!buffer) {
+        return 0;
+    }
+
+    int result = map_parse_text(map, buffer, blockShift, derived);
+    free(buffer);
+    return result;
+}
+
+// Read a whole file into a null-terminated buffer the caller frees; NULL on failure
+static char* map_read_all(const char *filename) {
+    FILE *file = fopen(filename, "rb");
+    if (!file) {
+        fprintf(stderr, "Could not open map file: %s\n", filename);
+        return NULL;
+    }
+
+    // Read file into a buffer
+    fseek(file, 0, SEEK_END);
+    long fileSize = ftell(file);
+    rewind(file);
+
+    char *buffer = (char*)malloc(fileSize + 1);
+    if (!buffer) {
+        fclose(file);
+        return NULL;
+    }
+
+    size_t bytesRead = fread(buffer, 1, fileSize, file);
+    buffer[bytesRead] = '\0';  // Null terminate the string
+    fclose(file);
+    return buffer;
+}
+
+// Find the size and starting position of a text map as map_parse_text would,
+// without storing any tile; returns 0 when it has no data
+static int map_measure_text(const char *text, int *width, int *height, double *startX, double *startY) {
+    int inData = 0;
+    *width = 0;
+    *height = 0;
+    *startX = 22.0;
+    *startY = 12.0;
+    for (const char *line = text; *line; ) {
+        const char *end = map_line_end(line);
+
+        if (map_line_is_blank(line, end) ||
+            map_line_has_marker(line, end, NAME_MARKER) ||
+            map_line_has_marker(line, end, AMBIENT_MARKER) ||
+            map_line_has_marker(line, end, LIGHT_MARKER)) {
+            // Nothing that sizes the map
+        } else if (map_line_has_marker(line, end, START_MARKER)) {
+            sscanf(line + strlen(START_MARKER), "%lf,%lf", startX, startY);
+        } else if (map_line_has_marker(line, end, DATA_MARKER)) {
+            // The last DATA: section is the one used
+            inData = 1;
+            *width = 0;
+            *height = 0;
+        } else if (map_line_starts_grid(line, end)) {
+            inData = 0;
+        } else if (inData) {
+            int length = map_row_length(line, end);
+            if (length > *width) {
+                *width = length;
+            }
+            (*height)++;
+        }
+
+        line = *end ? end + 1 : end;
+    }
+    return *width > 0 && *height > 0;
+}
+
+// Map a compiled map file; with derived set, a missing distance field is built
+// and the light levels are baked
+static int map_open_binary(Map *map, const char *filename, int derived) {
+    memset(map, 0, sizeof(Map));
+
+    size_t size;
+    Uint8 *data = (Uint8*)map_map_file(filename, &size);
+    if (!data) {
+        fprintf(stderr, "Could not open map file: %s\n", filename);
+        return 0;
+    }
+
+    // Older files are the same up to the end of their header: version 1 has no
+    // floor sections, versions 1 and 2 no lights
+    MapFileHeader header;
+    memset(&header, 0, sizeof(header));
+    if (size >= MAP_FILE_HEADER_V1) {
+        memcpy(&header, data, MAP_FILE_HEADER_V1);
+    }
+    int v1 = header.version == 1 && header.headerSize == MAP_FILE_HEADER_V1;
+    int v2 = header.version == 2 && header.headerSize == MAP_FILE_HEADER_V2;
+    int v3 = header.version == MAP_FILE_VERSION && header.headerSize == sizeof(header);
+    if (size < MAP_FILE_HEADER_V1 || memcmp(header.magic, MAP_FILE_MAGIC, 4) != 0 ||
+        (!v1 && !v2 && !v3) || size < header.headerSize) {
+        fprintf(stderr, "Not a version 1 to %d compiled map: %s\n", MAP_FILE_VERSION, filename);
+        map_unmap_file(data, size);
+        return 0;
+    }
+    memcpy(&header, data, header.headerSize);
+    if (!v3) {
+        header.ambient = MAP_LIGHT_FULL;
+    }
+
+    // The sections are used in place, so the header has to describe them exactly
+    map->width = header.width;
+    map->height = header.height;
+    map->blockShift = (int)header.blockShift;
+    if (header.width <= 0 || header.height <= 0 || header.blockShift > 8 ||
+        header.tileBytes != sizeof(MapTile)) {
+        fprintf(stderr, "Invalid map header: %s\n", filename);
+        map_unmap_file(data, size);
+        memset(map, 0, sizeof(Map));
+        return 0;
+    }
+    int edge = 1 << map->blockShift;
+    map->blocksPerRow = (map->width + edge - 1) >> map->blockShift;
+
+    // Sections follow each other in file order: tiles, distance, floor, ceiling, lights
+    Uint64 sectionSize = map_storage_size(map);
+    Uint64 lightSize = (Uint64)header.lightCount * sizeof(MapLight);
+    int hasDistance = (header.flags & MAP_FILE_DISTANCE) != 0;
+    int hasFloor = (header.flags & MAP_FILE_FLOOR) != 0;
+    int hasLights = (header.flags & MAP_FILE_LIGHTS) != 0;
+    Uint64 end = header.headerSize;
+    if (header.sectionSize != sectionSize || (v1 && hasFloor) || (!v3 && hasLights) ||
+        header.ambient < 0 || header.ambient > MAP_LIGHT_FULL ||
+        !map_section_fits(header.tileOffset, sectionSize, size, &end) ||
+        (hasDistance && !map_section_fits(header.distanceOffset, sectionSize, size, &end)) ||
+        (hasFloor && (!map_section_fits(header.floorOffset, sectionSize, size, &end) ||
+                      !map_section_fits(header.ceilingOffset, sectionSize, size, &end))) ||
+        (hasLights && (header.lightCount == 0 || !map_section_fits(header.lightOffset, lightSize, size, &end)))) {
+        fprintf(stderr, "Truncated or corrupt map file: %s\n", filename);
+        map_unmap_file(data, size);
+        memset(map, 0, sizeof(Map));
+        return 0;
+    }
+
+    Uint64 checksum = map_checksum(MAP_FNV_OFFSET, data + header.tileOffset, sectionSize);
+    if (hasDistance) {
+        checksum = map_checksum(checksum, data + header.distanceOffset, sectionSize);
+    }
+    if (hasFloor) {
+        checksum = map_checksum(checksum, data + header.floorOffset, sectionSize);
+        checksum = map_checksum(checksum, data + header.ceilingOffset, sectionSize);
+    }
+    if (hasLights) {
+        checksum = map_checksum(checksum, data + header.lightOffset, lightSize);
+    }
+    if (checksum != header.checksum) {
+        fprintf(stderr, "Checksum mismatch in map file: %s\n", filename);
+        map_unmap_file(data, size);
+        memset(map, 0, sizeof(Map));
+        return 0;
+    }
+
+    map->mapping = data;
+    map->mappingSize = size;
+    map->tiles = data + header.tileOffset;
+    map->startX = header.startX;
+    map->startY = header.startY;
+    memcpy(map->name, header.name, sizeof(map->name));
+    map->name[sizeof(map->name) - 1] = '\0';
+    if (hasFloor) {
+        map->floor = data + header.floorOffset;
+        map->ceiling = data + header.ceilingOffset;
+    }
+
+    if (hasDistance) {
+        map->distance = data + header.distanceOffset;
+    } else if (derived && !map_build_distance(map)) {
+        map_destroy(map);
+        return 0;
+    }
+
+    // Lights are copied out so they can change; their levels are baked on load
+    map->ambient = header.ambient;
+    if (hasLights) {
+        map->lights = (MapLight*)malloc(lightSize);
+        if (!map->lights) {
+            map_destroy(map);
+            return 0;
+        }
+        memcpy(map->lights, data + header.lightOffset, lightSize);
+        map->lightCount = (int)header.lightCount;
+    }
+    if (derived && !lighting_bake(map)) {
+        map_destroy(map);
+        return 0;
+    }
+    return 1;
+}
+
+// Distance from tile (x, y) to the outside of the map, capped at MAP_DISTANCE_MAX:
+// the most its distance to a wall can be
+static int map_edge_distance(const Map *map, int x, int y) {
+    int d = x + 1;
+    if (y + 1 < d) d = y + 1;
+    if (map->width - x < d) d = map->width - x;
+    if (map->height - y < d) d = map->height - y;
+    return d < MAP_DISTANCE_MAX ? d : MAP_DISTANCE_MAX;
+}
+
+// Append tile (x, y) to a queue; returns 0 when out of memory
+static int map_queue_push(MapQueue *queue, int x, int y) {
+    if (queue->count == queue->capacity) {
+        int capacity = queue->capacity ? queue->capacity * 2 : 256;
+        int *tiles = (int*)realloc(queue->tiles, (size_t)capacity * 2 * sizeof(int));
+        if (!tiles) {
+            return 0;
+        }
+        queue->tiles = tiles;
+        queue->capacity = capacity;
+    }
+    queue->tiles[queue->count * 2] = x;
+    queue->tiles[queue->count * 2 + 1] = y;
+    queue->count++;
+    return 1;
+}
+
+// Check whether a plane chunk differs from the same chunk of another plane; a
+// missing plane reads as all 0
+static int map_chunk_differs(const Uint8 *a, const Uint8 *b, size_t offset, size_t size) {
+    static const Uint8 zeros[MAP_ALIGNMENT];
+    return memcmp(a ? a + offset : zeros, b ? b + offset : zeros, size) != 0;
+}
+
+// Update the distance field after the count tiles (x, y pairs) in tiles turned
+// from wall to empty or back, visiting only the tiles whose distance changes
+// and their neighbours; returns 0 when out of memory
+static int map_update_distance(Map *map, const int *tiles, int count) {
+    Uint8 *distance = map->distance;
+    size_t storage = map_storage_size(map);
+    Uint8 *raised = (Uint8*)calloc((storage + 7) / 8, 1);
+    MapQueue raise = {NULL, 0, 0};
+    MapQueue buckets[MAP_DISTANCE_MAX + 1];
+    memset(buckets, 0, sizeof(buckets));
+    int ok = raised != NULL;
+
+    // Raise: a removed wall, and then every tile whose distance was only as
+    // short as it was through a raised tile, no longer knows its distance.
+    // A tile keeps it while a neighbour one closer is not raised, or when it is
+    // as far from a wall as it can be from the outside of the map.
+    for (int i = 0; ok && i < count; i++) {
+        int x = tiles[i * 2];
+        int y = tiles[i * 2 + 1];
+        size_t index = map_tile_index(map, x, y);
+        if (map->tiles[index] == TILE_EMPTY && distance[index] == 0) {
+            raised[index >> 3] |= (Uint8)(1 << (index & 7));
+            ok = map_queue_push(&raise, x, y);
+        }
+    }
+    for (int i = 0; ok && i < raise.count; i++) {
+        int x = raise.tiles[i * 2];
+        int y = raise.tiles[i * 2 + 1];
+        for (int ny = y - 1; ok && ny <= y + 1; ny++) {
+            for (int nx = x - 1; ok && nx <= x + 1; nx++) {
+                if (nx < 0 || ny < 0 || nx >= map->width || ny >= map->height) {
+                    continue;
+                }
+                size_t index = map_tile_index(map, nx, ny);
+                int d = distance[index];
+                if ((raised[index >> 3] & (1 << (index & 7))) || d == 0 || d == MAP_DISTANCE_MAX ||
+                    d == map_edge_distance(map, nx, ny)) {
+                    continue;
+                }
+
+                int supported = 0;
+                for (int sy = ny - 1; !supported && sy <= ny + 1; sy++) {
+                    for (int sx = nx - 1; !supported && sx <= nx + 1; sx++) {
+                        if (sx >= 0 && sy >= 0 && sx < map->width && sy < map->height) {
+                            size_t support = map_tile_index(map, sx, sy);
+                            supported = distance[support] == d - 1 &&
+                                        !(raised[support >> 3] & (1 << (support & 7)));
+                        }
+                    }
+                }
+                if (!supported) {
+                    raised[index >> 3] |= (Uint8)(1 << (index & 7));
+                    ok = map_queue_push(&raise, nx, ny);
+                }
+            }
+        }
+    }
+
+    // Lower: raised tiles start from their distance to the outside of the map
+    // and new walls from 0, and distances spread out from them and from the
+    // tiles around the raised ones, nearest first, as far as they shorten
+    for (int i = 0; ok && i < raise.count; i++) {
+        int x = raise.tiles[i * 2];
+        int y = raise.tiles[i * 2 + 1];
+        int d = map_edge_distance(map, x, y);
+        distance[map_tile_index(map, x, y)] = (Uint8)d;
+        ok = map_queue_push(&buckets[d], x, y);
+    }
+    for (int i = 0; ok && i < count; i++) {
+        int x = tiles[i * 2];
+        int y = tiles[i * 2 + 1];
+        size_t index = map_tile_index(map, x, y);
+        if (map->tiles[index] != TILE_EMPTY) {
+            distance[index] = 0;
+            ok = map_queue_push(&buckets[0], x, y);
+        }
+    }
+    for (int i = 0; ok && i < raise.count; i++) {
+        int x = raise.tiles[i * 2];
+        int y = raise.tiles[i * 2 + 1];
+        for (int ny = y - 1; ok && ny <= y + 1; ny++) {
+            for (int nx = x - 1; ok && nx <= x + 1; nx++) {
+                if (nx >= 0 && ny >= 0 && nx < map->width && ny < map->height) {
+                    size_t index = map_tile_index(map, nx, ny);
+                    if (!(raised[index >> 3] & (1 << (index & 7)))) {
+                        ok = map_queue_push(&buckets[distance[index]], nx, ny);
+                    }
+                }
+            }
+        }
+    }
+    for (int d = 0; ok && d < MAP_DISTANCE_MAX; d++) {
+        // Tiles only ever move to the next bucket, so this one does not grow
+        for (int i = 0; ok && i < buckets[d].count; i++) {
+            int x = buckets[d].tiles[i * 2];
+            int y = buckets[d].tiles[i * 2 + 1];
+            if (distance[map_tile_index(map, x, y)] != d) {
+                continue;
+            }
+            for (int ny = y - 1; ok && ny <= y + 1; ny++) {
+                for (int nx = x - 1; ok && nx <= x + 1; nx++) {
+                    if (nx >= 0 && ny >= 0 && nx < map->width && ny < map->height) {
+                        size_t index = map_tile_index(map, nx, ny);
+                        if (distance[index] > d + 1) {
+                            distance[index] = (Uint8)(d + 1);
+                            ok = map_queue_push(&buckets[d + 1], nx, ny);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    for (int d = 0; d <= MAP_DISTANCE_MAX; d++) {
+        free(buckets[d].tiles);
+    }
+    free(raise.tiles);
+    free(raised);
+    return ok;
+}
@@ -0,0 +1,246 @@
+#ifndef MAP_H
+#define MAP_H
+
+#include <stddef.h>
+#include <SDL.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Dimensions of the built-in default map
+#define MAP_WIDTH 24
+#define MAP_HEIGHT 24
+
+// Map tile types
+#define TILE_EMPTY 0
+#define TILE_WALL 1
+#define TILE_WALL2 2
+#define TILE_WALL3 3
+#define TILE_WALL4 4
+
+// Largest tile value a map can store
+#define MAP_TILE_MAX 255
+
+// Tiles are stored in square blocks of (1 << MAP_BLOCK_SHIFT) tiles per side so
+// a ray stepping in either axis stays within a few cache lines; an 8x8 block of
+// byte tiles is exactly one 64-byte line
+#define MAP_BLOCK_SHIFT 3
+
+// Alignment of the tile storage
+#define MAP_ALIGNMENT 64
+
+// Largest value of the empty-space distance field
+#define MAP_DISTANCE_MAX 255
+
+// Light levels: level l shades a color by (l + 1) / MAP_LIGHT_LEVELS
+#define MAP_LIGHT_LEVELS 32
+#define MAP_LIGHT_FULL (MAP_LIGHT_LEVELS - 1)
+#define MAP_LIGHT_HALF (MAP_LIGHT_LEVELS / 2 - 1)
+
+// Faces of a wall tile, named by the tile edge they lie on; open tiles keep
+// their floor and ceiling level in every face
+#define MAP_FACE_X_MIN 0
+#define MAP_FACE_X_MAX 1
+#define MAP_FACE_Y_MIN 2
+#define MAP_FACE_Y_MAX 3
+#define MAP_FACES 4
+
+// Compiled binary map format
+#define MAP_FILE_MAGIC "RCMP"
+#define MAP_FILE_VERSION 3
+#define MAP_FILE_EXTENSION ".rcmap"
+#define MAP_FILE_DISTANCE 0x1       // Header flag: the file has a distance field section
+#define MAP_FILE_FLOOR 0x2          // Header flag: the file has floor and ceiling sections
+#define MAP_FILE_LIGHTS 0x4         // Header flag: the file has a light section
+
+// One map cell
+typedef Uint8 MapTile;
+
+// Changed rectangles a map remembers for renderers that keep their last frame;
+// a renderer that fell further behind redraws everything
+#define MAP_DAMAGE_LOG 32
+
+// A rectangle of tiles [x0, x1] x [y0, y1] whose tiles, floors or light levels changed
+typedef struct MapDamage {
+    Sint32 x0;
+    Sint32 y0;
+    Sint32 x1;
+    Sint32 y1;
+} MapDamage;
+
+// A point light in the centre of tile (x, y): level at its centre, fading to
+// nothing radius tiles away
+typedef struct MapLight {
+    Sint32 x;
+    Sint32 y;
+    Sint32 radius;
+    Sint32 level;
+} MapLight;
+
+// Header at the start of a compiled map file; all fields are little-endian and
+// every section starts at a multiple of MAP_ALIGNMENT so it can be used in place
+typedef struct MapFileHeader {
+    char magic[4];          // MAP_FILE_MAGIC
+    Uint32 version;         // MAP_FILE_VERSION
+    Uint32 headerSize;      // sizeof(MapFileHeader)
+    Uint32 flags;           // MAP_FILE_* flags
+    Sint32 width;
+    Sint32 height;
+    Uint32 tileBytes;       // Bytes per tile, sizeof(MapTile)
+    Uint32 blockShift;      // Block layout of the tile and distance sections
+    double startX;
+    double startY;
+    Uint64 tileOffset;      // Tile section, map_storage_size bytes
+    Uint64 distanceOffset;  // Distance section of the same size, 0 when absent
+    Uint64 sectionSize;     // Size of each section in bytes
+    Uint64 checksum;        // FNV-1a over all sections, in file order
+    char name[64];
+    Uint64 floorOffset;     // Floor and ceiling texture sections, 0 when absent (version 2)
+    Uint64 ceilingOffset;
+    Uint64 lightOffset;     // Light section, lightCount MapLights, 0 when absent (version 3)
+    Uint32 lightCount;
+    Sint32 ambient;         // Light level where no light reaches
+} MapFileHeader;
+
+// Sizes of the version 1 and 2 headers, which end at the name and the ceiling offset
+#define MAP_FILE_HEADER_V1 offsetof(MapFileHeader, floorOffset)
+#define MAP_FILE_HEADER_V2 offsetof(MapFileHeader, lightOffset)
+
+// Structure representing the map: a heap tile grid of any size
+typedef struct Map {
+    MapTile *tiles;     // Tile grid in block order, padded to whole blocks
+    void *storage;      // Allocation backing tiles, NULL for a map that owns nothing
+    Uint8 *distance;    // Chebyshev distance from each tile to the nearest wall, in the
+                        // tile layout (NULL until map_build_distance)
+    void *distanceStorage;
+    Uint8 *floor;       // Floor texture of each tile in the tile layout, 0 for the flat color
+                        // (NULL when the map has no floor textures)
+    void *floorStorage;
+    Uint8 *ceiling;     // Ceiling texture of each tile, allocated together with floor
+    void *ceilingStorage;
+    MapLight *lights;   // Light sources, owned by the map
+    int lightCount;
+    int ambient;        // Light level where no light reaches
+    Uint8 *light;       // MAP_FACES light levels per tile in the tile layout, baked from the
+                        // lights (NULL for unlit maps: no lights at full ambient)
+    MapDamage damage[MAP_DAMAGE_LOG];   // Last rectangles changed, a ring indexed by damageCount
+    Uint32 damageCount; // Rectangles marked since the map was created
+    void *mapping;      // Compiled map file the planes live in, or NULL
+    size_t mappingSize;
+    int width;
+    int height;
+    int blockShift;     // log2 of the block edge, 0 for a plain row-major grid
+    int blocksPerRow;   // Blocks per row of blocks, including the padding block
+    double startX;  // Starting X position for player
+    double startY;  // Starting Y position for player
+    char name[64];  // Map name
+} Map;
+
+// Allocate an empty (all TILE_EMPTY) width x height map with the given block layout
+int map_create(Map *map, int width, int height, int blockShift);
+
+// Free the tile storage of a map
+void map_destroy(Map *map);
+
+// Create dst as a copy of src stored with a different block layout
+int map_copy(Map *dst, const Map *src, int blockShift);
+
+// Add floor and ceiling texture planes to a map, all 0 (flat color)
+int map_create_floors(Map *map);
+
+// Parse a map in the text format (NAME:, START:, DATA: sections, optional
+// FLOOR: and CEILING: sections of the same shape, AMBIENT:level and any number
+// of LIGHT:x,y,radius,level lines); the grid is sized from the longest data row
+// and the number of data rows
+int map_parse(Map *map, const char *text, int blockShift);
+
+// Read a map from a text file
+int map_load_text(Map *map, const char *filename, int blockShift);
+
+// Map a compiled map file into memory and use its tiles and distance field in place
+int map_load_binary(Map *map, const char *filename);
+
+// Load a map file in either format, chosen by its extension
+int map_load_file(Map *map, const char *filename);
+
+// Load only the tiles, floors and lights of a map file, as map_load_file would
+// lay them out, without building the distance field or baking light levels (a
+// compiled map still brings the distance field it was saved with)
+int map_load_tiles(Map *map, const char *filename);
+
+// Read the name of a text or compiled map file without loading the map
+int map_read_name(const char *filename, char *name, size_t size);
+
+// Read the size and starting position of a text or compiled map file without
+// loading the map; the rows of a text map are counted, not parsed
+int map_read_size(const char *filename, int *width, int *height, double *startX, double *startY);
+
+// Write a map as a compiled map file, including its distance field if built,
+// its floor and ceiling textures if it has them and its lights; an existing
+// file is replaced at once, never left half written
+int map_save_binary(const Map *map, const char *filename);
+
+// Number of bytes of tile storage, including block padding
+size_t map_storage_size(const Map *map);
+
+// Build the empty-space distance field: for every tile, the Chebyshev distance
+// (capped at MAP_DISTANCE_MAX) to the closest wall, counting everything outside
+// the map as wall. A tile at distance d is the centre of an empty square of
+// radius d - 1 that lies entirely inside the map.
+int map_build_distance(Map *map);
+
+// Bring a loaded map up to date with source, a newer version of the same file
+// read with map_load_tiles. Only the tiles that differ are written, in place,
+// and the distance field and light levels are repaired around them instead of
+// being rebuilt. Returns the number of tiles changed, -1 if the maps differ in
+// size or layout or when out of memory.
+int map_apply_changes(Map *map, const Map *source);
+
+// Record that the tiles, floors or light levels of [x0, x1] x [y0, y1] changed,
+// so a renderer that kept its last frame redraws what shows them
+void map_mark_changed(Map *map, int x0, int y0, int x1, int y1);
+
+// Position of tile (x, y) in the tile array
+static inline size_t map_tile_index(const Map *map, int x, int y) {
+    int shift = map->blockShift;
+    int mask = (1 << shift) - 1;
+    size_t block = (size_t)(y >> shift) * map->blocksPerRow + (size_t)(x >> shift);
+    return (block << (2 * shift)) | ((size_t)(y & mask) << shift) | (size_t)(x & mask);
+}
+
+// Read tile (x, y); the caller keeps x and y inside the map
+static inline int map_get(const Map *map, int x, int y) {
+    return map->tiles[map_tile_index(map, x, y)];
+}
+
+// Read the distance field at (x, y); the field must be built
+static inline int map_distance(const Map *map, int x, int y) {
+    return map->distance[map_tile_index(map, x, y)];
+}
+
+// Floor texture of tile (x, y); the map must have floor planes
+static inline int map_floor(const Map *map, int x, int y) {
+    return map->floor[map_tile_index(map, x, y)];
+}
+
+// Ceiling texture of tile (x, y); the map must have floor planes
+static inline int map_ceiling(const Map *map, int x, int y) {
+    return map->ceiling[map_tile_index(map, x, y)];
+}
+
+// Light level of one face of tile (x, y); the map must be lit
+static inline int map_light(const Map *map, int x, int y, int face) {
+    return map->light[map_tile_index(map, x, y) * MAP_FACES + face];
+}
+
+// Write tile (x, y); the caller keeps x and y inside the map
+static inline void map_set(Map *map, int x, int y, int tile) {
+    map->tiles[map_tile_index(map, x, y)] = (MapTile)tile;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MAP_H
@@ -0,0 +1,75 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Plain command line tool, no SDL main wrapper
+#define SDL_MAIN_HANDLED
+
+#include "map.h"
+
+// Print usage information
+static void mapc_usage(const char *program) {
+    fprintf(stderr, "Usage: %s [--flat] [--no-distance] INPUT.map [OUTPUT%s]\n", program, MAP_FILE_EXTENSION);
+    fprintf(stderr, "Compiles a text map into the binary map format the engine maps in place.\n");
+    fprintf(stderr, "  --flat         store tiles row by row instead of in cache blocks\n");
+    fprintf(stderr, "  --no-distance  leave out the distance field; it is built at load time\n");
+}
+
+int main(int argc, char *argv[]) {
+    const char *input = NULL;
+    const char *output = NULL;
+    int blockShift = MAP_BLOCK_SHIFT;
+    int distance = 1;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--flat") == 0) {
+            blockShift = 0;
+        } else if (strcmp(argv[i], "--no-distance") == 0) {
+            distance = 0;
+        } else if (argv[i][0] != '-' && !input) {
+            input = argv[i];
+        } else if (argv[i][0] != '-' && !output) {
+            output = argv[i];
+        } else {
+            mapc_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (!input) {
+        mapc_usage(argv[0]);
+        return 1;
+    }
+
+    // Default output: the input path with the compiled extension
+    char defaultOutput[512];
+    if (!output) {
+        const char *ext = strrchr(input, '.');
+        const char *slash = strrchr(input, '/');
+        size_t stem = (ext && (!slash || ext > slash)) ? (size_t)(ext - input) : strlen(input);
+        snprintf(defaultOutput, sizeof(defaultOutput), "%.*s%s", (int)stem, input, MAP_FILE_EXTENSION);
+        output = defaultOutput;
+    }
+
+    Map map;
+    if (!map_load_text(&map, input, blockShift)) {
+        fprintf(stderr, "Failed to parse map: %s\n", input);
+        return 1;
+    }
+
+    if (!distance) {
+        // The text loader always builds it, drop it before writing
+        free(map.distanceStorage);
+        map.distanceStorage = NULL;
+        map.distance = NULL;
+    }
+
+    int ok = map_save_binary(&map, output);
+    if (ok) {
+        printf("%s -> %s (%s, %dx%d, %s)\n", input, output, map.name, map.width, map.height,
+               blockShift ? "blocked" : "flat");
+    }
+
+    map_destroy(&map);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,398 @@
+// inotify and poll are Linux and POSIX, not C99
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#endif
+
+#include "catalog.h"
+#include "lighting.h"
+#include "mapwatch.h"
+
+#ifdef __linux__
+
+// Changed files remembered while waiting for them to settle
+#define MAPWATCH_MAX_CHANGED 64
+
+// ****************************************************
+// Private (static) function declarations
+// ****************************************************
+
+// Thread entry point: collect changed files and read them once they settle
+static int mapwatch_main(void *data);
+
+// Read a changed file and queue it for mapwatch_poll, replacing an older
+// version still waiting; a file that does not load is reported and skipped
+static void mapwatch_read(MapWatcher *watcher, const char *name);
+
+// Queue a map for mapwatch_poll, replacing an older version of the same file
+// still waiting; a built map older than the newest version read is dropped
+static void mapwatch_queue(MapWatcher *watcher, MapReload *reload);
+
+// Find the newest version read of a file, adding the file; NULL when out of memory
+static Uint32* mapwatch_newest(MapWatcher *watcher, const char *path);
+
+// Build the distance field and light levels of every map handed back
+static void mapwatch_build_waiting(MapWatcher *watcher);
+
+// ****************************************************
+// Public API Implementation
+// ****************************************************
+
+// Start watching a directory; returns NULL when it cannot be watched
+MapWatcher* mapwatch_start(const char *directory) {
+    MapWatcher *watcher = (MapWatcher*)calloc(1, sizeof(MapWatcher));
+    if (!watcher) {
+        fprintf(stderr, "Failed to allocate the map watcher!\n");
+        return NULL;
+    }
+    snprintf(watcher->directory, sizeof(watcher->directory), "%s", directory);
+
+    // Files are read once written and closed, or moved in whole
+    watcher->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    watcher->wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (watcher->fd < 0 || watcher->wake < 0 ||
+        inotify_add_watch(watcher->fd, directory, IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        fprintf(stderr, "Could not watch map directory %s: %s\n", directory, strerror(errno));
+        if (watcher->fd >= 0) {
+            close(watcher->fd);
+        }
+        if (watcher->wake >= 0) {
+            close(watcher->wake);
+        }
+        free(watcher);
+        return NULL;
+    }
+
+    SDL_AtomicSet(&watcher->stop, 0);
+    SDL_AtomicSet(&watcher->pending, 0);
+    watcher->lock = SDL_CreateMutex();
+    if (watcher->lock) {
+        watcher->thread = SDL_CreateThread(mapwatch_main, "raycaster-mapwatch", watcher);
+    }
+    if (!watcher->thread) {
+        fprintf(stderr, "Failed to create map watcher thread: %s\n", SDL_GetError());
+        mapwatch_stop(watcher);
+        return NULL;
+    }
+    return watcher;
+}
+
+// Stop the thread and free the watcher with any maps not taken
+void mapwatch_stop(MapWatcher *watcher) {
+    if (!watcher) {
+        return;
+    }
+
+    SDL_AtomicSet(&watcher->stop, 1);
+    if (watcher->thread) {
+        SDL_WaitThread(watcher->thread, NULL);
+    }
+    for (int i = 0; i < watcher->readyCount; i++) {
+        map_destroy(&watcher->ready[i].map);
+    }
+    free(watcher->ready);
+    for (int i = 0; i < watcher->buildCount; i++) {
+        map_destroy(&watcher->builds[i].map);
+    }
+    free(watcher->builds);
+    free(watcher->files);
+    if (watcher->lock) {
+        SDL_DestroyMutex(watcher->lock);
+    }
+    close(watcher->fd);
+    close(watcher->wake);
+    free(watcher);
+}
+
+// Number of maps read and waiting for mapwatch_poll, without taking the lock
+int mapwatch_pending(MapWatcher *watcher) {
+    return watcher ? SDL_AtomicGet(&watcher->pending) : 0;
+}
+
+// Take the oldest map read; returns 0 when none is waiting. A file saved
+// again before it was taken is only returned once, as last read.
+int mapwatch_poll(MapWatcher *watcher, MapReload *reload) {
+    if (!watcher || SDL_AtomicGet(&watcher->pending) == 0) {
+        return 0;
+    }
+
+    SDL_LockMutex(watcher->lock);
+    int found = watcher->readyCount > 0;
+    if (found) {
+        *reload = watcher->ready[0];
+        watcher->readyCount--;
+        if (watcher->readyCount > 0) {
+            memmove(&watcher->ready[0], &watcher->ready[1], watcher->readyCount * sizeof(MapReload));
+        }
+        SDL_AtomicSet(&watcher->pending, watcher->readyCount);
+    }
+    SDL_UnlockMutex(watcher->lock);
+    return found;
+}
+
+// Hand a map taken with mapwatch_poll back to the thread to build its distance
+// field and light levels, for a map whose size changed and that would stall a
+// frame; mapwatch_poll returns it again with built set, unless the file was
+// read again meanwhile. Returns 0 if it could not be queued, and the map stays
+// the caller's.
+int mapwatch_build(MapWatcher *watcher, MapReload *reload) {
+    if (!watcher) {
+        return 0;
+    }
+
+    SDL_LockMutex(watcher->lock);
+    if (watcher->buildCount == watcher->buildCapacity) {
+        int capacity = watcher->buildCapacity ? watcher->buildCapacity * 2 : 4;
+        MapReload *grown = (MapReload*)realloc(watcher->builds, capacity * sizeof(MapReload));
+        if (grown) {
+            watcher->builds = grown;
+            watcher->buildCapacity = capacity;
+        }
+    }
+    int queued = watcher->buildCount < watcher->buildCapacity;
+    if (queued) {
+        watcher->builds[watcher->buildCount++] = *reload;
+    }
+    SDL_UnlockMutex(watcher->lock);
+
+    if (queued) {
+        Uint64 one = 1;
+        if (write(watcher->wake, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+            perror("write");
+        }
+    }
+    return queued;
+}
+
+// ****************************************************
+// Private functions implementation
+// ****************************************************
+
+// Thread entry point: collect changed files and read them once they settle
+static int mapwatch_main(void *data) {
+    MapWatcher *watcher = (MapWatcher*)data;
+    char changed[MAPWATCH_MAX_CHANGED][256];
+    int changedCount = 0;
+    Uint32 lastChange = 0;
+
+    // Events are read whole into a buffer aligned for struct inotify_event
+    Uint64 buffer[512];
+
+    while (!SDL_AtomicGet(&watcher->stop)) {
+        struct pollfd fds[2];
+        fds[0].fd = watcher->fd;
+        fds[0].events = POLLIN;
+        fds[0].revents = 0;
+        fds[1].fd = watcher->wake;
+        fds[1].events = POLLIN;
+        fds[1].revents = 0;
+        int ready = poll(fds, 2, changedCount > 0 ? MAPWATCH_SETTLE_MS : MAPWATCH_POLL_MS);
+        if (ready < 0 && errno != EINTR) {
+            perror("poll");
+            break;
+        }
+
+        // Maps handed back first: the game is waiting for them
+        if (ready > 0 && (fds[1].revents & POLLIN)) {
+            Uint64 count;
+            if (read(watcher->wake, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+                perror("read");
+            }
+            mapwatch_build_waiting(watcher);
+        }
+
+        ssize_t length;
+        while (ready > 0 && (fds[0].revents & POLLIN) && (length = read(watcher->fd, buffer, sizeof(buffer))) > 0) {
+            for (const char *next = (const char*)buffer; next < (const char*)buffer + length; ) {
+                const struct inotify_event *event = (const struct inotify_event*)next;
+                next += sizeof(struct inotify_event) + event->len;
+                if (event->len == 0 || !catalog_is_map_file(event->name)) {
+                    continue;
+                }
+
+                int known = 0;
+                for (int i = 0; !known && i < changedCount; i++) {
+                    known = strcmp(changed[i], event->name) == 0;
+                }
+                if (known) {
+                    continue;
+                }
+                if (changedCount == MAPWATCH_MAX_CHANGED) {
+                    // Too many files at once: read those waiting now
+                    for (int i = 0; i < changedCount; i++) {
+                        mapwatch_read(watcher, changed[i]);
+                    }
+                    changedCount = 0;
+                }
+                snprintf(changed[changedCount++], sizeof(changed[0]), "%s", event->name);
+            }
+            lastChange = SDL_GetTicks();
+        }
+
+        if (changedCount > 0 && SDL_GetTicks() - lastChange >= MAPWATCH_SETTLE_MS) {
+            for (int i = 0; i < changedCount; i++) {
+                mapwatch_read(watcher, changed[i]);
+            }
+            changedCount = 0;
+        }
+    }
+    return 0;
+}
+
+// Read a changed file and queue it for mapwatch_poll, replacing an older
+// version still waiting; a file that does not load is reported and skipped
+static void mapwatch_read(MapWatcher *watcher, const char *name) {
+    MapReload reload;
+    memset(&reload, 0, sizeof(reload));
+    snprintf(reload.path, sizeof(reload.path), "%s/%s", watcher->directory, name);
+
+    Uint64 start = SDL_GetPerformanceCounter();
+    if (!map_load_tiles(&reload.map, reload.path)) {
+        fprintf(stderr, "Could not reload %s, keeping the map as it was\n", reload.path);
+        return;
+    }
+    reload.loadMs = (double)(SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+    reload.sequence = ++watcher->reads;
+    Uint32 *newest = mapwatch_newest(watcher, reload.path);
+    if (newest) {
+        *newest = reload.sequence;
+    }
+    mapwatch_queue(watcher, &reload);
+}
+
+// Queue a map for mapwatch_poll, replacing an older version of the same file
+// still waiting; a built map older than the newest version read is dropped
+static void mapwatch_queue(MapWatcher *watcher, MapReload *reload) {
+    // The file was saved again while this version was being built: the newer
+    // version is waiting, or the game has applied it already
+    if (reload->built) {
+        const Uint32 *newest = mapwatch_newest(watcher, reload->path);
+        if (newest && *newest != reload->sequence) {
+            map_destroy(&reload->map);
+            return;
+        }
+    }
+
+    SDL_LockMutex(watcher->lock);
+    int index = 0;
+    while (index < watcher->readyCount && strcmp(watcher->ready[index].path, reload->path) != 0) {
+        index++;
+    }
+    if (index < watcher->readyCount) {
+        map_destroy(&watcher->ready[index].map);
+        watcher->ready[index] = *reload;
+    } else {
+        if (watcher->readyCount == watcher->readyCapacity) {
+            int capacity = watcher->readyCapacity ? watcher->readyCapacity * 2 : 8;
+            MapReload *grown = (MapReload*)realloc(watcher->ready, capacity * sizeof(MapReload));
+            if (grown) {
+                watcher->ready = grown;
+                watcher->readyCapacity = capacity;
+            }
+        }
+        if (watcher->readyCount < watcher->readyCapacity) {
+            watcher->ready[watcher->readyCount++] = *reload;
+        } else {
+            fprintf(stderr, "Failed to queue reloaded map %s\n", reload->path);
+            map_destroy(&reload->map);
+        }
+    }
+    SDL_AtomicSet(&watcher->pending, watcher->readyCount);
+    SDL_UnlockMutex(watcher->lock);
+}
+
+// Build the distance field and light levels of every map handed back
+static void mapwatch_build_waiting(MapWatcher *watcher) {
+    for (;;) {
+        MapReload reload;
+        SDL_LockMutex(watcher->lock);
+        int found = watcher->buildCount > 0;
+        if (found) {
+            reload = watcher->builds[0];
+            watcher->buildCount--;
+            memmove(&watcher->builds[0], &watcher->builds[1], watcher->buildCount * sizeof(MapReload));
+        }
+        SDL_UnlockMutex(watcher->lock);
+        if (!found) {
+            return;
+        }
+
+        // A compiled map brings its distance field
+        Uint64 start = SDL_GetPerformanceCounter();
+        if ((!reload.map.distance && !map_build_distance(&reload.map)) || !lighting_bake(&reload.map)) {
+            fprintf(stderr, "Could not build the new version of %s, keeping the map as it was\n", reload.path);
+            map_destroy(&reload.map);
+            continue;
+        }
+        reload.loadMs += (double)(SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+        reload.built = 1;
+        mapwatch_queue(watcher, &reload);
+    }
+}
+
+// Find the newest version read of a file, adding the file; NULL when out of memory
+static Uint32* mapwatch_newest(MapWatcher *watcher, const char *path) {
+    for (int i = 0; i < watcher->fileCount; i++) {
+        if (strcmp(watcher->files[i].path, path) == 0) {
+            return &watcher->files[i].sequence;
+        }
+    }
+
+    if (watcher->fileCount == watcher->fileCapacity) {
+        int capacity = watcher->fileCapacity ? watcher->fileCapacity * 2 : 16;
+        MapWatchFile *grown = (MapWatchFile*)realloc(watcher->files, capacity * sizeof(MapWatchFile));
+        if (!grown) {
+            return NULL;
+        }
+        watcher->files = grown;
+        watcher->fileCapacity = capacity;
+    }
+    MapWatchFile *file = &watcher->files[watcher->fileCount++];
+    snprintf(file->path, sizeof(file->path), "%s", path);
+    file->sequence = 0;
+    return &file->sequence;
+}
+
+#else
+
+// Start watching a directory; map hot reload needs inotify, so never on other systems
+MapWatcher* mapwatch_start(const char *directory) {
+    fprintf(stderr, "Map hot reload needs inotify, not watching %s\n", directory);
+    return NULL;
+}
+
+// Stop the thread and free the watcher with any maps not taken
+void mapwatch_stop(MapWatcher *watcher) {
+    (void)watcher;
+}
+
+// Number of maps read and waiting for mapwatch_poll, without taking the lock
+int mapwatch_pending(MapWatcher *watcher) {
+    (void)watcher;
+    return 0;
+}
+
+// Take the oldest map read; returns 0 when none is waiting
+int mapwatch_poll(MapWatcher *watcher, MapReload *reload) {
+    (void)watcher;
+    (void)reload;
+    return 0;
+}
+
+// Hand a map back to be built; there is no thread to build it on
+int mapwatch_build(MapWatcher *watcher, MapReload *reload) {
+    (void)watcher;
+    (void)reload;
+    return 0;
+}
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef MAPWATCH_H
+#define MAPWATCH_H
+
+#include <SDL.h>
+
+#include "map.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// How long the watcher thread sleeps between checks for a stop request
+#define MAPWATCH_POLL_MS 100
+
+// Quiet time after the last change to a file before it is read, so a save
+// made of several writes or a rename is read once, whole
+#define MAPWATCH_SETTLE_MS 50
+
+// A map file that changed on disk, read again on the watcher thread
+typedef struct MapReload {
+    char path[512];     // Directory and file name, as catalog_scan names the file
+    Map map;            // Its tiles, read with map_load_tiles; catalog_update takes it over
+    double loadMs;      // Time spent reading and parsing the file, and building it when built
+    int built;          // Distance field and light levels built too, by mapwatch_build
+    Uint32 sequence;    // Order the watcher read it in, across all files
+} MapReload;
+
+// The newest version the watcher has read of a file
+typedef struct MapWatchFile {
+    char path[512];
+    Uint32 sequence;
+} MapWatchFile;
+
+// Background thread that watches a map directory with inotify and reads every
+// map file saved into it; the game applies the maps it has read between frames
+typedef struct MapWatcher {
+    char directory[256];
+    int fd;                     // inotify descriptor
+    SDL_Thread *thread;
+    SDL_atomic_t stop;          // Set to stop the thread
+    SDL_mutex *lock;
+    MapReload *ready;           // Maps read and not yet taken, guarded by lock
+    int readyCount;
+    int readyCapacity;
+    SDL_atomic_t pending;       // readyCount, readable without the lock
+    MapReload *builds;          // Maps handed back to be built whole, guarded by lock
+    int buildCount;
+    int buildCapacity;
+    int wake;                   // eventfd that wakes the thread when a map is handed back
+    Uint32 reads;               // Versions read so far, numbering them
+    MapWatchFile *files;        // Newest version of every file read, watcher thread only
+    int fileCount;
+    int fileCapacity;
+} MapWatcher;
+
+// Start watching a directory; returns NULL when it cannot be watched
+MapWatcher* mapwatch_start(const char *directory);
+
+// Stop the thread and free the watcher with any maps not taken
+void mapwatch_stop(MapWatcher *watcher);
+
+// Number of maps read and waiting for mapwatch_poll, without taking the lock
+int mapwatch_pending(MapWatcher *watcher);
+
+// Take the oldest map read; returns 0 when none is waiting. A file saved
+// again before it was taken is only returned once, as last read.
+int mapwatch_poll(MapWatcher *watcher, MapReload *reload);
+
+// Hand a map taken with mapwatch_poll back to the thread to build its distance
+// field and light levels, for a map whose size changed and that would stall a
+// frame; mapwatch_poll returns it again with built set, unless the file was
+// read again meanwhile. Returns 0 if it could not be queued, and the map stays
+// the caller's.
+int mapwatch_build(MapWatcher *watcher, MapReload *reload);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MAPWATCH_H
@@ -0,0 +1,166 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "profiler.h"
+
+// ****************************************************
+// Private (static) function declarations
+// ****************************************************
+
+// Write the name of ring thread as Chrome thread metadata
+static void profiler_write_thread_name(FILE *file, int thread);
+
+// ****************************************************
+// Public API Implementation
+// ****************************************************
+
+// Create a profiler that is not capturing; rings are allocated by the captures that use them
+Profiler* profiler_create(void) {
+    Profiler *profiler = (Profiler*)calloc(1, sizeof(Profiler));
+    if (!profiler) {
+        fprintf(stderr, "Failed to allocate profiler!\n");
+        return NULL;
+    }
+    SDL_AtomicSet(&profiler->capturing, 0);
+    return profiler;
+}
+
+// Free a profiler and its rings
+void profiler_destroy(Profiler *profiler) {
+    if (!profiler) {
+        return;
+    }
+    for (int i = 0; i < PROFILER_MAX_THREADS; i++) {
+        free(profiler->rings[i].events);
+    }
+    free(profiler);
+}
+
+// Start a capture for the non-worker threads and workerCount render workers,
+// dropping the events of the last one; returns 0 when out of memory
+int profiler_start(Profiler *profiler, int workerCount) {
+    int threads = PROFILER_THREAD_WORKERS + workerCount;
+    if (threads > PROFILER_MAX_THREADS) {
+        threads = PROFILER_MAX_THREADS;
+    }
+
+    // Nothing records while no capture runs, so the rings can be reset here
+    for (int i = 0; i < PROFILER_MAX_THREADS; i++) {
+        ProfilerRing *ring = &profiler->rings[i];
+        SDL_AtomicSet(&ring->head, 0);
+        if (i >= threads) {
+            continue;
+        }
+        if (!ring->events) {
+            ring->events = (ProfilerEvent*)malloc(PROFILER_RING_EVENTS * sizeof(ProfilerEvent));
+            if (!ring->events) {
+                fprintf(stderr, "Failed to allocate profiler events!\n");
+                return 0;
+            }
+        }
+    }
+
+    profiler->captureStart = SDL_GetPerformanceCounter();
+    SDL_AtomicSet(&profiler->capturing, 1);
+    return 1;
+}
+
+// Stop recording; the events stay until the next capture starts
+void profiler_stop(Profiler *profiler) {
+    SDL_AtomicSet(&profiler->capturing, 0);
+}
+
+// Write the captured events as a Chrome trace_event JSON file
+int profiler_write_trace(const Profiler *profiler, const char *path) {
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        fprintf(stderr, "Failed to open trace file %s\n", path);
+        return 0;
+    }
+
+    double ticksPerUs = SDL_GetPerformanceFrequency() / 1e6;
+    int first = 1;
+    fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [");
+    for (int thread = 0; thread < PROFILER_MAX_THREADS; thread++) {
+        const ProfilerRing *ring = &profiler->rings[thread];
+        int head = ring->events ? SDL_AtomicGet((SDL_atomic_t*)&ring->head) : 0;
+        if (head == 0) {
+            continue;
+        }
+
+        fprintf(file, "%s\n  ", first ? "" : ",");
+        first = 0;
+        profiler_write_thread_name(file, thread);
+
+        // A ring that wrapped keeps only its newest events
+        int oldest = head > PROFILER_RING_EVENTS ? head - PROFILER_RING_EVENTS : 0;
+        for (int i = oldest; i < head; i++) {
+            const ProfilerEvent *event = &ring->events[i & (PROFILER_RING_EVENTS - 1)];
+            double ts = (double)(Sint64)(event->time - profiler->captureStart) / ticksPerUs;
+            if (event->phase == PROFILER_SCOPE) {
+                fprintf(file, ",\n  {\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, "
+                        "\"ts\": %.3f, \"dur\": %.3f}", event->name, thread, ts, event->value / ticksPerUs);
+            } else {
+                fprintf(file, ",\n  {\"name\": \"%s\", \"ph\": \"C\", \"pid\": 1, \"tid\": %d, "
+                        "\"ts\": %.3f, \"args\": {\"value\": %llu}}", event->name, thread, ts,
+                        (unsigned long long)event->value);
+            }
+        }
+    }
+    fprintf(file, "\n]}\n");
+
+    int ok = !ferror(file);
+    if (fclose(file) != 0) {
+        ok = 0;
+    }
+    if (!ok) {
+        fprintf(stderr, "Failed to write trace file %s\n", path);
+    }
+    return ok;
+}
+
+// Number of events captured so far, at most PROFILER_RING_EVENTS per thread
+int profiler_event_count(const Profiler *profiler) {
+    int count = 0;
+    for (int i = 0; i < PROFILER_MAX_THREADS; i++) {
+        int head = SDL_AtomicGet((SDL_atomic_t*)&profiler->rings[i].head);
+        count += head < PROFILER_RING_EVENTS ? head : PROFILER_RING_EVENTS;
+    }
+    return count;
+}
+
+// Record an event into a thread's ring; threads without a ring are ignored
+void profiler_record(Profiler *profiler, int thread, const char *name, char phase, Uint64 time, Uint64 value) {
+    if (thread < 0 || thread >= PROFILER_MAX_THREADS || !profiler->rings[thread].events) {
+        return;
+    }
+
+    // Only this thread moves head; the increment publishes the event after it is written
+    ProfilerRing *ring = &profiler->rings[thread];
+    int head = SDL_AtomicGet(&ring->head);
+    ProfilerEvent *event = &ring->events[head & (PROFILER_RING_EVENTS - 1)];
+    event->name = name;
+    event->time = time;
+    event->value = value;
+    event->phase = phase;
+    SDL_AtomicAdd(&ring->head, 1);
+}
+
+// ****************************************************
+// Private functions implementation
+// ****************************************************
+
+// Write the name of ring thread as Chrome thread metadata
+static void profiler_write_thread_name(FILE *file, int thread) {
+    fprintf(file, "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": \"", thread);
+    if (thread == PROFILER_THREAD_MAIN) {
+        fprintf(file, "main");
+    } else if (thread == PROFILER_THREAD_SIM) {
+        fprintf(file, "simulation");
+    } else if (thread == PROFILER_THREAD_RENDER) {
+        fprintf(file, "render");
+    } else {
+        fprintf(file, "render worker %d", thread - PROFILER_THREAD_WORKERS);
+    }
+    fprintf(file, "\"}}");
+}
@@ -0,0 +1,99 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <SDL.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Rings of the threads that are not render workers; render worker i records
+// into ring PROFILER_THREAD_WORKERS + i (worker 0 is whichever thread renders)
+#define PROFILER_THREAD_MAIN 0
+#define PROFILER_THREAD_SIM 1
+#define PROFILER_THREAD_RENDER 2
+#define PROFILER_THREAD_WORKERS 3
+#define PROFILER_MAX_THREADS 35
+
+// Events each ring keeps, several seconds of frames; older ones are
+// overwritten, power of two
+#define PROFILER_RING_EVENTS 131072
+
+// Chrome trace_event phases of the recorded events
+#define PROFILER_SCOPE 'X'
+#define PROFILER_COUNTER 'C'
+
+// One recorded event: a timed scope or a counter sample
+typedef struct ProfilerEvent {
+    const char *name;       // Static string
+    Uint64 time;            // Performance counter at the start of the scope or at the sample
+    Uint64 value;           // Scope duration in counter ticks, or the counter's value
+    char phase;             // PROFILER_SCOPE or PROFILER_COUNTER
+} ProfilerEvent;
+
+// Events of one thread; only that thread writes, so recording is a store and
+// an atomic head increment, and readers take the events before head
+typedef struct ProfilerRing {
+    ProfilerEvent *events;
+    SDL_atomic_t head;      // Events recorded so far; the newest is at (head - 1) % PROFILER_RING_EVENTS
+    char padding[64];       // Keep neighbouring heads off the same cache line
+} ProfilerRing;
+
+// Capture state and one ring per thread
+typedef struct Profiler {
+    SDL_atomic_t capturing; // Scopes and counters are only recorded while set
+    ProfilerRing rings[PROFILER_MAX_THREADS];
+    Uint64 captureStart;    // Performance counter when the capture started
+} Profiler;
+
+// Create a profiler that is not capturing; rings are allocated by the captures that use them
+Profiler* profiler_create(void);
+
+// Free a profiler and its rings
+void profiler_destroy(Profiler *profiler);
+
+// Start a capture for the non-worker threads and workerCount render workers,
+// dropping the events of the last one; returns 0 when out of memory
+int profiler_start(Profiler *profiler, int workerCount);
+
+// Stop recording; the events stay until the next capture starts
+void profiler_stop(Profiler *profiler);
+
+// Write the captured events as a Chrome trace_event JSON file
+int profiler_write_trace(const Profiler *profiler, const char *path);
+
+// Number of events captured so far, at most PROFILER_RING_EVENTS per thread
+int profiler_event_count(const Profiler *profiler);
+
+// Record an event into a thread's ring; threads without a ring are ignored
+void profiler_record(Profiler *profiler, int thread, const char *name, char phase, Uint64 time, Uint64 value);
+
+// Check whether a capture is running
+static inline int profiler_capturing(Profiler *profiler) {
+    return profiler && SDL_AtomicGet(&profiler->capturing);
+}
+
+// Start of a scope: the performance counter while capturing, 0 otherwise
+static inline Uint64 profiler_begin(Profiler *profiler) {
+    return profiler_capturing(profiler) ? SDL_GetPerformanceCounter() : 0;
+}
+
+// End a scope started with profiler_begin; scopes begun outside a capture are dropped
+static inline void profiler_end(Profiler *profiler, int thread, const char *name, Uint64 start) {
+    if (start != 0 && profiler_capturing(profiler)) {
+        profiler_record(profiler, thread, name, PROFILER_SCOPE, start, SDL_GetPerformanceCounter() - start);
+    }
+}
+
+// Sample a counter while capturing
+static inline void profiler_counter(Profiler *profiler, int thread, const char *name, Uint64 value) {
+    if (profiler_capturing(profiler)) {
+        profiler_record(profiler, thread, name, PROFILER_COUNTER, SDL_GetPerformanceCounter(), value);
+    }
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PROFILER_H
@@ -0,0 +1,97 @@
+#ifndef RAYCASTER_H
+#define RAYCASTER_H
+
+#include "engine.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Rays traced together by the packet kernel
+#define RAY_PACKET_SIZE 4
+
+// Closest wall distance used for projection, keeps line heights within int range
+#define RAY_MIN_WALL_DIST 1e-4
+
+// Instruction set the packet kernel was compiled for
+#if defined(__AVX__)
+#define RAYCASTER_SIMD "avx"
+#elif defined(__SSE2__)
+#define RAYCASTER_SIMD "sse2"
+#else
+#define RAYCASTER_SIMD "scalar"
+#endif
+
+// Fine angles per turn of the fixed-point path, and the fraction bits kept
+// when view and column angles are added before rounding to a fine angle
+#define RAY_FIXED_ANGLE_BITS 16
+#define RAY_FIXED_ANGLES (1 << RAY_FIXED_ANGLE_BITS)
+#define RAY_FIXED_ANGLE_FRACTION 8
+
+// Largest map edge the fixed-point path can trace, positions are 16.16
+#define RAY_FIXED_MAX_MAP 32767
+
+// Closest wall distance of the fixed-point path in 16.16, about RAY_MIN_WALL_DIST
+#define RAY_FIXED_MIN_WALL_DIST 7
+
+// Per-column tables of the fixed-point path for one view width and camera
+// plane: where each column's ray points relative to the view direction
+typedef struct RayFixedColumns {
+    int width;          // Columns the tables were built for, 0 before the first build
+    double dirLength;   // Camera the tables were built for: |dir|, and the plane
+    double planeAlong;  // along and across the view direction
+    double planeAcross;
+    Sint32 *angle;      // Column angle relative to the view, in fine angles with fraction bits
+    Sint32 *scale;      // 1 / |ray| in 2.30, projects ray lengths on the view direction
+} RayFixedColumns;
+
+// Inputs of RAY_PACKET_SIZE rays traced together
+typedef struct RayPacket {
+    double posX[RAY_PACKET_SIZE];   // Ray origins
+    double posY[RAY_PACKET_SIZE];
+    double dirX[RAY_PACKET_SIZE];   // Ray directions (not necessarily normalized)
+    double dirY[RAY_PACKET_SIZE];
+    double projHeight;              // Screen height for lineHeight, 0 to skip projection
+    double maxDist;                 // Longest ray traced, in lengths of its direction; INFINITY for no limit
+} RayPacket;
+
+// Trace a single ray through the map with scalar DDA (the reference path)
+void raycaster_cast(const Map *map, double posX, double posY, double dirX, double dirY,
+                    double projHeight, RayHit *hit);
+
+// Trace a single ray no farther than maxDist lengths of its direction, without
+// projection; a ray that gets no farther misses (hit is 0)
+void raycaster_cast_range(const Map *map, double posX, double posY, double dirX, double dirY,
+                          double maxDist, RayHit *hit);
+
+// Trace a packet of rays with masked SIMD stepping until every lane has hit or
+// run out of range; results are bit-identical to raycaster_cast_range (or to
+// raycaster_cast without a range) for each lane
+void raycaster_cast_packet(const Map *map, const RayPacket *packet, RayHit *hits);
+
+// Fill the fine angle tables of the fixed-point path (cosines and secants);
+// call once before tracing, later calls do nothing
+void raycaster_fixed_init(void);
+
+// Fine angle of a view direction, with RAY_FIXED_ANGLE_FRACTION fraction bits
+Uint32 raycaster_fixed_view_angle(double dirX, double dirY);
+
+// Rebuild the per-column tables if the width or the camera's field of view
+// changed; returns 0 when out of memory
+int raycaster_fixed_columns_update(RayFixedColumns *columns, const Player *player, int width);
+
+// Free the per-column tables
+void raycaster_fixed_columns_free(RayFixedColumns *columns);
+
+// Trace a single ray with integer-only DDA: the origin in 16.16, the ray at a
+// fine angle, and scale (2.30) projecting ray lengths on the view direction.
+// Follows the same rules as raycaster_cast, so with exact inputs the two agree
+// up to rounding of the tables
+void raycaster_cast_fixed(const Map *map, Sint32 posX, Sint32 posY, Uint32 angle, Sint32 scale,
+                          int projHeight, RayHit *hit);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // RAYCASTER_H
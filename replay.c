@@ -0,0 +1,155 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "replay.h"
+
+// ****************************************************
+// Public API Implementation
+// ****************************************************
+
+// Create a recording starting from the engine's current state; NULL on failure
+Replay* replay_create(const char *path, const Engine *engine) {
+    Replay *replay = (Replay*)calloc(1, sizeof(Replay));
+    if (!replay) {
+        fprintf(stderr, "Failed to allocate recording!\n");
+        return NULL;
+    }
+
+    ReplayHeader *header = &replay->header;
+    memcpy(header->magic, REPLAY_MAGIC, 4);
+    header->version = REPLAY_VERSION;
+    header->headerSize = sizeof(ReplayHeader);
+    header->windowWidth = engine->windowWidth;
+    header->windowHeight = engine->windowHeight;
+    header->renderScale = engine->renderScale;
+    header->mapIndex = engine->currentMapIndex;
+    header->demoSprites = engine->demoSprites;
+    header->fixedPoint = engine->fixedPoint;
+    header->player = engine->player;
+    snprintf(header->mapName, sizeof(header->mapName), "%s", engine->map->name);
+    replay->writing = 1;
+    replay->renderScale = engine->renderScale;
+
+    replay->file = fopen(path, "wb");
+    if (!replay->file || fwrite(header, sizeof(ReplayHeader), 1, replay->file) != 1) {
+        fprintf(stderr, "Could not create recording: %s\n", path);
+        if (replay->file) {
+            fclose(replay->file);
+        }
+        free(replay);
+        return NULL;
+    }
+    return replay;
+}
+
+// Open a recording for playback and check its header; NULL on failure
+Replay* replay_open(const char *path) {
+    Replay *replay = (Replay*)calloc(1, sizeof(Replay));
+    if (!replay) {
+        fprintf(stderr, "Failed to allocate recording!\n");
+        return NULL;
+    }
+
+    replay->file = fopen(path, "rb");
+    if (!replay->file) {
+        fprintf(stderr, "Could not open recording: %s\n", path);
+        free(replay);
+        return NULL;
+    }
+
+    ReplayHeader *header = &replay->header;
+    if (fread(header, sizeof(ReplayHeader), 1, replay->file) != 1 ||
+        memcmp(header->magic, REPLAY_MAGIC, 4) != 0 || header->version != REPLAY_VERSION ||
+        header->headerSize != sizeof(ReplayHeader)) {
+        fprintf(stderr, "Not a recording of this version: %s\n", path);
+        fclose(replay->file);
+        free(replay);
+        return NULL;
+    }
+    header->mapName[sizeof(header->mapName) - 1] = '\0';
+    replay->renderScale = header->renderScale;
+    return replay;
+}
+
+// Append a frame to a recording; its delta time is stored in whole microseconds
+int replay_write_frame(Replay *replay, const ReplayFrame *frame) {
+    // A flags byte, the delta time, then only what changed
+    Uint8 record[1 + sizeof(Uint32) + 1 + sizeof(double)];
+    size_t size = 0;
+    Uint8 flags = (Uint8)(frame->keys & REPLAY_KEYS_MASK);
+    if (frame->mapIndex >= 0) flags |= REPLAY_FRAME_MAP;
+    if (frame->renderScale != replay->renderScale) flags |= REPLAY_FRAME_SCALE;
+    record[size++] = flags;
+
+    Uint32 micros = (Uint32)(frame->deltaTime * 1e6 + 0.5);
+    memcpy(record + size, &micros, sizeof(micros));
+    size += sizeof(micros);
+    if (flags & REPLAY_FRAME_MAP) {
+        record[size++] = (Uint8)frame->mapIndex;
+    }
+    if (flags & REPLAY_FRAME_SCALE) {
+        memcpy(record + size, &frame->renderScale, sizeof(double));
+        size += sizeof(double);
+        replay->renderScale = frame->renderScale;
+    }
+
+    if (fwrite(record, 1, size, replay->file) != size) {
+        fprintf(stderr, "Failed to write recording frame\n");
+        return 0;
+    }
+    replay->header.frameCount++;
+    return 1;
+}
+
+// Read the next frame of a recording; returns 1 for a frame, 0 at the end, -1 if the file is damaged
+int replay_read_frame(Replay *replay, ReplayFrame *frame) {
+    int flags = fgetc(replay->file);
+    if (flags == EOF) {
+        return 0;
+    }
+
+    Uint32 micros;
+    if (fread(&micros, sizeof(micros), 1, replay->file) != 1) {
+        return -1;
+    }
+    frame->keys = flags & REPLAY_KEYS_MASK;
+    frame->deltaTime = micros / 1e6;
+    frame->mapIndex = -1;
+    if (flags & REPLAY_FRAME_MAP) {
+        int mapIndex = fgetc(replay->file);
+        if (mapIndex == EOF) {
+            return -1;
+        }
+        frame->mapIndex = mapIndex;
+    }
+    if (flags & REPLAY_FRAME_SCALE) {
+        if (fread(&replay->renderScale, sizeof(double), 1, replay->file) != 1) {
+            return -1;
+        }
+    }
+    frame->renderScale = replay->renderScale;
+    return 1;
+}
+
+// Finish a recording (writing its frame count) or end a playback, and free it
+int replay_close(Replay *replay) {
+    if (!replay) {
+        return 1;
+    }
+
+    int ok = 1;
+    if (replay->writing) {
+        // The header went out before any frame; only its count changed since
+        ok = fseek(replay->file, 0, SEEK_SET) == 0 &&
+             fwrite(&replay->header, sizeof(ReplayHeader), 1, replay->file) == 1;
+    }
+    if (fclose(replay->file) != 0) {
+        ok = 0;
+    }
+    if (!ok) {
+        fprintf(stderr, "Failed to finish recording\n");
+    }
+    free(replay);
+    return ok;
+}
@@ -0,0 +1,74 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdio.h>
+
+#include "engine.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Recording file identification
+#define REPLAY_MAGIC "RCRP"
+#define REPLAY_VERSION 1
+
+// Flags byte of a recorded frame: the ENGINE_KEY_* bits held, and which
+// optional fields follow the frame's delta time
+#define REPLAY_KEYS_MASK 0x0F
+#define REPLAY_FRAME_MAP 0x10       // A map switch: one byte, the catalog index
+#define REPLAY_FRAME_SCALE 0x20     // A new render scale: a double
+
+// State of the engine before the first recorded frame, in host byte order
+typedef struct ReplayHeader {
+    char magic[4];          // REPLAY_MAGIC
+    Uint32 version;         // REPLAY_VERSION
+    Uint32 headerSize;      // sizeof(ReplayHeader)
+    Uint32 frameCount;      // Frames in the file, written when the recording is closed
+    Sint32 windowWidth;     // Output resolution the frames were rendered for
+    Sint32 windowHeight;
+    double renderScale;     // Render scale of the first frame
+    Sint32 mapIndex;        // Catalog index of the active map, -1 for the default map
+    Sint32 demoSprites;     // Sprites scattered over each map
+    Sint32 fixedPoint;      // Rays traced with the fixed-point DDA
+    Sint32 reserved;
+    Player player;          // Pose before the first frame
+    char mapName[64];       // Name of the active map, to check a replay uses the same maps
+} ReplayHeader;
+
+// One frame as the main loop saw it
+typedef struct ReplayFrame {
+    int keys;               // ENGINE_KEY_* bits held
+    double deltaTime;       // Movement time step in seconds, whole microseconds
+    int mapIndex;           // Map switched to before moving, -1 for none
+    double renderScale;     // Render scale the frame was rendered at
+} ReplayFrame;
+
+// An open recording, being written or played back
+typedef struct Replay {
+    FILE *file;
+    ReplayHeader header;
+    int writing;
+    double renderScale;     // Render scale of the last frame written or read
+} Replay;
+
+// Create a recording starting from the engine's current state; NULL on failure
+Replay* replay_create(const char *path, const Engine *engine);
+
+// Open a recording for playback and check its header; NULL on failure
+Replay* replay_open(const char *path);
+
+// Append a frame to a recording; its delta time is stored in whole microseconds
+int replay_write_frame(Replay *replay, const ReplayFrame *frame);
+
+// Read the next frame of a recording; returns 1 for a frame, 0 at the end, -1 if the file is damaged
+int replay_read_frame(Replay *replay, ReplayFrame *frame);
+
+// Finish a recording (writing its frame count) or end a playback, and free it
+int replay_close(Replay *replay);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // REPLAY_H
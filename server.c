@@ -0,0 +1,716 @@
+// Sockets, shared memory and descriptor passing are POSIX, not C99
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#endif
+
+#include "server.h"
+
+#ifndef _WIN32
+
+// How long the loop sleeps in poll with nothing to do, so it notices a stop request
+#define SERVER_POLL_MS 100
+
+// Requests rendered together at most, across connections
+#define SERVER_BATCH_REQUESTS 4096
+
+// A render request waiting for ring space or for its batch to be rendered
+typedef struct ServerJob {
+    ServerRequest request;
+    ServerPose *poses;
+    Uint32 status;
+    Uint64 frameBytes;
+    Uint64 offset;          // Ring offset of its frames, once reserved
+    Uint64 end;             // Ring position just past its frames
+} ServerJob;
+
+// Frames handed to a client that it has not released yet
+typedef struct ServerSpan {
+    Uint32 id;
+    Uint64 end;             // Ring position just past the request's frames
+} ServerSpan;
+
+// One connection: its ring, its buffered input and output, and its requests in order
+typedef struct ServerClient {
+    int fd;
+    Uint8 *ring;
+    Uint64 ringBytes;
+    Uint64 head;            // Ring positions grow without wrapping: frames are written up to
+    Uint64 tail;            // head and the client has released them up to tail
+    Uint8 *input;
+    size_t inputUsed;
+    size_t inputCapacity;
+    Uint8 *output;
+    size_t outputUsed;
+    size_t outputCapacity;
+    ServerJob *jobs;        // Parsed render requests not rendered yet, oldest first
+    int jobCount;
+    size_t jobCapacity;
+    ServerSpan *spans;      // Rendered requests not released yet, oldest first
+    int spanCount;
+    size_t spanCapacity;
+} ServerClient;
+
+// The server's state
+typedef struct Server {
+    Engine *engine;
+    int listenFd;
+    ServerClient *clients[SERVER_MAX_CLIENTS];
+    int clientCount;
+    int connections;        // Clients accepted so far, naming their rings
+    ServerMapInfo *maps;    // Sent to every client after the hello
+    int mapCount;
+    ServerJob *batch[SERVER_BATCH_REQUESTS];    // Jobs of the batch being rendered
+    int batchClient[SERVER_BATCH_REQUESTS];     // and the index of the client each came from
+    int batchFull;          // The last batch left requests behind that had ring space
+    EngineView *views;      // Views of one map of the batch
+    Uint64 requests;        // Totals reported on shutdown
+    Uint64 frames;
+    Uint64 batches;
+} Server;
+
+// Set by the signal handler to stop the loop
+static volatile sig_atomic_t serverStop = 0;
+
+// ****************************************************
+// Private (static) function declarations
+// ****************************************************
+
+// Signal handler: stop serving after the current batch
+static void server_handle_signal(int signal);
+
+// Read the name, size and starting position of every map from its file
+// header; maps are only loaded when a batch renders them
+static int server_read_maps(Server *server);
+
+// Read the name, size and starting position of every map again after a reload
+// changed some; maps that are not cached are read from their file header
+static void server_update_maps(Server *server);
+
+// Create the listening socket at path, replacing a stale socket file
+static int server_listen(const char *path);
+
+// Accept a connection: create its ring and send the hello and the map list
+static void server_accept(Server *server);
+
+// Close a connection and free everything it owns
+static void server_drop(Server *server, int index);
+
+// Read what a client sent and queue its requests; returns 0 if it has gone or broke the protocol
+static int server_receive(Server *server, ServerClient *client);
+
+// Queue one render request, checking it against the maps and the ring
+static int server_queue_job(Server *server, ServerClient *client, const ServerRequest *request,
+                            const ServerPose *poses);
+
+// Release a request's frames and every one handed out before it
+static void server_release(ServerClient *client, Uint32 id);
+
+// Reserve ring space after every frame not yet released; frames never wrap
+static int server_reserve(ServerClient *client, Uint64 bytes, Uint64 *offset);
+
+// Take the oldest requests of every connection that have ring space, render
+// them grouped by map and queue the replies; returns the requests taken
+static int server_render_batch(Server *server);
+
+// Append bytes to a client's output; returns 0 when out of memory
+static int server_append(ServerClient *client, const void *data, size_t size);
+
+// Send as much buffered output as the socket takes; returns 0 if the client has gone
+static int server_flush(ServerClient *client);
+
+// Grow a buffer to hold at least size bytes
+static int server_grow(void **buffer, size_t *capacity, size_t size, size_t element);
+
+// ****************************************************
+// Public API Implementation
+// ****************************************************
+
+// Serve render requests on a Unix domain socket at path until SIGINT or
+// SIGTERM. Requests waiting on every connection are batched by map and
+// rendered with engine_render_views; a request waits while its client's ring
+// is full. Returns 0 on a clean shutdown, 1 on failure.
+int server_run(Engine *engine, const char *path) {
+    Server server;
+    memset(&server, 0, sizeof(server));
+    server.engine = engine;
+    server.views = (EngineView*)malloc(SERVER_BATCH_VIEWS * sizeof(EngineView));
+    if (!server.views) {
+        fprintf(stderr, "Failed to allocate the render server!\n");
+        return 1;
+    }
+    if (!server_read_maps(&server)) {
+        free(server.views);
+        return 1;
+    }
+
+    server.listenFd = server_listen(path);
+    if (server.listenFd < 0) {
+        free(server.maps);
+        free(server.views);
+        return 1;
+    }
+
+    // A client that disconnects mid-reply must not kill the server
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, server_handle_signal);
+    signal(SIGTERM, server_handle_signal);
+    printf("Serving %d maps on %s\n", server.mapCount, path);
+
+    struct pollfd fds[SERVER_MAX_CLIENTS + 1];
+    int pending = 0;
+    while (!serverStop) {
+        // Sleep only when the last batch left no requests behind that could be rendered now
+        fds[0].fd = server.listenFd;
+        fds[0].events = POLLIN;
+        for (int i = 0; i < server.clientCount; i++) {
+            fds[i + 1].fd = server.clients[i]->fd;
+            fds[i + 1].events = POLLIN | (server.clients[i]->outputUsed ? POLLOUT : 0);
+        }
+        int ready = poll(fds, server.clientCount + 1, pending ? 0 : SERVER_POLL_MS);
+        if (ready < 0 && errno != EINTR) {
+            perror("poll");
+            break;
+        }
+
+        // Read every connection before rendering, so requests that arrived
+        // together are rendered together; dropping a client moves the last one
+        // into its place, so go from the back
+        for (int i = server.clientCount - 1; ready > 0 && i >= 0; i--) {
+            ServerClient *client = server.clients[i];
+            int ok = 1;
+            if (fds[i + 1].revents & (POLLIN | POLLHUP | POLLERR)) {
+                ok = server_receive(&server, client);
+            }
+            if (ok && (fds[i + 1].revents & POLLOUT)) {
+                ok = server_flush(client);
+            }
+            if (!ok) {
+                server_drop(&server, i);
+            }
+        }
+        if (ready > 0 && (fds[0].revents & POLLIN)) {
+            server_accept(&server);
+        }
+
+        // Maps saved since the last pass change between batches, never during one
+        if (engine_apply_map_reloads(engine) > 0) {
+            server_update_maps(&server);
+        }
+
+        // Requests a full batch left behind are rendered on the next pass without waiting
+        server_render_batch(&server);
+        pending = server.batchFull;
+        for (int i = server.clientCount - 1; i >= 0; i--) {
+            if (!server_flush(server.clients[i])) {
+                server_drop(&server, i);
+            }
+        }
+    }
+
+    while (server.clientCount > 0) {
+        server_drop(&server, server.clientCount - 1);
+    }
+    close(server.listenFd);
+    unlink(path);
+    free(server.maps);
+    free(server.views);
+
+    printf("Served %llu requests, %llu frames in %llu batches\n", (unsigned long long)server.requests,
+           (unsigned long long)server.frames, (unsigned long long)server.batches);
+    return 0;
+}
+
+// ****************************************************
+// Private functions implementation
+// ****************************************************
+
+// Signal handler: stop serving after the current batch
+static void server_handle_signal(int signal) {
+    (void)signal;
+    serverStop = 1;
+}
+
+// Read the name, size and starting position of every map from its file
+// header; maps are only loaded when a batch renders them
+static int server_read_maps(Server *server) {
+    MapCatalog *catalog = &server->engine->maps;
+    server->mapCount = catalog->count;
+    server->maps = (ServerMapInfo*)calloc(server->mapCount > 0 ? server->mapCount : 1, sizeof(ServerMapInfo));
+    if (!server->maps) {
+        fprintf(stderr, "Failed to allocate the map list!\n");
+        return 0;
+    }
+
+    for (int i = 0; i < server->mapCount; i++) {
+        ServerMapInfo *info = &server->maps[i];
+        int width, height;
+        if (!catalog_size(catalog, i, &width, &height, &info->startX, &info->startY)) {
+            fprintf(stderr, "Failed to read map %d for serving\n", i);
+            continue;
+        }
+        strncpy(info->name, catalog_name(catalog, i), sizeof(info->name) - 1);
+        info->width = width;
+        info->height = height;
+    }
+    return 1;
+}
+
+// Read the name, size and starting position of every map again after a reload
+// changed some; maps that are not cached are read from their file header
+static void server_update_maps(Server *server) {
+    MapCatalog *catalog = &server->engine->maps;
+    for (int i = 0; i < server->mapCount && i < catalog->count; i++) {
+        ServerMapInfo *info = &server->maps[i];
+        int width, height;
+        double startX, startY;
+        if (!catalog_size(catalog, i, &width, &height, &startX, &startY)) {
+            // Keep what clients were told last; the file may be mid-save
+            continue;
+        }
+        memset(info->name, 0, sizeof(info->name));
+        strncpy(info->name, catalog_name(catalog, i), sizeof(info->name) - 1);
+        info->width = width;
+        info->height = height;
+        info->startX = startX;
+        info->startY = startY;
+    }
+}
+
+// Create the listening socket at path, replacing a stale socket file
+static int server_listen(const char *path) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", path);
+        return -1;
+    }
+    strcpy(address.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    unlink(path);
+    if (bind(fd, (struct sockaddr*)&address, sizeof(address)) < 0 || listen(fd, SERVER_MAX_CLIENTS) < 0) {
+        fprintf(stderr, "Failed to listen on %s: %s\n", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return fd;
+}
+
+// Accept a connection: create its ring and send the hello and the map list
+static void server_accept(Server *server) {
+    int fd = accept(server->listenFd, NULL, NULL);
+    if (fd < 0) {
+        return;
+    }
+    if (server->clientCount == SERVER_MAX_CLIENTS) {
+        fprintf(stderr, "Refusing a connection: %d clients already\n", SERVER_MAX_CLIENTS);
+        close(fd);
+        return;
+    }
+
+    // The ring is shared memory without a name: unlinked as soon as it exists,
+    // it lives on through the descriptors and mappings of server and client
+    char name[64];
+    snprintf(name, sizeof(name), "/raycaster-%ld-%d", (long)getpid(), server->connections++);
+    int ringFd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (ringFd >= 0) {
+        shm_unlink(name);
+    }
+    void *ring = MAP_FAILED;
+    if (ringFd >= 0 && ftruncate(ringFd, SERVER_RING_BYTES) == 0) {
+        ring = mmap(NULL, SERVER_RING_BYTES, PROT_READ | PROT_WRITE, MAP_SHARED, ringFd, 0);
+    }
+    ServerClient *client = (ServerClient*)calloc(1, sizeof(ServerClient));
+    if (ring == MAP_FAILED || !client) {
+        fprintf(stderr, "Failed to create a frame ring: %s\n", strerror(errno));
+        if (ring != MAP_FAILED) munmap(ring, SERVER_RING_BYTES);
+        if (ringFd >= 0) close(ringFd);
+        free(client);
+        close(fd);
+        return;
+    }
+    client->fd = fd;
+    client->ring = (Uint8*)ring;
+    client->ringBytes = SERVER_RING_BYTES;
+
+    // The hello carries the ring's descriptor; the client maps it and the server's copy can go
+    ServerHello hello;
+    memset(&hello, 0, sizeof(hello));
+    memcpy(hello.magic, SERVER_MAGIC, 4);
+    hello.version = SERVER_VERSION;
+    hello.ringBytes = SERVER_RING_BYTES;
+    hello.mapCount = (Uint32)server->mapCount;
+    hello.maxViews = SERVER_MAX_VIEWS;
+
+    char control[CMSG_SPACE(sizeof(int))];
+    memset(control, 0, sizeof(control));
+    struct iovec part = { &hello, sizeof(hello) };
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &part;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(header), &ringFd, sizeof(int));
+    int sent = sendmsg(fd, &message, 0) == (ssize_t)sizeof(hello);
+    close(ringFd);
+
+    server->clients[server->clientCount++] = client;
+    if (!sent) {
+        server_drop(server, server->clientCount - 1);
+        return;
+    }
+
+    // Names and starting positions, so clients can pick maps and place cameras
+    server_append(client, server->maps, server->mapCount * sizeof(ServerMapInfo));
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+// Close a connection and free everything it owns
+static void server_drop(Server *server, int index) {
+    ServerClient *client = server->clients[index];
+    close(client->fd);
+    munmap(client->ring, client->ringBytes);
+    for (int i = 0; i < client->jobCount; i++) {
+        free(client->jobs[i].poses);
+    }
+    free(client->jobs);
+    free(client->spans);
+    free(client->input);
+    free(client->output);
+    free(client);
+    server->clients[index] = server->clients[--server->clientCount];
+}
+
+// Read what a client sent and queue its requests; returns 0 if it has gone or broke the protocol
+static int server_receive(Server *server, ServerClient *client) {
+    for (;;) {
+        if (!server_grow((void**)&client->input, &client->inputCapacity, client->inputUsed + 65536, 1)) {
+            return 0;
+        }
+        ssize_t received = recv(client->fd, client->input + client->inputUsed,
+                                client->inputCapacity - client->inputUsed, 0);
+        if (received == 0) {
+            return 0;
+        }
+        if (received < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            return 0;
+        }
+        client->inputUsed += (size_t)received;
+    }
+
+    // Every complete message; a partial one stays for the next read
+    size_t used = 0;
+    while (client->inputUsed - used >= sizeof(ServerRequest)) {
+        ServerRequest request;
+        memcpy(&request, client->input + used, sizeof(request));
+        if (request.type == SERVER_RELEASE) {
+            server_release(client, request.id);
+            used += sizeof(request);
+            continue;
+        }
+        if (request.type != SERVER_RENDER || request.viewCount > SERVER_MAX_VIEWS) {
+            fprintf(stderr, "Dropping a client: bad request type %u with %u views\n",
+                    request.type, request.viewCount);
+            return 0;
+        }
+
+        size_t size = sizeof(request) + request.viewCount * sizeof(ServerPose);
+        if (client->inputUsed - used < size) {
+            break;
+        }
+        if (!server_queue_job(server, client, &request, (const ServerPose*)(client->input + used + sizeof(request)))) {
+            return 0;
+        }
+        used += size;
+    }
+    memmove(client->input, client->input + used, client->inputUsed - used);
+    client->inputUsed -= used;
+    return 1;
+}
+
+// Queue one render request, checking it against the maps and the ring
+static int server_queue_job(Server *server, ServerClient *client, const ServerRequest *request,
+                            const ServerPose *poses) {
+    if (!server_grow((void**)&client->jobs, &client->jobCapacity, client->jobCount + 1,
+                     sizeof(ServerJob))) {
+        return 0;
+    }
+
+    ServerJob *job = &client->jobs[client->jobCount];
+    memset(job, 0, sizeof(ServerJob));
+    job->request = *request;
+    job->frameBytes = (Uint64)request->width * request->height * sizeof(Uint32);
+    if (request->mapIndex < 0 || request->mapIndex >= server->mapCount) {
+        job->status = SERVER_BAD_MAP;
+    } else if (request->viewCount == 0 || request->width == 0 || request->height == 0 ||
+               request->width > SERVER_MAX_SIZE || request->height > SERVER_MAX_SIZE) {
+        job->status = SERVER_BAD_REQUEST;
+    } else if (job->frameBytes * request->viewCount > client->ringBytes) {
+        job->status = SERVER_TOO_LARGE;
+    } else {
+        // Poses are unaligned in the input buffer, and it moves
+        job->poses = (ServerPose*)malloc(request->viewCount * sizeof(ServerPose));
+        if (!job->poses) {
+            return 0;
+        }
+        memcpy(job->poses, poses, request->viewCount * sizeof(ServerPose));
+    }
+    client->jobCount++;
+    return 1;
+}
+
+// Release a request's frames and every one handed out before it
+static void server_release(ServerClient *client, Uint32 id) {
+    for (int i = 0; i < client->spanCount; i++) {
+        if (client->spans[i].id == id) {
+            client->tail = client->spans[i].end;
+            memmove(client->spans, client->spans + i + 1, (client->spanCount - i - 1) * sizeof(ServerSpan));
+            client->spanCount -= i + 1;
+            if (client->spanCount == 0) {
+                // Failed requests after the last frames handed out held space too
+                client->tail = client->head;
+            }
+            return;
+        }
+    }
+}
+
+// Reserve ring space after every frame not yet released; frames never wrap
+static int server_reserve(ServerClient *client, Uint64 bytes, Uint64 *offset) {
+    Uint64 head = client->head;
+    Uint64 physical = head % client->ringBytes;
+    if (client->tail == head && physical > 0) {
+        // Nothing is handed out: start again at the beginning of the ring, or
+        // a request larger than what is left before its end would never fit
+        head += client->ringBytes - physical;
+        client->tail = head;
+    } else if (physical + bytes > client->ringBytes) {
+        head += client->ringBytes - physical;
+    }
+    if (head + bytes - client->tail > client->ringBytes) {
+        return 0;
+    }
+    *offset = head % client->ringBytes;
+    client->head = head + bytes;
+    return 1;
+}
+
+// Take the oldest requests of every connection that have ring space, render
+// them grouped by map and queue the replies; returns the requests taken
+static int server_render_batch(Server *server) {
+    Engine *engine = server->engine;
+    int jobCount = 0;
+    int viewCount = 0;
+    int taken[SERVER_MAX_CLIENTS];
+    int handed[SERVER_MAX_CLIENTS];
+
+    // Each connection's requests are taken in order, up to the first that does not fit
+    server->batchFull = 0;
+    for (int c = 0; c < server->clientCount; c++) {
+        ServerClient *client = server->clients[c];
+        taken[c] = 0;
+        handed[c] = 0;
+        while (taken[c] < client->jobCount) {
+            ServerJob *job = &client->jobs[taken[c]];
+            if (jobCount == SERVER_BATCH_REQUESTS ||
+                (job->status == SERVER_OK && viewCount + (int)job->request.viewCount > SERVER_BATCH_VIEWS)) {
+                server->batchFull = 1;
+                break;
+            }
+            if (job->status == SERVER_OK) {
+                // Room for its span comes first, so frames handed out can always be released
+                if (!server_grow((void**)&client->spans, &client->spanCapacity,
+                                 client->spanCount + handed[c] + 1, sizeof(ServerSpan))) {
+                    job->status = SERVER_FAILED;
+                    free(job->poses);
+                    job->poses = NULL;
+                } else if (!server_reserve(client, job->frameBytes * job->request.viewCount, &job->offset)) {
+                    break;
+                } else {
+                    job->end = client->head;
+                    viewCount += job->request.viewCount;
+                    handed[c]++;
+                }
+            }
+            server->batch[jobCount] = job;
+            server->batchClient[jobCount] = c;
+            jobCount++;
+            taken[c]++;
+        }
+    }
+    if (jobCount == 0) {
+        return 0;
+    }
+
+    // One engine_render_views per map, so switching maps costs once per batch
+    for (int first = 0; first < jobCount; first++) {
+        ServerJob *lead = server->batch[first];
+        if (lead->status != SERVER_OK || lead->poses == NULL) {
+            continue;
+        }
+        int mapIndex = lead->request.mapIndex;
+        int ok = engine->currentMapIndex == mapIndex || engine_set_map(engine, mapIndex);
+
+        int views = 0;
+        for (int j = first; j < jobCount; j++) {
+            ServerJob *job = server->batch[j];
+            if (job->status != SERVER_OK || job->poses == NULL || job->request.mapIndex != mapIndex) {
+                continue;
+            }
+            ServerClient *client = server->clients[server->batchClient[j]];
+            for (Uint32 v = 0; v < job->request.viewCount; v++) {
+                EngineView *view = &server->views[views++];
+                const ServerPose *pose = &job->poses[v];
+                view->camera = engine->player;
+                view->camera.posX = pose->posX;
+                view->camera.posY = pose->posY;
+                view->camera.dirX = pose->dirX;
+                view->camera.dirY = pose->dirY;
+                view->camera.planeX = pose->planeX;
+                view->camera.planeY = pose->planeY;
+                view->pixels = (Uint32*)(client->ring + job->offset + v * job->frameBytes);
+                view->width = job->request.width;
+                view->height = job->request.height;
+                view->pitch = job->request.width;
+            }
+            free(job->poses);
+            job->poses = NULL;
+            if (!ok) {
+                job->status = SERVER_BAD_MAP;
+            }
+        }
+        if (ok && engine_render_views(engine, server->views, views)) {
+            server->frames += views;
+        } else if (ok) {
+            // Nothing of this map was written, so its requests fail
+            for (int j = first; j < jobCount; j++) {
+                ServerJob *job = server->batch[j];
+                if (job->status == SERVER_OK && job->request.mapIndex == mapIndex) {
+                    job->status = SERVER_FAILED;
+                }
+            }
+        }
+    }
+    server->batches++;
+
+    // Replies in request order; frames handed out wait for their release
+    for (int j = 0; j < jobCount; j++) {
+        ServerJob *job = server->batch[j];
+        ServerClient *client = server->clients[server->batchClient[j]];
+        ServerReply reply;
+        memset(&reply, 0, sizeof(reply));
+        reply.type = SERVER_FRAMES;
+        reply.id = job->request.id;
+        reply.status = job->status;
+        if (job->status == SERVER_OK) {
+            reply.viewCount = job->request.viewCount;
+            reply.offset = job->offset;
+            reply.frameBytes = job->frameBytes;
+            reply.width = job->request.width;
+            reply.height = job->request.height;
+            client->spans[client->spanCount].id = job->request.id;
+            client->spans[client->spanCount].end = job->end;
+            client->spanCount++;
+        }
+        server_append(client, &reply, sizeof(reply));
+        server->requests++;
+    }
+
+    for (int c = 0; c < server->clientCount; c++) {
+        ServerClient *client = server->clients[c];
+        if (client->spanCount == 0) {
+            // Space of failed requests is not waiting for any release
+            client->tail = client->head;
+        }
+        if (taken[c] > 0) {
+            memmove(client->jobs, client->jobs + taken[c], (client->jobCount - taken[c]) * sizeof(ServerJob));
+            client->jobCount -= taken[c];
+        }
+    }
+    return jobCount;
+}
+
+// Append bytes to a client's output; returns 0 when out of memory
+static int server_append(ServerClient *client, const void *data, size_t size) {
+    if (!server_grow((void**)&client->output, &client->outputCapacity, client->outputUsed + size, 1)) {
+        return 0;
+    }
+    memcpy(client->output + client->outputUsed, data, size);
+    client->outputUsed += size;
+    return 1;
+}
+
+// Send as much buffered output as the socket takes; returns 0 if the client has gone
+static int server_flush(ServerClient *client) {
+    size_t sent = 0;
+    while (sent < client->outputUsed) {
+        ssize_t count = send(client->fd, client->output + sent, client->outputUsed - sent, 0);
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            return 0;
+        }
+        sent += (size_t)count;
+    }
+    if (sent > 0) {
+        memmove(client->output, client->output + sent, client->outputUsed - sent);
+        client->outputUsed -= sent;
+    }
+    return 1;
+}
+
+// Grow a buffer to hold at least size bytes
+static int server_grow(void **buffer, size_t *capacity, size_t size, size_t element) {
+    if (size <= *capacity) {
+        return 1;
+    }
+    size_t grown = *capacity ? *capacity : 64;
+    while (grown < size) grown *= 2;
+    void *resized = realloc(*buffer, grown * element);
+    if (!resized) {
+        fprintf(stderr, "Failed to allocate server buffers!\n");
+        return 0;
+    }
+    *buffer = resized;
+    *capacity = grown;
+    return 1;
+}
+
+#else
+
+// Serve render requests on a Unix domain socket at path; not available on Windows
+int server_run(Engine *engine, const char *path) {
+    (void)engine;
+    (void)path;
+    fprintf(stderr, "The render server needs Unix domain sockets\n");
+    return 1;
+}
+
+#endif
@@ -0,0 +1,101 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "engine.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Render server protocol. A client connects to the server's Unix domain
+// socket and receives a ServerHello, with the descriptor of a shared memory
+// ring of its own attached, and then one ServerMapInfo per installed map.
+// Each ServerRequest it sends is answered by a ServerReply in the same order;
+// a render reply only says where in the ring the frames were written. All
+// messages are fixed-size structs in host byte order, the socket being local.
+#define SERVER_MAGIC "RCSV"
+#define SERVER_VERSION 1
+
+// Message types
+#define SERVER_RENDER 1         // Client: render the ServerPose records that follow
+#define SERVER_RELEASE 2        // Client: done with the frames of a request and every one before it
+#define SERVER_FRAMES 3         // Server: a render request's frames are in the ring
+
+// Status of a render reply
+#define SERVER_OK 0
+#define SERVER_BAD_MAP 1        // No map with that catalog index
+#define SERVER_BAD_REQUEST 2    // No views, or a view size out of range
+#define SERVER_TOO_LARGE 3      // The frames would not fit the ring even when it is empty
+#define SERVER_FAILED 4         // Rendering failed or the server ran out of memory; no frames
+
+// Limits
+#define SERVER_RING_BYTES (64u << 20)   // Shared frame ring of each connection
+#define SERVER_MAX_VIEWS 4096           // Views one request may carry
+#define SERVER_MAX_SIZE 4096            // Largest view width or height
+#define SERVER_MAX_CLIENTS 64
+#define SERVER_BATCH_VIEWS 16384        // Views rendered together at most, across connections
+
+// First message on a connection; the ring's descriptor comes with it
+typedef struct ServerHello {
+    char magic[4];          // SERVER_MAGIC
+    Uint32 version;         // SERVER_VERSION
+    Uint64 ringBytes;       // Size of the shared ring to map
+    Uint32 mapCount;        // ServerMapInfo records that follow
+    Uint32 maxViews;        // SERVER_MAX_VIEWS
+} ServerHello;
+
+// A map a request can name by its catalog index
+typedef struct ServerMapInfo {
+    char name[64];
+    Sint32 width;
+    Sint32 height;
+    double startX;          // The map's starting position, always open
+    double startY;
+} ServerMapInfo;
+
+// A request from a client; a render request is followed by viewCount poses
+typedef struct ServerRequest {
+    Uint32 type;            // SERVER_RENDER or SERVER_RELEASE
+    Uint32 id;              // Chosen by the client, echoed in the reply or naming the request released
+    Sint32 mapIndex;        // Catalog index of the map to render
+    Uint16 width;           // Size of every view of the request
+    Uint16 height;
+    Uint32 viewCount;
+    Uint32 reserved;
+} ServerRequest;
+
+// A camera of a render request, as the fields of a Player
+typedef struct ServerPose {
+    double posX;
+    double posY;
+    double dirX;
+    double dirY;
+    double planeX;
+    double planeY;
+} ServerPose;
+
+// Answer to a render request. Frame i is ARGB8888, width pixels per row, at
+// ring offset + i * frameBytes; it stays valid until the client releases the
+// request (or one after it), and only then is its space reused.
+typedef struct ServerReply {
+    Uint32 type;            // SERVER_FRAMES
+    Uint32 id;              // The request's id
+    Uint32 status;          // SERVER_OK or why nothing was rendered
+    Uint32 viewCount;
+    Uint64 offset;
+    Uint64 frameBytes;
+    Uint32 width;
+    Uint32 height;
+} ServerReply;
+
+// Serve render requests on a Unix domain socket at path until SIGINT or
+// SIGTERM. Requests waiting on every connection are batched by map and
+// rendered with engine_render_views; a request waits while its client's ring
+// is full. Returns 0 on a clean shutdown, 1 on failure.
+int server_run(Engine *engine, const char *path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SERVER_H
@@ -0,0 +1,335 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "texture.h"
+
+// A unique texel color and the number of texels that have it
+typedef struct TextureColor {
+    Uint32 color;
+    Uint32 weight;
+} TextureColor;
+
+// A box of the median cut: a run of the sorted unique colors
+typedef struct TextureBox {
+    int start;
+    int count;
+} TextureBox;
+
+// Channel the unique colors are being sorted by, as a shift (qsort has no context)
+static int textureSortShift;
+
+// ****************************************************
+// Private (static) function declarations
+// ****************************************************
+
+// Check whether a texture size is a power of two
+static int texture_is_power_of_two(int size);
+
+// Average four ARGB8888 texels channel by channel
+static Uint32 texture_average(Uint32 a, Uint32 b, Uint32 c, Uint32 d);
+
+// Check whether a texel is drawn: alpha of at least one half
+static inline int texture_is_opaque(Uint32 texel) {
+    return (texel >> 24) >= 0x80;
+}
+
+// Order colors by the channel at textureSortShift, then by the whole color
+static int texture_compare_channel(const void *a, const void *b);
+
+// Widest channel of a box as a shift, and its range through *range
+static int texture_box_channel(const TextureColor *colors, const TextureBox *box, int *range);
+
+// Average of a box's colors weighted by their texel counts, ARGB8888
+static Uint32 texture_box_color(const TextureColor *colors, const TextureBox *box);
+
+// ****************************************************
+// Public API Implementation
+// ****************************************************
+
+// Allocate a black width x height texture and room for its mip chain; both
+// sizes must be powers of two
+int texture_create(WallTexture *texture, int width, int height) {
+    memset(texture, 0, sizeof(WallTexture));
+    if (!texture_is_power_of_two(width) || !texture_is_power_of_two(height)) {
+        fprintf(stderr, "Texture size must be a power of two: %dx%d\n", width, height);
+        return 0;
+    }
+
+    // Halve both sides until one of them is a single texel
+    size_t offset = 0;
+    int levels = 0;
+    while (levels < TEXTURE_MAX_LEVELS) {
+        texture->levelOffset[levels] = offset;
+        offset += (size_t)(width >> levels) * (height >> levels);
+        levels++;
+        if ((width >> levels) == 0 || (height >> levels) == 0) {
+            break;
+        }
+    }
+
+    texture->texels = (Uint32*)calloc(offset, sizeof(Uint32));
+    if (!texture->texels) {
+        fprintf(stderr, "Failed to allocate texture!\n");
+        return 0;
+    }
+
+    texture->width = width;
+    texture->height = height;
+    texture->levels = levels;
+    texture->texelCount = offset;
+    return 1;
+}
+
+// Free the texels and palette entries of a texture
+void texture_destroy(WallTexture *texture) {
+    free(texture->texels);
+    free(texture->indices);
+    memset(texture, 0, sizeof(WallTexture));
+}
+
+// Rebuild every mip level from level 0 with a 2x2 box filter
+void texture_build_mips(WallTexture *texture) {
+    for (int level = 1; level < texture->levels; level++) {
+        int width = texture->width >> level;
+        int height = texture->height >> level;
+        for (int x = 0; x < width; x++) {
+            const Uint32 *left = texture_column(texture, level - 1, 2 * x);
+            const Uint32 *right = texture_column(texture, level - 1, 2 * x + 1);
+            Uint32 *column = (Uint32*)texture_column(texture, level, x);
+            for (int y = 0; y < height; y++) {
+                column[y] = texture_average(left[2 * y], left[2 * y + 1], right[2 * y], right[2 * y + 1]);
+            }
+        }
+    }
+}
+
+// Build a palette of up to colors entries for every level of count textures:
+// the reserved colors first, exactly, then a median cut of the opaque texel
+// colors; returns the number of entries used, 0 on failure
+int texture_build_palette(const WallTexture *const *textures, int count, const Uint32 *reserved,
+                          int reservedCount, Uint32 *palette, int colors) {
+    if (reservedCount >= colors) {
+        fprintf(stderr, "No palette entries left after %d reserved colors\n", reservedCount);
+        return 0;
+    }
+
+    size_t total = 0;
+    for (int t = 0; t < count; t++) {
+        total += textures[t]->texelCount;
+    }
+    TextureColor *unique = (TextureColor*)malloc((total > 0 ? total : 1) * sizeof(TextureColor));
+    TextureBox *boxes = (TextureBox*)malloc(colors * sizeof(TextureBox));
+    if (!unique || !boxes) {
+        fprintf(stderr, "Failed to allocate palette!\n");
+        free(unique);
+        free(boxes);
+        return 0;
+    }
+
+    // Unique opaque colors with the number of texels of each
+    size_t gathered = 0;
+    for (int t = 0; t < count; t++) {
+        for (size_t i = 0; i < textures[t]->texelCount; i++) {
+            if (texture_is_opaque(textures[t]->texels[i])) {
+                unique[gathered].color = textures[t]->texels[i] & 0xFFFFFFu;
+                unique[gathered++].weight = 1;
+            }
+        }
+    }
+    textureSortShift = 0;
+    qsort(unique, gathered, sizeof(TextureColor), texture_compare_channel);
+    int uniqueCount = 0;
+    for (size_t i = 0; i < gathered; i++) {
+        if (uniqueCount > 0 && unique[uniqueCount - 1].color == unique[i].color) {
+            unique[uniqueCount - 1].weight++;
+        } else {
+            unique[uniqueCount++] = unique[i];
+        }
+    }
+
+    // Split the box with the widest channel at its median texel until every entry is used
+    int boxCount = 0;
+    if (uniqueCount > 0) {
+        boxes[boxCount].start = 0;
+        boxes[boxCount++].count = uniqueCount;
+    }
+    while (reservedCount + boxCount < colors) {
+        int widest = -1;
+        int widestRange = 0;
+        for (int b = 0; b < boxCount; b++) {
+            int range;
+            texture_box_channel(unique, &boxes[b], &range);
+            if (boxes[b].count > 1 && range > widestRange) {
+                widest = b;
+                widestRange = range;
+            }
+        }
+        if (widest < 0) {
+            break;
+        }
+
+        TextureBox *box = &boxes[widest];
+        int range;
+        textureSortShift = texture_box_channel(unique, box, &range);
+        qsort(unique + box->start, box->count, sizeof(TextureColor), texture_compare_channel);
+
+        Uint64 boxWeight = 0;
+        for (int i = 0; i < box->count; i++) {
+            boxWeight += unique[box->start + i].weight;
+        }
+        int split = 1;
+        Uint64 below = unique[box->start].weight;
+        while (split < box->count - 1 && 2 * below < boxWeight) {
+            below += unique[box->start + split].weight;
+            split++;
+        }
+        boxes[boxCount].start = box->start + split;
+        boxes[boxCount++].count = box->count - split;
+        box->count = split;
+    }
+
+    for (int i = 0; i < reservedCount; i++) {
+        palette[i] = reserved[i] | 0xFF000000u;
+    }
+    for (int b = 0; b < boxCount; b++) {
+        palette[reservedCount + b] = texture_box_color(unique, &boxes[b]);
+    }
+
+    free(unique);
+    free(boxes);
+    return reservedCount + boxCount;
+}
+
+// Map every texel of a texture to its nearest of colors (at most 256) palette
+// entries; transparent texels map to TEXTURE_CLEAR_ENTRY, which no opaque texel uses
+int texture_build_indices(WallTexture *texture, const Uint32 *palette, int colors) {
+    free(texture->indices);
+    texture->indices = (Uint8*)malloc(texture->texelCount);
+    if (!texture->indices) {
+        fprintf(stderr, "Failed to allocate texture palette entries!\n");
+        return 0;
+    }
+
+    // Neighbouring texels mostly repeat, so the last match is tried first
+    Uint32 lastColor = 0;
+    int lastIndex = -1;
+    for (size_t i = 0; i < texture->texelCount; i++) {
+        if (!texture_is_opaque(texture->texels[i])) {
+            texture->indices[i] = TEXTURE_CLEAR_ENTRY;
+            continue;
+        }
+        Uint32 color = texture->texels[i] & 0xFFFFFFu;
+        if (lastIndex < 0 || color != lastColor) {
+            int best = 0;
+            int bestDistance = 0x7FFFFFFF;
+            for (int p = 0; p < colors; p++) {
+                if (p == TEXTURE_CLEAR_ENTRY) {
+                    continue;
+                }
+                int dr = (int)((color >> 16) & 0xFF) - (int)((palette[p] >> 16) & 0xFF);
+                int dg = (int)((color >> 8) & 0xFF) - (int)((palette[p] >> 8) & 0xFF);
+                int db = (int)(color & 0xFF) - (int)(palette[p] & 0xFF);
+                int distance = dr * dr + dg * dg + db * db;
+                if (distance < bestDistance) {
+                    best = p;
+                    bestDistance = distance;
+                }
+            }
+            lastColor = color;
+            lastIndex = best;
+        }
+        texture->indices[i] = (Uint8)lastIndex;
+    }
+    return 1;
+}
+
+// Pick the mip level for a wall slice lineHeight pixels high: the largest
+// level that still has at least one texel per pixel
+int texture_select_level(const WallTexture *texture, int lineHeight) {
+    int level = 0;
+    while (level + 1 < texture->levels && (texture->height >> (level + 1)) >= lineHeight) {
+        level++;
+    }
+    return level;
+}
+
+// Pick the mip level for a surface sampled every footprint texels of level 0
+// (16.16 fixed point): the largest level that still has at least one texel per pixel
+int texture_select_footprint_level(const WallTexture *texture, Uint32 footprint) {
+    int level = 0;
+    while (level + 1 < texture->levels && (footprint >> (level + 1)) >= (1u << 16)) {
+        level++;
+    }
+    return level;
+}
+
+// ****************************************************
+// Private functions implementation
+// ****************************************************
+
+// Check whether a texture size is a power of two
+static int texture_is_power_of_two(int size) {
+    return size > 0 && (size & (size - 1)) == 0;
+}
+
+// Average four ARGB8888 texels channel by channel
+static Uint32 texture_average(Uint32 a, Uint32 b, Uint32 c, Uint32 d) {
+    Uint32 result = 0;
+    for (int shift = 0; shift < 32; shift += 8) {
+        Uint32 sum = ((a >> shift) & 0xFF) + ((b >> shift) & 0xFF) +
+                     ((c >> shift) & 0xFF) + ((d >> shift) & 0xFF);
+        result |= ((sum + 2) / 4) << shift;
+    }
+    return result;
+}
+
+// Order colors by the channel at textureSortShift, then by the whole color
+static int texture_compare_channel(const void *a, const void *b) {
+    Uint32 colorA = ((const TextureColor*)a)->color;
+    Uint32 colorB = ((const TextureColor*)b)->color;
+    Uint32 channelA = (colorA >> textureSortShift) & 0xFF;
+    Uint32 channelB = (colorB >> textureSortShift) & 0xFF;
+    if (channelA != channelB) {
+        return channelA < channelB ? -1 : 1;
+    }
+    return colorA < colorB ? -1 : colorA > colorB;
+}
+
+// Widest channel of a box as a shift, and its range through *range
+static int texture_box_channel(const TextureColor *colors, const TextureBox *box, int *range) {
+    int widest = 0;
+    *range = -1;
+    for (int shift = 0; shift < 24; shift += 8) {
+        int low = 255;
+        int high = 0;
+        for (int i = box->start; i < box->start + box->count; i++) {
+            int channel = (colors[i].color >> shift) & 0xFF;
+            if (channel < low) low = channel;
+            if (channel > high) high = channel;
+        }
+        if (high - low > *range) {
+            *range = high - low;
+            widest = shift;
+        }
+    }
+    return widest;
+}
+
+// Average of a box's colors weighted by their texel counts, ARGB8888
+static Uint32 texture_box_color(const TextureColor *colors, const TextureBox *box) {
+    Uint64 sums[3] = {0, 0, 0};
+    Uint64 weight = 0;
+    for (int i = box->start; i < box->start + box->count; i++) {
+        for (int c = 0; c < 3; c++) {
+            sums[c] += (Uint64)((colors[i].color >> (8 * c)) & 0xFF) * colors[i].weight;
+        }
+        weight += colors[i].weight;
+    }
+
+    Uint32 result = 0xFF000000u;
+    for (int c = 0; c < 3; c++) {
+        result |= (Uint32)((sums[c] + weight / 2) / weight) << (8 * c);
+    }
+    return result;
+}
@@ -0,0 +1,78 @@
+#ifndef TEXTURE_H
+#define TEXTURE_H
+
+#include <stddef.h>
+#include <SDL.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Most mip levels a texture can have (a 32768 texel edge)
+#define TEXTURE_MAX_LEVELS 16
+
+// Palette entry of transparent texels (alpha below one half), for sprites
+#define TEXTURE_CLEAR_ENTRY 0
+
+// A wall texture kept on the CPU for the software renderer. Texels are stored
+// column-major, since a wall slice reads one texel column top to bottom, with
+// every mip level after the previous one in the same block. Once a palette is
+// built, indices holds the same texels as palette entries, in the same layout.
+typedef struct WallTexture {
+    Uint32 *texels;     // ARGB8888, all levels, NULL until texture_create
+    Uint8 *indices;     // Palette entries, all levels, NULL until texture_build_indices
+    int width;          // Size of level 0, powers of two
+    int height;
+    int levels;         // Level l is (width >> l) x (height >> l), down to one texel
+    size_t levelOffset[TEXTURE_MAX_LEVELS];  // First texel of each level
+    size_t texelCount;  // Texels in all levels
+} WallTexture;
+
+// Allocate a black width x height texture and room for its mip chain; both
+// sizes must be powers of two
+int texture_create(WallTexture *texture, int width, int height);
+
+// Free the texels and palette entries of a texture
+void texture_destroy(WallTexture *texture);
+
+// Rebuild every mip level from level 0 with a 2x2 box filter
+void texture_build_mips(WallTexture *texture);
+
+// Build a palette of up to colors entries for every level of count textures:
+// the reserved colors first, exactly, then a median cut of the opaque texel
+// colors; returns the number of entries used, 0 on failure
+int texture_build_palette(const WallTexture *const *textures, int count, const Uint32 *reserved,
+                          int reservedCount, Uint32 *palette, int colors);
+
+// Map every texel of a texture to its nearest of colors (at most 256) palette
+// entries; transparent texels map to TEXTURE_CLEAR_ENTRY, which no opaque texel uses
+int texture_build_indices(WallTexture *texture, const Uint32 *palette, int colors);
+
+// Pick the mip level for a wall slice lineHeight pixels high: the largest
+// level that still has at least one texel per pixel
+int texture_select_level(const WallTexture *texture, int lineHeight);
+
+// Pick the mip level for a surface sampled every footprint texels of level 0
+// (16.16 fixed point): the largest level that still has at least one texel per pixel
+int texture_select_footprint_level(const WallTexture *texture, Uint32 footprint);
+
+// Texel column x of a mip level, (height >> level) texels top to bottom
+static inline const Uint32* texture_column(const WallTexture *texture, int level, int x) {
+    return texture->texels + texture->levelOffset[level] + (size_t)x * (texture->height >> level);
+}
+
+// Palette entry column x of a mip level, laid out like texture_column
+static inline const Uint8* texture_index_column(const WallTexture *texture, int level, int x) {
+    return texture->indices + texture->levelOffset[level] + (size_t)x * (texture->height >> level);
+}
+
+// Write texel (x, y) of level 0
+static inline void texture_set(WallTexture *texture, int x, int y, Uint32 color) {
+    texture->texels[(size_t)x * texture->height + y] = color;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TEXTURE_H
@@ -0,0 +1,260 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "threadpool.h"
+
+// Largest number of tasks a single dispatch can hold in a packed range
+#define THREADPOOL_MAX_BATCH 0xFFFF
+
+// ****************************************************
+// Private (static) function declarations
+// ****************************************************
+
+// Worker thread entry point
+static int threadpool_worker_main(void *data);
+
+// Execute tasks from the own range, then steal from others until none are left
+static void threadpool_work(ThreadPool *pool, ThreadPoolWorker *self);
+
+// Take the back half of another worker's range; returns a task index or -1.
+// The rest of the stolen half becomes the own range, unless a new dispatch
+// gave this worker a share meanwhile: then it is returned in kept instead.
+static int threadpool_steal(ThreadPool *pool, ThreadPoolWorker *self, int *kept);
+
+// Pack and unpack a [begin, end) task range
+static inline int threadpool_pack(int begin, int end) {
+    return (int)(((Uint32)begin << 16) | (Uint32)end);
+}
+
+static inline int threadpool_begin(int range) {
+    return (int)((Uint32)range >> 16);
+}
+
+static inline int threadpool_end(int range) {
+    return (int)((Uint32)range & 0xFFFF);
+}
+
+// ****************************************************
+// Public API Implementation
+// ****************************************************
+
+// Create a pool with the given number of workers (<= 0 uses one per CPU core)
+ThreadPool* threadpool_create(int workerCount) {
+    if (workerCount <= 0) {
+        workerCount = SDL_GetCPUCount();
+    }
+    if (workerCount < 1) {
+        workerCount = 1;
+    }
+
+    ThreadPool *pool = (ThreadPool*)calloc(1, sizeof(ThreadPool));
+    if (!pool) {
+        return NULL;
+    }
+
+    pool->workers = (ThreadPoolWorker*)calloc(workerCount, sizeof(ThreadPoolWorker));
+    pool->lock = SDL_CreateMutex();
+    pool->wake = SDL_CreateCond();
+    pool->done = SDL_CreateCond();
+    if (!pool->workers || !pool->lock || !pool->wake || !pool->done) {
+        threadpool_destroy(pool);
+        return NULL;
+    }
+
+    pool->workerCount = workerCount;
+    for (int i = 0; i < workerCount; i++) {
+        pool->workers[i].pool = pool;
+        pool->workers[i].index = i;
+        SDL_AtomicSet(&pool->workers[i].range, 0);
+    }
+
+    // Worker 0 is whichever thread calls threadpool_run
+    for (int i = 1; i < workerCount; i++) {
+        pool->workers[i].thread = SDL_CreateThread(threadpool_worker_main, "raycaster-worker", &pool->workers[i]);
+        if (!pool->workers[i].thread) {
+            fprintf(stderr, "Failed to create worker thread: %s\n", SDL_GetError());
+            pool->workerCount = i;
+            break;
+        }
+    }
+
+    return pool;
+}
+
+// Stop the worker threads and free the pool
+void threadpool_destroy(ThreadPool *pool) {
+    if (!pool) {
+        return;
+    }
+
+    if (pool->lock) {
+        SDL_LockMutex(pool->lock);
+        pool->shutdown = 1;
+        SDL_CondBroadcast(pool->wake);
+        SDL_UnlockMutex(pool->lock);
+    }
+
+    if (pool->workers) {
+        for (int i = 1; i < pool->workerCount; i++) {
+            SDL_WaitThread(pool->workers[i].thread, NULL);
+        }
+        free(pool->workers);
+    }
+
+    if (pool->done) SDL_DestroyCond(pool->done);
+    if (pool->wake) SDL_DestroyCond(pool->wake);
+    if (pool->lock) SDL_DestroyMutex(pool->lock);
+    free(pool);
+}
+
+// Run taskCount tasks across the pool and return when all have finished
+void threadpool_run(ThreadPool *pool, int taskCount, ThreadPoolTask task, void *context) {
+    // Without helper threads there is nothing to schedule
+    if (!pool || pool->workerCount == 1) {
+        for (int i = 0; i < taskCount; i++) {
+            task(context, i, 0);
+        }
+        return;
+    }
+
+    // Packed ranges hold 16-bit indices, so very large jobs go out in batches
+    for (int base = 0; base < taskCount; base += THREADPOOL_MAX_BATCH) {
+        int count = taskCount - base;
+        if (count > THREADPOOL_MAX_BATCH) {
+            count = THREADPOOL_MAX_BATCH;
+        }
+
+        pool->task = task;
+        pool->context = context;
+        pool->taskBase = base;
+        SDL_AtomicSet(&pool->pending, count);
+
+        // Give every worker an even contiguous share; stealing evens out the cost
+        for (int i = 0; i < pool->workerCount; i++) {
+            int begin = (int)((long)count * i / pool->workerCount);
+            int end = (int)((long)count * (i + 1) / pool->workerCount);
+            SDL_AtomicSet(&pool->workers[i].range, threadpool_pack(begin, end));
+        }
+
+        SDL_LockMutex(pool->lock);
+        pool->generation++;
+        SDL_CondBroadcast(pool->wake);
+        SDL_UnlockMutex(pool->lock);
+
+        threadpool_work(pool, &pool->workers[0]);
+
+        // Wait for tasks other workers are still executing
+        SDL_LockMutex(pool->lock);
+        while (SDL_AtomicGet(&pool->pending) > 0) {
+            SDL_CondWait(pool->done, pool->lock);
+        }
+        SDL_UnlockMutex(pool->lock);
+    }
+}
+
+// ****************************************************
+// Private functions implementation
+// ****************************************************
+
+// Worker thread entry point
+static int threadpool_worker_main(void *data) {
+    ThreadPoolWorker *self = (ThreadPoolWorker*)data;
+    ThreadPool *pool = self->pool;
+    int seen = 0;
+
+    for (;;) {
+        SDL_LockMutex(pool->lock);
+        while (pool->generation == seen && !pool->shutdown) {
+            SDL_CondWait(pool->wake, pool->lock);
+        }
+        seen = pool->generation;
+        int shutdown = pool->shutdown;
+        SDL_UnlockMutex(pool->lock);
+
+        if (shutdown) {
+            break;
+        }
+
+        threadpool_work(pool, self);
+    }
+
+    return 0;
+}
+
+// Execute tasks from the own range, then steal from others until none are left
+static void threadpool_work(ThreadPool *pool, ThreadPoolWorker *self) {
+    int kept = 0;
+    for (;;) {
+        int taskIndex = -1;
+
+        // Stolen tasks that could not be published run first, on this worker only
+        if (threadpool_begin(kept) < threadpool_end(kept)) {
+            taskIndex = threadpool_begin(kept);
+            kept = threadpool_pack(taskIndex + 1, threadpool_end(kept));
+        }
+
+        // Pop from the front of the own range
+        while (taskIndex < 0) {
+            int range = SDL_AtomicGet(&self->range);
+            int begin = threadpool_begin(range);
+            int end = threadpool_end(range);
+            if (begin >= end) {
+                break;
+            }
+            if (SDL_AtomicCAS(&self->range, range, threadpool_pack(begin + 1, end))) {
+                taskIndex = begin;
+                break;
+            }
+        }
+
+        if (taskIndex < 0) {
+            taskIndex = threadpool_steal(pool, self, &kept);
+            if (taskIndex < 0) {
+                return;  // Every range is empty
+            }
+        }
+
+        pool->task(pool->context, pool->taskBase + taskIndex, self->index);
+
+        // The last task to finish wakes the dispatching thread
+        if (SDL_AtomicAdd(&pool->pending, -1) == 1) {
+            SDL_LockMutex(pool->lock);
+            SDL_CondSignal(pool->done);
+            SDL_UnlockMutex(pool->lock);
+        }
+    }
+}
+
+// Take the back half of another worker's range; returns a task index or -1.
+// The rest of the stolen half becomes the own range, unless a new dispatch
+// gave this worker a share meanwhile: then it is returned in kept instead.
+static int threadpool_steal(ThreadPool *pool, ThreadPoolWorker *self, int *kept) {
+    // Read before stealing: the stolen rest only replaces it while it is still
+    // this empty range, not a share a new dispatch has put there since
+    int own = SDL_AtomicGet(&self->range);
+    int ownEmpty = threadpool_begin(own) >= threadpool_end(own);
+    for (int n = 1; n < pool->workerCount; n++) {
+        ThreadPoolWorker *victim = &pool->workers[(self->index + n) % pool->workerCount];
+
+        for (;;) {
+            int range = SDL_AtomicGet(&victim->range);
+            int begin = threadpool_begin(range);
+            int end = threadpool_end(range);
+            if (begin >= end) {
+                break;  // Nothing left here, try the next worker
+            }
+
+            // Leave the victim the front half; run the first stolen task and
+            // keep the rest as our own range so it can be stolen in turn
+            int mid = begin + (end - begin) / 2;
+            if (SDL_AtomicCAS(&victim->range, range, threadpool_pack(begin, mid))) {
+                if (mid + 1 < end && !(ownEmpty && SDL_AtomicCAS(&self->range, own, threadpool_pack(mid + 1, end)))) {
+                    *kept = threadpool_pack(mid + 1, end);
+                }
+                return mid;
+            }
+        }
+    }
+
+    return -1;
+}
@@ -0,0 +1,51 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <SDL.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Task callback: runs task taskIndex of the current job on worker workerIndex
+typedef void (*ThreadPoolTask)(void *context, int taskIndex, int workerIndex);
+
+// Per-worker state; the task range is packed into one atomic so owner pops
+// and thief steals are a single compare-and-swap
+typedef struct ThreadPoolWorker {
+    SDL_atomic_t range;         // Remaining tasks: begin in the high 16 bits, end in the low 16 bits
+    SDL_Thread *thread;         // NULL for worker 0, which is the calling thread
+    struct ThreadPool *pool;
+    int index;
+    char padding[64];           // Keep neighbouring ranges off the same cache line
+} ThreadPoolWorker;
+
+// Persistent pool of worker threads with per-worker work stealing
+typedef struct ThreadPool {
+    ThreadPoolWorker *workers;
+    int workerCount;            // Including the calling thread
+    SDL_mutex *lock;
+    SDL_cond *wake;             // Signalled when a new job is published
+    SDL_cond *done;             // Signalled when the last task of a job finishes
+    int generation;             // Job counter, guarded by lock
+    int shutdown;               // Set to stop the worker threads
+    SDL_atomic_t pending;       // Tasks of the current job not yet finished
+    ThreadPoolTask task;        // Current job
+    void *context;
+    int taskBase;               // Index of the first task in the current batch
+} ThreadPool;
+
+// Create a pool with the given number of workers (<= 0 uses one per CPU core)
+ThreadPool* threadpool_create(int workerCount);
+
+// Stop the worker threads and free the pool
+void threadpool_destroy(ThreadPool *pool);
+
+// Run taskCount tasks across the pool and return when all have finished
+void threadpool_run(ThreadPool *pool, int taskCount, ThreadPoolTask task, void *context);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // THREADPOOL_H
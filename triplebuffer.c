@@ -0,0 +1,32 @@
+#include "triplebuffer.h"
+
+// ****************************************************
+// Public API Implementation
+// ****************************************************
+
+// Start with the writer on slot 0, the reader on slot 1 and nothing published
+void triplebuffer_init(TripleBuffer *buffer) {
+    buffer->back = 0;
+    buffer->front = 1;
+    SDL_AtomicSet(&buffer->state, 2);
+}
+
+// Publish the back slot as the newest; back moves to the slot to fill next
+void triplebuffer_publish(TripleBuffer *buffer) {
+    // The exchange is a full barrier, so the slot's contents are visible before its index
+    int previous = SDL_AtomicSet(&buffer->state, buffer->back | TRIPLE_BUFFER_FRESH);
+    buffer->back = previous & ~TRIPLE_BUFFER_FRESH;
+}
+
+// Take the newest published slot as front if one arrived since the last
+// acquire; returns 0 and keeps front otherwise
+int triplebuffer_acquire(TripleBuffer *buffer) {
+    if (!(SDL_AtomicGet(&buffer->state) & TRIPLE_BUFFER_FRESH)) {
+        return 0;
+    }
+
+    // Only the writer runs concurrently, and it only ever leaves the state fresh
+    int previous = SDL_AtomicSet(&buffer->state, buffer->front);
+    buffer->front = previous & ~TRIPLE_BUFFER_FRESH;
+    return 1;
+}
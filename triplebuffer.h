@@ -0,0 +1,39 @@
+#ifndef TRIPLEBUFFER_H
+#define TRIPLEBUFFER_H
+
+#include <SDL.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Set in the shared state while the middle slot holds a publish not yet acquired
+#define TRIPLE_BUFFER_FRESH 4
+
+// Lock-free hand-off of the newest of three slots from one writer thread to one
+// reader thread: the writer fills back, the reader holds front and the third
+// slot sits in between; publishing and acquiring each swap with the middle slot
+// in one atomic exchange, so neither side ever waits for the other
+typedef struct TripleBuffer {
+    SDL_atomic_t state;         // Middle slot index, with TRIPLE_BUFFER_FRESH
+    char padding[64];           // Keep the writer's and reader's slots off the shared line
+    int back;                   // Slot the writer fills, owned by the writer
+    char backPadding[64];
+    int front;                  // Slot the reader holds, owned by the reader
+} TripleBuffer;
+
+// Start with the writer on slot 0, the reader on slot 1 and nothing published
+void triplebuffer_init(TripleBuffer *buffer);
+
+// Publish the back slot as the newest; back moves to the slot to fill next
+void triplebuffer_publish(TripleBuffer *buffer);
+
+// Take the newest published slot as front if one arrived since the last
+// acquire; returns 0 and keeps front otherwise
+int triplebuffer_acquire(TripleBuffer *buffer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TRIPLEBUFFER_H